@@ -0,0 +1,498 @@
+/**
+ * Microbenchmarks of the data structures on the hot path of SAM, written
+ * with Google Benchmark.  Each benchmark is parameterized by the number of
+ * distinct keys (vertices, feature map keys) and/or the window size, so
+ * that regressions show up as a function of both.
+ *
+ * To record the results of a release as JSON:
+ *
+ *   ./benchmarks/SamBenchmarks --benchmark_out=sam-<version>.json \
+ *     --benchmark_out_format=json
+ *
+ * and to compare two runs, use compare.py from Google Benchmark's tools:
+ *
+ *   compare.py benchmarks sam-<old>.json sam-<new>.json
+ *
+ * --benchmark_filter=<regex> runs a subset, e.g. --benchmark_filter=Graph.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <limits>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sam/CompressedSparse.hpp>
+#include <sam/EdgeRequestMap.hpp>
+#include <sam/ExponentialHistogram.hpp>
+#include <sam/Expression.hpp>
+#include <sam/FeatureMap.hpp>
+#include <sam/Features.hpp>
+#include <sam/InProcessTransport.hpp>
+#include <sam/ModelScorer.hpp>
+#include <sam/Quantile.hpp>
+#include <sam/SlidingWindow.hpp>
+#include <sam/SubgraphQuery.hpp>
+#include <sam/SubgraphQueryResult.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/VastNetflowGenerators.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+
+typedef Edge<size_t, EmptyLabel, VastNetflow> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+typedef CompressedSparse<EdgeType, SourceIp, DestIp, TimeSeconds,
+  DurationSeconds, StringHashFunction, StringEqualityFunction> GraphType;
+typedef SubgraphQuery<VastNetflow, SourceIp, DestIp, TimeSeconds,
+  DurationSeconds> QueryType;
+typedef SubgraphQueryResult<EdgeType, SourceIp, DestIp, TimeSeconds,
+  DurationSeconds> ResultType;
+typedef EdgeRequestMap<VastNetflow, SourceIp, DestIp, TimeSeconds,
+  StringHashFunction, StringHashFunction,
+  StringEqualityFunction, StringEqualityFunction> RequestMapType;
+
+/// How many distinct pre-generated inputs a benchmark cycles through.
+#define BENCHMARK_NUM_INPUTS 4096
+
+/// Seconds between consecutive edges given to the graph benchmarks.
+#define BENCHMARK_EDGE_INTERVAL 0.001
+
+namespace {
+
+/**
+ * Netflows between numVertices vertices named node0 ... node<n-1>.
+ */
+std::vector<EdgeType> makeEdges(size_t numVertices, size_t n)
+{
+  srand(0);
+  RandomPoolGenerator generator(numVertices);
+  Tuplizer tuplizer;
+  std::vector<EdgeType> edges;
+  for (size_t i = 0; i < n; i++) {
+    edges.push_back(tuplizer(i, generator.generate(0.0)));
+  }
+  return edges;
+}
+
+std::vector<std::string> makeKeys(size_t numKeys)
+{
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < numKeys; i++) {
+    keys.push_back("node" + std::to_string(i));
+  }
+  return keys;
+}
+
+/**
+ * Adds edges from the pool to the graph, each BENCHMARK_EDGE_INTERVAL
+ * seconds after the previous one.
+ */
+double fillGraph(GraphType& graph, std::vector<EdgeType>& edges,
+                 size_t numEdges)
+{
+  double time = 0;
+  for (size_t i = 0; i < numEdges; i++) {
+    EdgeType& edge = edges[i % edges.size()];
+    std::get<TimeSeconds>(edge.tuple) = time;
+    graph.addEdge(edge);
+    time += BENCHMARK_EDGE_INTERVAL;
+  }
+  return time;
+}
+
+}
+
+/**
+ * CompressedSparse::addEdge in steady state, i.e. with a full window of
+ * edges that expire as new ones come in.
+ * Args: number of vertices, window in seconds.
+ */
+static void BM_CompressedSparseAddEdge(benchmark::State& state)
+{
+  size_t numVertices = state.range(0);
+  double window = state.range(1);
+  auto edges = makeEdges(numVertices, BENCHMARK_NUM_INPUTS);
+  GraphType graph(numVertices, window);
+  double time = fillGraph(graph, edges, window / BENCHMARK_EDGE_INTERVAL);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    EdgeType& edge = edges[i++ % edges.size()];
+    std::get<TimeSeconds>(edge.tuple) = time;
+    benchmark::DoNotOptimize(graph.addEdge(edge));
+    time += BENCHMARK_EDGE_INTERVAL;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CompressedSparseAddEdge)
+  ->ArgNames({"vertices", "window"})
+  ->ArgsProduct({{100, 10000}, {1, 10}});
+
+/**
+ * CompressedSparse::findEdges for all the edges of a source in the window.
+ * Args: number of vertices, window in seconds.
+ */
+static void BM_CompressedSparseFindEdges(benchmark::State& state)
+{
+  size_t numVertices = state.range(0);
+  double window = state.range(1);
+  auto edges = makeEdges(numVertices, BENCHMARK_NUM_INPUTS);
+  GraphType graph(numVertices, window);
+  fillGraph(graph, edges, window / BENCHMARK_EDGE_INTERVAL);
+  auto sources = makeKeys(numVertices);
+  double max = std::numeric_limits<double>::max();
+
+  size_t i = 0;
+  size_t numFound = 0;
+  for (auto _ : state) {
+    std::list<EdgeType> found;
+    graph.findEdges(sources[i++ % sources.size()], nullValue<std::string>(),
+                    0, max, 0, max, found);
+    numFound += found.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["edges_found"] = benchmark::Counter(numFound,
+    benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_CompressedSparseFindEdges)
+  ->ArgNames({"vertices", "window"})
+  ->ArgsProduct({{100, 10000}, {1, 10}});
+
+/**
+ * FeatureMap::updateInsert of an existing key.
+ * Args: number of keys.
+ */
+static void BM_FeatureMapUpdateInsert(benchmark::State& state)
+{
+  size_t numKeys = state.range(0);
+  auto keys = makeKeys(numKeys);
+  FeatureMap featureMap(2 * numKeys);
+  for (auto const& key : keys) {
+    featureMap.updateInsert(key, "sum", SingleFeature(0));
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(featureMap.updateInsert(keys[i % numKeys], "sum",
+                                                     SingleFeature(i)));
+    i++;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FeatureMapUpdateInsert)
+  ->ArgName("keys")
+  ->Arg(100)->Arg(10000)->Arg(1000000);
+
+/**
+ * ExponentialHistogram::add, the window of the Sum and Variance operators.
+ * Args: window size.
+ */
+static void BM_ExponentialHistogramAdd(benchmark::State& state)
+{
+  ExponentialHistogram<double> histogram(state.range(0), 2);
+  size_t i = 0;
+  for (auto _ : state) {
+    histogram.add(i++ % 100);
+  }
+  benchmark::DoNotOptimize(histogram.getTotal());
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExponentialHistogramAdd)
+  ->ArgName("window")
+  ->Arg(1000)->Arg(100000)->Arg(1000000);
+
+/**
+ * SlidingWindow::add, the window of the TopK operator, with basic windows
+ * of a tenth of the window.
+ * Args: number of keys, window size.
+ */
+static void BM_SlidingWindowAdd(benchmark::State& state)
+{
+  size_t numKeys = state.range(0);
+  size_t window = state.range(1);
+  auto keys = makeKeys(numKeys);
+  SlidingWindow<std::string> slidingWindow(window, window / 10, 2);
+
+  size_t i = 0;
+  for (auto _ : state) {
+    slidingWindow.add(keys[i++ % numKeys]);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SlidingWindowAdd)
+  ->ArgNames({"keys", "window"})
+  ->ArgsProduct({{10, 1000}, {1000, 100000}});
+
+/**
+ * QuantileDataStructure::insert followed by getQuantile, what the Quantile
+ * operator does for each tuple of a key.
+ * Args: window size.
+ */
+static void BM_QuantileInsertQuery(benchmark::State& state)
+{
+  QuantileDetails::QuantileDataStructure<double> window(state.range(0), 8,
+                                                        200);
+  std::vector<double> values(BENCHMARK_NUM_INPUTS);
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = (i * 7919) % 1000;
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    window.insert(values[i++ % values.size()]);
+    benchmark::DoNotOptimize(window.getQuantile(0.99));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QuantileInsertQuery)
+  ->ArgName("window")
+  ->Arg(1000)->Arg(10000)->Arg(100000);
+
+/**
+ * makeVastNetflow, parsing a line of VAST netflow.
+ */
+static void BM_MakeVastNetflow(benchmark::State& state)
+{
+  std::vector<std::string> lines;
+  srand(0);
+  RandomGenerator generator;
+  for (size_t i = 0; i < BENCHMARK_NUM_INPUTS; i++) {
+    lines.push_back(generator.generate(1365582756.384094 + i));
+  }
+
+  size_t i = 0;
+  size_t numBytes = 0;
+  for (auto _ : state) {
+    std::string const& line = lines[i++ % lines.size()];
+    benchmark::DoNotOptimize(makeVastNetflow(line));
+    numBytes += line.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(numBytes);
+}
+BENCHMARK(BM_MakeVastNetflow);
+
+/**
+ * Expression::evaluate of a filter on the tuple fields,
+ * SourcePort - DestPort * 2 > 26000.
+ */
+static void BM_ExpressionEvaluateFields(benchmark::State& state)
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  std::list<std::shared_ptr<ExpressionToken<VastNetflow>>> infixList;
+  infixList.push_back(
+    std::make_shared<FieldToken<SourcePort, VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<SubOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<FieldToken<DestPort, VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<MultOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<NumberToken<VastNetflow>>(featureMap, 2));
+  infixList.push_back(
+    std::make_shared<GreaterThanOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<NumberToken<VastNetflow>>(featureMap, 26000));
+  Expression<VastNetflow> expression(infixList);
+
+  auto edges = makeEdges(100, BENCHMARK_NUM_INPUTS);
+  std::string key = "key";
+  size_t i = 0;
+  double result = 0;
+  for (auto _ : state) {
+    expression.evaluate(key, edges[i++ % edges.size()].tuple, result);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExpressionEvaluateFields);
+
+/**
+ * Expression::evaluate of a filter on a feature, sum.value + 1 < 10, which
+ * looks the feature up in the feature map.
+ * Args: number of keys in the feature map.
+ */
+static void BM_ExpressionEvaluateFeature(benchmark::State& state)
+{
+  size_t numKeys = state.range(0);
+  auto keys = makeKeys(numKeys);
+  auto featureMap = std::make_shared<FeatureMap>(2 * numKeys);
+  for (size_t i = 0; i < numKeys; i++) {
+    featureMap->updateInsert(keys[i], "sum", SingleFeature(i));
+  }
+
+  auto function = [](Feature const * feature)->double {
+    return feature->getValue();
+  };
+  std::list<std::shared_ptr<ExpressionToken<VastNetflow>>> infixList;
+  infixList.push_back(
+    std::make_shared<FuncToken<VastNetflow>>(featureMap, function, "sum"));
+  infixList.push_back(std::make_shared<AddOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<NumberToken<VastNetflow>>(featureMap, 1));
+  infixList.push_back(
+    std::make_shared<LessThanOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<NumberToken<VastNetflow>>(featureMap, 10));
+  Expression<VastNetflow> expression(infixList);
+
+  VastNetflow netflow = makeEdges(100, 1)[0].tuple;
+  size_t i = 0;
+  double result = 0;
+  for (auto _ : state) {
+    expression.evaluate(keys[i++ % numKeys], netflow, result);
+    benchmark::DoNotOptimize(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExpressionEvaluateFeature)
+  ->ArgName("keys")
+  ->Arg(100)->Arg(10000)->Arg(1000000);
+
+/**
+ * SubgraphQueryResult::addEdge, extending a partial result of a two edge
+ * query (target e1 bait; target e2 controller; 0 < starttime(e2) < 10) by
+ * its second edge.
+ */
+static void BM_SubgraphQueryResultAddEdge(benchmark::State& state)
+{
+  auto featureMap = std::make_shared<FeatureMap>(1000);
+  auto query = std::make_shared<QueryType>(featureMap);
+  query->addExpression(TimeEdgeExpression(EdgeFunction::StartTime, "e1",
+    EdgeOperator::Assignment, 0));
+  query->addExpression(EdgeExpression("target1", "e1", "bait"));
+  query->addExpression(TimeEdgeExpression(EdgeFunction::StartTime, "e2",
+    EdgeOperator::GreaterThan, 0));
+  query->addExpression(TimeEdgeExpression(EdgeFunction::StartTime, "e2",
+    EdgeOperator::LessThan, 10));
+  query->addExpression(EdgeExpression("target1", "e2", "controller"));
+  query->finalize();
+
+  Tuplizer tuplizer;
+  std::string firstString = "156.0,2013-04-10 08:32:36,"
+    "20130410083236.384094,17,UDP,target,bait,29986,1900,0,0,1.0,133,0,1,"
+    "0,1,0,0";
+  std::string secondString = "160.0,2013-04-10 08:32:36,"
+    "20130410083236.384094,17,UDP,target,controller,29986,1900,0,0,1.0,133,"
+    "0,1,0,1,0,0";
+  EdgeType first = tuplizer(1, firstString);
+  EdgeType second = tuplizer(2, secondString);
+  ResultType result(query, first);
+
+  for (auto _ : state) {
+    auto extended = result.addEdge(second);
+    benchmark::DoNotOptimize(extended.first);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SubgraphQueryResultAddEdge);
+
+/**
+ * EdgeRequestMap::process with one edge request per vertex of a tenth of
+ * the vertices.  Matching edges go to the other node over the direct
+ * transport, which drops them.
+ * Args: number of vertices, table capacity.
+ */
+static void BM_EdgeRequestMapProcess(benchmark::State& state)
+{
+  size_t numVertices = state.range(0);
+  size_t tableCapacity = state.range(1);
+  // Each run needs its own transports.
+  static size_t startingPort = 20000;
+  startingPort++;
+
+  typedef RequestMapType::EdgeTransportType::FunctionType FunctionType;
+  std::vector<FunctionType> none;
+  std::vector<FunctionType> drop = {[](VastNetflow const&) {}};
+  DirectTransport<VastNetflow> node0(2, 0, none, startingPort, 1000,
+    std::vector<DirectTransport<VastNetflow>::DrainFunctionType>(), 10);
+  DirectTransport<VastNetflow> node1(2, 1, drop, startingPort, 1000,
+    std::vector<DirectTransport<VastNetflow>::DrainFunctionType>(), 10);
+
+  size_t numSent = 0;
+  {
+    RequestMapType map(2, 0, tableCapacity, &node0);
+    auto keys = makeKeys(numVertices);
+    for (size_t i = 0; i < numVertices; i += 10) {
+      RequestMapType::EdgeRequestType request;
+      request.setTarget(keys[i]);
+      request.setReturn(1);
+      map.addRequest(request);
+    }
+
+    auto edges = makeEdges(numVertices, BENCHMARK_NUM_INPUTS);
+    size_t i = 0;
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(map.process(edges[i++ % edges.size()].tuple));
+    }
+    numSent = node0.getTotalMessagesSent();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["edges_sent"] = benchmark::Counter(numSent,
+    benchmark::Counter::kAvgIterations);
+  node0.terminate();
+  node1.terminate();
+}
+BENCHMARK(BM_EdgeRequestMapProcess)
+  ->ArgNames({"vertices", "capacity"})
+  ->ArgsProduct({{100, 10000}, {1000, 100000}});
+
+/**
+ * TreeEnsembleModel::score of a batch of rows, the way ModelScorer scores
+ * them, with complete trees over 20 features.  Scoring the rows of a
+ * pipeline needs at least a million rows a second (items_per_second); on
+ * one core only the 100 trees of depth 4 get there (see TreeEnsembleModel).
+ * Args: number of trees, depth of the trees.
+ */
+static void BM_TreeEnsembleScore(benchmark::State& state)
+{
+  size_t numTrees = state.range(0);
+  size_t depth = state.range(1);
+  size_t numFeatures = 20;
+  size_t batchSize = MODEL_SCORER_BATCH_SIZE;
+
+  srand(0);
+  std::ostringstream file;
+  file << "tree_ensemble\nfeatures";
+  for (size_t j = 0; j < numFeatures; j++) file << " f" << j;
+  size_t treeSize = (size_t(1) << (depth + 1)) - 1;
+  file << "\nroots";
+  for (size_t t = 0; t < numTrees; t++) file << " " << t * treeSize;
+  file << "\n";
+  for (size_t t = 0; t < numTrees; t++) {
+    // Node k of a tree has children 2k + 1 and 2k + 2.
+    for (size_t k = 0; k < treeSize; k++) {
+      double value = (double) rand() / RAND_MAX;
+      if (2 * k + 1 < treeSize) {
+        size_t left = t * treeSize + 2 * k + 1;
+        file << "nodes " << rand() % numFeatures << " " << value << " "
+             << left << " " << left + 1 << "\n";
+      } else {
+        file << "nodes -1 " << value << " -1 -1\n";
+      }
+    }
+  }
+  std::istringstream in(file.str());
+  TreeEnsembleModel model(ModelDescription(in, "benchmark"));
+
+  std::vector<double> columns(numFeatures * batchSize);
+  for (auto& value : columns) value = (double) rand() / RAND_MAX;
+  std::vector<double> scores(batchSize);
+
+  for (auto _ : state) {
+    model.score(columns.data(), batchSize, batchSize, scores.data());
+    benchmark::DoNotOptimize(scores.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * batchSize);
+}
+BENCHMARK(BM_TreeEnsembleScore)
+  ->ArgNames({"trees", "depth"})
+  ->ArgsProduct({{100, 500}, {4, 8}});
+
+BENCHMARK_MAIN();
@@ -230,17 +230,10 @@ void createPipeline(std::shared_ptr<ProducerType> producer,
   timeLapseSeries->registerConsumer(projectToDest);
  
   identifier = "serverAveClientsTimeDiffVar";
-  auto aveFunction = [](std::list<std::shared_ptr<Feature>> myList)->double {
-    double sum = 0;
-    for (auto feature : myList) {
-      sum = sum + feature->evaluate<double>(valueFunc); 
-    }
-    return sum / myList.size();
-  };
 
   auto destTimeDiffVar = 
     std::make_shared<CollapsedConsumer<EdgeType, DestIp>>(
-                                               aveFunction,
+                                               Aggregation::Average,
                                                "destSourceTimeDiffVariance",
                                                nodeId, 
                                                featureMap, 
@@ -342,6 +335,7 @@ int main(int argc, char** argv) {
   // and write the results to the outputfile.
   string inputfile;
   string outputfile;
+  string outputFormat; ///> csv or columnar
 
   // Where subgraph results are written
   string printerLocation;
@@ -425,7 +419,11 @@ int main(int argc, char** argv) {
     ("outputfile",
       po::value<string>(&outputfile),
       "If --create_features is specified, the produced file will"
-      " be a csv file of features.")
+      " be a file of features.")
+    ("outputFormat",
+      po::value<string>(&outputFormat)->default_value("csv"),
+      "The format of --outputfile: csv or columnar, a binary column file "
+      "that scripts/learning.py can memory map (default: csv).")
     ("printerLocation",
       po::value<std::string>(&printerLocation)->default_value(""),
       "Where subgraph results are written.")
@@ -496,8 +494,8 @@ int main(int argc, char** argv) {
     auto receiver = std::make_shared<ReadCSVType>(nodeId, inputfile);
 
     // subscriber collects the features for each netflow
-    auto subscriber = std::make_shared<FeatureSubscriber>(outputfile, 
-                                                          featureCapacity);
+    auto subscriber = std::make_shared<FeatureSubscriber>(outputfile,
+      featureCapacity, featureOutputFormatFromString(outputFormat));
 
     std::cout << "Creating Pipeline " << std::endl;
     // createPipeline creates all the operators and ties them together.  It 
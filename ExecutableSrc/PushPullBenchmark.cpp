@@ -28,6 +28,12 @@ int main(int argc, char** argv) {
   size_t numPushSockets; ///> Number of push sockets per node
   bool useNetflowString = false;
   int timeout; ///> Timeout in milliseconds for zmq::send() calls
+  int pullThreadTimeout; ///> Pull threads exit after this much silence
+  bool local = false; ///> All nodes run on this host
+  bool noSharedMemory = false; ///> Use TCP even between co-located nodes
+  std::string compression; ///> Codec for batches sent over ZeroMQ
+  double compressionThreshold; ///> Bytes/s above which batches compress
+  size_t batchSize; ///> Messages per sendBatch call
 
   /// An example netflow string.  This is used as the message 
   /// when --netflowString is selected.
@@ -66,6 +72,23 @@ int main(int argc, char** argv) {
     ("timeout", po::value<int>(&timeout)->default_value(-1),
       "Send Timeout in milliseconds.  If -1, then block until complete."
       "  (Default -1)")
+    ("pullThreadTimeout", po::value<int>(&pullThreadTimeout)->default_value(
+      PUSH_PULL_PULL_THREAD_TIMEOUT),
+      "Pull threads exit if nothing arrives for this many milliseconds.  If"
+      " -1, they wait until every node has sent terminate.")
+    ("local", po::bool_switch(&local),
+      "If specified, all nodes run on this host as separate processes.")
+    ("noSharedMemory", po::bool_switch(&noSharedMemory),
+      "If specified, nodes on the same host talk over TCP instead of "
+      "shared memory.")
+    ("compression", po::value<std::string>(&compression)->default_value(
+      "none"), "Codec for the batches sent over ZeroMQ: none, lz4 or zstd.")
+    ("compressionThreshold", po::value<double>(&compressionThreshold)->
+      default_value(PUSH_PULL_COMPRESSION_THRESHOLD),
+      "Batches are compressed while a push socket is offered more than this "
+      "many bytes per second.  If 0, every batch is compressed.")
+    ("batchSize", po::value<size_t>(&batchSize)->default_value(1),
+      "The number of messages sent to a node at once with sendBatch.")
   ;
 
   // Parse the command line variables
@@ -95,8 +118,10 @@ int main(int argc, char** argv) {
   std::vector<std::string> hostnames;
   hostnames.resize(numNodes);
 
-  if (numNodes == 1) { // Case when we are operating on one node
-    hostnames[0] = "127.0.0.1";
+  if (numNodes == 1 || local) { // Case when we are operating on one node
+    for (size_t i = 0; i < numNodes; i++) {
+      hostnames[i] = "127.0.0.1";
+    }
   } else {
     for (size_t i = 0; i < numNodes; i++) {
       //printf("i %lu\n", i);
@@ -116,20 +141,26 @@ int main(int argc, char** argv) {
 
   PushPull* pushPull = new PushPull(numNodes, nodeId, numPushSockets, 
                                     numPullThreads, hostnames, hwm,
-                                    functions, startingPort, timeout);
+                                    functions, startingPort, timeout,
+                                    local, 
+                                    std::vector<PushPull::DrainFunctionType>(),
+                                    pullThreadTimeout, !noSharedMemory,
+                                    compressionCodecFromString(compression),
+                                    compressionThreshold);
 
   
 
 
   // Thread to create data and send it out.  
   auto function = [message, numNodes, nodeId, numPushSockets, numPullThreads,
-    hostnames, hwm, pushPull, numMessages]()
+    hostnames, hwm, pushPull, numMessages, batchSize]()
   {
     std::random_device rd;
     auto myRand = std::mt19937(rd());
     auto dist = std::uniform_int_distribution<size_t>(0, numNodes-1);
+    std::vector<std::string> batch(std::max<size_t>(1, batchSize), message);
 
-    for( size_t i = 0; i < numMessages; i++)
+    for( size_t i = 0; i < numMessages; i += batch.size())
     {
       bool found = false;
       size_t node;
@@ -144,7 +175,12 @@ int main(int argc, char** argv) {
         }
       }
       //printf("Node %lu sending message %s\n", nodeId, message.c_str());
-      pushPull->send(message, node);
+      if (batch.size() == 1) {
+        pushPull->send(message, node);
+      } else {
+        batch.resize(std::min(batch.size(), numMessages - i));
+        pushPull->sendBatch(batch, node);
+      }
     }
   };
 
@@ -173,6 +209,32 @@ int main(int argc, char** argv) {
   printf("Node %lu total time: %f \n", nodeId, totalTime);
   printf("Node %lu messages/second: %f\n", nodeId, totalMessages / totalTime);
   printf("Node %lu total messages received: %lu \n", nodeId, totalReceived);
+  if (pushPull->getTotalBatches() > 0) {
+    printf("Node %lu messages per wake up: %f\n", nodeId, 
+      totalReceived / static_cast<double>(pushPull->getTotalBatches()));
+  }
+  if (totalReceived > 0) {
+    printf("Node %lu mean receive path time (us): %f\n", nodeId,
+      pushPull->getTotalBusyTime() * 1e6 / totalReceived);
+  }
+  printf("Node %lu pull thread idle time (s): %f\n", nodeId,
+    pushPull->getTotalIdleTime());
+  printf("Node %lu transport: %s\n", nodeId,
+    numNodes > 1 && pushPull->isColocated(nodeId == 0 ? 1 : 0) ?
+    "shared memory" : "zeromq");
+  if (pushPull->getCompression() != CompressionCodec::None) {
+    printf("Node %lu compressed batches: %lu\n", nodeId,
+      pushPull->getTotalCompressedBatches());
+    printf("Node %lu compress time (s): %f decompress time (s): %f\n",
+      nodeId, pushPull->getTotalCompressTime(),
+      pushPull->getTotalDecompressTime());
+    for (size_t node = 0; node < numNodes; node++) {
+      if (node == nodeId) continue;
+      printf("Node %lu->%lu bytes: %lu wire bytes: %lu ratio: %f\n", nodeId,
+        node, pushPull->getBytesSent(node), pushPull->getWireBytesSent(node),
+        pushPull->getCompressionRatio(node));
+    }
+  }
 
 
 }
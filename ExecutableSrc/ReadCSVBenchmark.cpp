@@ -0,0 +1,132 @@
+/**
+ * Measures how fast a netflow capture can be replayed from disk with
+ * ReadCSV and with ReadMappedCSV using an increasing number of threads.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <boost/program_options.hpp>
+
+#include <sam/sam.hpp>
+#include <sam/tuples/VastNetflowGenerators.hpp>
+
+namespace po = boost::program_options;
+using namespace sam;
+using namespace sam::vast_netflow;
+using namespace std::chrono;
+
+typedef Edge<size_t, SingleBoolLabel, VastNetflow> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+
+/**
+ * Consumer that only counts what it is given.
+ */
+class CountingConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  size_t count = 0;
+
+  bool consume(EdgeType const& edge) {
+    count++;
+    return true;
+  }
+
+  bool consumeBatch(EdgeType const* edges, size_t numEdges) {
+    count += numEdges;
+    return true;
+  }
+
+  void terminate() {}
+};
+
+/**
+ * Runs the data source and reports the throughput.
+ */
+template <typename DataSource>
+void run(std::string name, DataSource& source)
+{
+  auto consumer = std::make_shared<CountingConsumer>();
+  source.registerConsumer(consumer);
+  if (!source.connect()) {
+    std::cerr << "Couldn't connect " << name << std::endl;
+    return;
+  }
+
+  auto begin = high_resolution_clock::now();
+  source.receive();
+  auto end = high_resolution_clock::now();
+  double seconds = duration_cast<duration<double>>(end - begin).count();
+
+  std::cout << name << " tuples " << consumer->count << " seconds "
+            << seconds << " tuples per second " << consumer->count / seconds
+            << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  std::string inputfile; ///> The capture to replay
+  size_t numNetflows; ///> Number of netflows to generate if no inputfile
+  size_t maxThreads; ///> Largest number of threads to try
+  size_t chunkSize; ///> Bytes parsed by a thread at a time
+  bool unordered = false; ///> Deliver chunks as soon as they are parsed
+
+  po::options_description desc("Benchmark for replaying a netflow capture "
+    "with ReadCSV and ReadMappedCSV");
+  desc.add_options()
+    ("help", "help message")
+    ("inputfile", po::value<std::string>(&inputfile),
+      "A file of labeled VAST netflows.  If not given, --numNetflows "
+      "netflows are generated into a temporary file.")
+    ("numNetflows", po::value<size_t>(&numNetflows)->default_value(1000000),
+      "The number of netflows to generate if there is no inputfile")
+    ("maxThreads", po::value<size_t>(&maxThreads)->default_value(
+      std::thread::hardware_concurrency()),
+      "ReadMappedCSV is run with 1, 2, 4, ... up to this many threads")
+    ("chunkSize", po::value<size_t>(&chunkSize)->default_value(
+      READ_MAPPED_CSV_CHUNK_SIZE),
+      "The number of bytes a thread parses at a time")
+    ("unordered", po::bool_switch(&unordered),
+      "Deliver chunks in the order they are parsed rather than file order")
+  ;
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 1;
+  }
+
+  bool generated = false;
+  if (inputfile.empty()) {
+    inputfile = "ReadCSVBenchmark.csv";
+    generated = true;
+    UniformDestPort generator("192.168.0.1", 1000);
+    std::ofstream file(inputfile);
+    for (size_t i = 0; i < numNetflows; i++) {
+      file << i % 2 << "," << generator.generate() << "\n";
+    }
+  }
+
+  // The first pass also brings the file into the page cache.
+  {
+    ReadCSV<EdgeType, Tuplizer> source(0, inputfile);
+    run("ReadCSV", source);
+  }
+
+  for (size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+    ReadMappedCSV<EdgeType, Tuplizer> source(0, inputfile, numThreads,
+                                             !unordered, chunkSize);
+    run("ReadMappedCSV threads " + std::to_string(numThreads), source);
+  }
+
+  if (generated) {
+    std::remove(inputfile.c_str());
+  }
+
+  return 0;
+}
@@ -8,9 +8,6 @@
  */
 
 //#define DEBUG
-#define TIMING
-#define DETAIL_TIMING
-#define METRICS
 #define DROP_QUERIES
 //#define DETAIL_METRICS
 //#define NOBLOCK
@@ -52,12 +49,9 @@ typedef GraphStoreType::ResultType ResultType;
 
 
 void printStuff(std::shared_ptr<GraphStoreType> graphStore, size_t nodeId) {
-  #ifdef TIMING
   printf("Node %lu Timing total consume time: %f\n", nodeId, 
     graphStore->getTotalTimeConsume());
-  #endif
 
-  #ifdef DETAIL_TIMING
   printf("Node %lu Detail Timing ConsumeDoesTheWork::addEdge: %f\n", nodeId,
     graphStore->getTotalTimeConsumeAddEdge());
   printf("Node %lu Detail Timing ConsumeDoesTheWork::resultMap->process: %f\n", 
@@ -102,9 +96,7 @@ void printStuff(std::shared_ptr<GraphStoreType> graphStore, size_t nodeId) {
     nodeId, graphStore->getTotalTimeProcessLoop1());
   printf("Node %lu Detail Timing total processLoop2 time: %f\n",
     nodeId, graphStore->getTotalTimeProcessLoop2());
-  #endif
 
-  #ifdef METRICS
   /////// EdgeRequestMap metrics /////////////////////////////////////
   printf("Node %lu Metrics total EdgeRequestMap edge push attempts: %lu\n", nodeId,
     graphStore->getTotalEdgeRequestMapPushes());
@@ -136,29 +128,8 @@ void printStuff(std::shared_ptr<GraphStoreType> graphStore, size_t nodeId) {
   printf("Node %lu total GraphStore request fails: %lu\n", nodeId,
     graphStore->getTotalRequestPushFails());
 
-  #endif
-
-  #ifdef DETAIL_TIMING
-  /*std::list<double> const& consumeTimes = graphStore->getConsumeTimes();
-  double average = std::accumulate(consumeTimes.begin(),
-                               consumeTimes.end(), 0.0) / consumeTimes.size();
-
-  std::list<double> diff;
-  std::transform(consumeTimes.begin(), consumeTimes.end(), diff.begin(),
-                 std::bind2nd(std::minus<double>(), average));
-  double sq_sum = std::inner_product(diff.begin(), diff.end(), diff.begin(), 0);
-  double stdev = std::sqrt(sq_sum / consumeTimes.size());
-  size_t i = 0;
-  printf("Node %lu expected iteration time %f\n", nodeId, 1.0/rate);
-  for (double t : consumeTimes) {
-    if (t > average + 2 * stdev) {
-      printf("Node %lu Consume time outside 2 stddev (i, time): %lu %f\n", 
-        nodeId, i, t);
-    }
-    i++;
-  }*/
-  #endif
- 
+  printf("Node %lu Metrics\n%s", nodeId,
+    MetricsRegistry::instance().report().c_str());
 }
 
 int main(int argc, char** argv) {
@@ -188,6 +159,9 @@ int main(int argc, char** argv) {
   size_t timeout = 1000;
   double dropTolerance;
   double keepQueries;
+  bool metrics; ///> Whether to record timing metrics
+  int metricsPort; ///> Localhost port metrics are served on; 0 is off
+  size_t traceInterval; ///> Traces the latency of one in this many edges
 
   po::options_description desc("This code creates a set of vertices "
     " and generates edges amongst that set.  It finds triangles among the"
@@ -253,6 +227,15 @@ int main(int argc, char** argv) {
       "How long (in seconds) this process can get behind before dropping.")
     ("keepQueries", po::value<double>(&keepQueries)->default_value(1.0),
       "Percentage of checks aginst queries to keep") 
+    ("metrics", po::bool_switch(&metrics)->default_value(false),
+      "Records timing metrics and prints them at the end (also turned on "
+      "by the SAM_METRICS environment variable)")
+    ("metricsPort", po::value<int>(&metricsPort)->default_value(0),
+      "Records metrics and serves them in the Prometheus format at "
+      "http://localhost:<metricsPort>/metrics (default: 0, not served)")
+    ("traceInterval", po::value<size_t>(&traceInterval)->default_value(0),
+      "Traces the latency from generation to each stage of one in this "
+      "many edges; needs --metrics or --metricsPort (default: 0, none)")
   ;
 
   // Parse the command line variables
@@ -266,6 +249,18 @@ int main(int argc, char** argv) {
     return 1;
   }
 
+  if (metrics || metricsPort > 0) {
+    MetricsRegistry::setEnabled(true);
+  }
+  if (traceInterval > 0) {
+    LatencyTracer::setSampleInterval(traceInterval);
+  }
+  std::unique_ptr<MetricsServer> metricsServer;
+  if (metricsPort > 0) {
+    metricsServer.reset(new MetricsServer(metricsPort));
+    metricsServer->start();
+  }
+
   std::ofstream ofile;
   if (outputNetflowFile != "") {
     ofile.open(outputNetflowFile);
@@ -448,6 +443,7 @@ int main(int argc, char** argv) {
       try {
         auto consumeTime1 = std::chrono::high_resolution_clock::now();
         EdgeType edge = tuplizer(i, str);
+        edge.ingestTime = LatencyTracer::stamp();
         pushPull->consume(edge);
         auto consumeTime2 = std::chrono::high_resolution_clock::now();
         double consumeTime = duration_cast<duration<double>>(
@@ -1,7 +1,3 @@
-#define TIMING
-#define DETAIL_TIMING
-#define METRICS
-
 #include <sam/GraphStore.hpp>
 #include <sam/EdgeDescription.hpp>
 #include <sam/SubgraphQuery.hpp>
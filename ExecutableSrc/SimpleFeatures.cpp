@@ -480,6 +480,7 @@ int main(int argc, char** argv) {
   // and write the results to the outputfile.
   string inputfile;
   string outputfile;
+  string outputFormat; ///> csv or columnar
 
   // Where subgraph results are written
   string printerLocation;
@@ -563,7 +564,11 @@ int main(int argc, char** argv) {
     ("outputfile",
       po::value<string>(&outputfile),
       "If --create_features is specified, the produced file will"
-      " be a csv file of features.")
+      " be a file of features.")
+    ("outputFormat",
+      po::value<string>(&outputFormat)->default_value("csv"),
+      "The format of --outputfile: csv or columnar, a binary column file "
+      "that scripts/learning.py can memory map (default: csv).")
     ("printerLocation",
       po::value<std::string>(&printerLocation)->default_value(""),
       "Where subgraph results are written.")
@@ -634,8 +639,8 @@ int main(int argc, char** argv) {
     auto receiver = std::make_shared<ReadCSVType>(nodeId, inputfile);
 
     // subscriber collects the features for each netflow
-    auto subscriber = std::make_shared<FeatureSubscriber>(outputfile, 
-                                                          featureCapacity);
+    auto subscriber = std::make_shared<FeatureSubscriber>(outputfile,
+      featureCapacity, featureOutputFormatFromString(outputFormat));
 
 
     receiver->registerSubscriber(subscriber, "label");
@@ -14,6 +14,15 @@
 
 #include <sam/sam.hpp>
 
+/**
+ * Measures how fast ReadSocket can ingest netflows over a socket.  Serve a
+ * file of VAST netflows on the loopback interface, e.g.
+ *
+ *   nc -l 9999 < netflows.csv
+ *
+ * and run TestNCSpeed once with the default ReadSocket::receive and once
+ * with --batched to compare against ReadSocket::receiveBatched.
+ */
 
 namespace po = boost::program_options;
 using std::string;
@@ -30,14 +39,20 @@ int main(int argc, char* argv[])
 {
 	string ip;
 	int port;
-	int n;
-	time_t timestamp_sec1, timestamp_sec2;
+	size_t batchSize;
+	size_t bufferSize;
 
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help","help message")
 		("ip", po::value<string>(&ip)->default_value("localhost"), "The ip to receive data")
 		("port", po::value<int>(&port)->default_value(9999), "The port to receive data")
+		("batched", "Use ReadSocket::receiveBatched instead of receive")
+		("batchSize", po::value<size_t>(&batchSize)->default_value(1024),
+		  "The number of edges handed to consumers at once with --batched")
+		("bufferSize", po::value<size_t>(&bufferSize)->default_value(
+		  READ_SOCKET_LARGE_BUFFER_SIZE),
+		  "The size of the receive buffer in bytes with --batched")
 	;
 
 	po::variables_map vm;
@@ -59,14 +74,18 @@ int main(int argc, char* argv[])
   milliseconds ms1 = duration_cast<milliseconds>(
     system_clock::now().time_since_epoch()
   );
-	string line = "";
-	int count = 0;
-  socket.receive();
+  if (vm.count("batched")) {
+    socket.receiveBatched(batchSize, bufferSize);
+  } else {
+    socket.receive();
+  }
   milliseconds ms2 = duration_cast<milliseconds>(
     system_clock::now().time_since_epoch()
   );
-  std::cout << "Seconds " <<
-    static_cast<double>(ms2.count() - ms1.count()) / 1000 << std::endl;
+  double seconds = static_cast<double>(ms2.count() - ms1.count()) / 1000;
+  std::cout << "Seconds " << seconds << std::endl;
+  std::cout << "Tuples per second " << 
+    socket.getNumReceived() / seconds << std::endl;
 
 
 	return 0;
@@ -0,0 +1,691 @@
+/*
+ * ThroughputHarness.cpp
+ * Measures the end-to-end throughput of a SAM pipeline.  All the nodes of
+ * the cluster run as threads of this process and talk to each other through
+ * the chosen transport (zeromq over localhost, or one of the in-process
+ * transports).  Each node is driven by a synthetic traffic generator at a
+ * target rate, or as fast as it can go, and the harness reports the
+ * tuples/sec sent in (ingest) and the tuples/sec the pipeline got through
+ * until it drained, the p50/p99 latency from ingest to the last stage of
+ * the pipeline, how many tuples were dropped and the peak resident memory
+ * during the run.  With --sweep the rate is increased step by step to find
+ * where the pipeline saturates, judged by the drained rate.
+ *
+ * The traffic is generated before the clock starts, from a seed, so that
+ * runs can be repeated and the cost of generating and parsing netflows is
+ * not part of the measurement.
+ */
+
+#include <boost/program_options.hpp>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/sam.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+namespace po = boost::program_options;
+using std::string;
+using std::vector;
+using namespace std::chrono;
+
+typedef VastNetflow TupleType;
+typedef EmptyLabel LabelType;
+typedef Edge<size_t, LabelType, TupleType> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+typedef GraphStore<EdgeType, Tuplizer, SourceIp, DestIp,
+                   TimeSeconds, DurationSeconds,
+                   StringHashFunction, StringHashFunction,
+                   StringEqualityFunction, StringEqualityFunction>
+        GraphStoreType;
+typedef GraphStoreType::QueryType SubgraphQueryType;
+typedef TupleStringHashFunction<TupleType, SourceIp> SourceHash;
+typedef TupleStringHashFunction<TupleType, DestIp> TargetHash;
+typedef ZeroMQPushPull<EdgeType, Tuplizer, SourceHash, TargetHash>
+        PartitionType;
+
+/// How often in ms the resident memory is sampled during a step.
+#define HARNESS_RSS_INTERVAL 50
+
+/// Ports a sweep step leaves free for the next one, on top of the ones the
+/// step's nodes use.
+#define HARNESS_PORT_PADDING 10
+
+/**
+ * The settings of a run.
+ */
+struct HarnessOptions
+{
+  size_t numNodes;
+  TransportType transportType;
+  string generator;
+  string pipeline;
+  size_t numVertices;
+  size_t numServers;
+  size_t poolSize;
+  double duration;
+  size_t numTuples;
+  double tupleInterval;
+  size_t startingPort;
+  size_t hwm;
+  size_t queueLength;
+  size_t numPushSockets;
+  size_t numPullThreads;
+  size_t timeout;
+  double dropTolerance;
+  size_t N;
+  size_t featureCapacity;
+  size_t graphCapacity;
+  size_t tableCapacity;
+  size_t resultsCapacity;
+  double timeWindow;
+  double queryTimeWindow;
+  unsigned int seed;
+};
+
+/**
+ * What one run at one rate measured.
+ */
+struct StepResult
+{
+  double offeredRate = 0; ///> Tuples/sec asked for; 0 is as fast as possible
+  double ingestRate = 0; ///> Tuples/sec sent into the pipeline
+  double drainedRate = 0; ///> Tuples/sec sent over the time until drained
+  double seconds = 0; ///> How long the nodes took to send their tuples
+  double drainSeconds = 0; ///> Until the last tuple got through the operators
+  size_t numSent = 0; ///> Tuples the nodes sent
+  size_t numDropped = 0; ///> Tuples dropped for being late or by transports
+  size_t numResults = 0; ///> Subgraph query results found
+  long peakRssKb = 0; ///> Most resident memory sampled during the step
+  HistogramSnapshot latency; ///> Ingest to the last stage of the pipeline
+};
+
+/**
+ * Registered after a node's operators, so it sees each edge once they are
+ * done with it.  Keeps when that last happened.
+ */
+class DrainClock : public AbstractConsumer<EdgeType>
+{
+private:
+  std::atomic<int64_t> last; ///> steady_clock nanoseconds
+
+public:
+  DrainClock() : last(0) {}
+
+  bool consume(EdgeType const& edge) { return consumeBatch(&edge, 1); }
+
+  bool consumeBatch(EdgeType const* edges, size_t numEdges)
+  {
+    int64_t now = duration_cast<nanoseconds>(
+      steady_clock::now().time_since_epoch()).count();
+    int64_t seen = last.load();
+    while (seen < now && !last.compare_exchange_weak(seen, now)) {}
+    return true;
+  }
+
+  void terminate() {}
+
+  /**
+   * When the operators last finished an edge; the epoch if never.
+   */
+  steady_clock::time_point lastEdge() const
+  {
+    return steady_clock::time_point(nanoseconds(last.load()));
+  }
+};
+
+/**
+ * One node of the cluster: its partitioner and pipeline.
+ */
+struct HarnessNode
+{
+  std::shared_ptr<FeatureMap> featureMap;
+  std::shared_ptr<PartitionType> pushPull;
+  std::shared_ptr<FeatureSubscriber> subscriber;
+  std::shared_ptr<GraphStoreType> graphStore;
+  vector<std::shared_ptr<AbstractConsumer<EdgeType>>> operators;
+  std::shared_ptr<DrainClock> drainClock;
+  size_t numDropped = 0; ///> Tuples the driver dropped for being late
+};
+
+/**
+ * Creates the generator named on the command line.
+ */
+std::shared_ptr<AbstractVastNetflowGenerator>
+createGenerator(HarnessOptions const& options, size_t nodeId)
+{
+  string const& name = options.generator;
+  if (name == "random") {
+    return std::make_shared<RandomGenerator>();
+  } else if (name == "pool") {
+    return std::make_shared<RandomPoolGenerator>(options.numVertices);
+  } else if (name == "wateringhole") {
+    return std::make_shared<WateringHoleGenerator>(options.numVertices,
+                                                   options.numServers);
+  } else if (name == "uniformdestport") {
+    return std::make_shared<UniformDestPort>(
+      "192.168.0." + std::to_string(nodeId + 1), options.numVertices);
+  } else if (name == "onepair") {
+    return std::make_shared<OnePairSizeDist>(
+      "192.168.1." + std::to_string(nodeId + 1), "192.168.0.1",
+      1000, 100, 100, 10);
+  }
+  throw std::invalid_argument("Unknown generator " + name + "; expected "
+    "random, pool, wateringhole, uniformdestport or onepair");
+}
+
+/**
+ * Generates and parses the traffic of a node.  The node sends the pool
+ * over and over, moving the time of each tuple forward.
+ */
+vector<EdgeType> createPool(HarnessOptions const& options, size_t nodeId)
+{
+  auto generator = createGenerator(options, nodeId);
+  srand(options.seed + nodeId);
+  generator->seed(options.seed + nodeId);
+
+  Tuplizer tuplizer;
+  vector<EdgeType> pool;
+  pool.reserve(options.poolSize);
+  for (size_t i = 0; i < options.poolSize; i++) {
+    string str = generator->generate(0.0);
+    pool.push_back(tuplizer(i, str));
+  }
+  return pool;
+}
+
+std::shared_ptr<SubgraphQueryType>
+createTriangleQuery(std::shared_ptr<FeatureMap> featureMap,
+                    double queryTimeWindow)
+{
+  std::string e0 = "e0";
+  std::string e1 = "e1";
+  std::string e2 = "e2";
+  std::string nodex = "nodex";
+  std::string nodey = "nodey";
+  std::string nodez = "nodez";
+
+  EdgeExpression x2y(nodex, e0, nodey);
+  EdgeExpression y2z(nodey, e1, nodez);
+  EdgeExpression z2x(nodez, e2, nodex);
+  TimeEdgeExpression startE0First(EdgeFunction::StartTime, e0,
+                                  EdgeOperator::Assignment, 0);
+  TimeEdgeExpression startE1First(EdgeFunction::StartTime, e1,
+                                  EdgeOperator::GreaterThan, 0);
+  TimeEdgeExpression startE2First(EdgeFunction::StartTime, e2,
+                                  EdgeOperator::GreaterThan, 0);
+  TimeEdgeExpression startE0Second(EdgeFunction::StartTime, e0,
+                                   EdgeOperator::LessThan, queryTimeWindow);
+  TimeEdgeExpression startE1Second(EdgeFunction::StartTime, e1,
+                                   EdgeOperator::LessThan, queryTimeWindow);
+  TimeEdgeExpression startE2Second(EdgeFunction::StartTime, e2,
+                                   EdgeOperator::LessThan, queryTimeWindow);
+
+  auto query = std::make_shared<SubgraphQueryType>(featureMap);
+  query->addExpression(x2y);
+  query->addExpression(y2z);
+  query->addExpression(z2x);
+  query->addExpression(startE0First);
+  query->addExpression(startE1First);
+  query->addExpression(startE2First);
+  query->addExpression(startE0Second);
+  query->addExpression(startE1Second);
+  query->addExpression(startE2Second);
+  query->finalize();
+  return query;
+}
+
+std::shared_ptr<SubgraphQueryType>
+createWateringHoleQuery(std::shared_ptr<FeatureMap> featureMap,
+                        double queryTimeWindow, string const& topkId)
+{
+  std::string e0 = "e0";
+  std::string e1 = "e1";
+  std::string bait = "bait";
+  std::string target = "target";
+  std::string controller = "controller";
+
+  EdgeExpression target2Bait(target, e0, bait);
+  EdgeExpression target2Controller(target, e1, controller);
+  TimeEdgeExpression endE0Second(EdgeFunction::EndTime, e0,
+                                 EdgeOperator::Assignment, 0);
+  TimeEdgeExpression startE1First(EdgeFunction::StartTime, e1,
+                                  EdgeOperator::GreaterThan, 0);
+  TimeEdgeExpression startE1Second(EdgeFunction::StartTime, e1,
+                                   EdgeOperator::LessThan, queryTimeWindow);
+  VertexConstraintExpression baitTopK(bait, VertexOperator::In, topkId);
+  VertexConstraintExpression controllerNotTopK(controller,
+                                               VertexOperator::NotIn, topkId);
+
+  auto query = std::make_shared<SubgraphQueryType>(featureMap);
+  query->addExpression(target2Bait);
+  query->addExpression(target2Controller);
+  query->addExpression(endE0Second);
+  query->addExpression(startE1First);
+  query->addExpression(startE1Second);
+  query->addExpression(baitTopK);
+  query->addExpression(controllerNotTopK);
+  query->finalize();
+  return query;
+}
+
+/**
+ * Sets up the partitioner and pipeline of a node.
+ * \param portBase The first port of the step; the partitioner uses
+ *   portsPerComponent ports from there and the GraphStore the two ranges
+ *   after that.
+ */
+std::shared_ptr<HarnessNode> createNode(HarnessOptions const& options,
+                                        size_t nodeId,
+                                        vector<string> const& hostnames,
+                                        size_t portBase,
+                                        size_t portsPerComponent)
+{
+  auto node = std::make_shared<HarnessNode>();
+  node->featureMap = std::make_shared<FeatureMap>(options.featureCapacity);
+  node->pushPull = std::make_shared<PartitionType>(options.queueLength,
+    options.numNodes, nodeId, hostnames, portBase, options.timeout, true,
+    options.hwm, options.numPushSockets, options.numPullThreads,
+    options.transportType);
+
+  if (options.pipeline == "features") {
+    node->subscriber = std::make_shared<FeatureSubscriber>("/dev/null",
+      options.featureCapacity);
+
+    string identifier = "sumSrcTotalBytes";
+    auto sum = std::make_shared<ExponentialHistogramSum<double, EdgeType,
+      SrcTotalBytes, DestIp>>(options.N, 2, nodeId, node->featureMap,
+                              identifier);
+    sum->registerSubscriber(node->subscriber, identifier);
+    node->operators.push_back(sum);
+
+    identifier = "varSrcTotalBytes";
+    auto variance = std::make_shared<ExponentialHistogramVariance<double,
+      EdgeType, SrcTotalBytes, DestIp>>(options.N, 2, nodeId,
+                                        node->featureMap, identifier);
+    variance->registerSubscriber(node->subscriber, identifier);
+    node->operators.push_back(variance);
+
+    node->subscriber->init();
+  } else if (options.pipeline == "triangles" ||
+             options.pipeline == "wateringhole") {
+    node->graphStore = std::make_shared<GraphStoreType>(
+      options.numNodes, nodeId, hostnames, portBase + portsPerComponent,
+      options.hwm, options.graphCapacity, options.tableCapacity,
+      options.resultsCapacity, options.numPushSockets,
+      options.numPullThreads, options.timeout, options.timeWindow,
+      node->featureMap, MAX_NUM_FUTURES, true, options.transportType);
+
+    std::shared_ptr<SubgraphQueryType> query;
+    if (options.pipeline == "triangles") {
+      query = createTriangleQuery(node->featureMap, options.queryTimeWindow);
+    } else {
+      string topkId = "topk";
+      node->operators.push_back(std::make_shared<TopK<EdgeType, DestIp>>(
+        options.N, 2, 2, nodeId, node->featureMap, topkId));
+      query = createWateringHoleQuery(node->featureMap,
+                                      options.queryTimeWindow, topkId);
+    }
+    node->graphStore->registerQuery(query);
+    node->operators.push_back(node->graphStore);
+  } else {
+    throw std::invalid_argument("Unknown pipeline " + options.pipeline +
+      "; expected features, triangles or wateringhole");
+  }
+
+  for (auto op : node->operators) {
+    node->pushPull->registerConsumer(op);
+  }
+  node->drainClock = std::make_shared<DrainClock>();
+  node->pushPull->registerConsumer(node->drainClock);
+  return node;
+}
+
+/**
+ * Sends numTuples tuples from the pool into the node, paced to rate
+ * tuples/sec when rate is positive.  A tuple more than dropTolerance
+ * seconds late is dropped.
+ */
+void drive(HarnessOptions const& options, size_t nodeId,
+           HarnessNode& node, vector<EdgeType> const& pool,
+           size_t numTuples, double rate)
+{
+  double increment = rate > 0 ? 1 / rate : 0;
+  auto t1 = steady_clock::now();
+  for (size_t i = 0; i < numTuples; i++) {
+    if (rate > 0) {
+      double due = i * increment;
+      double diff = duration_cast<duration<double>>(
+        steady_clock::now() - t1).count();
+      if (diff < due) {
+        std::this_thread::sleep_for(duration<double>(due - diff));
+      } else if (diff - due > options.dropTolerance) {
+        node.numDropped++;
+        continue;
+      }
+    }
+
+    EdgeType edge = pool[i % pool.size()];
+    edge.id = i * options.numNodes + nodeId;
+    std::get<TimeSeconds>(edge.tuple) = i * options.tupleInterval;
+    edge.ingestTime = LatencyTracer::stamp();
+    node.pushPull->consume(edge);
+  }
+  node.pushPull->terminate();
+}
+
+/**
+ * The resident memory of the process now, from /proc/self/statm.
+ * getrusage's ru_maxrss can't be used per step since it only ever grows.
+ */
+long rssKb()
+{
+  std::ifstream statm("/proc/self/statm");
+  long size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Samples the resident memory every HARNESS_RSS_INTERVAL ms from when it
+ * is created until stop, and keeps the most seen.
+ */
+class RssSampler
+{
+private:
+  long peakKb;
+  bool stopped = false;
+  std::mutex mutex;
+  std::condition_variable stopping;
+  std::thread thread;
+
+public:
+  RssSampler() : peakKb(rssKb())
+  {
+    thread = std::thread([this]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      auto interval = milliseconds(HARNESS_RSS_INTERVAL);
+      while (!stopping.wait_for(lock, interval, [this]() { return stopped; }))
+      {
+        peakKb = std::max(peakKb, rssKb());
+      }
+    });
+  }
+
+  ~RssSampler() { stop(); }
+
+  long stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+    }
+    stopping.notify_all();
+    if (thread.joinable()) thread.join();
+    peakKb = std::max(peakKb, rssKb());
+    return peakKb;
+  }
+};
+
+/**
+ * Runs the pipeline once at the given total rate.
+ */
+StepResult runStep(HarnessOptions const& options,
+                   vector<vector<EdgeType>> const& pools,
+                   double rate, size_t portBase)
+{
+  size_t numNodes = options.numNodes;
+  double nodeRate = rate / numNodes;
+  size_t numTuples = rate > 0 ?
+    static_cast<size_t>(std::ceil(nodeRate * options.duration)) :
+    options.numTuples;
+
+  vector<string> hostnames(numNodes);
+  for (size_t i = 0; i < numNodes; i++) {
+    hostnames[i] = options.transportType == TransportType::ZeroMQ ?
+      "localhost" : "node" + std::to_string(i);
+  }
+  size_t portsPerComponent = options.numPushSockets * numNodes * numNodes;
+
+  vector<std::shared_ptr<HarnessNode>> nodes;
+  for (size_t i = 0; i < numNodes; i++) {
+    nodes.push_back(createNode(options, i, hostnames, portBase,
+                               portsPerComponent));
+  }
+
+  TraceStage lastStage = options.pipeline == "features" ?
+    TraceStage::FeatureWrite : TraceStage::GraphAdd;
+  HistogramSnapshot before = LatencyTracer::histogram(lastStage).snapshot();
+  vector<std::shared_ptr<DrainClock>> drainClocks;
+  for (auto const& node : nodes) drainClocks.push_back(node->drainClock);
+
+  RssSampler rssSampler;
+  auto t1 = steady_clock::now();
+  vector<std::thread> threads;
+  for (size_t i = 0; i < numNodes; i++) {
+    threads.push_back(std::thread(drive, std::cref(options), i,
+      std::ref(*nodes[i]), std::cref(pools[i]), numTuples, nodeRate));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto t2 = steady_clock::now();
+
+  StepResult result;
+  result.offeredRate = rate;
+  result.seconds = duration_cast<duration<double>>(t2 - t1).count();
+  for (auto const& node : nodes) {
+    result.numDropped += node->numDropped + node->pushPull->getNumSendFailures();
+    if (node->graphStore) {
+      result.numDropped += node->graphStore->getTotalEdgePushFails() +
+                           node->graphStore->getTotalRequestPushFails();
+      result.numResults += node->graphStore->getNumResults();
+    }
+    result.numSent += numTuples - node->numDropped;
+  }
+  result.ingestRate = result.numSent / result.seconds;
+
+  // Tearing down the nodes waits for the edges still in flight, so their
+  // latency is counted too, and the pipeline has drained when the last of
+  // them got through the operators.
+  nodes.clear();
+  auto drained = t2;
+  for (auto const& clock : drainClocks) {
+    drained = std::max(drained, clock->lastEdge());
+  }
+  result.drainSeconds = duration_cast<duration<double>>(drained - t1).count();
+  result.drainedRate = result.numSent / result.drainSeconds;
+  result.latency = LatencyTracer::histogram(lastStage).snapshot();
+  result.latency -= before;
+  result.peakRssKb = rssSampler.stop();
+  return result;
+}
+
+void printHeader()
+{
+  printf("%14s %14s %14s %10s %10s %10s %10s %10s %12s %10s\n",
+    "offered_tps", "ingest_tps", "drained_tps", "seconds", "drain_s",
+    "p50_ms", "p99_ms", "dropped", "peak_rss_mb", "results");
+}
+
+void printResult(StepResult const& result)
+{
+  string offered = result.offeredRate > 0 ?
+    std::to_string(static_cast<size_t>(result.offeredRate)) : "max";
+  printf("%14s %14.0f %14.0f %10.3f %10.3f %10.3f %10.3f %10lu %12.1f "
+    "%10lu\n", offered.c_str(), result.ingestRate, result.drainedRate,
+    result.seconds, result.drainSeconds, result.latency.quantile(0.5) / 1e6,
+    result.latency.quantile(0.99) / 1e6, result.numDropped,
+    result.peakRssKb / 1024.0, result.numResults);
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+
+  HarnessOptions options;
+  string transport; ///> zeromq, direct or queue
+  double rate; ///> Total tuples per second over all nodes; 0 is no limit
+  size_t traceInterval; ///> Traces the latency of one in this many edges
+  bool sweep; ///> Whether to increase the rate until saturation
+  double sweepFactor; ///> How much the rate grows each sweep step
+  size_t sweepSteps; ///> The most sweep steps
+  double saturationRatio; ///> Drained/offered rate below which we saturated
+  double maxLatency; ///> p99 latency (seconds) above which we saturated
+
+  po::options_description desc("Measures the throughput and latency of a "
+    "pipeline running on numNodes nodes inside this process, driven by "
+    "synthetic traffic.");
+  desc.add_options()
+    ("help", "help message")
+    ("numNodes", po::value<size_t>(&options.numNodes)->default_value(2),
+      "The number of nodes, each run as threads of this process "
+      "(default: 2).")
+    ("transport", po::value<string>(&transport)->default_value("zeromq"),
+      "How the nodes talk to each other: zeromq (over localhost), direct "
+      "or queue (default: zeromq).")
+    ("generator", po::value<string>(&options.generator)->default_value(
+      "pool"), "The traffic generator: random, pool, wateringhole, "
+      "uniformdestport or onepair (default: pool).")
+    ("pipeline", po::value<string>(&options.pipeline)->default_value(
+      "features"), "What the nodes compute: features, triangles or "
+      "wateringhole (default: features).")
+    ("numVertices", po::value<size_t>(&options.numVertices)->default_value(
+      1000), "Vertices of the pool generator, clients of the watering hole "
+      "generator and ports of the uniformdestport generator "
+      "(default: 1000).")
+    ("numServers", po::value<size_t>(&options.numServers)->default_value(
+      10), "Servers of the watering hole generator (default: 10).")
+    ("poolSize", po::value<size_t>(&options.poolSize)->default_value(
+      100000), "How many tuples each node generates up front and then "
+      "cycles through (default: 100000).")
+    ("seed", po::value<unsigned int>(&options.seed)->default_value(0),
+      "Seed of the generators; node i uses seed + i (default: 0).")
+    ("rate", po::value<double>(&rate)->default_value(10000),
+      "Tuples per second over all nodes; 0 sends as fast as possible "
+      "(default: 10000).")
+    ("duration", po::value<double>(&options.duration)->default_value(5),
+      "Seconds each rate is run for (default: 5).")
+    ("numTuples", po::value<size_t>(&options.numTuples)->default_value(
+      100000), "Tuples each node sends when the rate is 0 "
+      "(default: 100000).")
+    ("tupleInterval", po::value<double>(&options.tupleInterval)->
+      default_value(0.01), "Seconds of netflow time between the tuples of a "
+      "node (default: 0.01).")
+    ("dropTolerance", po::value<double>(&options.dropTolerance)->
+      default_value(1), "How long (in seconds) a node can get behind before "
+      "dropping tuples (default: 1).")
+    ("sweep", po::bool_switch(&sweep)->default_value(false),
+      "Multiplies the rate by sweepFactor after each run until the pipeline "
+      "saturates.")
+    ("sweepFactor", po::value<double>(&sweepFactor)->default_value(2),
+      "How much the rate grows each sweep step (default: 2).")
+    ("sweepSteps", po::value<size_t>(&sweepSteps)->default_value(10),
+      "The most sweep steps (default: 10).")
+    ("saturationRatio", po::value<double>(&saturationRatio)->default_value(
+      0.95), "The pipeline is saturated when the rate it drains at is less "
+      "than this fraction of the offered rate (default: 0.95).")
+    ("maxLatency", po::value<double>(&maxLatency)->default_value(1),
+      "The pipeline is saturated when the p99 latency is above this many "
+      "seconds (default: 1).")
+    ("traceInterval", po::value<size_t>(&traceInterval)->default_value(100),
+      "Traces the latency of one in this many tuples (default: 100).")
+    ("startingPort", po::value<size_t>(&options.startingPort)->
+      default_value(10000), "The first port used (default: 10000).")
+    ("hwm", po::value<size_t>(&options.hwm)->default_value(10000),
+      "The high water mark of the sockets (default: 10000).")
+    ("queueLength", po::value<size_t>(&options.queueLength)->default_value(
+      1000), "The length of the input queue (default: 1000).")
+    ("numPushSockets", po::value<size_t>(&options.numPushSockets)->
+      default_value(1), "Push sockets a node creates to talk to another "
+      "node (default: 1).")
+    ("numPullThreads", po::value<size_t>(&options.numPullThreads)->
+      default_value(1), "Pull threads per node (default: 1).")
+    ("timeout", po::value<size_t>(&options.timeout)->default_value(1000),
+      "How long (in ms) to wait before a send call fails (default: 1000).")
+    ("N", po::value<size_t>(&options.N)->default_value(10000),
+      "The sliding window of the feature operators (default: 10000).")
+    ("featureCapacity", po::value<size_t>(&options.featureCapacity)->
+      default_value(100000), "How many slots in the feature map and feature "
+      "subscriber (default: 100000).")
+    ("graphCapacity", po::value<size_t>(&options.graphCapacity)->
+      default_value(1000), "How many slots in the csr and csc "
+      "(default: 1000).")
+    ("tableCapacity", po::value<size_t>(&options.tableCapacity)->
+      default_value(1000), "How many slots in SubgraphQueryResultMap and "
+      "EdgeRequestMap (default: 1000).")
+    ("resultsCapacity", po::value<size_t>(&options.resultsCapacity)->
+      default_value(1000), "How many results are kept (default: 1000).")
+    ("timeWindow", po::value<double>(&options.timeWindow)->default_value(10),
+      "How long edges and intermediate results are kept (default: 10).")
+    ("queryTimeWindow", po::value<double>(&options.queryTimeWindow)->
+      default_value(1), "Time window for a query to be satisfied "
+      "(default: 1).")
+  ;
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 1;
+  }
+
+  if (sweep && rate <= 0) {
+    std::cerr << "--sweep needs a starting --rate above 0" << std::endl;
+    return 1;
+  }
+
+  options.transportType = transportTypeFromString(transport);
+
+  MetricsRegistry::setEnabled(true);
+  LatencyTracer::setSampleInterval(traceInterval);
+
+  vector<vector<EdgeType>> pools;
+  for (size_t i = 0; i < options.numNodes; i++) {
+    pools.push_back(createPool(options, i));
+  }
+
+  size_t portsPerStep = 3 * options.numPushSockets * options.numNodes *
+                        options.numNodes + HARNESS_PORT_PADDING;
+  size_t numSteps = sweep ? sweepSteps : 1;
+  double saturationRate = 0;
+  bool saturated = false;
+
+  printHeader();
+  for (size_t step = 0; step < numSteps && !saturated; step++) {
+    StepResult result = runStep(options, pools, rate,
+      options.startingPort + step * portsPerStep);
+    printResult(result);
+
+    saturated = result.numDropped > 0 ||
+      result.drainedRate < saturationRatio * rate ||
+      result.latency.quantile(0.99) > maxLatency * 1e9;
+    if (!saturated) {
+      saturationRate = result.drainedRate;
+    }
+    rate *= sweepFactor;
+  }
+
+  if (sweep) {
+    if (saturated) {
+      printf("Highest sustained rate before saturation: %.0f tuples/sec\n",
+        saturationRate);
+    } else {
+      printf("Did not saturate; highest sustained rate: %.0f tuples/sec\n",
+        saturationRate);
+    }
+  }
+
+  return 0;
+}
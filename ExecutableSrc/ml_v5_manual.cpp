@@ -200,37 +200,34 @@ void createPipeline(std::shared_ptr<ProducerType> producer,
                
   timeLapseSeries->registerConsumer(projectToDest);
  
-  auto aveFunction = [](std::list<std::shared_ptr<Feature>> myList)->double {
-    double sum = 0;
-    for (auto feature : myList) {
-      sum = sum + feature->evaluate<double>(valueFunc); 
-    }
-    return sum / myList.size();
-  };
 
   identifier = "AveTimeDiffVar";
   auto aveTimeDiffVar = 
     std::make_shared<CollapsedConsumer<EdgeType, DestIp>>(
-                                               aveFunction,
+                                               Aggregation::Average,
                                                "destSourceTimeDiffVariance",
                                                nodeId, 
                                                featureMap, 
                                                identifier); 
   
   producer->registerConsumer(aveTimeDiffVar);
-  aveTimeDiffVar->registerSubscriber(subscriber, identifier);
+  if (subscriber != NULL) {
+    aveTimeDiffVar->registerSubscriber(subscriber, identifier);
+  }
 
   identifier = "AveTimeDiffAve";
   auto aveTimeDiffAve = 
     std::make_shared<CollapsedConsumer<EdgeType, DestIp>>(
-                                               aveFunction,
+                                               Aggregation::Average,
                                                "destSourceTimeDiffAve",
                                                nodeId, 
                                                featureMap, 
                                                identifier); 
   
   producer->registerConsumer(aveTimeDiffAve);
-  aveTimeDiffAve->registerSubscriber(subscriber, identifier);
+  if (subscriber != NULL) {
+    aveTimeDiffAve->registerSubscriber(subscriber, identifier);
+  }
 
 
 }
@@ -326,10 +323,29 @@ int main(int argc, char** argv) {
   // and write the results to the outputfile.
   string inputfile;
   string outputfile;
+  string outputFormat; ///> csv or columnar
 
   // Where subgraph results are written
   string printerLocation;
 
+  // The localhost port metrics are served on; 0 doesn't serve them.
+  int metricsPort;
+
+  // Traces the latency of one in this many edges; 0 traces none.
+  size_t traceInterval;
+
+  // When streaming, the features of each item can be scored with a model
+  // exported by scripts/export_model.py; the alerts go to alertFile.
+  string modelFile;
+  string alertFile;
+  double threshold;
+  size_t scoreBatchSize;
+  size_t scoreMaxDelay;
+
+  // How the batches sent to the other nodes are compressed.
+  string compression;
+  double compressionThreshold;
+
   /****************** Process commandline arguments ****************/
 
   po::options_description desc(
@@ -409,10 +425,53 @@ int main(int argc, char** argv) {
     ("outputfile",
       po::value<string>(&outputfile),
       "If --create_features is specified, the produced file will"
-      " be a csv file of features.")
+      " be a file of features.")
+    ("outputFormat",
+      po::value<string>(&outputFormat)->default_value("csv"),
+      "The format of --outputfile: csv or columnar, a binary column file "
+      "that scripts/learning.py can memory map (default: csv).")
     ("printerLocation",
       po::value<std::string>(&printerLocation)->default_value(""),
       "Where subgraph results are written.")
+    ("metricsPort",
+      po::value<int>(&metricsPort)->default_value(0),
+      "Records metrics and serves them in the Prometheus format at "
+      "http://localhost:<metricsPort>/metrics (default: 0, not served).")
+    ("traceInterval",
+      po::value<size_t>(&traceInterval)->default_value(0),
+      "Traces the latency from ingest to each stage of one in this many "
+      "edges; needs --metricsPort (default: 0, none).")
+    ("model",
+      po::value<string>(&modelFile)->default_value(""),
+      "When reading from a socket, scores the features of each item with "
+      "this model (see scripts/export_model.py) and reports the items "
+      "scoring at or above its threshold (default: none).")
+    ("alertFile",
+      po::value<string>(&alertFile)->default_value(""),
+      "Where alerts are written as key,score lines (default: stdout).")
+    ("threshold",
+      po::value<double>(&threshold),
+      "Overrides the threshold of --model.")
+    ("scoreBatchSize",
+      po::value<size_t>(&scoreBatchSize)->default_value(
+        MODEL_SCORER_BATCH_SIZE),
+      "How many items are scored together; 1 scores each item as soon as "
+      "its features are ready.")
+    ("scoreMaxDelay",
+      po::value<size_t>(&scoreMaxDelay)->default_value(
+        MODEL_SCORER_MAX_DELAY),
+      "How long in ms an item may wait for the others of its batch before "
+      "it is scored anyway; 0 waits for the batch to fill.")
+    ("compression",
+      po::value<string>(&compression)->default_value("none"),
+      "Compresses the items sent to the other nodes with none, lz4 or zstd "
+      "while the link to a node is busy.  Every node needs the same "
+      "setting.  The socket is then read in batches of queueLength.")
+    ("compressionThreshold",
+      po::value<double>(&compressionThreshold)->default_value(
+        PUSH_PULL_COMPRESSION_THRESHOLD),
+      "The bytes per second sent to a node above which they are "
+      "compressed; 0 always compresses (default: 50e6).")
   ;
 
   po::variables_map vm;
@@ -443,6 +502,17 @@ int main(int argc, char** argv) {
   // by the specified pipeline.
   auto featureMap = std::make_shared<FeatureMap>(featureCapacity);
 
+  // Serves the metrics of this node for as long as it runs.
+  std::unique_ptr<MetricsServer> metricsServer;
+  if (metricsPort > 0) {
+    MetricsRegistry::setEnabled(true);
+    metricsServer.reset(new MetricsServer(metricsPort));
+    metricsServer->start();
+  }
+  if (traceInterval > 0) {
+    LatencyTracer::setSampleInterval(traceInterval);
+  }
+
   /***************** Creating Features ***********************/
 
   if(vm.count("create_features"))
@@ -477,7 +547,7 @@ int main(int argc, char** argv) {
 
     auto receiver = std::make_shared<ReadCSVType>(nodeId, inputfile);
     auto subscriber = std::make_shared<FeatureSubscriber>(outputfile,
-                                                      featureCapacity);
+      featureCapacity, featureOutputFormatFromString(outputFormat));
 
     receiver->registerSubscriber(subscriber, "label");
 
@@ -545,7 +615,13 @@ int main(int argc, char** argv) {
                                            startingPort,
                                            timeout,
                                            local,
-                                           hwm);
+                                           hwm,
+                                           1, 1,
+                                           TransportType::ZeroMQ,
+                                           CompressionConfig(
+                                             compressionCodecFromString(
+                                               compression),
+                                             compressionThreshold));
 
     receiver->registerConsumer(partitioner);
 
@@ -554,11 +630,25 @@ int main(int argc, char** argv) {
     // in createPipeline.
     auto producer =std::static_pointer_cast<ProducerType>(partitioner);
 
+    // In test mode the subscriber writes no file and hands its rows to
+    // the model instead.
+    std::shared_ptr<FeatureSubscriber> subscriber;
+    if (modelFile != "") {
+      auto model = loadModel(modelFile);
+      if (vm.count("threshold")) {
+        model->setThreshold(threshold);
+      }
+      subscriber = std::make_shared<FeatureSubscriber>("", featureCapacity);
+      subscriber->registerRowConsumer(std::make_shared<ModelScorer>(model,
+        std::make_shared<StreamAlertSink>(alertFile), scoreBatchSize,
+        scoreMaxDelay));
+    }
+
     size_t resultsCapacity = 1000;
     createPipeline<EdgeType, Tuplizer, PartitionType, ProducerType>(
               producer,
               featureMap,
-              NULL,
+              subscriber,
               numNodes,
               nodeId,
               hostnames,
@@ -568,6 +658,9 @@ int main(int argc, char** argv) {
               numSockets, numPullThreads, timeout, timeWindow,
               queueLength, printerLocation);
 
+    if (subscriber) {
+      subscriber->init();
+    }
     if (!receiver->connect()) {
       std::cout << "Couldn't connected to " << ncIp << ":" << ncPort << std::endl;
       return -1;
@@ -575,12 +668,20 @@ int main(int argc, char** argv) {
     milliseconds ms1 = duration_cast<milliseconds>(
       system_clock::now().time_since_epoch()
     );
-    receiver->receive();
+    // Only batches give the partitioner something worth compressing.
+    if (compression != "none") {
+      receiver->receiveBatched(queueLength);
+    } else {
+      receiver->receive();
+    }
     milliseconds ms2 = duration_cast<milliseconds>(
       system_clock::now().time_since_epoch()
     );
     std::cout << "Seconds for Node" << nodeId << ": "
       << static_cast<double>(ms2.count() - ms1.count()) / 1000 << std::endl;
+    if (subscriber) {
+      subscriber->close();
+    }
   }
 
 }
@@ -65,6 +65,7 @@ trait BaseParsing extends RegexParsers {
   def simpleSumKeyWord = "(?i)simplesum".r
   def selfSimilarityKeyWord = "(?i)similarity".r
   def countDistinctKeyWord = "(?i)countdistinct".r
+  def quantileKeyWord = "(?i)quantile".r
   
   // Arithmetic Operators
   def arithmeticOperator = plus | minus
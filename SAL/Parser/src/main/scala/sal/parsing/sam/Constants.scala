@@ -34,6 +34,7 @@ object Constants {
   val EHSumKey              = "EHSumKey"
   val EHVarKey              = "EHVarKey"
   val SimpleSumKey          = "SimpleSumKey"
+  val QuantileKey           = "QuantileKey"
   val FilterKey             = "FilterKey"
 
   /************* end memory keys ********************/
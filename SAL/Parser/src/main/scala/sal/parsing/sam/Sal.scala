@@ -23,15 +23,25 @@ object Sal extends Parsing
     parse(document, fileContents) match
     {
       case Success(matched,_) => 
+        // Some errors, like a filter on a variable that isn't a topk
+        // feature, are only found when the code is generated.
+        val code = try {
+          matched.toString
+        } catch {
+          case e: IllegalArgumentException =>
+            println("ERROR: " + e.getMessage)
+            System.exit(1)
+            ""
+        }
         if (args.length > 1) 
         {
           val outfile = args(1)
           val pw = new PrintWriter(new File(outfile))
-          pw.write(matched.toString)
+          pw.write(code)
           pw.close
 
         } else {
-          println(matched)
+          println(code)
         }
       case Failure(msg,_) => println("FAILURE: " + msg)
       case Error(msg,_) => println("ERROR: " + msg)
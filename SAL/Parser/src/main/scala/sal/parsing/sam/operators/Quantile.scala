@@ -0,0 +1,59 @@
+package sal.parsing.sam.operators
+
+import scala.collection.mutable.HashMap
+import sal.parsing.sam.BaseParsing
+import sal.parsing.sam.Constants
+import sal.parsing.sam.Util
+
+trait Quantile extends BaseParsing
+{
+  def quantileOperator : Parser[QuantileExp] = 
+    // When the window size is not specified
+    quantileKeyWord ~ "(" ~ identifier ~ "," ~ float ~ ")" ^^
+    {case quantile ~ lpar ~ id ~ c1 ~ q ~ rpar =>
+      val windowSize = memory.getOrElse(Constants.WindowSize,
+        Constants.DefaultWindowSize).toInt;
+      QuantileExp(id, q, windowSize, memory)} |
+    // When the parameters are specified
+    quantileKeyWord ~ "(" ~ identifier ~ "," ~ float ~ "," ~ posInt ~ ")" ^^
+    {case quantile ~ lpar ~ id ~ c1 ~ q ~ c2 ~ n ~ rpar =>
+      QuantileExp(id, q, n, memory)}
+}
+
+/**
+ * An expression of the form Quantile(field, q, N).
+ * @param field This is a keyword of the high-level language
+ *   indicating what field the quantile is computed over.
+ * @param q The quantile, e.g. 0.99 for the 99th percentile.
+ * @param N The number of items in the window
+ */
+case class QuantileExp(field: String, q: Float, N: Int,
+                       memory: HashMap[String, String])
+  extends OperatorExp(field, memory) with Util
+{
+  override def createOpString() =
+  {
+    val lstream = memory.get(Constants.CurrentLStream).get
+    val rstream = memory.get(Constants.CurrentRStream).get
+
+    memory += lstream + Constants.OperatorType -> Constants.QuantileKey
+
+    // Getting fields that are arguments of the template
+    val tupleType = memory.get(lstream + Constants.TupleType).get
+    val numKeys = memory.get(lstream + Constants.NumKeys).get
+    var keysString = ""
+    for (i <- 0 until numKeys.toInt ) {
+      keysString = keysString +
+        memory.get(lstream + Constants.KeyStr + i).get + ", "
+    }
+    keysString = keysString.dropRight(2)
+
+    var rString = "  identifier = \"" + lstream + "\";\n"
+    rString += "  auto " + lstream +
+      " = std::make_shared<Quantile<\n" +
+      "    double, EdgeType, " + field + ", " + keysString + ">>(" +
+      N.toString + ", " + q.toString + ", nodeId, featureMap, identifier);\n"
+    rString += addRegisterStatements(lstream, rstream, memory)
+    rString
+  }
+}
@@ -46,6 +46,9 @@ case class TopKExp(field: String, N: Int, b: Int, k: Int,
     // feature, we can later figure out what blah.value(0) means in a
     // filter expression.
     memory += lstream + Constants.OperatorType -> Constants.TopKKey
+
+    // How many values the feature has, so value(index) can be checked.
+    memory += lstream + Constants.TopKK -> k.toString
     
     // We need the input type later, too
     memory += lstream + Constants.TupleType -> tupleType
@@ -5,6 +5,27 @@ import scala.collection.mutable.HashMap
 import sal.parsing.sam.Constants
 import com.typesafe.scalalogging.LazyLogging
 
+/**
+ * Tokens that can be written directly as a C++ expression.  The filter
+ * statement strings these together into a lambda so that SAM doesn't have
+ * to interpret the expression token by token.
+ */
+trait InlineToken
+{
+  /**
+   * @return The C++ code for this token inside the generated lambda.
+   *   The lambda has the parameters key, input, and result and captures
+   *   featureMap.
+   */
+  def cppExpression : String
+
+  /**
+   * @return Any C++ conditions that must hold before cppExpression can be
+   *   evaluated, e.g. that a feature exists in the feature map.
+   */
+  def cppConditions : List[String] = List()
+}
+
 trait InfixUtil 
 {
   /**
@@ -30,8 +51,10 @@ trait InfixUtil
  * token that represents >.   
  */
 case class GreaterThanToken( memory: HashMap[String, String] )
-extends LazyLogging with InfixUtil
+extends LazyLogging with InfixUtil with InlineToken
 {
+  def cppExpression = ">"
+
   /**
    * The toString method is called after a successful match of the parser.
    */
@@ -66,8 +89,10 @@ extends LazyLogging with InfixUtil
  * token that represents <. 
  */
 case class LessThanToken( memory: HashMap[String, String] )
-extends LazyLogging with InfixUtil
+extends LazyLogging with InfixUtil with InlineToken
 {
+  def cppExpression = "<"
+
   /**
    * The toString method is called after a successful match of the parser.
    */
@@ -101,8 +126,10 @@ extends LazyLogging with InfixUtil
  * token that represents +. 
  */
 case class PlusToken( memory: HashMap[String, String])
-extends LazyLogging with InfixUtil
+extends LazyLogging with InfixUtil with InlineToken
 {
+  def cppExpression = "+"
+
   /**
    * The toString method is called after a successful match of the parser.
    */
@@ -138,8 +165,10 @@ extends LazyLogging with InfixUtil
  * token that represents -. 
  */
 case class MinusToken(memory: HashMap[String,String] )
-extends LazyLogging with InfixUtil
+extends LazyLogging with InfixUtil with InlineToken
 {
+  def cppExpression = "-"
+
   /**
    * The toString method is called after a successful match of the parser.
    */
@@ -174,8 +203,10 @@ extends LazyLogging with InfixUtil
  * token that represents a float. 
  */
 case class FloatToken(value : Float, memory: HashMap[String, String] )
-extends LazyLogging with InfixUtil
+extends LazyLogging with InfixUtil with InlineToken
 {
+  def cppExpression = value.toString
+
   override def toString = {
 
     logger.info("floatToken.toString")
@@ -58,11 +58,17 @@ trait Filter extends BaseParsing with LazyLogging  {
   }
 
   def functionToken : Parser[FunctionToken] = {
-    identifier ~ "." ~ identifier ~ "(" ~ int ~ ")" ^^
+    identifier ~ "." ~ identifier ~ "(" ~ int ~ ")" >>
     {
       case id ~ dot ~ function ~ lparan ~ index ~ rparan =>
         logger.info("functionToken")
-        FunctionToken(id, function, index, memory)
+        if (FunctionToken.functions.contains(function)) {
+          success(FunctionToken(id, function, index, memory))
+        } else {
+          err("Unsupported function " + id + "." + function +
+            " in filter expression; supported are " +
+            FunctionToken.functions.mkString(", "))
+        }
     }
   }
   
@@ -95,27 +101,24 @@ extends Statement with LazyLogging with Util
 
     memory += Constants.CurrentRStream -> rstream
     
-    // SAM expects an infix list of filter expression tokens.  We
-    // need to create the list that will hold the tokens in infix
-    // order.
+    // SAL knows the whole expression at this point, so instead of building
+    // a list of tokens that SAM would evaluate one at a time, we generate
+    // a lambda that computes the expression directly.
+    val tokens = flatten(expression)
+    val conditions = tokens.flatMap(_.cppConditions).distinct
+    val body = tokens.map(_.cppExpression).mkString(" ")
+
     var rString = ""
-    var infixVar = "infixList" + FilterStatement.counter
-    rString += "  std::list<std::shared_ptr<ExpressionToken<" +
-      tupleType + ">>> " + infixVar + ";\n\n"
-    memory += Constants.CurrentInfixVariable -> infixVar
-
-    var expressionString = expression.toString
-
-    // TODO The below block of code is a hack.  Calling toString on expression
-    // creates extraneous text to be generated that must be removed.
-    // There should be a way with case statements to generate the 
-    // proper code without the extra stuff.  Need to figure out.
-    val index = expressionString.indexOf(' ')
-    expressionString =expressionString.substring(index, expressionString.length)
-    expressionString = expressionString.replace(")~","")
-    expressionString = expressionString.replace("~","")
-    expressionString = expressionString.substring(0, expressionString.length -1)
-    rString += expressionString
+    val functionVar = "filterFunction" + FilterStatement.counter
+    rString += "  auto " + functionVar + " = [featureMap](" +
+      "std::string const& key,\n" +
+      "    " + tupleType + " const& input, double& result) -> bool {\n"
+    for (condition <- conditions) {
+      rString += "    if (!" + condition + ") { return false; }\n"
+    }
+    rString += "    result = " + body + ";\n" +
+      "    return true;\n" +
+      "  };\n\n"
 
     // Gets the key fields needed for the template parameters.
     val keyFieldTemplateParameters = createKeyFieldsTemplateParameters(memory)
@@ -123,7 +126,7 @@ extends Statement with LazyLogging with Util
     val expressionVar = "filterExpression" + FilterStatement.counter
 
     rString += "  auto " + expressionVar + " = std::make_shared<" +
-      "Expression<" + tupleType + ">>(" + infixVar + ");\n\n"
+      "Expression<" + tupleType + ">>(" + functionVar + ");\n\n"
       
 
     rString += "  auto " + lstream + " = std::make_shared<Filter<" +
@@ -143,6 +146,16 @@ extends Statement with LazyLogging with Util
 
     rString
   }
+
+  /**
+   * The parser combinators give us the expression as nested pairs of
+   * tokens.  This returns the tokens in infix order.
+   */
+  def flatten(expression: Any) : List[InlineToken] = expression match
+  {
+    case pair: Parsers#`~`[_, _] => flatten(pair._1) ++ flatten(pair._2)
+    case token: InlineToken => List(token)
+  }
 }
 
 
@@ -8,6 +8,9 @@ import sal.parsing.sam.Constants
 object FunctionToken { 
   var functionCount = 0 
   var tokenCount = 0  
+
+  // The functions that can be called in a filter expression.
+  val functions = List("value")
 }
 
 /**
@@ -16,7 +19,9 @@ object FunctionToken {
  * for topk variables.  This can be expanded to include other functions
  * for other operator types and functions.  However, there is the limitation
  * that the function have the same schema for the function, i.e. a single
- * int as the parameter.
+ * int as the parameter.  The parser rejects any other function, and code
+ * generation throws an IllegalArgumentException if id is not a topk
+ * variable or the index is out of range.
  *
  * @param id The variable upon which a function is being called (e.g. top2)
  * @param function The function being used (e.g. value)
@@ -30,9 +35,41 @@ case class FunctionToken (id : String,
                              function : String,
                              index : Int,
                              memory: HashMap[String, String])
-extends LazyLogging
+extends LazyLogging with InlineToken
 {  
 
+  override def cppConditions = 
+    List("featureMap->exists(key, \"" + id + "\")")
+
+  /**
+   * Checks that the function can be generated for id, which is only known
+   * once the statements defining id have been generated.
+   */
+  def check() = {
+    val call = id + "." + function + "(" + index + ")"
+    memory.get(id + Constants.OperatorType) match
+    {
+      case Some(Constants.TopKKey) =>
+        val k = memory.get(id + Constants.TopKK).map(_.toInt)
+        if (index < 0 || k.exists(index >= _)) {
+          throw new IllegalArgumentException("Index out of range in " + call +
+            k.map("; " + id + " keeps the top " + _ + " values").getOrElse(""))
+        }
+      case Some(_) =>
+        throw new IllegalArgumentException(function + " in " + call +
+          " is only defined for topk variables")
+      case None =>
+        throw new IllegalArgumentException(id + " in " + call +
+          " is not a feature defined before the filter")
+    }
+  }
+
+  def cppExpression = {
+    check()
+    "static_cast<TopKFeature const *>(featureMap->at(key, \"" + id +
+    "\").get())->getFrequencies()[" + index + "]"
+  }
+
   override def toString = {
     logger.info("FunctionToken.toString")
 
@@ -41,9 +78,8 @@ extends LazyLogging
     // There can be different function tokens.  We find out what kind it
     // is by looking into memory.  This value should have been set by 
     // 
-    val operatorType = memory(id + Constants.OperatorType)
-
-    operatorType match 
+    check()
+    memory(id + Constants.OperatorType) match 
     {
       case Constants.TopKKey => 
 
@@ -0,0 +1,50 @@
+import org.scalatest.FlatSpec
+import sal.parsing.sam.operators.Quantile
+import sal.parsing.sam.Constants
+
+class QuantileSpec extends FlatSpec with Quantile {
+
+  "A quantile operator" must "use the default window size in Constants when" +
+  " no global defaults have been specified" in {
+    memory.clear
+    memory += Constants.CurrentLStream -> "features1"
+    memory += Constants.CurrentRStream -> "VerticesBySource"
+    memory += "features1" + Constants.TupleType -> "EdgeType"
+    memory += "features1" + Constants.NumKeys -> 1.toString
+    memory += "features1" + Constants.KeyStr + 0 -> "SourceIp"
+    parseAll(quantileOperator, "quantile(SrcTotalBytes, 0.99)")
+      match
+    {
+      case Success(matched,_) => 
+         assert(matched.toString.contains(
+           "std::make_shared<Quantile<"))
+         assert(matched.toString.contains(
+           "double, EdgeType, SrcTotalBytes, SourceIp>"))
+         assert(matched.toString.contains(
+           "(" + Constants.DefaultWindowSize + ", 0.99,")) 
+      case Failure(msg,_) => assert(false)
+      case Error(msg,_) => assert(false)
+    }
+  }
+
+  "A quantile operator" must "use the window size when specified" in
+  {
+    memory.clear
+    memory += Constants.CurrentLStream -> "features1"
+    memory += Constants.CurrentRStream -> "VerticesBySource"
+    memory += "features1" + Constants.TupleType -> "EdgeType"
+    memory += "features1" + Constants.NumKeys -> 1.toString
+    memory += "features1" + Constants.KeyStr + 0 -> "SourceIp"
+    memory += Constants.WindowSize -> "22"
+    parseAll(quantileOperator, "quantile(DurationSeconds, 0.5, 1000)")
+      match
+    {
+      case Success(matched,_) => 
+         assert(matched.toString.contains(
+           "double, EdgeType, DurationSeconds, SourceIp>"))
+         assert(matched.toString.contains("(1000, 0.5,"))
+      case Failure(msg,_) => assert(false)
+      case Error(msg,_) => assert(false)
+    }
+  }
+}
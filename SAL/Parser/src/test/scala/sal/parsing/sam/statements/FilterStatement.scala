@@ -6,9 +6,63 @@ import sal.parsing.sam.statements.Filter
 
 class FilterSpec extends FlatSpec with Filter {
 
-  "A filterStatement" must "match the statement" in {
+  // What the statements before the filter would have put in memory.
+  def setMemory() = {
+    memory.clear
+    memory += "VerticesByDest" + Constants.TupleType -> "VastNetflow"
+    memory += "VerticesByDest" + Constants.NumKeys -> 1.toString
+    memory += "VerticesByDest" + Constants.KeyStr + 0 -> "DestIp"
+    memory += "top2" + Constants.OperatorType -> Constants.TopKKey
+    memory += "top2" + Constants.TopKK -> 2.toString
+    memory += "average" + Constants.OperatorType -> "AverageKey"
+  }
+
+  "A filterStatement" must "generate a lambda for the expression" in {
+    setMemory()
+    parseAll(filterStatement, "servers = FILTER VerticesByDest BY " +
+                              "top2.value(0) + top2.value(1) > 0.9;")
+      match
+    {
+      case Success(matched,_) =>
+        val code = matched.toString
+        assert(code.contains("VastNetflow const& input, double& result)"))
+        assert(code.contains(
+          "if (!featureMap->exists(key, \"top2\")) { return false; }"))
+        assert(code.contains("->getFrequencies()[0] + "))
+        assert(code.contains("->getFrequencies()[1] > 0.9;"))
+        assert(code.contains("std::make_shared<Filter<VastNetflow,DestIp>>"))
+      case Failure(msg,_) => assert(false)
+      case Error(msg,_) => assert(false)
+    }
+  }
 
+  "A filterStatement" must "reject functions other than value" in {
+    setMemory()
+    parseAll(filterStatement,
+             "servers = FILTER VerticesByDest BY top2.key(0) > 0.9;")
+      match
+    {
+      case Success(matched,_) => assert(false)
+      case Failure(msg,_) => assert(false)
+      case Error(msg,_) => assert(msg.contains("top2.key"))
+    }
+  }
 
+  "A filterStatement" must "reject value on features that aren't topk " +
+    "or indices that are out of range" in {
+    for (expression <- List("average.value(0)", "unknown.value(0)",
+                            "top2.value(2)")) {
+      setMemory()
+      parseAll(filterStatement,
+               "servers = FILTER VerticesByDest BY " + expression + " < 1;")
+        match
+      {
+        case Success(matched,_) =>
+          intercept[IllegalArgumentException] { matched.toString }
+        case Failure(msg,_) => assert(false)
+        case Error(msg,_) => assert(false)
+      }
+    }
   }
 
 }
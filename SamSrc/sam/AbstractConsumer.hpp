@@ -9,6 +9,7 @@
 #define ABSTRACTCONSUMER_HPP
 
 #include <string>
+#include <sam/Metrics.hpp>
 #include <sam/tuples/Edge.hpp>
 
 namespace sam {
@@ -16,7 +17,9 @@ namespace sam {
 template <typename EdgeType>
 class AbstractConsumer {
 protected:
-  size_t feedCount = 0;
+  /// How many edges were consumed.  Readable from other threads, e.g. by
+  /// the metrics endpoint.
+  SingleWriterCounter feedCount;
 
 public:
 	AbstractConsumer() {}
@@ -24,8 +27,28 @@ public:
 
 	virtual bool consume(EdgeType const& edge) = 0;
 
+  /**
+   * Consumes a batch of edges in order.  The default calls consume() on
+   * each edge.  Operators can override this to amortize the per-tuple 
+   * costs (key generation, map lookups, feature map updates) over the
+   * batch.
+   * \param edges Pointer to the first edge of the batch.
+   * \param numEdges The number of edges in the batch.
+   * \return Returns false if any of the edges were not consumed.
+   */
+  virtual bool consumeBatch(EdgeType const* edges, size_t numEdges)
+  {
+    bool consumed = true;
+    for (size_t i = 0; i < numEdges; i++) {
+      consumed = consume(edges[i]) && consumed;
+    }
+    return consumed;
+  }
+
   virtual void terminate() = 0;
 
+  size_t getFeedCount() const { return feedCount; }
+
 };
 
 
@@ -0,0 +1,46 @@
+#ifndef SAM_ABSTRACT_ROW_CONSUMER_HPP
+#define SAM_ABSTRACT_ROW_CONSUMER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sam {
+
+/**
+ * Gets the rows FeatureSubscriber completes, e.g. to score them with a
+ * model.  Register with FeatureSubscriber::registerRowConsumer before
+ * FeatureSubscriber::init.
+ */
+class AbstractRowConsumer
+{
+public:
+  virtual ~AbstractRowConsumer() {}
+
+  /**
+   * Called once by FeatureSubscriber::init with the names of the columns,
+   * in the order of the values of each row.
+   */
+  virtual void init(std::vector<std::string> const& names) = 0;
+
+  /**
+   * Called for each completed row, from whichever thread completed it.
+   * The values are only valid during the call.
+   * \param key The key (SamGeneratedId) of the item the row describes.
+   * \param values The values of the row, one per column.
+   * \param ingestTime The ingest time of the item if it was sampled for
+   *   latency tracing, otherwise 0.
+   */
+  virtual void consumeRow(std::size_t key, double const* values,
+                          int64_t ingestTime) = 0;
+
+  /**
+   * Called when no more rows are coming, e.g. to process rows that were
+   * held back for batching.
+   */
+  virtual void terminate() = 0;
+};
+
+}
+
+#endif
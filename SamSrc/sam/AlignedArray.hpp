@@ -0,0 +1,68 @@
+#ifndef SAM_ALIGNED_ARRAY_HPP
+#define SAM_ALIGNED_ARRAY_HPP
+
+/**
+ * Heap arrays of over-aligned types, e.g. shards declared
+ * alignas(64) so that each gets its own cache line.
+ *
+ * Before C++17, new and std::allocator (and so make_shared) only align to
+ * alignof(std::max_align_t), 16 bytes on x86-64, whatever alignas the type
+ * asks for.  Shards allocated that way may share cache lines after all.
+ * Classes with such shards keep them in an AlignedArray rather than as a
+ * member array, so the classes themselves can be allocated as usual.
+ */
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+namespace sam {
+
+/**
+ * Destroys the elements of an array made by makeAlignedArray and frees it.
+ */
+template <typename T>
+struct AlignedArrayDelete
+{
+  size_t size;
+
+  AlignedArrayDelete(size_t size = 0) : size(size) {}
+
+  void operator()(T* array) const
+  {
+    for (size_t i = 0; i < size; i++) array[i].~T();
+    free(array);
+  }
+};
+
+template <typename T>
+using AlignedArray = std::unique_ptr<T[], AlignedArrayDelete<T>>;
+
+/**
+ * size default constructed T, the first at a multiple of alignof(T).
+ * \throws std::bad_alloc if the memory can't be had.
+ */
+template <typename T>
+AlignedArray<T> makeAlignedArray(size_t size)
+{
+  size_t alignment = alignof(T) < sizeof(void*) ? sizeof(void*) : alignof(T);
+  void* memory = nullptr;
+  if (posix_memalign(&memory, alignment, size * sizeof(T)) != 0) {
+    throw std::bad_alloc();
+  }
+  T* array = static_cast<T*>(memory);
+  size_t constructed = 0;
+  try {
+    for (; constructed < size; constructed++) new (array + constructed) T();
+  } catch (...) {
+    AlignedArrayDelete<T> destroy(constructed);
+    destroy(array);
+    throw;
+  }
+  return AlignedArray<T>(array, AlignedArrayDelete<T>(size));
+}
+
+}
+
+#endif
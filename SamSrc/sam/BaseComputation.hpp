@@ -1,10 +1,13 @@
 #ifndef BASE_COMPUTATION_HPP
 #define BASE_COMPUTATION_HPP
 
+#include <atomic>
+#include <memory>
 #include <vector>
 #include <string>
 
 #include <sam/FeatureMap.hpp>
+#include <sam/Metrics.hpp>
 
 
 namespace sam
@@ -25,10 +28,38 @@ protected:
   /// key/featurename to feature.
   std::shared_ptr<FeatureMap> featureMap;
 
+  /// The number of keys the operator keeps state for.  Operators with
+  /// per-key state update it when they add a key, so that it can be read
+  /// from other threads.
+  std::atomic<size_t> numKeys;
+
+  std::vector<std::unique_ptr<CallbackMetric>> callbackMetrics;
+
+  /**
+   * Registers the throughput and number of keys of the operator with the
+   * MetricsRegistry, labeled with the node id and identifier.  Operators
+   * call it from their constructor.  They must derive from AbstractConsumer
+   * before BaseComputation, so that feedCount outlives the registration.
+   * \param feedCount The operator's count of consumed edges.
+   */
+  void registerMetrics(SingleWriterCounter const& feedCount)
+  {
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    std::string labels = metricLabels({{"node", std::to_string(nodeId)},
+      {"operator", identifier}});
+    SingleWriterCounter const* count = &feedCount;
+    callbackMetrics.push_back(registry.callback("sam_operator_edges_total",
+      labels, "Edges consumed by the operator", MetricKind::Counter,
+      [count]() { return (double) count->value(); }));
+    callbackMetrics.push_back(registry.callback("sam_operator_keys",
+      labels, "Keys the operator keeps state for", MetricKind::Gauge,
+      [this]() { return (double) numKeys.load(std::memory_order_relaxed); }));
+  }
+
 public:
   BaseComputation(size_t nodeId,
                   std::shared_ptr<FeatureMap> featureMap, 
-                  std::string identifier)
+                  std::string identifier) : numKeys(0)
   {
     this->featureMap = featureMap;
     this->nodeId = nodeId;
@@ -91,8 +91,23 @@ public:
    */
   void parallelFeed(EdgeType const& s);
 
+  /**
+   * Feeds a batch of items to each of the consumers.  Equivalent to 
+   * calling parallelFeed on each item, but only takes the lock once.
+   */
+  void parallelFeed(EdgeType const* items, size_t numItems);
+
   size_t getNumReadItems() const { return numReadItems; }
 
+private:
+  /**
+   * Hands the items in the inputQueue to the consumers and empties the
+   * queue.  The lock must be held.
+   */
+  void flushQueue();
+
+public:
+
 };
 
 template <typename EdgeType>
@@ -147,31 +162,11 @@ void BaseProducer<EdgeType>::parallelFeed(EdgeType const& item) {
   inputQueue[numItems] = item; // T(item);
   numItems++;
 
-  //  this->queueLength));
   if (numItems >= queueLength) {
     DEBUG_PRINT("Node %lu BaseProducer::parallelFeed %s numItems %lu >= "
       "queueLength %lu consumers.size() %lu \n", nodeId, 
       item.toString().c_str(), numItems, queueLength, consumers.size()); 
-    //for(size_t i = 0; i < consumers.size(); i++) {
-    //  threads[i] = std::thread(parallelFeedFunction, i);
-    //}
-
-    //for(size_t i = 0; i < consumers.size(); i++) {
-    //  threads[i].join();
-    //}
-    // Serial for debugging
-    
-    for(size_t j = 0; j < this->queueLength; j++) {
-      
-      
-      for(size_t i = 0; i < consumers.size(); i++) {
-        DEBUG_PRINT("Node %lu BaseProducer::parallelFeed j %lu i %lu "
-          "queueLength %lu tuple %s\n", nodeId, j, i, this->queueLength, 
-          inputQueue[j].toString().c_str());
-        consumers[i]->consume(inputQueue[j]);
-      }
-    }
-    numItems = 0;
+    flushQueue();
   } 
 
   lock.unlock();
@@ -180,6 +175,38 @@ void BaseProducer<EdgeType>::parallelFeed(EdgeType const& item) {
 }
 
 
+template <typename EdgeType>
+void BaseProducer<EdgeType>::parallelFeed(EdgeType const* items, 
+                                          size_t numNewItems) 
+{
+  lock.lock();
+  numReadItems += numNewItems;
+  for (size_t i = 0; i < numNewItems; i++) {
+    inputQueue[numItems] = items[i];
+    numItems++;
+    if (numItems >= queueLength) {
+      flushQueue();
+    }
+  }
+  lock.unlock();
+}
+
+template <typename EdgeType>
+void BaseProducer<EdgeType>::flushQueue() 
+{
+  // Each consumer gets the whole queue as one batch, so the consumers see 
+  // the items one consumer at a time rather than interleaved.  A consumer
+  // that reads features produced by another consumer of this producer sees
+  // them as of the end of the batch; a queueLength of 1 restores the 
+  // per-item interleaving.
+  for(size_t i = 0; i < consumers.size(); i++) {
+    DEBUG_PRINT("Node %lu BaseProducer::flushQueue i %lu numItems %lu\n",
+      nodeId, i, numItems);
+    consumers[i]->consumeBatch(inputQueue, numItems);
+  }
+  numItems = 0;
+}
+
 } /* namespace sam */
 
 #endif /* ABSTRACTPRODUCER_H_ */
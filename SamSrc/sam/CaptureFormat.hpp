@@ -0,0 +1,286 @@
+#ifndef SAM_CAPTURE_FORMAT_HPP
+#define SAM_CAPTURE_FORMAT_HPP
+
+/**
+ * A binary, columnar format for recording a stream of edges (e.g. netflows)
+ * and replaying it without parsing text.  CaptureWriter writes it and
+ * ReadCapture reads it back.
+ *
+ * The file layout is
+ *
+ *   header:  magic "SAMCAP01", uint32 number of columns, and for each
+ *            column a uint8 kind and a uint8 width.
+ *   blocks:  uint32 number of records, then each column stored
+ *            contiguously.  Numeric columns hold the raw values.  String
+ *            columns (e.g. IPs) hold uint32 indices into the dictionary.
+ *   footer:  the string dictionary, then for each block its offset,
+ *            number of records, and the smallest and largest value of the
+ *            time field.
+ *   trailer: uint64 offset of the footer and the magic "SAMCAPND".
+ *
+ * The columns are the fields of the edge's label followed by the fields of
+ * its tuple.  Ids are not stored; they are generated again on replay.
+ * Values are stored in the byte order of the machine that wrote them.
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sam {
+
+class CaptureException : public std::runtime_error {
+public:
+  CaptureException(char const * message) : std::runtime_error(message) { }
+  CaptureException(std::string message) : std::runtime_error(message) { }
+};
+
+namespace CaptureDetails {
+
+static char const HeaderMagic[] = "SAMCAP01";
+static char const TrailerMagic[] = "SAMCAPND";
+static size_t const MagicSize = 8;
+
+static uint8_t const NumericColumn = 0;
+static uint8_t const StringColumn = 1;
+
+/**
+ * Describes how a field type is stored.
+ */
+template <typename T, typename Enable = void>
+struct Column;
+
+template <typename T>
+struct Column<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+  static uint8_t const kind = NumericColumn;
+  static size_t const width = sizeof(T);
+};
+
+template <>
+struct Column<std::string>
+{
+  static uint8_t const kind = StringColumn;
+  static size_t const width = sizeof(uint32_t);
+};
+
+/**
+ * Maps strings to dense indices and back.
+ */
+class Dictionary
+{
+private:
+  std::unordered_map<std::string, uint32_t> indices;
+  std::vector<std::string> strings;
+
+public:
+  uint32_t encode(std::string const& s)
+  {
+    auto it = indices.find(s);
+    if (it != indices.end()) return it->second;
+    uint32_t index = static_cast<uint32_t>(strings.size());
+    indices.emplace(s, index);
+    strings.push_back(s);
+    return index;
+  }
+
+  std::string const& decode(uint32_t index) const
+  {
+    if (index >= strings.size()) {
+      throw CaptureException("Capture dictionary index " +
+        std::to_string(index) + " out of range");
+    }
+    return strings[index];
+  }
+
+  void add(std::string s)
+  {
+    encode(s);
+  }
+
+  size_t size() const { return strings.size(); }
+
+  std::vector<std::string> const& getStrings() const { return strings; }
+};
+
+/**
+ * Per-block entry of the time index.
+ */
+struct BlockInfo
+{
+  uint64_t offset; ///> Offset of the block in the file
+  uint32_t numRecords;
+  double minTime; ///> Smallest value of the time field in the block
+  double maxTime; ///> Largest value of the time field in the block
+};
+
+/**
+ * Appends the raw bytes of a value to a buffer.
+ */
+template <typename T>
+void append(std::vector<char>& buffer, T const& value)
+{
+  char const* bytes = reinterpret_cast<char const*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T read(char const*& position)
+{
+  T value;
+  memcpy(&value, position, sizeof(T));
+  position += sizeof(T);
+  return value;
+}
+
+/**
+ * Operations on all the fields of a std::tuple, one column per field.
+ */
+template <typename TupleType>
+struct TupleColumns
+{
+  static size_t const size = std::tuple_size<TupleType>::value;
+  typedef std::make_index_sequence<size> Indices;
+
+  /// The kind and width of each column.
+  static void describe(std::vector<std::pair<uint8_t, uint8_t>>& columns)
+  {
+    describe(columns, Indices());
+  }
+
+  /// Appends the fields of tuple to the column buffers starting at first.
+  static void append(TupleType const& tuple,
+                     std::vector<std::vector<char>>& buffers,
+                     size_t first,
+                     Dictionary& dictionary)
+  {
+    append(tuple, buffers, first, dictionary, Indices());
+  }
+
+  /// Sets the fields of tuples[0..n) from the columns starting at position,
+  /// and advances position past them.
+  template <typename EdgeType, typename Getter>
+  static void decode(std::vector<EdgeType>& edges,
+                     Getter getter,
+                     char const*& position,
+                     Dictionary const& dictionary)
+  {
+    decode(edges, getter, position, dictionary, Indices());
+  }
+
+private:
+  template <size_t... Is>
+  static void describe(std::vector<std::pair<uint8_t, uint8_t>>& columns,
+                       std::index_sequence<Is...>)
+  {
+    int dummy[] = {0, (columns.push_back(std::make_pair(
+      Column<typename std::tuple_element<Is, TupleType>::type>::kind,
+      static_cast<uint8_t>(
+        Column<typename std::tuple_element<Is, TupleType>::type>::width))),
+      0)...};
+    (void) dummy;
+  }
+
+  template <size_t... Is>
+  static void append(TupleType const& tuple,
+                     std::vector<std::vector<char>>& buffers,
+                     size_t first,
+                     Dictionary& dictionary,
+                     std::index_sequence<Is...>)
+  {
+    int dummy[] = {0, (appendField(std::get<Is>(tuple), buffers[first + Is],
+                                   dictionary), 0)...};
+    (void) dummy;
+  }
+
+  template <typename T>
+  static void appendField(T const& value, std::vector<char>& buffer,
+                          Dictionary&)
+  {
+    CaptureDetails::append(buffer, value);
+  }
+
+  static void appendField(std::string const& value, std::vector<char>& buffer,
+                          Dictionary& dictionary)
+  {
+    CaptureDetails::append(buffer, dictionary.encode(value));
+  }
+
+  /// Nothing to decode, e.g. for EmptyLabel.
+  template <typename EdgeType, typename Getter>
+  static void decode(std::vector<EdgeType>&, Getter, char const*&,
+                     Dictionary const&, std::index_sequence<>)
+  {
+  }
+
+  template <typename EdgeType, typename Getter, size_t... Is>
+  static void decode(std::vector<EdgeType>& edges,
+                     Getter getter,
+                     char const*& position,
+                     Dictionary const& dictionary,
+                     std::index_sequence<Is...>)
+  {
+    int dummy[] = {0, (decodeColumn<Is>(edges, getter, position, dictionary),
+                       0)...};
+    (void) dummy;
+  }
+
+  /// Decodes one column, so the inner loop touches a single contiguous
+  /// array.
+  template <size_t I, typename EdgeType, typename Getter>
+  static void decodeColumn(std::vector<EdgeType>& edges,
+                           Getter getter,
+                           char const*& position,
+                           Dictionary const& dictionary)
+  {
+    for (auto& edge : edges) {
+      decodeField(std::get<I>(getter(edge)), position, dictionary);
+    }
+  }
+
+  template <typename T>
+  static void decodeField(T& field, char const*& position,
+                          Dictionary const&)
+  {
+    field = read<T>(position);
+  }
+
+  static void decodeField(std::string& field, char const*& position,
+                          Dictionary const& dictionary)
+  {
+    field = dictionary.decode(read<uint32_t>(position));
+  }
+};
+
+/**
+ * The columns of an edge: the label fields followed by the tuple fields.
+ */
+template <typename EdgeType>
+struct EdgeColumns
+{
+  typedef typename EdgeType::LocalLabelType LabelType;
+  typedef typename EdgeType::LocalTupleType TupleType;
+
+  static size_t const size = TupleColumns<LabelType>::size +
+                             TupleColumns<TupleType>::size;
+
+  static std::vector<std::pair<uint8_t, uint8_t>> describe()
+  {
+    std::vector<std::pair<uint8_t, uint8_t>> columns;
+    TupleColumns<LabelType>::describe(columns);
+    TupleColumns<TupleType>::describe(columns);
+    return columns;
+  }
+};
+
+}
+
+}
+
+#endif
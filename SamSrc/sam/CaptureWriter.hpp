@@ -0,0 +1,209 @@
+#ifndef SAM_CAPTURE_WRITER_HPP
+#define SAM_CAPTURE_WRITER_HPP
+
+/**
+ * A consumer that records the edges it sees to a binary capture file (see
+ * CaptureFormat.hpp) so that they can be replayed later with ReadCapture.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sam/AbstractConsumer.hpp>
+#include <sam/CaptureFormat.hpp>
+
+#define CAPTURE_BLOCK_SIZE 65536
+
+namespace sam {
+
+/**
+ * \tparam EdgeType The type of edges being recorded.
+ * \tparam timeField The index of the tuple field holding the time of the
+ *   edge (e.g. TimeSeconds).  It is used to build the time index.
+ */
+template <typename EdgeType, size_t timeField>
+class CaptureWriter : public AbstractConsumer<EdgeType>
+{
+public:
+  typedef typename EdgeType::LocalLabelType LabelType;
+  typedef typename EdgeType::LocalTupleType TupleType;
+
+private:
+  typedef CaptureDetails::TupleColumns<LabelType> LabelColumns;
+  typedef CaptureDetails::TupleColumns<TupleType> TupleColumns;
+
+  std::string filename;
+  std::ofstream file;
+  size_t blockSize; ///> Number of records per block
+
+  CaptureDetails::Dictionary dictionary;
+  std::vector<CaptureDetails::BlockInfo> blocks;
+
+  /// The records of the current block, one buffer per column.
+  std::vector<std::vector<char>> columns;
+  uint32_t numRecords = 0;
+  double minTime;
+  double maxTime;
+
+  uint64_t offset = 0; ///> Where the next block will be written
+  bool closed = false;
+  std::mutex mutex;
+
+public:
+  /**
+   * \param filename The file to write the capture to.  It is overwritten.
+   * \param blockSize The number of records in a block.  This is the
+   *   granularity of seeking on replay.
+   */
+  CaptureWriter(std::string filename, size_t blockSize = CAPTURE_BLOCK_SIZE) :
+    filename(filename),
+    file(filename, std::ios::binary | std::ios::trunc),
+    blockSize(std::max<size_t>(1, blockSize)),
+    columns(CaptureDetails::EdgeColumns<EdgeType>::size)
+  {
+    if (!file) {
+      throw CaptureException("CaptureWriter couldn't open " + filename);
+    }
+    resetTimes();
+
+    std::vector<char> header(CaptureDetails::HeaderMagic,
+      CaptureDetails::HeaderMagic + CaptureDetails::MagicSize);
+    auto description = CaptureDetails::EdgeColumns<EdgeType>::describe();
+    CaptureDetails::append(header, static_cast<uint32_t>(description.size()));
+    for (auto const& column : description) {
+      CaptureDetails::append(header, column.first);
+      CaptureDetails::append(header, column.second);
+    }
+    write(header);
+  }
+
+  ~CaptureWriter()
+  {
+    try {
+      close();
+    } catch (std::exception const& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+
+  bool consume(EdgeType const& edge)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    add(edge);
+    return true;
+  }
+
+  bool consumeBatch(EdgeType const* edges, size_t numEdges)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < numEdges; i++) {
+      add(edges[i]);
+    }
+    return true;
+  }
+
+  /**
+   * Finishes the capture.
+   */
+  void terminate()
+  {
+    close();
+  }
+
+  /**
+   * Writes the last block and the footer.  Nothing can be added after.
+   */
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) return;
+    flushBlock();
+
+    std::vector<char> footer;
+    auto const& strings = dictionary.getStrings();
+    CaptureDetails::append(footer, static_cast<uint64_t>(strings.size()));
+    for (auto const& s : strings) {
+      CaptureDetails::append(footer, static_cast<uint32_t>(s.size()));
+      footer.insert(footer.end(), s.begin(), s.end());
+    }
+
+    CaptureDetails::append(footer, static_cast<uint64_t>(blocks.size()));
+    for (auto const& block : blocks) {
+      CaptureDetails::append(footer, block.offset);
+      CaptureDetails::append(footer, block.numRecords);
+      CaptureDetails::append(footer, block.minTime);
+      CaptureDetails::append(footer, block.maxTime);
+    }
+
+    CaptureDetails::append(footer, offset);
+    footer.insert(footer.end(), CaptureDetails::TrailerMagic,
+      CaptureDetails::TrailerMagic + CaptureDetails::MagicSize);
+    write(footer);
+
+    file.close();
+    closed = true;
+  }
+
+  size_t getNumBlocks() const { return blocks.size(); }
+
+private:
+  void add(EdgeType const& edge)
+  {
+    if (closed) {
+      throw CaptureException("CaptureWriter: " + filename + " is closed");
+    }
+    LabelColumns::append(edge.label, columns, 0, dictionary);
+    TupleColumns::append(edge.tuple, columns, LabelColumns::size, dictionary);
+
+    double time = std::get<timeField>(edge.tuple);
+    minTime = std::min(minTime, time);
+    maxTime = std::max(maxTime, time);
+
+    if (++numRecords >= blockSize) {
+      flushBlock();
+    }
+  }
+
+  void flushBlock()
+  {
+    if (numRecords == 0) return;
+
+    CaptureDetails::BlockInfo block = {offset, numRecords, minTime, maxTime};
+    blocks.push_back(block);
+
+    std::vector<char> count;
+    CaptureDetails::append(count, numRecords);
+    write(count);
+    for (auto& column : columns) {
+      write(column);
+      column.clear();
+    }
+
+    numRecords = 0;
+    resetTimes();
+  }
+
+  void write(std::vector<char> const& bytes)
+  {
+    file.write(bytes.data(), bytes.size());
+    if (!file) {
+      throw CaptureException("CaptureWriter failed writing to " + filename);
+    }
+    offset += bytes.size();
+  }
+
+  void resetTimes()
+  {
+    minTime = std::numeric_limits<double>::max();
+    maxTime = std::numeric_limits<double>::lowest();
+  }
+};
+
+}
+
+#endif
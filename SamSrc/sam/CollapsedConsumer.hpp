@@ -11,8 +11,8 @@ namespace sam {
 
 
 template  <typename EdgeType, size_t... keyFields>
-class CollapsedConsumer : public BaseComputation, 
-                          public AbstractConsumer<EdgeType>,
+class CollapsedConsumer : public AbstractConsumer<EdgeType>,
+                          public BaseComputation,
                           public FeatureProducer
 {
 private:
@@ -22,6 +22,13 @@ private:
    */
   std::function<double(std::list<std::shared_ptr<Feature>>)> func;
 
+  /**
+   * Used instead of func when the collapsed consumer is constructed with
+   * an aggregation, which the MapFeature keeps up to date.  Then each
+   * tuple costs O(1) rather than a pass over the whole list.
+   */
+  Aggregation aggregation = Aggregation::Sum;
+
   /**
    * The collapsed consumer is aggregating a list of features with
    * a targetId.  This is specified at constuction time. 
@@ -43,7 +50,25 @@ public:
             targetId(_targetId),
             BaseComputation(nodeId, featureMap, newIdentifier)
   {
-    
+    this->registerMetrics(this->feedCount);
+  }
+
+  /**
+   * \param aggregation The aggregation of the values of the features.
+   *   Features that are NaN are left out of it (see MapFeature), where a
+   *   function sees every feature.
+   */
+  CollapsedConsumer(
+            Aggregation aggregation,
+            std::string _targetId,
+            size_t nodeId,
+            std::shared_ptr<FeatureMap> featureMap,
+            std::string newIdentifier) :
+            aggregation(aggregation),
+            targetId(_targetId),
+            BaseComputation(nodeId, featureMap, newIdentifier)
+  {
+    this->registerMetrics(this->feedCount);
   }
  
   bool consume(EdgeType const& edge)
@@ -67,12 +92,13 @@ public:
     {
       auto mapFeature = std::static_pointer_cast<const MapFeature>(
                           this->featureMap->at(key, targetId));
-      double result = mapFeature->evaluate(func);
+      double result = func ? mapFeature->evaluate(func) :
+                             mapFeature->aggregate(aggregation);
        
       SingleFeature feature(result);
       this->featureMap->updateInsert(key, this->identifier, feature);
 
-      this->notifySubscribers(edge.id, result);
+      this->notifySubscribers(edge, result);
   
       return true;   
     } else {
@@ -4,6 +4,7 @@
 #include <map>
 #include <mutex>
 #include <sam/Util.hpp>
+#include <sam/Metrics.hpp>
 #include <sam/EdgeRequest.hpp>
 #include <thread>
 
@@ -72,10 +73,9 @@ private:
    */
   size_t cleanupEdges(size_t index);
 
-  #ifdef METRICS
-  mutable size_t totalEdgesAdded = 0;
-  mutable size_t totalEdgesDeleted = 0; 
-  #endif
+  /// Only counted while metrics are enabled (see Metrics.hpp).
+  std::shared_ptr<Counter> totalEdgesAdded;
+  std::shared_ptr<Counter> totalEdgesDeleted; 
 
 
 public:
@@ -83,8 +83,11 @@ public:
   /**
    * \param capacity How big the storage is.
    * \param window How big the time window is in seconds.
+   * \param labels The labels of the metrics of this graph, as formatted by
+   *   metricLabels, e.g. the node and whether it is the csr or csc.
    */
-  CompressedSparse(size_t capacity, double window);
+  CompressedSparse(size_t capacity, double window, 
+                   std::string const& labels = "");
 
   ~CompressedSparse();
   
@@ -139,10 +142,8 @@ public:
    */
   size_t countEdges() const;
 
-  #ifdef METRICS
-  size_t getTotalEdgesAdded() const { return totalEdgesAdded; }
-  size_t getTotalEdgesDeleted() const { return totalEdgesDeleted; }
-  #endif
+  size_t getTotalEdgesAdded() const { return totalEdgesAdded->value(); }
+  size_t getTotalEdgesDeleted() const { return totalEdgesDeleted->value(); }
 
 };
 
@@ -150,12 +151,19 @@ template <typename EdgeType, size_t source, size_t target,
           size_t time, size_t duration,
           typename HF, typename EF>
 CompressedSparse<EdgeType, source, target, time, duration, HF, EF>::
-CompressedSparse( size_t capacity, double window ) :
+CompressedSparse( size_t capacity, double window, std::string const& labels ) :
   currentTime(0)
 {
   this->capacity = capacity;
   this->window = window;
 
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  totalEdgesAdded = registry.counter("sam_compressed_sparse_edges_added_total",
+    labels, "Edges added to the graph");
+  totalEdgesDeleted = registry.counter(
+    "sam_compressed_sparse_edges_deleted_total", labels,
+    "Edges removed from the graph because they expired");
+
   mutexes = new std::mutex[capacity];
 
   alle = new std::list<std::list<EdgeType>>[capacity];
@@ -331,7 +339,7 @@ const
                 " %s\n", toString(tuple).c_str());
               
               it = l.erase(it);
-              METRICS_INCREMENT(this->totalEdgesDeleted)
+              totalEdgesDeleted->add();
             }
           }
         }
@@ -354,7 +362,7 @@ CompressedSparse<EdgeType, source, target, time, duration, HF, EF>::addEdge(
 {
   DEBUG_PRINT("CompressedSparse::addEdge tuple %s\n",  
               edge.toString().c_str());
-  METRICS_INCREMENT(totalEdgesAdded)
+  totalEdgesAdded->add();
 
   TupleType tuple = edge.tuple;
 
@@ -456,7 +464,7 @@ cleanupEdges( size_t index )
         "window %f\n", currentTime.load(), std::get<time>(l.front().tuple),
         window);
       l.pop_front();
-      METRICS_INCREMENT(totalEdgesDeleted)
+      totalEdgesDeleted->add();
     }
   }
   return work;
@@ -0,0 +1,373 @@
+#ifndef SAM_COMPRESSION_HPP
+#define SAM_COMPRESSION_HPP
+
+/**
+ * Compression of the batches PushPull sends over ZeroMQ.
+ *
+ * With compression configured, every ZeroMQ message PushPull sends is a
+ * frame holding a batch of one or more messages:
+ *  - one byte naming the codec the rest was compressed with (0 for none),
+ *  - for a compressed frame, the uint32 size of the uncompressed payload,
+ *  - the payload, compressed or not: each message as a uint32 length
+ *    followed by its bytes.
+ * The terminate message stays the empty ZeroMQ message.  A compressed
+ * payload may be at most PUSH_PULL_MAX_FRAME_PAYLOAD bytes, so a corrupt
+ * header can't make the receiver allocate gigabytes.
+ *
+ * Whether a batch gets compressed is up to an AdaptiveCompression per
+ * destination node, shared by the push sockets to that node.  It compresses
+ * while the bytes offered to the node come in faster than a threshold,
+ * i.e. when the network is likely the bottleneck, and sends batches as
+ * they are otherwise, since compressing then only costs CPU and latency.
+ * Only batches of PUSH_PULL_COMPRESSION_MIN_BYTES or more are compressed,
+ * so a single tuple sent on its own never is; callers that have many
+ * messages for a node hand them over together with sendBatch.
+ *
+ * LZ4 and zstd are only available when compiled in with SAM_WITH_LZ4 and
+ * SAM_WITH_ZSTD (CMake defines them when it finds the libraries).
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef SAM_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef SAM_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+/// The rate in bytes per second offered to a node above which the batches
+/// sent to it are compressed.
+#define PUSH_PULL_COMPRESSION_THRESHOLD 50e6
+
+/// How often in ms the rate offered to a node is measured.
+#define PUSH_PULL_COMPRESSION_WINDOW 100
+
+/// Batches smaller than this many bytes are never compressed.
+#define PUSH_PULL_COMPRESSION_MIN_BYTES 256
+
+/// The largest uncompressed payload a compressed frame may hold.  Bigger
+/// payloads are sent uncompressed.
+#define PUSH_PULL_MAX_FRAME_PAYLOAD (1 << 28)
+
+/// The zstd level.  Level 1 is the fastest and still beats LZ4's ratio.
+#define PUSH_PULL_ZSTD_LEVEL 1
+
+namespace sam {
+
+class CompressionException : public std::runtime_error {
+public:
+  CompressionException(char const * message) : std::runtime_error(message) {}
+  CompressionException(std::string message) : std::runtime_error(message) {}
+};
+
+/// The value of each codec is its id in the frame header.
+enum class CompressionCodec : uint8_t
+{
+  None = 0,
+  LZ4 = 1,
+  Zstd = 2
+};
+
+/**
+ * Parses the name of a codec as given on the command line: "none", "lz4"
+ * or "zstd".
+ * \throws CompressionException if the name is unknown.
+ */
+inline CompressionCodec compressionCodecFromString(std::string const& name)
+{
+  if (name == "none") return CompressionCodec::None;
+  if (name == "lz4")  return CompressionCodec::LZ4;
+  if (name == "zstd") return CompressionCodec::Zstd;
+  throw CompressionException("Unknown compression codec " + name +
+    "; expected none, lz4 or zstd");
+}
+
+/**
+ * The compression settings transports hand on to PushPull.  The in-process
+ * transports ignore them.
+ */
+struct CompressionConfig
+{
+  CompressionCodec codec; ///> None sends messages unframed
+  double threshold; ///> See AdaptiveCompression
+
+  CompressionConfig(CompressionCodec codec = CompressionCodec::None,
+                    double threshold = PUSH_PULL_COMPRESSION_THRESHOLD) :
+    codec(codec), threshold(threshold) {}
+};
+
+/**
+ * Whether the codec was compiled in.
+ */
+inline bool isCompressionAvailable(CompressionCodec codec)
+{
+  switch (codec) {
+    case CompressionCodec::None: return true;
+#ifdef SAM_WITH_LZ4
+    case CompressionCodec::LZ4: return true;
+#endif
+#ifdef SAM_WITH_ZSTD
+    case CompressionCodec::Zstd: return true;
+#endif
+    default: return false;
+  }
+}
+
+namespace CompressionDetails {
+
+static size_t const LengthSize = sizeof(uint32_t);
+
+inline void putLength(char* out, size_t length)
+{
+  uint32_t value = static_cast<uint32_t>(length);
+  std::memcpy(out, &value, LengthSize);
+}
+
+inline size_t getLength(char const* in)
+{
+  uint32_t value;
+  std::memcpy(&value, in, LengthSize);
+  return value;
+}
+
+/**
+ * Compresses size bytes of src into dst, which has room for capacity
+ * bytes.  Returns the compressed size, or 0 if it didn't fit.
+ */
+inline size_t compress(CompressionCodec codec, char const* src, size_t size,
+                       char* dst, size_t capacity)
+{
+  // Unused when no codec is compiled in.
+  (void) src; (void) size; (void) dst; (void) capacity;
+  switch (codec) {
+#ifdef SAM_WITH_LZ4
+    case CompressionCodec::LZ4:
+      return LZ4_compress_default(src, dst, size, capacity);
+#endif
+#ifdef SAM_WITH_ZSTD
+    case CompressionCodec::Zstd: {
+      size_t n = ZSTD_compress(dst, capacity, src, size, PUSH_PULL_ZSTD_LEVEL);
+      return ZSTD_isError(n) ? 0 : n;
+    }
+#endif
+    default:
+      throw CompressionException("Compression codec " +
+        std::to_string(static_cast<int>(codec)) + " isn't available");
+  }
+}
+
+/**
+ * Decompresses size bytes of src into the rawSize bytes at dst.
+ * \throws CompressionException if the data is corrupt.
+ */
+inline void decompress(CompressionCodec codec, char const* src, size_t size,
+                       char* dst, size_t rawSize)
+{
+  (void) src; (void) size; (void) dst; (void) rawSize;
+  bool ok = false;
+  switch (codec) {
+#ifdef SAM_WITH_LZ4
+    case CompressionCodec::LZ4: {
+      int n = LZ4_decompress_safe(src, dst, size, rawSize);
+      ok = n >= 0 && static_cast<size_t>(n) == rawSize;
+      break;
+    }
+#endif
+#ifdef SAM_WITH_ZSTD
+    case CompressionCodec::Zstd:
+      ok = ZSTD_decompress(dst, rawSize, src, size) == rawSize;
+      break;
+#endif
+    default:
+      throw CompressionException("Received a frame compressed with codec " +
+        std::to_string(static_cast<int>(codec)) + ", which isn't available");
+  }
+  if (!ok) {
+    throw CompressionException("Couldn't decompress a frame");
+  }
+}
+
+}
+
+/**
+ * Adds a message to the payload of a batch.
+ */
+inline void appendToBatch(std::string& payload, char const* data,
+                          size_t length)
+{
+  size_t offset = payload.size();
+  payload.resize(offset + CompressionDetails::LengthSize + length);
+  CompressionDetails::putLength(&payload[offset], length);
+  std::memcpy(&payload[offset + CompressionDetails::LengthSize], data,
+              length);
+}
+
+/**
+ * Turns the payload of a batch into a frame.
+ * \param codec The codec to compress with, or None to leave the payload as
+ *   it is.  If compressing doesn't make the payload smaller, or the payload
+ *   is larger than PUSH_PULL_MAX_FRAME_PAYLOAD, it is left as it is too.
+ * \return Returns true if the frame was compressed.
+ */
+inline bool encodeFrame(CompressionCodec codec, std::string const& payload,
+                        std::string& frame)
+{
+  using namespace CompressionDetails;
+  if (codec != CompressionCodec::None &&
+      payload.size() <= PUSH_PULL_MAX_FRAME_PAYLOAD)
+  {
+    size_t header = 1 + LengthSize;
+    frame.resize(header + payload.size());
+    size_t n = compress(codec, payload.data(), payload.size(),
+                        &frame[header], payload.size());
+    if (n > 0) {
+      frame[0] = static_cast<char>(codec);
+      putLength(&frame[1], payload.size());
+      frame.resize(header + n);
+      return true;
+    }
+  }
+  frame.resize(1 + payload.size());
+  frame[0] = static_cast<char>(CompressionCodec::None);
+  std::memcpy(&frame[1], payload.data(), payload.size());
+  return false;
+}
+
+/**
+ * Returns the payload of a frame, decompressing it into scratch if it was
+ * compressed.
+ * \param scratch Holds the decompressed payload, so it can be reused from
+ *   one frame to the next.
+ * \throws CompressionException if the frame is malformed, claims a payload
+ *   larger than PUSH_PULL_MAX_FRAME_PAYLOAD or uses a codec that isn't
+ *   available.
+ */
+inline std::pair<char const*, size_t> decodeFrame(char const* frame,
+  size_t size, std::string& scratch)
+{
+  using namespace CompressionDetails;
+  if (size == 0) {
+    throw CompressionException("Empty frame");
+  }
+  CompressionCodec codec = static_cast<CompressionCodec>(frame[0]);
+  if (codec == CompressionCodec::None) {
+    return std::make_pair(frame + 1, size - 1);
+  }
+  if (size < 1 + LengthSize) {
+    throw CompressionException("Truncated frame header");
+  }
+  size_t payloadSize = getLength(frame + 1);
+  if (payloadSize > PUSH_PULL_MAX_FRAME_PAYLOAD) {
+    throw CompressionException("Frame payload of " +
+      std::to_string(payloadSize) + " bytes is too large");
+  }
+  scratch.resize(payloadSize);
+  decompress(codec, frame + 1 + LengthSize, size - 1 - LengthSize,
+             &scratch[0], payloadSize);
+  return std::make_pair(scratch.data(), payloadSize);
+}
+
+/**
+ * Calls f with each message in the payload of a batch, as a std::string.
+ * The whole payload is checked first, so f isn't called at all for a
+ * malformed one.
+ * \return Returns the number of messages.
+ * \throws CompressionException if the payload is malformed.
+ */
+template <typename F>
+size_t forEachInBatch(char const* payload, size_t size, F&& f)
+{
+  using namespace CompressionDetails;
+  size_t numMessages = 0;
+  for (size_t offset = 0; offset < size; numMessages++) {
+    if (size - offset < LengthSize) {
+      throw CompressionException("Truncated message length in batch");
+    }
+    size_t length = getLength(payload + offset);
+    offset += LengthSize;
+    if (size - offset < length) {
+      throw CompressionException("Truncated message in batch");
+    }
+    offset += length;
+  }
+
+  std::string message;
+  for (size_t offset = 0; offset < size; ) {
+    size_t length = getLength(payload + offset);
+    offset += LengthSize;
+    message.assign(payload + offset, length);
+    offset += length;
+    f(message);
+  }
+  return numMessages;
+}
+
+/**
+ * Decides for one destination whether its batches are compressed.  Every
+ * window ms it measures the rate of bytes offered for the destination; it
+ * starts compressing once the rate exceeds the threshold and stops once it
+ * falls below half of it, so it doesn't flip back and forth around the
+ * threshold.  A threshold of 0 compresses every batch.  PushPull keeps one
+ * per node, which the threads sending to the node share no matter which
+ * push socket they picked, so the rate is that of all the node's sockets.
+ */
+class AdaptiveCompression
+{
+private:
+  double threshold; ///> Bytes per second above which batches are compressed
+  std::chrono::milliseconds window; ///> How often the rate is measured
+  std::chrono::steady_clock::time_point windowBegin;
+  size_t windowBytes = 0; ///> Bytes offered since windowBegin
+  bool compressing;
+  mutable std::mutex mutex; ///> Senders to the node offer concurrently
+
+public:
+  AdaptiveCompression(double threshold = PUSH_PULL_COMPRESSION_THRESHOLD,
+                      int windowMs = PUSH_PULL_COMPRESSION_WINDOW) :
+    threshold(threshold), window(windowMs),
+    windowBegin(std::chrono::steady_clock::now()),
+    compressing(threshold <= 0) {}
+
+  /**
+   * Notes that a batch of the given size is about to be sent.
+   * \return Returns true if the batch should be compressed.
+   */
+  bool offer(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    windowBytes += bytes;
+    if (threshold > 0) {
+      auto now = std::chrono::steady_clock::now();
+      auto elapsed = now - windowBegin;
+      if (elapsed >= window) {
+        double rate = windowBytes /
+          std::chrono::duration<double>(elapsed).count();
+        if (rate > threshold) {
+          compressing = true;
+        } else if (rate < threshold / 2) {
+          compressing = false;
+        }
+        windowBegin = now;
+        windowBytes = 0;
+      }
+    }
+    return compressing && bytes >= PUSH_PULL_COMPRESSION_MIN_BYTES;
+  }
+
+  bool isCompressing() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return compressing;
+  }
+};
+
+}
+
+#endif
@@ -168,6 +168,7 @@ public:
                 BaseComputation(nodeId, featureMap, identifier)
 
   {
+    this->registerMetrics(this->feedCount);
     this->N = N;
   }
 
@@ -198,6 +199,7 @@ public:
     if (allWindows.count(key) == 0) {
       auto value = new value_t(N);
       allWindows[key] = value;
+      this->numKeys = allWindows.size();
     }
 
     // Update the data structure
@@ -214,7 +216,7 @@ public:
     // identify the feature.
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    this->notifySubscribers(edge.id, currentDistinctCount);
+    this->notifySubscribers(edge, currentDistinctCount);
 
     return true;
   }
@@ -7,10 +7,9 @@
 #include <sam/EdgeRequest.hpp>
 #include <sam/Null.hpp>
 #include <sam/Util.hpp>
+#include <sam/Metrics.hpp>
 #include <sam/TemporalSet.hpp>
-#include <sam/ZeroMQUtil.hpp>
-
-#define TOLERANCE 1.0
+#include <sam/Transport.hpp>
 
 namespace sam {
 
@@ -40,15 +39,18 @@ public:
   typedef EdgeRequest<TupleType, source, target> EdgeRequestType;
   typedef typename std::tuple_element<source, TupleType>::type SourceType;
   typedef typename std::tuple_element<target, TupleType>::type TargetType;
+  typedef Transport<TupleType> EdgeTransportType;
 
 public:
   /**
    * Constructor.  
+   * \param edgeCommunicator Sends matching tuples to the nodes that asked
+   *   for them.  Not owned by this class.
    */
    EdgeRequestMap(std::size_t numNodes,
                   std::size_t nodeId,
                   size_t tableCapacity,
-                  PushPull* edgeCommunicator);
+                  EdgeTransportType* edgeCommunicator);
 
   /**
    * Destructor.
@@ -69,34 +71,36 @@ public:
    */
   size_t process(TupleType const& tuple);
 
-  #ifdef METRICS
+  // The metrics below only count while metrics are enabled (see
+  // Metrics.hpp).
+
   /**
    * Returns how many edges we've sent
    */
-  size_t getTotalEdgePushes() { return edgePushCounter; }
+  size_t getTotalEdgePushes() { return edgePushCounter->value(); }
 
   /**
    * Returns how many edge pushes failed (because of timeout).
    */
-  size_t getTotalEdgePushFails() { return sendFailCounter; }
+  size_t getTotalEdgePushFails() { return sendFailCounter->value(); }
 
   /**
    * Returns how many total edge requests this class examines.
    */
-  uint64_t getTotalEdgeRequestsViewed() { return edgeRequestsViewedCounter; }
-  #endif
+  uint64_t getTotalEdgeRequestsViewed() 
+  {
+    return edgeRequestsViewedCounter->value();
+  }
 
-  #ifdef DETAIL_TIMING
   /**
    * Returns the total time spent pushing edges to a zmq socket.
    */
-  double getTotalTimePush() { return totalTimePush; }
+  double getTotalTimePush() { return pushTime->totalSeconds(); }
 
   /**
    * Returns the total time spent waiting for a lock to an ale entry.
    */
-  double getTotalTimeLock() { return totalTimeLock; }
-  #endif
+  double getTotalTimeLock() { return lockTime->totalSeconds(); }
 	
   /**
    * Iterates through the edge push sockets and sends a terminate
@@ -129,7 +133,7 @@ private:
   /// mutexes for each array element of ale.
   std::mutex* mutexes;
 
-  PushPull* edgeCommunicator;
+  EdgeTransportType* edgeCommunicator;
 
   std::function<size_t(TupleType const&)> sourceIndexFunction;
   std::function<bool(EdgeRequestType const&, TupleType const&)> 
@@ -142,20 +146,16 @@ private:
     sourceTargetCheckFunction;
 
 
-  #ifdef METRICS
   /// Keeps track of how many edges we send
-  std::atomic<size_t> edgePushCounter;
+  std::shared_ptr<Counter> edgePushCounter;
 
   /// How many pushes fail
-  std::atomic<size_t> sendFailCounter; 
+  std::shared_ptr<Counter> sendFailCounter; 
 
-  std::atomic<uint64_t> edgeRequestsViewedCounter;
-  #endif 
+  std::shared_ptr<Counter> edgeRequestsViewedCounter;
 
-  #ifdef DETAIL_TIMING
-  double totalTimePush = 0;
-  double totalTimeLock = 0;
-  #endif
+  std::shared_ptr<LatencyHistogram> pushTime; ///> Sending matching edges
+  std::shared_ptr<LatencyHistogram> lockTime; ///> Waiting for ale locks
 
   std::atomic<bool> terminated;
 };
@@ -169,15 +169,24 @@ EdgeRequestMap<TupleType, source, target, time,
 EdgeRequestMap( std::size_t numNodes,
                 std::size_t nodeId,
                 size_t tableCapacity,
-                PushPull* edgeCommunicator)
+                EdgeTransportType* edgeCommunicator)
 {
   this->edgeCommunicator = edgeCommunicator;
 
-  #ifdef METRICS
-  sendFailCounter = 0;
-  edgePushCounter = 0;
-  edgeRequestsViewedCounter = 0;
-  #endif
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  std::string labels = metricLabels({{"node", std::to_string(nodeId)}});
+  edgePushCounter = registry.counter("sam_edge_request_map_edges_sent_total",
+    labels, "Edges sent to the nodes that requested them");
+  sendFailCounter = registry.counter(
+    "sam_edge_request_map_send_failures_total", labels,
+    "Edges that couldn't be sent to the nodes that requested them");
+  edgeRequestsViewedCounter = registry.counter(
+    "sam_edge_request_map_requests_viewed_total", labels,
+    "Edge requests looked at while processing edges");
+  pushTime = registry.histogram("sam_edge_request_map_send_seconds", labels,
+    "Time spent sending an edge to a node that requested it");
+  lockTime = registry.histogram("sam_edge_request_map_lock_seconds", labels,
+    "Time spent waiting for the lock of an edge request list");
 
   sourceIndexFunction = [this](TupleType const& tuple) {
     SourceType src = std::get<source>(tuple);
@@ -361,25 +370,22 @@ process(TupleType const& tuple,
 
   double currentTime = std::get<time>(tuple);
 
-  // To prevent duplicates being sent, we keep track of which nodes has seen
-  // the tuple already.
-  bool sentEdges[numNodes];
-  for (size_t i = 0; i < numNodes; i++) sentEdges[i] = false;
+  // To prevent duplicates being sent, we keep track of which nodes have
+  // asked for the tuple.
+  bool requestingNodes[numNodes];
+  for (size_t i = 0; i < numNodes; i++) requestingNodes[i] = false;
 
-  DETAIL_TIMING_BEG1
-  mutexes[index].lock();
-  DETAIL_TIMING_END_TOL1(nodeId, totalTimeLock, TOLERANCE, 
-    "EdgeRequestMap::process obtaining lock exceeded "
-    "tolerance")
+  {
+    ScopedTimer timer(lockTime);
+    mutexes[index].lock();
+  }
   size_t count = 0;
 
   DEBUG_PRINT("Node %lu EdgeRequestMap::process number of requests to look at"
     " %lu processing tuple %s\n", nodeId, ale[index].size(), 
     toString(tuple).c_str());
 
-  #ifdef METRICS
-  edgeRequestsViewedCounter.fetch_add(ale[index].size());
-  #endif
+  edgeRequestsViewedCounter->add(ale[index].size());
 
   for(auto edgeRequest = ale[index].begin();
         edgeRequest != ale[index].end();)
@@ -402,56 +408,52 @@ process(TupleType const& tuple,
 
       count++;
       if(checkFunction(*edgeRequest, tuple)) {
-        
-        size_t node = edgeRequest->getReturn();
-        
-        if (!sentEdges[node]) {
-
-          if (!terminated) {
-           
-            std::string message = toString(tuple);
-            
-            DEBUG_PRINT("Node %lu->%lu EdgeRequestMap::process sending"
-              " edge %s\n", nodeId, node, toString(tuple).c_str());
-            
-            ////// Sending tuple and checking timing /////
-            
-            DETAIL_TIMING_BEG2
-            bool sent = edgeCommunicator->send(message, node);
-            DETAIL_TIMING_END_TOL2(nodeId, totalTimePush, TOLERANCE, 
-              "EdgeRequestMap::process sending message exceeded "
-              "tolerance")
-            
-            //// End sending tuple
-            
-            sentEdges[node] = true;
-            double edgeTime = std::get<time>(tuple);
-
-            if (!sent) {
-              DEBUG_PRINT("Node %lu->%lu EdgeRequestMap::process error sending"
-                " edge %s\n", nodeId, node, toString(tuple).c_str());
-              
-              #ifdef METRICS
-              sendFailCounter.fetch_add(1);
-              #endif
-
-            } else {
- 
-              #ifdef METRICS
-              edgePushCounter.fetch_add(1);
-              #endif
-            }
-          } else {
-            DEBUG_PRINT("Node %lu EdgeRequestMap::process existing because"
-              " terminated\n", nodeId);
-          }
-        }
+        requestingNodes[edgeRequest->getReturn()] = true;
       }
       ++edgeRequest;
     }
   }
 
   mutexes[index].unlock();
+
+  // The tuple is sent after the lock is released.  A transport can deliver
+  // it inline (DirectTransport), and the receiving node may add requests
+  // to this same bucket while handling it.
+  for (size_t node = 0; node < numNodes; node++) {
+    if (!requestingNodes[node]) {
+      continue;
+    }
+    if (terminated) {
+      DEBUG_PRINT("Node %lu EdgeRequestMap::process existing because"
+        " terminated\n", nodeId);
+      break;
+    }
+
+    DEBUG_PRINT("Node %lu->%lu EdgeRequestMap::process sending"
+      " edge %s\n", nodeId, node, toString(tuple).c_str());
+
+    ////// Sending tuple and checking timing /////
+
+    bool sent;
+    {
+      ScopedTimer timer(pushTime);
+      sent = edgeCommunicator->send(tuple, node);
+    }
+
+    //// End sending tuple
+
+    if (!sent) {
+      DEBUG_PRINT("Node %lu->%lu EdgeRequestMap::process error sending"
+        " edge %s\n", nodeId, node, toString(tuple).c_str());
+
+      sendFailCounter->add();
+
+    } else {
+
+      edgePushCounter->add();
+    }
+  }
+
   return count;
 }
 
@@ -8,6 +8,8 @@
 
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 #include <sam/AbstractConsumer.hpp>
 #include <sam/BaseComputation.hpp>
@@ -57,6 +59,7 @@ public:
                           BaseComputation(nodeId, featureMap, identifier) 
                                           
   {
+    this->registerMetrics(this->feedCount);
     this->N = N;
     this->k = k;
   }
@@ -79,18 +82,14 @@ public:
     std::string key = generateKey<keyFields...>(edge.tuple);
 
     // Create an exponential histogram if it doesn't exist for the given key
-    if (allWindows.count(key) == 0) {
-      auto eh = std::shared_ptr<ExponentialHistogram<T>>(
-                  new ExponentialHistogram<T>(N, k));
-      allWindows[key] = eh;
-    }
+    ExponentialHistogram<T>* eh = getWindow(key);
 
     // Update the data structure
     T value = std::get<valueField>(edge.tuple);
-    allWindows[key]->add(value);
+    eh->add(value);
 
     // Getting the current sum and providing that to the feature map.
-    T currentSum = allWindows[key]->getTotal();
+    T currentSum = eh->getTotal();
     SingleFeature feature(currentSum);
 
     // Update the freature map with the new feature.  The feature map
@@ -99,13 +98,75 @@ public:
     // identify the feature.
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    this->notifySubscribers(edge.id, currentSum);
+    this->notifySubscribers(edge, currentSum);
+
+    return true;
+  }
+
+  /**
+   * Processes a batch of tuples.  Each distinct key in the batch is looked
+   * up in allWindows once, and the feature map is updated once per key with
+   * the sum after the last tuple of that key.  Subscribers are still 
+   * notified for every tuple.
+   * \param edges The tuples to process.
+   * \param numEdges The number of tuples.
+   */
+  bool consumeBatch(EdgeType const* edges, size_t numEdges)
+  {
+    size_t before = this->feedCount;
+    this->feedCount += numEdges;
+    if (this->feedCount / this->metricInterval > 
+        before / this->metricInterval) 
+    {
+      std::cout << "NodeId " << this->nodeId << " number of keys " 
+                << allWindows.size() << " feedCount " << this->feedCount
+                << std::endl;
+    }
+
+    // Resolve the histogram for every tuple up front, grouping the tuples
+    // by key so that allWindows is probed once per distinct key.
+    std::unordered_map<std::string, ExponentialHistogram<T>*> batchWindows;
+    std::vector<ExponentialHistogram<T>*> windows(numEdges);
+    for (size_t i = 0; i < numEdges; i++) {
+      std::string key = generateKey<keyFields...>(edges[i].tuple);
+      auto it = batchWindows.find(key);
+      if (it == batchWindows.end()) {
+        it = batchWindows.emplace(key, getWindow(key)).first;
+      }
+      windows[i] = it->second;
+    }
+
+    for (size_t i = 0; i < numEdges; i++) {
+      windows[i]->add(std::get<valueField>(edges[i].tuple));
+      this->notifySubscribers(edges[i], windows[i]->getTotal());
+    }
+
+    for (auto const& p : batchWindows) {
+      SingleFeature feature(p.second->getTotal());
+      this->featureMap->updateInsert(p.first, this->identifier, feature);
+    }
 
     return true;
   }
 
   void terminate() {}
 
+private:
+  /**
+   * Returns the histogram for the key, creating it if it doesn't exist.
+   */
+  ExponentialHistogram<T>* getWindow(std::string const& key)
+  {
+    auto it = allWindows.find(key);
+    if (it == allWindows.end()) {
+      auto eh = std::shared_ptr<ExponentialHistogram<T>>(
+                  new ExponentialHistogram<T>(N, k));
+      it = allWindows.emplace(key, eh).first;
+      this->numKeys = allWindows.size();
+    }
+    return it->second.get();
+  }
+
 };
 
 //TODO Should make the function a template parameter so we don't have to copy
@@ -138,6 +199,7 @@ public:
                           BaseComputation(nodeId, featureMap, identifier) 
                                           
   {
+    this->registerMetrics(this->feedCount);
     this->N = N;
     this->k = k;
   }
@@ -162,6 +224,7 @@ public:
       auto eh = std::shared_ptr<ExponentialHistogram<T>>(
                   new ExponentialHistogram<T>(N, k));
       allWindows[key] = eh;
+      this->numKeys = allWindows.size();
     }
 
     T value = std::get<valueField>(edge.tuple);
@@ -177,7 +240,7 @@ public:
     // Notify any subscribers of the new value, which is a frequency.
     DEBUG_PRINT("ExponentialHistogramAve::consume id %s notifying " 
       "subscribers with edge id %lu\n", this->identifier.c_str(), edge.id)
-    this->notifySubscribers(edge.id, 
+    this->notifySubscribers(edge, 
                             currentSum / allWindows[key]->getNumItems());
 
     return true;
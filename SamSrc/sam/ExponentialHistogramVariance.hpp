@@ -49,6 +49,7 @@ public:
                             nodeId,featureMap, identifier) 
                                           
   {
+    this->registerMetrics(this->feedCount);
     this->N = N;
     this->k = k;
   }
@@ -84,6 +85,7 @@ public:
       p = std::pair<std::string, 
                     std::shared_ptr<ExponentialHistogram<T>>>(key, eh);
       squares[key] = eh;
+      this->numKeys = sums.size();
     }
 
     std::string sValue = boost::lexical_cast<std::string>(
@@ -108,7 +110,7 @@ public:
 
     DEBUG_PRINT("ExponentialHistogramVariance::consume id %s notifying " 
       "subscribers with edge id %lu\n", this->identifier.c_str(), edge.id)
-    notifySubscribers(edge.id, currentVariance);    
+    notifySubscribers(edge, currentVariance);    
 
     return true;
   }
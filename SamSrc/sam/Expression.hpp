@@ -7,7 +7,9 @@
 #include <string>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <tuple>
+#include <functional>
 #include <sam/FeatureMap.hpp>
 #include <sam/Tokens.hpp>
 #include <sam/Util.hpp>
@@ -15,14 +17,44 @@
 namespace sam {
 
 
+/**
+ * An arithmetic/comparison expression over a tuple and the feature map,
+ * used by Filter and TransformProducer.
+ *
+ * The infix token list is converted to postfix form and then compiled into
+ * a flat array of instructions (see ExpressionOpCode).  evaluate runs the
+ * instructions with a switch over the opcodes and a fixed-size stack of
+ * doubles, so there is no virtual call or heap allocation per token except
+ * for tokens that need the feature map.  If any token can't be compiled,
+ * the expression is evaluated token by token as before.
+ *
+ * Alternatively, an expression can be given as a function that does the
+ * whole evaluation, which is what the SAL code generator emits.
+ */
 template <typename TupleType>
 class Expression 
 {
-  
+public:
+  /// Signature of an expression that has been compiled to C++.  It has the
+  /// same contract as evaluate.
+  typedef std::function<bool(std::string const&, TupleType const&, double&)>
+    FunctionType;
+
 protected:
   // Stores the expression in postfix form.
   std::list<std::shared_ptr<ExpressionToken<TupleType>>> postfixList;
 
+  // The compiled form of postfixList.
+  std::vector<ExpressionInstruction<TupleType>> program;
+  bool compiled = false; ///> False if a token couldn't be compiled.
+  bool valid = false; ///> False if the program would underflow the stack.
+  size_t maxDepth = 0; ///> The largest stack the program needs.
+
+  FunctionType function; ///> Set if constructed from a function.
+
+  /// Programs that need at most this much stack don't allocate.
+  static size_t const SmallStackSize = 16;
+
 public:
   /**
    * Constructor for expression.  It expects a list of tokens in 
@@ -48,11 +80,154 @@ public:
       postfixList.push_back(top);
       operatorStack.pop();
     }
+
+    compile();
   }
 
+  /**
+   * Constructor for an expression that has already been compiled to a
+   * function, e.g. a lambda generated by SAL.
+   */
+  Expression(FunctionType function) : function(function) {}
+
+  /**
+   * Evaluates the expression.
+   * \param key The key used to look up features in the feature map.
+   * \param input The tuple the expression is evaluated on.
+   * \param result Set to the value of the expression.
+   * \return Returns false if the expression couldn't be evaluated, e.g.
+   *   because a feature isn't available yet.
+   */
   bool evaluate(std::string const& key, 
                 TupleType const& input, 
                 double& result) const 
+  {
+    if (function) {
+      return function(key, input, result);
+    }
+    if (!compiled) {
+      return interpret(key, input, result);
+    }
+    if (!valid) {
+      return false;
+    }
+
+    double smallStack[SmallStackSize];
+    std::vector<double> largeStack;
+    double* stack = smallStack;
+    if (maxDepth > SmallStackSize) {
+      largeStack.resize(maxDepth);
+      stack = largeStack.data();
+    }
+
+    // compile() has checked that the operators never underflow the stack.
+    size_t top = 0;
+    for (auto const& instruction : program) {
+      switch (instruction.opCode) {
+        case ExpressionOpCode::PUSH_NUMBER:
+          stack[top++] = instruction.number;
+          break;
+        case ExpressionOpCode::LOAD_FIELD:
+          stack[top++] = instruction.loadField(input);
+          break;
+        case ExpressionOpCode::CALL:
+          if (!instruction.token->evaluateValue(key, input, stack[top])) {
+            return false;
+          }
+          top++;
+          break;
+        case ExpressionOpCode::ADD:
+          top--;
+          stack[top - 1] = stack[top - 1] + stack[top];
+          break;
+        case ExpressionOpCode::SUB:
+          top--;
+          stack[top - 1] = stack[top - 1] - stack[top];
+          break;
+        case ExpressionOpCode::MULT:
+          top--;
+          stack[top - 1] = stack[top - 1] * stack[top];
+          break;
+        case ExpressionOpCode::LESS_THAN:
+          top--;
+          stack[top - 1] = stack[top - 1] < stack[top];
+          break;
+        case ExpressionOpCode::GREATER_THAN:
+          top--;
+          stack[top - 1] = stack[top - 1] > stack[top];
+          break;
+        default:
+          return false;
+      }
+    }
+    result = stack[top - 1];
+    return true;
+  }
+
+  /**
+   * Gives the tokens of the expression the store to keep per-key state in
+   * (see PrevToken).
+   */
+  void setPreviousValueStore(std::shared_ptr<PreviousValueStore> store)
+  {
+    for (auto token : postfixList) {
+      token->setPreviousValueStore(store);
+    }
+  }
+
+  /**
+   * Returns true if the expression is evaluated with compiled
+   * instructions (or a function) rather than token by token.
+   */
+  bool isCompiled() const { return compiled || static_cast<bool>(function); }
+
+private:
+  /**
+   * Translates the postfix list into instructions and works out how much
+   * stack the program needs.
+   */
+  void compile()
+  {
+    program.clear();
+    compiled = true;
+    valid = true;
+    maxDepth = 0;
+
+    size_t depth = 0;
+    for (auto token : postfixList) {
+      ExpressionInstruction<TupleType> instruction = token->compile();
+      switch (instruction.opCode) {
+        case ExpressionOpCode::NOT_COMPILABLE:
+          compiled = false;
+          program.clear();
+          return;
+        case ExpressionOpCode::PUSH_NUMBER:
+        case ExpressionOpCode::LOAD_FIELD:
+        case ExpressionOpCode::CALL:
+          depth++;
+          break;
+        default:
+          if (depth < 2) {
+            valid = false;
+          } else {
+            depth--;
+          }
+      }
+      maxDepth = std::max(maxDepth, depth);
+      program.push_back(instruction);
+    }
+
+    if (depth == 0) {
+      valid = false;
+    }
+  }
+
+  /**
+   * Evaluates the postfix list token by token.
+   */
+  bool interpret(std::string const& key, 
+                 TupleType const& input, 
+                 double& result) const 
   {
     std::stack<double> mystack;
     int i = 0;
@@ -63,19 +238,20 @@ public:
         return false;
       }
     }
+    if (mystack.empty()) {
+      return false;
+    }
     result = mystack.top();
     return true;
   }
 
-
-private:
   void addOperator(std::shared_ptr<OperatorToken<TupleType>> o1,
   std::stack<std::shared_ptr<OperatorToken<TupleType>>> & operatorStack)
   {
     if (operatorStack.size() > 0) {
-      auto top = operatorStack.top();
       bool foundQualifyingTopElement = false;
       do {
+        auto top = operatorStack.top();
         foundQualifyingTopElement = false;
         if (
             (o1->isLeftAssociative() &&
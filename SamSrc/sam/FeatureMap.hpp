@@ -4,6 +4,7 @@
 #include <iostream>
 #include <atomic>
 #include <sam/Features.hpp>
+#include <sam/Metrics.hpp>
 #include <cstdio>
 
 #define MAP_EMPTY        0
@@ -36,6 +37,11 @@ private:
   // data structure and the name of the feature.
   std::string* keys;
 
+  // The number of occupied slots.
+  std::atomic<int> numEntries;
+
+  std::vector<std::unique_ptr<CallbackMetric>> callbackMetrics;
+
 public:   
   /**
    * Capacity should be 2 * numkeys * numfeatures
@@ -55,6 +61,15 @@ public:
     for (int i = 0; i < capacity; i++) {
       flag[i] = 0; 
     }
+
+    numEntries = 0;
+    MetricsRegistry& registry = MetricsRegistry::instance();
+    callbackMetrics.push_back(registry.callback("sam_feature_map_entries",
+      "", "Occupied slots of the feature maps", MetricKind::Gauge,
+      [this]() { return (double) getNumEntries(); }));
+    callbackMetrics.push_back(registry.callback("sam_feature_map_capacity",
+      "", "Slots of the feature maps", MetricKind::Gauge,
+      [this]() { return (double) this->capacity; }));
   }
 
   ~FeatureMap() {
@@ -92,6 +107,13 @@ public:
   bool exists(std::string const& key,
               std::string const& featureName) const; 
 
+  int getCapacity() const { return capacity; }
+
+  /**
+   * The number of key/featureName combos in the map.
+   */
+  int getNumEntries() const { return numEntries.load(); }
+
 private:
   /**
    * The hash function used to hash the key-featureName combo.
@@ -193,6 +215,7 @@ bool FeatureMap::updateInsert(std::string const& key,
           keys[i] = combinedKey;
           //std::cout << "blah1" << std::endl;
           flag[i] = MAP_OCCUPIED;
+          numEntries.fetch_add(1, std::memory_order_relaxed);
           //std::cout << "blah2" << std::endl;
           return true;
         }
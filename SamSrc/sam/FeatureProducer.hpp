@@ -2,6 +2,7 @@
 #define SAM_FEATURE_PRODUCER_HPP
 
 #include <sam/FeatureSubscriber.hpp>
+#include <sam/LatencyTracing.hpp>
 
 namespace sam {
 
@@ -12,6 +13,8 @@ protected:
   /// feature producer.
   std::vector<std::shared_ptr<FeatureSubscriber>> subscribers;  
   std::vector<std::string> names;
+  /// The slot of the feature in each subscriber.
+  std::vector<std::size_t> slots;
 
 public:
   /**
@@ -28,7 +31,20 @@ public:
    */
   void notifySubscribers(std::size_t id, double value) {
     for (int i = 0; i < subscribers.size(); i++) {
-      subscribers[i]->update(id, names[i], value);
+      subscribers[i]->update(id, slots[i], value);
+    }
+  }
+
+  /**
+   * Like notifySubscribers(id, value), but also passes on the ingest time
+   * of the edge the feature was computed from, if it was sampled for
+   * latency tracing.
+   */
+  template <typename EdgeType>
+  void notifySubscribers(EdgeType const& edge, double value) {
+    LatencyTracer::record(TraceStage::Operator, edge.ingestTime);
+    for (size_t i = 0; i < subscribers.size(); i++) {
+      subscribers[i]->update(edge.id, slots[i], value, edge.ingestTime);
     }
   }
    
@@ -38,7 +54,7 @@ void FeatureProducer::registerSubscriber(
   std::shared_ptr<FeatureSubscriber> subscriber,
   std::string name) 
 {
-  subscriber->addFeature(name);
+  slots.push_back(subscriber->addFeature(name));
   subscribers.push_back(subscriber);
   names.push_back(name);
 }
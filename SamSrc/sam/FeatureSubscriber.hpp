@@ -6,10 +6,15 @@
 #include <sstream>
 #include <map>
 #include <stdexcept>
-#include <mutex>
-#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <iostream>
 
 #include <sam/Util.hpp>
+#include <sam/AbstractRowConsumer.hpp>
+#include <sam/FeatureWriter.hpp>
+#include <sam/LatencyTracing.hpp>
 
 #define MAP_EMPTY        0
 #define MAP_OCCUPIED     1
@@ -19,56 +24,91 @@ namespace sam {
 
 /**
  * Has two modes, create feature mode and test mode.  In the create feature
- * mode, it outputs all of the features to a stringstream.  This might not
- * be the best approach.  A parallel implementation would be better.
+ * mode, it outputs all of the features to a file, as CSV or in the columnar
+ * format of FeatureWriter.  Rows are buffered and written by a separate
+ * thread, so the file is only complete after close (or destruction), and
+ * rows completed by different threads aren't written in the order they
+ * completed (see FeatureWriter).
  *
- * The other mode is test mode.  In test mode the feature subscriber has a
- * model that it applies to each example.  TODO: Test mode is not implemented. 
+ * The other mode is test mode.  In test mode the completed rows go to the
+ * registered row consumers, e.g. a ModelScorer that applies a model to each
+ * example.  The two can be combined; with an empty output file name no file
+ * is written.
  *
  * The only data type supported for features is doubles.
+ *
+ * Rows are assembled in a ring of capacity slots indexed by key % capacity,
+ * without locks.  Each slot has one atomic state holding the key that owns
+ * the slot, how many writers are in the middle of writing to it, and how
+ * many features have arrived.  A key that finds its slot owned by an older,
+ * unfinished row evicts it, and a key older than the owner is dropped; both
+ * mean more than capacity rows were in the making at once, and are counted
+ * by getNumOverruns() instead of mixing the values of two rows.  The writer
+ * that delivers the last feature of a row emits it, so each row is emitted
+ * exactly once.  Each feature is expected once per key.
  */
 class FeatureSubscriber
 {
 private:
+  // Layout of a slot state: the owning key + 1 (0 when the slot is free),
+  // the number of writers in flight, and the number of features written.
+  static constexpr uint64_t CountBits = 16;
+  static constexpr uint64_t InflightBits = 8;
+  static constexpr uint64_t OwnerShift = CountBits + InflightBits;
+  static constexpr uint64_t CountMask = (uint64_t(1) << CountBits) - 1;
+  static constexpr uint64_t InflightOne = uint64_t(1) << CountBits;
+  static constexpr uint64_t InflightMask =
+    ((uint64_t(1) << InflightBits) - 1) << CountBits;
+
   // The column/feature names
   std::vector<std::string> names;
 
-  std::map<std::string, int> featureIndices;
+  std::map<std::string, size_t> featureIndices;
 
-  // Stores the results of completed rows
-  std::ofstream out;
+  std::string outputfile;
+  FeatureOutputFormat format;
 
-  mutable std::mutex mu;
+  // Stores the results of completed rows.  Created by init, once the
+  // columns are known, unless there is no output file.
+  std::unique_ptr<FeatureWriter> writer;
 
-  // TODO: Figure out.  Before, this was a fixed sized hash table, but now
-  // we just cycle through because we have a sequence of increasing integers
-  // for the keys (SamGeneratedId).  As such, I think we can come up with a 
-  // bound on the needed capacity as a function of the number of features. 
+  // Get the completed rows as well, e.g. to score them.
+  std::vector<std::shared_ptr<AbstractRowConsumer>> rowConsumers;
+
+  // The number of rows that can be in the making at once.
   int capacity;
 
-  double* values = 0;
-  std::atomic<int>* counts = 0;
+  double* values = 0; ///> capacity rows of numFeatures values
+  std::atomic<uint64_t>* states = 0; ///> The state of each ring slot
 
   // Init must be called before update is called.  This variable keeps track.
   bool initCalled = false;
 
-  int numRows = 0; ///> Keeps track of how many rows we've written.
+  std::atomic<size_t> numRows; ///> Keeps track of how many rows we've written.
+  std::atomic<size_t> numOverruns; ///> Rows lost to the ring overrunning
 
   size_t numFeatures = 0;
 
+  void overrun();
+
 public:
 
+  /**
+   * \param outputfile Where the rows are written; "" writes no file.
+   * \param capacity How many rows can be in the making at once.
+   * \param format CSV or the columnar format of FeatureWriter.
+   */
   FeatureSubscriber(std::string outputfile,
-                    int capacity = 10000) 
-                    
+                    int capacity = 10000,
+                    FeatureOutputFormat format = FeatureOutputFormat::Csv) :
+    numRows(0), numOverruns(0)
   {
     this->capacity = capacity;
-    this->out = std::ofstream(outputfile);
-    counts = new std::atomic<int>[capacity];
-
-    // TODO add parallel loop
+    this->outputfile = outputfile;
+    this->format = format;
+    states = new std::atomic<uint64_t>[capacity];
     for(int i = 0; i < capacity; i++) {
-      counts[i] = 0;
+      states[i] = 0;
     }
   }
 
@@ -82,17 +122,40 @@ public:
       throw std::logic_error("init was called but no features have been "
         "added");
     }
+    if (numFeatures >= CountMask) {
+      throw std::logic_error("FeatureSubscriber supports at most " +
+        std::to_string(CountMask - 1) + " features");
+    }
     initCalled = true;
     values = new double[capacity * numFeatures]();
+    if (outputfile != "") {
+      writer.reset(new FeatureWriter(outputfile, names, format));
+    }
+    for (auto consumer : rowConsumers) {
+      consumer->init(names);
+    }
+  }
+
+  /**
+   * Adds a consumer of the completed rows.  Must be called before init.
+   */
+  void registerRowConsumer(std::shared_ptr<AbstractRowConsumer> consumer)
+  {
+    if (initCalled) {
+      throw std::logic_error("registerRowConsumer was called after init was "
+        "called.  This is not allowed.");
+    }
+    rowConsumers.push_back(consumer);
   }
 
   ~FeatureSubscriber() 
   {
+    close();
     if (values) {
       delete[] values;  
     }
-    if (counts) {
-      delete[] counts;
+    if (states) {
+      delete[] states;
     }
   }
  
@@ -100,97 +163,193 @@ public:
    * This method should be called by the FeatureProducer using 
    * FeatureProducer::registerSubscriber.  This method must be called
    * for each feature before init is called.
+   * \return The slot of the feature, which is given to update.
    */ 
-  void addFeature(std::string name) {
+  size_t addFeature(std::string name) {
     if (initCalled) {
       throw std::logic_error("addFeature was called after init was called."
         " This is not allowed.");
     }
+    if (featureIndices.count(name) > 0) {
+      throw std::logic_error("Feature " + name + " was added twice");
+    }
     names.push_back(name);
-    featureIndices[names[names.size() - 1]] = names.size() - 1;
+    featureIndices[name] = names.size() - 1;
     DEBUG_PRINT("FeatureSubscriber::addFeature Added feature %s with index "
      "%lu\n", name.c_str(), names.size() - 1) 
     numFeatures++;
+    return names.size() - 1;
   }
 
   int getNumFeatures() { return numFeatures; }
 
+  /**
+   * The number of rows written out so far.
+   */
+  size_t getNumRows() const { return numRows; }
+
+  /**
+   * The number of rows lost because more than capacity rows were in the
+   * making at once.
+   */
+  size_t getNumOverruns() const { return numOverruns; }
+
   /**
    * How the subscriber is informed of feature updates. 
-   * Once all of the feature values have arrived for a particular record, a csv
-   * line representing the data is output to a stringstream.  The stringstream
-   * can then be accessed via getOutput().
+   * Once all of the feature values have arrived for a particular record, the
+   * row is handed to the FeatureWriter.
    * \param key The key uniquely identifying the item that all the features
    *            are derived from.  We assume that the keys are a sequence of
    *            incresing integers.  This is the SamGeneratedId that is 
    *            preserved through all transformations.
-   * \param featureName Identifies uniquely the feature that needs to be
-   *            updated.  Generally this corresponds to the 
-   *            BaseComputation's identifier.
+   * \param feature The slot of the feature, as returned by addFeature.
    * \param value The value of the feature.
+   * \param ingestTime The ingest time of the item if it was sampled for
+   *            latency tracing, otherwise 0.  The features of an item all
+   *            carry the same ingest time.
+   * \return false if the value was dropped because the ring overran.
+   */
+  bool update(std::size_t key,
+              std::size_t feature,
+              double value,
+              int64_t ingestTime = 0);
+
+  /**
+   * Like update(key, feature, value, ingestTime), but looks the feature
+   * up by the name it was added with.
    */
   bool update(std::size_t key,
               std::string const& featureName,
-              double value);
+              double value,
+              int64_t ingestTime = 0)
+  {
+    auto it = featureIndices.find(featureName);
+    if (it == featureIndices.end()) {
+      throw std::logic_error("update was called with unknown feature " +
+        featureName);
+    }
+    return update(key, it->second, value, ingestTime);
+  }
 
+  /**
+   * Writes out the buffered rows and closes the file, and lets the row
+   * consumers finish the rows they hold.
+   */
   void close() {
-    out.close();
+    if (writer) {
+      writer->close();
+    }
+    for (auto consumer : rowConsumers) {
+      consumer->terminate();
+    }
   }
 
 };
 
+inline
+void FeatureSubscriber::overrun()
+{
+  if (numOverruns.fetch_add(1, std::memory_order_relaxed) == 0) {
+    std::cerr << "FeatureSubscriber: more than " << capacity << " rows were "
+      "in the making at once and rows are being dropped; increase the "
+      "capacity" << std::endl;
+  }
+}
+
 inline
 bool FeatureSubscriber::update(std::size_t key,
-                               std::string const& featureName,
-                               double value)
+                               std::size_t feature,
+                               double value,
+                               int64_t ingestTime)
 {
-  //std::lock_guard<std::mutex> lock(mu);
-  if (initCalled) {
-    DEBUG_PRINT("FeatureSubscriber::update key %lu featureName %s value %f\n",
-      key, featureName.c_str(), value)
-    int index = key % capacity;
-    int featureIndex = featureIndices[featureName];
-    values[index * numFeatures + featureIndex] = value;
-    counts[index].fetch_add(1);
-
-    if (counts[index] >= numFeatures) {
-      DEBUG_PRINT("FeatureSubscriber::update key %lu writing out row\n",
-        key, featureName.c_str(), value)
-      // counts[indes] >= numFeatures indicates that we have collected
-      // all of the features associated with the input item (i.e. netflow
-      // or whatever tuple).
-
-      // The lock_guard makes it so that only one thread can access the 
-      // following body of the if statement.
-      std::lock_guard<std::mutex> lock(mu);
-
-      counts[index] = 0;
-      for (int j = 0; j < numFeatures - 1; j++) {
-        out << values[index * numFeatures + j] << ","; 
+  if (!initCalled) {
+    throw std::logic_error("update was called before init was called."
+      "  This is not allowed.");
+  }
+  if (feature >= numFeatures) {
+    throw std::logic_error("update was called with unknown feature slot " +
+      std::to_string(feature));
+  }
+  DEBUG_PRINT("FeatureSubscriber::update key %lu feature %lu value %f\n",
+    key, feature, value)
+
+  size_t index = key % capacity;
+  uint64_t owner = static_cast<uint64_t>(key) + 1;
+  if (owner >= (uint64_t(1) << (64 - OwnerShift))) {
+    throw std::out_of_range("FeatureSubscriber key " + std::to_string(key) +
+      " is too large");
+  }
+  std::atomic<uint64_t>& state = states[index];
+
+  // Join the row of key, claiming the slot if it is free or holds an
+  // older row.
+  uint64_t s = state.load(std::memory_order_acquire);
+  while (true) {
+    uint64_t current = s >> OwnerShift;
+    if (current == owner) {
+      if ((s & CountMask) >= numFeatures) {
+        // The row is complete and being emitted; a feature came twice.
+        return false;
       }
-      out << values[index * numFeatures + numFeatures - 1] << std::endl;
-      //std::cout << "Returning true2 " << std::endl;
-
-      numRows++;
-      //std::cout << "Numrows in FeatureSubscriber " << numRows << std::endl;
-      if (this->numRows % 10000 == 0) {
-        std::cout << "Feature subscriber has written out " << this->numRows 
-                  << " rows" << std::endl;
+      if (state.compare_exchange_weak(s, s + InflightOne,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+        break;
       }
-
-      return true;
+    } else if (current > owner) {
+      // A newer row already took the slot.
+      overrun();
+      return false;
+    } else if ((s & InflightMask) != 0) {
+      // The older row is being written or emitted; it is done shortly.
+      std::this_thread::yield();
+      s = state.load(std::memory_order_acquire);
+    } else if (state.compare_exchange_weak(s,
+                 (owner << OwnerShift) + InflightOne,
+                 std::memory_order_acq_rel, std::memory_order_acquire)) {
+      if (current != 0) {
+        // The older row never got all of its features.
+        overrun();
+      }
+      break;
     }
+  }
 
-    return true;
-  } else {
-      throw std::logic_error("update was called before init was called."
-        "  This is not allowed.");
+  values[index * numFeatures + feature] = value;
+
+  // Leave the row, counting the feature.  The writer of the last feature
+  // stays in flight until the row is emitted so the slot can't be taken.
+  bool complete;
+  s = state.load(std::memory_order_relaxed);
+  uint64_t next;
+  do {
+    complete = (s & CountMask) + 1 >= numFeatures;
+    next = complete ? s + 1 : s + 1 - InflightOne;
+  } while (!state.compare_exchange_weak(s, next,
+             std::memory_order_acq_rel, std::memory_order_relaxed));
+
+  if (complete) {
+    // The other writers of the row counted their features as they left, so
+    // all its values are in.
+    DEBUG_PRINT("FeatureSubscriber::update key %lu writing out row\n", key)
+    double const* row = &values[index * numFeatures];
+    if (writer) {
+      writer->append(row);
+    }
+    for (auto const& consumer : rowConsumers) {
+      consumer->consumeRow(key, row, ingestTime);
+    }
+    state.store(0, std::memory_order_release);
 
+    size_t rows = numRows.fetch_add(1, std::memory_order_relaxed) + 1;
+    LatencyTracer::record(TraceStage::FeatureWrite, ingestTime);
+    if (rows % 10000 == 0) {
+      std::cout << "Feature subscriber has written out " << rows 
+                << " rows" << std::endl;
+    }
   }
+  return true;
 }
 
-
-
 }
 
 #endif
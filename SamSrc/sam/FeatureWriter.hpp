@@ -0,0 +1,415 @@
+#ifndef SAM_FEATURE_WRITER_HPP
+#define SAM_FEATURE_WRITER_HPP
+
+/**
+ * Buffered output of the rows of FeatureSubscriber.
+ *
+ * Rows are copied into column buffers, one set per shard so that threads
+ * completing rows at the same time rarely share a lock, and a full buffer
+ * is handed to a writer thread.  Formatting the doubles as text (or not at
+ * all, for the columnar format) happens on the writer thread, off the path
+ * of the operators.  So that a slow trickle of rows still reaches the file,
+ * the writer thread also takes a buffer that isn't full once its first row
+ * has waited maxDelay ms.
+ *
+ * A thread's rows always go to the same shard, and a shard's buffers are
+ * written in the order they were filled, so the rows of one thread are
+ * written in the order it appended them.  The rows of different threads
+ * are written a buffer at a time, though, not in the order they were
+ * appended.  Readers that need the rows in time order have to sort them.
+ *
+ * The columnar format is a typed column file that can be memory mapped:
+ *
+ *   header:  char[8]   magic "SAMCOLS1"
+ *            uint64_t  number of columns
+ *            uint64_t  rows per block
+ *            uint64_t  number of rows
+ *            uint64_t  size of the header in bytes (a multiple of 64)
+ *            the column names, each terminated by '\0', then zero padding
+ *   blocks:  number of columns * rows per block doubles, column by column.
+ *
+ * The last block is padded with zeros, so the data is an array of
+ * (number of blocks, number of columns, rows per block) doubles in the
+ * native byte order.  scripts/learning.py reads both formats.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/AlignedArray.hpp>
+
+/// Rows held by a column buffer before it is handed to the writer thread.
+#define FEATURE_WRITER_BLOCK_ROWS 4096
+
+/// Full buffers that may wait for the writer thread before writers block.
+#define FEATURE_WRITER_MAX_PENDING 64
+
+/// How long in ms a row may wait in a buffer that isn't full.
+#define FEATURE_WRITER_MAX_DELAY 1000
+
+/// How many sets of column buffers rows are spread over.
+#define FEATURE_WRITER_NUM_SHARDS 8
+
+namespace sam {
+
+class FeatureWriterException : public std::runtime_error {
+public:
+  FeatureWriterException(char const * message) : std::runtime_error(message) { }
+  FeatureWriterException(std::string message) : std::runtime_error(message) { }
+};
+
+enum class FeatureOutputFormat
+{
+  Csv,
+  Columnar
+};
+
+inline FeatureOutputFormat featureOutputFormatFromString(
+  std::string const& name)
+{
+  if (name == "csv") return FeatureOutputFormat::Csv;
+  if (name == "columnar") return FeatureOutputFormat::Columnar;
+  throw FeatureWriterException("Unknown feature output format " + name +
+    "; expected csv or columnar");
+}
+
+class FeatureWriter
+{
+public:
+  /**
+   * \param outputfile Where the rows are written.
+   * \param names The column names.
+   * \param format CSV or the columnar format.
+   * \param blockRows How many rows a column buffer holds.
+   * \param maxDelay How long in ms the first row of a buffer waits before
+   *   the buffer is written anyway.  0 waits for the buffer to fill or for
+   *   close.
+   */
+  FeatureWriter(std::string const& outputfile,
+                std::vector<std::string> const& names,
+                FeatureOutputFormat format = FeatureOutputFormat::Csv,
+                size_t blockRows = FEATURE_WRITER_BLOCK_ROWS,
+                size_t maxDelay = FEATURE_WRITER_MAX_DELAY);
+
+  ~FeatureWriter() { close(); }
+
+  /**
+   * Adds a row of getNumColumns() values.  Can be called from any thread.
+   */
+  void append(double const* values);
+
+  /**
+   * Writes the rows that are still buffered and closes the file.  Rows
+   * appended afterwards are dropped.
+   */
+  void close();
+
+  size_t getNumColumns() const { return numColumns; }
+
+  /**
+   * The number of rows written to the file so far.
+   */
+  size_t getNumRowsWritten() const
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return numRowsWritten;
+  }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Block
+  {
+    std::vector<double> columns; ///> Column j starts at j * blockRows
+    size_t numRows = 0;
+    Clock::time_point deadline; ///> When the block is written if not full
+  };
+
+  struct alignas(64) Shard
+  {
+    std::mutex mutex;
+    std::unique_ptr<Block> block;
+  };
+
+  std::ofstream out;
+  FeatureOutputFormat format;
+  size_t numColumns;
+  size_t blockRows;
+  Clock::duration maxDelay;
+  std::streamoff numRowsOffset = 0; ///> Where the header keeps the row count
+
+  AlignedArray<Shard> shards;
+
+  mutable std::mutex queueMutex;
+  std::condition_variable queueChanged;
+  std::deque<std::unique_ptr<Block>> pending;
+  bool closing = false;
+  bool closed = false;
+  size_t numRowsWritten = 0;
+
+  std::unique_ptr<Block> fileBlock; ///> Columnar only; written when full
+  std::unique_ptr<Block> spare; ///> Replaces a block flushExpired takes
+  std::thread writerThread;
+
+  std::unique_ptr<Block> newBlock() const;
+  void writeHeader(std::vector<std::string> const& names);
+  void push(std::unique_ptr<Block> block);
+  void flushExpired();
+  void writeLoop();
+  void writeCsv(Block const& block);
+  void writeColumnar(Block const& block);
+  void writeFileBlock();
+};
+
+inline
+FeatureWriter::FeatureWriter(std::string const& outputfile,
+                             std::vector<std::string> const& names,
+                             FeatureOutputFormat format,
+                             size_t blockRows,
+                             size_t maxDelay) :
+  out(outputfile, std::ios::out | std::ios::binary | std::ios::trunc),
+  format(format), numColumns(names.size()), blockRows(blockRows),
+  maxDelay(std::chrono::milliseconds(maxDelay)),
+  shards(makeAlignedArray<Shard>(FEATURE_WRITER_NUM_SHARDS))
+{
+  if (!out.is_open()) {
+    throw FeatureWriterException("Could not open " + outputfile);
+  }
+  if (numColumns == 0 || blockRows == 0) {
+    throw FeatureWriterException("FeatureWriter needs at least one column "
+      "and one row per block");
+  }
+  for (size_t i = 0; i < FEATURE_WRITER_NUM_SHARDS; i++) {
+    shards[i].block = newBlock();
+  }
+  if (format == FeatureOutputFormat::Columnar) {
+    writeHeader(names);
+    fileBlock = newBlock();
+  }
+  writerThread = std::thread(&FeatureWriter::writeLoop, this);
+}
+
+inline
+std::unique_ptr<FeatureWriter::Block> FeatureWriter::newBlock() const
+{
+  std::unique_ptr<Block> block(new Block());
+  block->columns.resize(numColumns * blockRows);
+  return block;
+}
+
+inline
+void FeatureWriter::writeHeader(std::vector<std::string> const& names)
+{
+  std::string nameBytes;
+  for (auto const& name : names) {
+    nameBytes += name;
+    nameBytes.push_back('\0');
+  }
+  size_t fixedSize = 8 + 4 * sizeof(uint64_t);
+  uint64_t headerSize = (fixedSize + nameBytes.size() + 63) / 64 * 64;
+  uint64_t fields[] = {numColumns, blockRows, 0, headerSize};
+
+  out.write("SAMCOLS1", 8);
+  numRowsOffset = 8 + 2 * sizeof(uint64_t);
+  out.write(reinterpret_cast<char const*>(fields), sizeof(fields));
+  out.write(nameBytes.data(), nameBytes.size());
+  std::string padding(headerSize - fixedSize - nameBytes.size(), '\0');
+  out.write(padding.data(), padding.size());
+}
+
+inline
+void FeatureWriter::append(double const* values)
+{
+  size_t shardIndex = std::hash<std::thread::id>()(std::this_thread::get_id())
+                      % FEATURE_WRITER_NUM_SHARDS;
+  Shard& shard = shards[shardIndex];
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  if (!shard.block) return; // closed
+  Block& block = *shard.block;
+  if (block.numRows == 0 && maxDelay != Clock::duration::zero()) {
+    block.deadline = Clock::now() + maxDelay;
+  }
+  for (size_t j = 0; j < numColumns; j++) {
+    block.columns[j * blockRows + block.numRows] = values[j];
+  }
+  if (++block.numRows == blockRows) {
+    // Pushed under the shard's lock, so that the shard's blocks are queued
+    // in the order they were filled.
+    push(std::move(shard.block));
+    shard.block = newBlock();
+  }
+}
+
+inline
+void FeatureWriter::push(std::unique_ptr<Block> block)
+{
+  std::unique_lock<std::mutex> lock(queueMutex);
+  queueChanged.wait(lock, [this]() {
+    return pending.size() < FEATURE_WRITER_MAX_PENDING || closing;
+  });
+  pending.push_back(std::move(block));
+  queueChanged.notify_all();
+}
+
+inline
+void FeatureWriter::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (closed) return;
+    closed = true;
+  }
+
+  for (size_t i = 0; i < FEATURE_WRITER_NUM_SHARDS; i++) {
+    Shard& shard = shards[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    std::unique_ptr<Block> block = std::move(shard.block);
+    if (block && block->numRows > 0) {
+      push(std::move(block));
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    closing = true;
+    queueChanged.notify_all();
+  }
+  writerThread.join();
+
+  if (format == FeatureOutputFormat::Columnar) {
+    if (fileBlock->numRows > 0) {
+      writeFileBlock();
+    }
+    uint64_t numRows = numRowsWritten;
+    out.seekp(numRowsOffset);
+    out.write(reinterpret_cast<char const*>(&numRows), sizeof(numRows));
+  }
+  out.close();
+}
+
+/**
+ * Queues the blocks whose first row has waited maxDelay.  Called by the
+ * writer thread, which can't wait for room in the queue, so the blocks are
+ * queued regardless, and which must not wait for a shard either: an
+ * appending thread may hold it while it waits for room in the queue.
+ */
+inline
+void FeatureWriter::flushExpired()
+{
+  Clock::time_point now = Clock::now();
+  for (size_t i = 0; i < FEATURE_WRITER_NUM_SHARDS; i++) {
+    if (!spare) spare = newBlock();
+    Shard& shard = shards[i];
+    std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+    if (!lock.owns_lock() || !shard.block || shard.block->numRows == 0 ||
+        now < shard.block->deadline)
+    {
+      continue;
+    }
+    std::lock_guard<std::mutex> queueLock(queueMutex);
+    pending.push_back(std::move(shard.block));
+    shard.block = std::move(spare);
+  }
+}
+
+inline
+void FeatureWriter::writeLoop()
+{
+  Clock::duration period = std::max<Clock::duration>(maxDelay / 4,
+    std::chrono::milliseconds(1));
+  Clock::time_point nextCheck = Clock::now() + period;
+  while (true) {
+    if (maxDelay != Clock::duration::zero() && Clock::now() >= nextCheck) {
+      flushExpired();
+      nextCheck = Clock::now() + period;
+    }
+
+    std::unique_ptr<Block> block;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      auto ready = [this]() { return !pending.empty() || closing; };
+      if (maxDelay == Clock::duration::zero()) {
+        queueChanged.wait(lock, ready);
+      } else {
+        queueChanged.wait_until(lock, nextCheck, ready);
+      }
+      if (pending.empty()) {
+        if (closing) return;
+        continue;
+      }
+      block = std::move(pending.front());
+      pending.pop_front();
+      queueChanged.notify_all();
+    }
+
+    if (format == FeatureOutputFormat::Csv) {
+      writeCsv(*block);
+    } else {
+      writeColumnar(*block);
+    }
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    numRowsWritten += block->numRows;
+  }
+}
+
+inline
+void FeatureWriter::writeCsv(Block const& block)
+{
+  for (size_t i = 0; i < block.numRows; i++) {
+    for (size_t j = 0; j < numColumns - 1; j++) {
+      out << block.columns[j * blockRows + i] << ",";
+    }
+    out << block.columns[(numColumns - 1) * blockRows + i] << "\n";
+  }
+  out.flush();
+}
+
+inline
+void FeatureWriter::writeColumnar(Block const& block)
+{
+  size_t copied = 0;
+  while (copied < block.numRows) {
+    size_t n = std::min(block.numRows - copied,
+                        blockRows - fileBlock->numRows);
+    for (size_t j = 0; j < numColumns; j++) {
+      std::memcpy(&fileBlock->columns[j * blockRows + fileBlock->numRows],
+                  &block.columns[j * blockRows + copied],
+                  n * sizeof(double));
+    }
+    fileBlock->numRows += n;
+    copied += n;
+    if (fileBlock->numRows == blockRows) {
+      writeFileBlock();
+    }
+  }
+}
+
+inline
+void FeatureWriter::writeFileBlock()
+{
+  // Only the last block is partial; its padding is zeroed.
+  for (size_t j = 0; j < numColumns; j++) {
+    std::fill(fileBlock->columns.begin() + j * blockRows + fileBlock->numRows,
+              fileBlock->columns.begin() + (j + 1) * blockRows, 0.0);
+  }
+  out.write(reinterpret_cast<char const*>(fileBlock->columns.data()),
+            fileBlock->columns.size() * sizeof(double));
+  fileBlock->numRows = 0;
+}
+
+}
+
+#endif
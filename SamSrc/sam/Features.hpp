@@ -1,8 +1,12 @@
 #ifndef FEATURES_HPP
 #define FEATURES_HPP
 
+#include <algorithm>
+#include <cmath>
 #include <exception>
 #include <boost/lexical_cast.hpp>
+#include <limits>
+#include <set>
 #include <vector>
 
 #define VALUE_FUNCTION "value"
@@ -57,13 +61,86 @@ auto valueFunc = [](Feature const * feature)->double {
   return feature->getValue();
 };
 
+/**
+ * Aggregations of the values of the features in a MapFeature that are kept
+ * up to date as the features change, rather than computed from all of them.
+ */
+enum class Aggregation
+{
+  Sum,
+  Average,
+  Variance, ///> Population variance
+  Min,
+  Max
+};
+
 /**
  * A feature that is a map of features.  This is used when we project out a 
  * field and 
+ *
+ * The map keeps running aggregates of the values of its features, so that
+ * aggregate() costs O(1) however many features there are, and replacing a
+ * feature costs O(log n) (for the min and max).  The features put in the
+ * map must not change afterwards; Project puts in copies.
+ *
+ * Features whose value is NaN (e.g. the average of an empty window) are
+ * kept in the map but left out of the aggregates, which are those of the
+ * other values.  A NaN would otherwise stick in the running mean after its
+ * feature was replaced, and can't be ordered in the set of values.
  */
 class MapFeature : public Feature {
 private:
   std::map<std::string, std::shared_ptr<Feature>> localFeatureMap;
+
+  // Running aggregates of the values of the features in localFeatureMap.
+  // The mean and the sum of squared differences from it (m2) are kept with
+  // Welford's method, which also allows taking a value out.
+  double sum = 0;
+  double mean = 0;
+  double m2 = 0;
+  std::multiset<double> sortedValues; ///> For the min and max
+
+  void put(std::string const& key, std::shared_ptr<Feature> const& feature)
+  {
+    auto it = localFeatureMap.find(key);
+    if (it != localFeatureMap.end()) {
+      removeValue(it->second->getValue());
+      it->second = feature;
+    } else {
+      localFeatureMap.emplace(key, feature);
+    }
+    addValue(feature->getValue());
+  }
+
+  void addValue(double x)
+  {
+    if (std::isnan(x)) return;
+    size_t n = sortedValues.size() + 1;
+    sum += x;
+    double delta = x - mean;
+    mean += delta / n;
+    m2 += delta * (x - mean);
+    sortedValues.insert(x);
+  }
+
+  void removeValue(double x)
+  {
+    if (std::isnan(x)) return;
+    size_t n = sortedValues.size();
+    auto it = sortedValues.find(x);
+    if (it != sortedValues.end()) {
+      sortedValues.erase(it);
+    }
+    if (n <= 1) {
+      sum = mean = m2 = 0;
+      return;
+    }
+    sum -= x;
+    double oldMean = mean;
+    mean = (n * mean - x) / (n - 1);
+    m2 = std::max(0.0, m2 - (x - oldMean) * (x - mean));
+  }
+
 public:
 
   /**
@@ -73,10 +150,38 @@ public:
   MapFeature(std::map<std::string, std::shared_ptr<Feature>> const& featureMap)
   {
     for (auto const& it : featureMap) {
-      localFeatureMap[it.first] = it.second;
+      put(it.first, it.second);
     }
   }
 
+  /**
+   * A map of one feature.
+   */
+  MapFeature(std::string const& key, std::shared_ptr<Feature> feature)
+  {
+    put(key, feature);
+  }
+
+  /**
+   * Returns an aggregate of the values of the features that aren't NaN,
+   * in O(1).  The average, variance, min and max of no such values are
+   * NaN, and their sum is 0.
+   */
+  double aggregate(Aggregation aggregation) const
+  {
+    if (aggregation == Aggregation::Sum) return sum;
+    if (sortedValues.empty()) return std::numeric_limits<double>::quiet_NaN();
+    switch (aggregation) {
+      case Aggregation::Average: return mean;
+      case Aggregation::Variance: return m2 / sortedValues.size();
+      case Aggregation::Min: return *sortedValues.begin();
+      case Aggregation::Max: return *sortedValues.rbegin();
+      default: return sum;
+    }
+  }
+
+  size_t size() const { return localFeatureMap.size(); }
+
   double evaluate(
     std::function<double(std::list<std::shared_ptr<Feature>>)> func) const
   {
@@ -95,23 +200,22 @@ public:
    */
   void update(Feature const& feature) {
     // Cast it to be the feature type we expect.
-    auto otherFeatureMap = 
+    auto const& otherFeatureMap = 
       static_cast<MapFeature const&>(feature).localFeatureMap;
 
     // We iterate over the items in the other map.  Generally this should
     // only be one item. 
-    for(auto& it : otherFeatureMap)
+    for(auto const& it : otherFeatureMap)
     {
-      localFeatureMap[it.first] = it.second;
+      put(it.first, it.second);
     }
   }
 
   /**
-   *
+   * The copy shares the features, which don't change, and the aggregates.
    */
   std::shared_ptr<Feature> createCopy() const {
-    std::shared_ptr<Feature> feature = 
-      std::make_shared<MapFeature>(localFeatureMap);
+    std::shared_ptr<Feature> feature = std::make_shared<MapFeature>(*this);
     return feature;
   }
 
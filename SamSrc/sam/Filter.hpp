@@ -2,6 +2,8 @@
 #define FILTER_HPP
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <sam/Expression.hpp>
 #include <sam/AbstractConsumer.hpp>
 #include <sam/BaseComputation.hpp>
@@ -29,10 +31,19 @@ public:
          BaseComputation(nodeId, featureMap, identifier), 
          BaseProducer<EdgeType>(nodeId, queueLength),
          expression(_exp)
-  {}
+  {
+    this->registerMetrics(this->feedCount);
+  }
 
   bool consume(EdgeType const& edge);
 
+  /**
+   * Evaluates the expression on a batch of edges and feeds the edges that
+   * pass to the consumers as one batch.  The feature map is updated once
+   * per key with the result for the last edge of that key.
+   */
+  bool consumeBatch(EdgeType const* edges, size_t numEdges);
+
   void terminate();
 
 };
@@ -41,6 +52,7 @@ template <typename EdgeType, size_t... keyFields>
 bool Filter<EdgeType, keyFields...>::consume(EdgeType const& edge) 
                                               
 {
+  this->feedCount++;
   string key = generateKey<keyFields...>(edge.tuple);
   double result = 0;
   bool b = expression->evaluate(key, edge.tuple, result); 
@@ -49,13 +61,41 @@ bool Filter<EdgeType, keyFields...>::consume(EdgeType const& edge)
     this->featureMap->updateInsert(key, this->identifier, feature); 
     if ( result ) {
       this->parallelFeed(edge);
-    } else {
-      BooleanFeature feature(0);
-      this->featureMap->updateInsert(key, this->identifier, feature);  
     }
   }
 
-  this->parallelFeed(edge);
+  return true;
+}
+
+template <typename EdgeType, size_t... keyFields>
+bool Filter<EdgeType, keyFields...>::consumeBatch(EdgeType const* edges,
+                                                  size_t numEdges)
+{
+  this->feedCount += numEdges;
+  std::vector<EdgeType> passed;
+  passed.reserve(numEdges);
+  std::unordered_map<string, double> results;
+
+  for (size_t i = 0; i < numEdges; i++) {
+    string key = generateKey<keyFields...>(edges[i].tuple);
+    double result = 0;
+    bool b = expression->evaluate(key, edges[i].tuple, result);
+    if (b) {
+      results[key] = result;
+      if ( result ) {
+        passed.push_back(edges[i]);
+      }
+    }
+  }
+
+  for (auto const& p : results) {
+    BooleanFeature feature(p.second);
+    this->featureMap->updateInsert(p.first, this->identifier, feature); 
+  }
+
+  if (!passed.empty()) {
+    this->parallelFeed(passed.data(), passed.size());
+  }
 
   return true;
 }
@@ -16,7 +16,9 @@
 #include <sam/SubgraphQuery.hpp>
 #include <sam/SubgraphQueryResultMap.hpp>
 #include <sam/EdgeRequestMap.hpp>
-#include <sam/ZeroMQUtil.hpp>
+#include <sam/LatencyTracing.hpp>
+#include <sam/Metrics.hpp>
+#include <sam/TransportFactory.hpp>
 #include <sam/FeatureMap.hpp>
 #include <sam/AbstractSubgraphPrinter.hpp>
 #include <zmq.hpp>
@@ -27,7 +29,6 @@
 namespace sam {
 
 #define MAX_NUM_FUTURES 1028
-#define TOLERANCE 1.0 
 
 class GraphStoreException : public std::runtime_error {
 public:
@@ -83,6 +84,9 @@ public:
 
   typedef EdgeDescription<TupleType, time, duration> EdgeDescriptionType;
 
+  typedef Transport<TupleType> EdgeTransportType;
+  typedef Transport<EdgeRequestType> RequestTransportType;
+
  
 private:
 
@@ -92,24 +96,19 @@ private:
   // Returns the node (cluster) associated with the target of the edge request.
   std::function<size_t(EdgeRequestType const&)> targetAddressFunction;
 
-  #ifdef TIMING
-  double totalTimeConsume = 0; 
-  #endif
-
-  #ifdef DETAIL_TIMING
-  double totalTimeConsumeAddEdge = 0;
-  double totalTimeConsumeResultMapProcess = 0; 
-  double totalTimeConsumeEdgeRequestMapProcess = 0;
-  double totalTimeConsumeCheckSubgraphQueries = 0;
-  double totalTimeConsumeProcessEdgeRequests = 0;
-  double totalTimeEdgeCallbackProcessEdgeRequests = 0;
-  double totalTimeEdgeCallbackResultMapProcess = 0;
-  double totalTimeRequestCallbackAddRequest = 0; 
-  double totalTimeRequestCallbackProcessAgainstGraph = 0; 
-
-  // A list of consume times
-  std::list<double> consumeTimes;
-  #endif
+  // How long the stages of consume and of the callbacks take.  They are
+  // only recorded while metrics are enabled (see Metrics.hpp).
+  std::shared_ptr<LatencyHistogram> timeConsume;
+  std::shared_ptr<LatencyHistogram> timeConsumeAddEdge;
+  std::shared_ptr<LatencyHistogram> timeConsumeResultMapProcess; 
+  std::shared_ptr<LatencyHistogram> timeConsumeEdgeRequestMapProcess;
+  std::shared_ptr<LatencyHistogram> timeConsumeCheckSubgraphQueries;
+  std::shared_ptr<LatencyHistogram> timeConsumeProcessEdgeRequests;
+  std::shared_ptr<LatencyHistogram> timeEdgeCallbackProcessEdgeRequests;
+  std::shared_ptr<LatencyHistogram> timeEdgeCallbackResultMapProcess;
+  std::shared_ptr<LatencyHistogram> timeRequestCallbackAddRequest; 
+  std::shared_ptr<LatencyHistogram> timeRequestCallbackProcessAgainstGraph; 
+  std::shared_ptr<LatencyHistogram> timeRequestSendEdge;
 
   size_t consumeCount = 0;
 
@@ -132,8 +131,11 @@ private:
   // Generates unique id for each tuple
   SimpleIdGenerator* idGenerator = idGenerator->getInstance(); 
 
-  PushPull* edgeCommunicator;
-  PushPull* requestCommunicator;
+  /// Carries edges that matched edge requests back to the requesting node.
+  std::unique_ptr<EdgeTransportType> edgeCommunicator;
+
+  /// Carries edge requests to the nodes owning the requested edges.
+  std::unique_ptr<RequestTransportType> requestCommunicator;
 
   /// Flag indicating terminate was called.
   std::atomic<bool> terminated; 
@@ -219,6 +221,12 @@ public:
    * \param featureMap The featureMap that is being used by this node.
    * \param maxFutures The number of async threads that can be created.
    * \param local Boolean indicating that we are on one node.
+   * \param transportType How edges and edge requests get to the other
+   *   nodes.  The in-process transports pass them as objects and need all
+   *   the nodes in this process.  With a single node there is nobody to
+   *   talk to, so the direct transport is always used.
+   * \param compression How the ZeroMQ transport compresses the edges and
+   *   edge requests it sends.
    */
   GraphStore(
              std::size_t numNodes,
@@ -238,7 +246,9 @@ public:
 #endif
              std::shared_ptr<FeatureMap> featureMap,
              size_t maxFutures = MAX_NUM_FUTURES,
-             bool local=false);
+             bool local=false,
+             TransportType transportType = TransportType::ZeroMQ,
+             CompressionConfig compression = CompressionConfig());
 
   ~GraphStore();
 
@@ -352,7 +362,9 @@ public:
     return requestCommunicator->getTotalMessagesFailed(); 
   }
 
-  #ifdef METRICS
+  // The getters below return what was recorded while metrics were
+  // enabled (see Metrics.hpp).  Times are in seconds.
+
   /**
    * Returns the number of edge map pushes
    */
@@ -373,13 +385,8 @@ public:
   size_t getTotalEdgeRequestMapRequestsViewed() {
     return edgeRequestMap->getTotalEdgeRequestsViewed();
   }
-  #endif
 
-  #ifdef TIMING
-  double getTotalTimeConsume() const { return totalTimeConsume; }
-  #endif
-
-  #ifdef DETAIL_TIMING
+  double getTotalTimeConsume() const { return timeConsume->totalSeconds(); }
 
   /**
    * Returns how long the edgeRequestMap spent sending data to a push
@@ -398,31 +405,31 @@ public:
   }
 
   double getTotalTimeConsumeAddEdge() const {
-    return totalTimeConsumeAddEdge;
+    return timeConsumeAddEdge->totalSeconds();
   }
   double getTotalTimeConsumeResultMapProcess() const {
-    return totalTimeConsumeResultMapProcess;
+    return timeConsumeResultMapProcess->totalSeconds();
   }
   double getTotalTimeConsumeEdgeRequestMapProcess() const {
-    return totalTimeConsumeEdgeRequestMapProcess;
+    return timeConsumeEdgeRequestMapProcess->totalSeconds();
   }
   double getTotalTimeConsumeCheckSubgraphQueries() const {
-    return totalTimeConsumeCheckSubgraphQueries;
+    return timeConsumeCheckSubgraphQueries->totalSeconds();
   }
   double getTotalTimeConsumeProcessEdgeRequests() const {
-    return totalTimeConsumeProcessEdgeRequests;
+    return timeConsumeProcessEdgeRequests->totalSeconds();
   }
   double getTotalTimeEdgeCallbackProcessEdgeRequests() const {
-    return totalTimeEdgeCallbackProcessEdgeRequests;
+    return timeEdgeCallbackProcessEdgeRequests->totalSeconds();
   }
   double getTotalTimeEdgeCallbackResultMapProcess() const {
-    return totalTimeEdgeCallbackResultMapProcess;
+    return timeEdgeCallbackResultMapProcess->totalSeconds();
   }
   double getTotalTimeRequestCallbackAddRequest() const {
-    return totalTimeRequestCallbackAddRequest;
+    return timeRequestCallbackAddRequest->totalSeconds();
   } 
   double getTotalTimeRequestCallbackProcessAgainstGraph() const {
-    return totalTimeRequestCallbackProcessAgainstGraph;
+    return timeRequestCallbackProcessAgainstGraph->totalSeconds();
   }
 
   /**
@@ -452,13 +459,6 @@ public:
     return resultMap->getTotalTimeProcessLoop2();
   }
 
-  std::list<double> const& getConsumeTimes() const {
-    return consumeTimes;
-  }
-
-  #endif
-
-  #ifdef METRICS
   size_t getTotalResultsCreatedInResultMap() const {
     return resultMap->getTotalResultsCreated();
   }
@@ -477,7 +477,6 @@ public:
   size_t getTotalEdgesDeletedInCsc() const {
     return csc->getTotalEdgesDeleted();
   }
-  #endif
 
 
 };
@@ -669,10 +668,9 @@ GraphStore<EdgeType, Tuplizer, source, target, time, duration,
 sendEdgeRequest(EdgeRequestType const& edgeRequest,
   std::function<size_t(EdgeRequestType const&)> addressFunction)
 {
-  std::string message = edgeRequest.serialize();
   size_t node = addressFunction(edgeRequest);
 
-  bool sent = requestCommunicator->send(message, node);
+  bool sent = requestCommunicator->send(edgeRequest, node);
 
   if (!sent) { 
     printf("Node %lu->%lu GraphStore::sendEdgeRequest failed"
@@ -748,81 +746,50 @@ consumeDoesTheWork(EdgeType const& edge)
 
   size_t totalWork = 0;
 
-  #ifdef TIMING
-  auto timestamp_consume1 = std::chrono::high_resolution_clock::now();
-  #endif
-
+  ScopedTimer consumeTimer(timeConsume);
 
   DEBUG_PRINT("Node %lu GraphStore::consumeDoesTheWork tuple %s\n", nodeId, 
     edge.toString().c_str());
 
 
   // Adds the edge to the graph
-  DETAIL_TIMING_BEG1
-  size_t workAddEdge = addEdge(edge);
-  DETAIL_TIMING_END_TOL1(nodeId, totalTimeConsumeAddEdge, TOLERANCE, 
-                     "GraphStore::consumeDoesTheWork addEdge")
+  size_t workAddEdge;
+  {
+    ScopedTimer timer(timeConsumeAddEdge);
+    workAddEdge = addEdge(edge);
+  }
+  LatencyTracer::record(TraceStage::GraphAdd, edge.ingestTime);
 
   // Check against existing queryResults.  The edgeRequest list is populated
   // with edge requests when we find we need a tuple that will reside 
   // elsewhere.
-  DETAIL_TIMING_BEG2
   std::list<EdgeRequestType> edgeRequests;
-  //resultMapLock.lock();
-  size_t workResultMapProcess = 
-    resultMap->process(edge, edgeRequests);
-  //resultMapLock.unlock();
-  DETAIL_TIMING_END_TOL2(nodeId, totalTimeConsumeResultMapProcess,  TOLERANCE,
-                     "GraphStore::consumeDoesTheWork resultMap->process")
+  size_t workResultMapProcess;
+  {
+    ScopedTimer timer(timeConsumeResultMapProcess);
+    workResultMapProcess = resultMap->process(edge, edgeRequests);
+  }
 
   // See if anybody needs this tuple and send it out to them.
-  DETAIL_TIMING_BEG2
-  size_t workEdgeRequestMap = edgeRequestMap->process(edge.tuple);
-  DETAIL_TIMING_END_TOL2(nodeId, totalTimeConsumeEdgeRequestMapProcess, 
-    TOLERANCE, "GraphStore::consumeDoesTheWork edgeRequestMap->process")
+  size_t workEdgeRequestMap;
+  {
+    ScopedTimer timer(timeConsumeEdgeRequestMapProcess);
+    workEdgeRequestMap = edgeRequestMap->process(edge.tuple);
+  }
 
   // Check against all registered queries
-  
-  size_t workCheckSubgraphQueries = 0;
-
-  DETAIL_TIMING_BEG2
-  workCheckSubgraphQueries = checkSubgraphQueries(edge, edgeRequests);
-  DETAIL_TIMING_END_TOL2(nodeId, totalTimeConsumeCheckSubgraphQueries, 
-    TOLERANCE, "GraphStore::consumeDoesTheWork checkSubgraphQueries")
+  size_t workCheckSubgraphQueries;
+  {
+    ScopedTimer timer(timeConsumeCheckSubgraphQueries);
+    workCheckSubgraphQueries = checkSubgraphQueries(edge, edgeRequests);
+  }
 
   // Send out the edge requests to the other nodes.
-  DETAIL_TIMING_BEG2
-  size_t workProcessEdgeRequests = processEdgeRequests(edgeRequests);
-  DETAIL_TIMING_END_TOL2(nodeId, totalTimeConsumeProcessEdgeRequests, TOLERANCE,
-                     "GraphStore::consumeDoesTheWork processEdgeRequests")
-
-  #ifdef TIMING
-  auto timestamp_consume2 = std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double> time_space = 
-    std::chrono::duration_cast<std::chrono::duration<double>>(
-      timestamp_consume2 - timestamp_consume1);
-  double time_consume = time_space.count(); 
-  totalTimeConsume += time_consume;
-
-  //#ifdef DETAIL_TIMING
-  //consumeTimes.push_back(time_consume);
-  //#endif
-
-  //#ifdef DETAIL_METRICS
-  //totalWork = workAddEdge + workResultMapProcess + workEdgeRequestMap + 
-  //            workCheckSubgraphQueries + workProcessEdgeRequests;
-  //printf("Node %lu GraphStore::consumeDoesTheWork DETAIL_METRICS "
-  //       "workAddEdge %lu "
-  //       "workResultMapProcess %lu "
-  //       "workEdgeRequestMap %lu "
-  //       "workCheckSubgraphQueries %lu "
-  //       "workProcessEdgeRequests %lu total work %lu time %f\n", 
-  //       nodeId, workAddEdge, workResultMapProcess,
-  //       workEdgeRequestMap, workCheckSubgraphQueries,
-  //       workProcessEdgeRequests, totalWork, time_consume);
-  //#endif
-  
-  #endif
+  size_t workProcessEdgeRequests;
+  {
+    ScopedTimer timer(timeConsumeProcessEdgeRequests);
+    workProcessEdgeRequests = processEdgeRequests(edgeRequests);
+  }
 
   DEBUG_PRINT("Node %lu exiting GraphStore::consumeDoesTheWork\n", nodeId);
 
@@ -921,7 +888,9 @@ GraphStore(
 #endif
              std::shared_ptr<FeatureMap> featureMap,
              size_t maxFutures,
-             bool local)
+             bool local,
+             TransportType transportType,
+             CompressionConfig compression)
 {
   this->featureMap = featureMap;
 
@@ -952,23 +921,46 @@ GraphStore(
   edgePushFails = 0;
   consumeThreadsActive = 0;
 
-  csr = std::make_shared<csrType>(graphCapacity, timeWindow); 
-  csc = std::make_shared<cscType>(graphCapacity, timeWindow); 
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  std::string node = std::to_string(nodeId);
+  auto stage = [&registry, &node](std::string const& name) {
+    return registry.histogram("sam_graph_store_seconds",
+      metricLabels({{"node", node}, {"stage", name}}),
+      "Time spent in a stage of GraphStore");
+  };
+  timeConsume = stage("consume");
+  timeConsumeAddEdge = stage("consume_add_edge");
+  timeConsumeResultMapProcess = stage("consume_result_map_process");
+  timeConsumeEdgeRequestMapProcess = stage("consume_edge_request_map_process");
+  timeConsumeCheckSubgraphQueries = stage("consume_check_subgraph_queries");
+  timeConsumeProcessEdgeRequests = stage("consume_process_edge_requests");
+  timeEdgeCallbackResultMapProcess = stage("edge_callback_result_map_process");
+  timeEdgeCallbackProcessEdgeRequests = 
+    stage("edge_callback_process_edge_requests");
+  timeRequestCallbackAddRequest = stage("request_callback_add_request");
+  timeRequestCallbackProcessAgainstGraph = 
+    stage("request_callback_process_against_graph");
+  timeRequestSendEdge = stage("request_send_edge");
+
+  csr = std::make_shared<csrType>(graphCapacity, timeWindow,
+    metricLabels({{"node", node}, {"graph", "csr"}})); 
+  csc = std::make_shared<cscType>(graphCapacity, timeWindow,
+    metricLabels({{"node", node}, {"graph", "csc"}})); 
   
   resultMap = 
     std::make_shared< ResultMapType>( numNodes, nodeId, 
       tableCapacity, resultsCapacity, *csr, *csc);
 
 
-  typedef PushPull::FunctionType FunctionType;
+  if (numNodes == 1) {
+    transportType = TransportType::Direct;
+  }
 
-  auto edgeCallback = [this](std::string str) 
+  auto edgeCallback = [this](TupleType const& tuple) 
   {
     // We give the edge a new id that is unique to this node.
     size_t id = idGenerator->generate();
-
-    // Change the string into the expected tuple type.
-    EdgeType edge = tuplizer(id, str);
+    EdgeType edge(id, LabelType(), tuple);
 
     DEBUG_PRINT("Node %lu GraphStore::edgeCallback received a"
       " tuple %s\n", this->nodeId, sam::toString(edge.tuple).c_str());
@@ -980,46 +972,57 @@ GraphStore(
     DEBUG_PRINT("Node %lu GraphStore::edgeCallback added edge %s\n",
       this->nodeId, sam::toString(edge.tuple).c_str());
 
-    DETAIL_TIMING_BEG1
     // Process the new edge over results and see if it satifies
     // queries.  If it does, there may be new edge requests.
     std::list<EdgeRequestType> edgeRequests;
-    //resultMapLock.lock();
-    resultMap->process(edge, edgeRequests);
-    //resultMapLock.unlock();
-    DETAIL_TIMING_END_TOL1(this->nodeId, totalTimeEdgeCallbackResultMapProcess, 
-      TOLERANCE, "GraphStore::edgeCallback resultMap->process")
+    {
+      ScopedTimer timer(timeEdgeCallbackResultMapProcess);
+      resultMap->process(edge, edgeRequests);
+    }
 
     DEBUG_PRINT("Node %lu GraphStore::edgeCallback processed"
       " edge %s\n", this->nodeId, sam::toString(edge.tuple).c_str());
 
     // Send out the edge requests to the other nodes.
-    DETAIL_TIMING_BEG2
+    ScopedTimer timer(timeEdgeCallbackProcessEdgeRequests);
     processEdgeRequests(edgeRequests);
-    DETAIL_TIMING_END_TOL2(this->nodeId, 
-      totalTimeEdgeCallbackProcessEdgeRequests, TOLERANCE, 
-      "GraphStore::edgeCallbackk processEdgeRequests")
   };
 
-  std::vector<FunctionType> edgeCommunicatorFunctions;
+  std::vector<typename EdgeTransportType::FunctionType> 
+    edgeCommunicatorFunctions;
   edgeCommunicatorFunctions.push_back(edgeCallback);
 
-  edgeCommunicator = new PushPull(numNodes, nodeId, numPushSockets,
+  // Only the ZeroMQ transport turns edges into strings.  Edges only travel
+  // in answer to edge requests, which carry no label, so neither does the
+  // string.
+  auto serializeTuple = [](TupleType const& tuple) {
+    return sam::toString(tuple);
+  };
+  auto deserializeTuple = [this](std::string const& str) {
+    return tuplizer(0, str).tuple;
+  };
+
+  edgeCommunicator = createTransport<TupleType>(transportType,
+                                  numNodes, nodeId, numPushSockets,
                                   numPullThreads, hostnames, hwm,
                                   edgeCommunicatorFunctions,
-                                  startingPort, timeout, local); 
+                                  startingPort, timeout, local,
+                                  serializeTuple, deserializeTuple, {},
+                                  PUSH_PULL_PULL_THREAD_TIMEOUT,
+                                  compression); 
 
+  // The ports after those of the edge communicator.
   size_t newStartingPort;
   if (local) {
     newStartingPort = startingPort + (numPushSockets * (numNodes-1)) * numNodes;
   } else {
-    newStartingPort = edgeCommunicator->getLastPort() + 1;
+    newStartingPort = startingPort + (numNodes - 1) * numPushSockets;
   }
 
   edgeRequestMap = std::make_shared< RequestMapType>( 
-    numNodes, nodeId, tableCapacity, edgeCommunicator);
+    numNodes, nodeId, tableCapacity, edgeCommunicator.get());
 
-  auto requestCallback = [this](std::string str)
+  auto requestCallback = [this](EdgeRequestType const& request)
   {
       
     // When we get an edge request, we need to check against
@@ -1032,25 +1035,21 @@ GraphStore(
     
     //generalLock.lock();
 
-    EdgeRequestType request(str);
     DEBUG_PRINT("Node %lu GraphStore::requestCallback received an edge request"
-      " length = %lu: %s %s\n", this->nodeId, str.size(), str.c_str(),
-      request.toString().c_str());
-
-    DETAIL_TIMING_BEG1
-    edgeRequestMap->addRequest(request);
-    DETAIL_TIMING_END_TOL1(this->nodeId, 
-      totalTimeRequestCallbackAddRequest, 
-      TOLERANCE, "GraphStore::requestCallback edgeRequestMap->addRequest")
+      ": %s\n", this->nodeId, request.toString().c_str());
+
+    {
+      ScopedTimer timer(timeRequestCallbackAddRequest);
+      edgeRequestMap->addRequest(request);
+    }
     DEBUG_PRINT("Node %lu RequestPullThread added edge request to map"
       ": %s\n", this->nodeId, request.toString().c_str());
       
 
-    DETAIL_TIMING_BEG2
-    processRequestAgainstGraph(request);
-    DETAIL_TIMING_END_TOL2(this->nodeId, 
-      totalTimeRequestCallbackProcessAgainstGraph, 
-      TOLERANCE, "GraphStore::requestCallback processRequestAgainstGraph")
+    {
+      ScopedTimer timer(timeRequestCallbackProcessAgainstGraph);
+      processRequestAgainstGraph(request);
+    }
     DEBUG_PRINT("Node %lu RequestPullThread processed edge request"
       " against graph: %s\n", this->nodeId, request.toString().c_str());
       
@@ -1060,13 +1059,25 @@ GraphStore(
       
   };
 
-  std::vector<FunctionType> requestCommunicatorFunctions;
+  std::vector<typename RequestTransportType::FunctionType>
+    requestCommunicatorFunctions;
   requestCommunicatorFunctions.push_back(requestCallback);
 
-  requestCommunicator = new PushPull(numNodes, nodeId, numPushSockets,
+  auto serializeRequest = [](EdgeRequestType const& request) {
+    return request.serialize();
+  };
+  auto deserializeRequest = [](std::string const& str) {
+    return EdgeRequestType(str);
+  };
+
+  requestCommunicator = createTransport<EdgeRequestType>(transportType,
+                                     numNodes, nodeId, numPushSockets,
                                      numPullThreads, hostnames, hwm,
                                      requestCommunicatorFunctions,
-                                     newStartingPort, timeout, local);
+                                     newStartingPort, timeout, local,
+                                     serializeRequest, deserializeRequest, {},
+                                     PUSH_PULL_PULL_THREAD_TIMEOUT,
+                                     compression);
 
 #ifdef DROP_QUERIES
   this->keepQueries = keepQueries;
@@ -1086,8 +1097,8 @@ GraphStore<EdgeType, Tuplizer, source, target, time, duration,
 {
   terminate();
 
-  delete requestCommunicator;
-  delete edgeCommunicator;
+  requestCommunicator.reset();
+  edgeCommunicator.reset();
 
   DEBUG_PRINT("Node %lu end of ~GraphStore\n", nodeId);
 }
@@ -1158,7 +1169,10 @@ processRequestAgainstGraph(EdgeRequestType const& edgeRequest)
   DEBUG_PRINT("Node %lu GraphStore::processRequestAgainstGraph found"
     " %lu edges\n", nodeId, foundEdges.size());
 
-  for (auto edge : foundEdges) {
+  // The edges all go to the same node, so they are sent as one batch,
+  // which the ZeroMQ transport can compress.
+  std::vector<TupleType> tuples;
+  for (auto const& edge : foundEdges) {
     SourceType src = std::get<source>(edge.tuple);
     TargetType trg = std::get<target>(edge.tuple);
     size_t srcHash = sourceHash(src) % numNodes;
@@ -1166,48 +1180,23 @@ processRequestAgainstGraph(EdgeRequestType const& edgeRequest)
 
     // Only send the message of the node won't get the message anyway.
     if (srcHash != node && trgHash != node) {
+      DEBUG_PRINT("Node %lu->%lu GraphStore::processRequestAgainstGraph"
+        " sending edge %s\n", nodeId, node, 
+        sam::toString(edge.tuple).c_str());
+      tuples.push_back(edge.tuple);
+    }
+  }
 
-      std::string message = sam::toString(edge.tuple);
-      //zmq::message_t message = tupleToZmq(edge);
-
-      double placeholder = 0;
-      DETAIL_TIMING_BEG1
-      DETAIL_TIMING_END_TOL1(nodeId, placeholder, TOLERANCE, 
-        "GraphStore::processRequestAgainstGraph obtaining lock exceeded "
-        "tolerance")
-      if (!terminated) {
-        DEBUG_PRINT("Node %lu->%lu GraphStore::processRequestAgainstGraph"
-          " sending edge %s\n", nodeId, node, message.c_str());
-        DETAIL_TIMING_BEG1
-        //#ifdef NOBLOCK
-        //bool sent = edgePushers[node]->send(message, ZMQ_NOBLOCK);     
-        //if (!sent) { 
-        //  edgePushFails.fetch_add(1);
-        //  edgePushCounter.fetch_add(-1);
-        //  DEBUG_PRINT("Node %lu->%lu GraphStore::processRequestAgainstGraph"
-        //    " failed sending edge: %s\n",
-        //    nodeId, node, sam::toString(edge).c_str()); 
-        //}
-        //#elif defined NOBLOCK_WHILE
-        //bool sent = false;
-        //while(!sent) {
-        //  sent = edgePushers[node]->send(message, ZMQ_NOBLOCK);
-        //}
-        //#else
-        bool sent = edgeCommunicator->send(message, node);
-        if (!sent) { 
-          edgePushFails.fetch_add(1);
-          DEBUG_PRINT("Node %lu->%lu GraphStore::processRequestAgainstGraph"
-            " failed sending edge: %s\n", nodeId, node, message.c_str()); 
-            
-        } else {
-          edgePushCounter.fetch_add(1);
-        }
-        //#endif
-        DETAIL_TIMING_END_TOL1(nodeId, placeholder, TOLERANCE, 
-          "GraphStore::processRequestAgainstGraph sending message exceeded "
-          "tolerance")
-      }
+  if (!terminated && !tuples.empty()) {
+    ScopedTimer timer(timeRequestSendEdge);
+    bool sent = edgeCommunicator->sendBatch(tuples.data(), tuples.size(),
+                                            node);
+    if (!sent) { 
+      edgePushFails.fetch_add(tuples.size());
+      DEBUG_PRINT("Node %lu->%lu GraphStore::processRequestAgainstGraph"
+        " failed sending %lu edges\n", nodeId, node, tuples.size()); 
+    } else {
+      edgePushCounter.fetch_add(tuples.size());
     }
   }
 }
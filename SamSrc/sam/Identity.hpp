@@ -41,7 +41,9 @@ public:
            std::string identifier) :
            BaseComputation(nodeId, featureMap, identifier) 
                                           
-  {}
+  {
+    this->registerMetrics(this->feedCount);
+  }
 
   bool consume(EdgeType const& edge) 
   {
@@ -56,7 +58,7 @@ public:
 
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    this->notifySubscribers(edge.id, value);
+    this->notifySubscribers(edge, value);
     
     return true;
   }
@@ -0,0 +1,565 @@
+#ifndef SAM_IN_PROCESS_TRANSPORT_HPP
+#define SAM_IN_PROCESS_TRANSPORT_HPP
+
+/**
+ * Transports between nodes that live in the same process: a single node
+ * run, or a unit test standing up several nodes.  Messages are handed over
+ * as objects; nothing is serialized and no sockets are created.
+ *
+ * The nodes find each other through an InProcessHub, looked up by the
+ * same starting port the ZeroMQ transport would use, so a node doesn't
+ * need to be told about the others.  A node may send to another that
+ * hasn't been created yet; send waits up to the timeout for it, the way a
+ * ZeroMQ push socket waits for its peer.
+ */
+
+#include <sam/Metrics.hpp>
+#include <sam/Transport.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sam {
+
+template <typename MessageType>
+class InProcessHub;
+
+/**
+ * What the direct and queue transports have in common: the callbacks,
+ * the counters, and the bookkeeping of which other nodes have terminated.
+ */
+template <typename MessageType>
+class InProcessTransport : public Transport<MessageType>
+{
+  friend class InProcessHub<MessageType>;
+
+public:
+  typedef typename Transport<MessageType>::FunctionType FunctionType;
+  typedef typename Transport<MessageType>::DrainFunctionType
+    DrainFunctionType;
+
+protected:
+  size_t numNodes; ///> How many nodes there are
+  size_t nodeId; ///> The id of this node
+  int timeout; ///> How long send waits, in ms; -1 waits forever
+  int pullThreadTimeout; ///> Silence after which receiving stops, in ms
+  std::vector<FunctionType> callbacks;
+  std::vector<DrainFunctionType> drainCallbacks;
+  std::shared_ptr<InProcessHub<MessageType>> hub;
+
+  std::atomic<size_t> totalMessagesSent;
+  std::atomic<size_t> totalMessagesReceived;
+  std::atomic<size_t> totalMessagesFailed;
+
+  /// When this node last received a message, in steady clock nanoseconds.
+  std::atomic<int64_t> lastReceived;
+
+  std::atomic<size_t> numPeersTerminated; ///> Other nodes done sending
+  std::atomic<size_t> numInFlight; ///> Deliveries to this node under way
+  std::mutex stateMutex;
+  std::condition_variable stateChanged; ///> Notified when a peer terminates
+  bool terminated = false;
+
+  InProcessTransport(size_t numNodes,
+                     size_t nodeId,
+                     std::vector<FunctionType> callbacks,
+                     std::vector<DrainFunctionType> drainCallbacks,
+                     size_t startingPort,
+                     int timeout,
+                     int pullThreadTimeout) :
+    numNodes(numNodes), nodeId(nodeId), timeout(timeout),
+    pullThreadTimeout(pullThreadTimeout), callbacks(callbacks),
+    drainCallbacks(drainCallbacks),
+    totalMessagesSent(0), totalMessagesReceived(0), totalMessagesFailed(0),
+    lastReceived(now()), numPeersTerminated(0), numInFlight(0)
+  {
+    if (nodeId >= numNodes) {
+      throw TransportException("Node id " + std::to_string(nodeId) +
+        " is not less than the number of nodes " + std::to_string(numNodes));
+    }
+    hub = InProcessHub<MessageType>::get(startingPort, numNodes);
+  }
+
+  /**
+   * Hands a message sent by another node to this node.  Called by the hub
+   * while the node is attached.
+   * \param timeout How long to wait, in ms, if the node can't take it yet.
+   */
+  virtual bool receive(MessageType const& message, int timeout) = 0;
+
+  /// Called by the hub each time another node terminates.
+  virtual void peerTerminated()
+  {
+    numPeersTerminated.fetch_add(1);
+    std::lock_guard<std::mutex> lock(stateMutex);
+    stateChanged.notify_all();
+  }
+
+  bool othersTerminated() const
+  {
+    return numPeersTerminated.load() >= numNodes - 1;
+  }
+
+  /// Whether nothing has arrived for pullThreadTimeout ms.
+  bool silent() const
+  {
+    return pullThreadTimeout >= 0 &&
+      now() - lastReceived.load() >= pullThreadTimeout * 1000000LL;
+  }
+
+  void handOn(MessageType const& message)
+  {
+    for (auto const& callback : callbacks) {
+      callback(message);
+    }
+  }
+
+  void drained()
+  {
+    for (auto const& callback : drainCallbacks) {
+      callback();
+    }
+  }
+
+  static int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+public:
+  bool send(MessageType const& message, size_t node)
+  {
+    if (node == nodeId || node >= numNodes) {
+      throw TransportException("Node " + std::to_string(nodeId) +
+        " can't send to node " + std::to_string(node));
+    }
+    bool sent = hub->deliver(node, message, timeout);
+    if (sent) {
+      totalMessagesSent.fetch_add(1);
+    } else {
+      printf("Node %lu InProcessTransport::send couldn't send message to "
+        "node %lu\n", nodeId, node);
+      totalMessagesFailed.fetch_add(1);
+    }
+    return sent;
+  }
+
+  size_t getTotalMessagesSent() const { return totalMessagesSent; }
+  size_t getTotalMessagesReceived() const { return totalMessagesReceived; }
+  size_t getTotalMessagesFailed() const { return totalMessagesFailed; }
+};
+
+/**
+ * Connects the in-process transports of one communicator, one per node.
+ * There is a hub per message type and starting port; it lives as long as
+ * a transport uses it.
+ */
+template <typename MessageType>
+class InProcessHub
+{
+public:
+  typedef InProcessTransport<MessageType> NodeTransport;
+
+private:
+  size_t numNodes;
+  std::mutex mutex;
+  std::condition_variable attachedChanged;
+  std::vector<NodeTransport*> nodes; ///> The attached transport of each node
+  std::vector<bool> terminatedNodes;
+
+public:
+  InProcessHub(size_t numNodes) :
+    numNodes(numNodes), nodes(numNodes, nullptr),
+    terminatedNodes(numNodes, false)
+  {}
+
+  /**
+   * The hub for the given starting port, created on first use.
+   * \throws TransportException if the hub exists with a different number
+   *   of nodes.
+   */
+  static std::shared_ptr<InProcessHub> get(size_t startingPort,
+                                           size_t numNodes)
+  {
+    static std::mutex registryMutex;
+    static std::map<size_t, std::weak_ptr<InProcessHub>> registry;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::shared_ptr<InProcessHub> hub = registry[startingPort].lock();
+    if (!hub) {
+      hub = std::make_shared<InProcessHub>(numNodes);
+      registry[startingPort] = hub;
+    } else if (hub->numNodes != numNodes) {
+      throw TransportException("In-process transport on port " +
+        std::to_string(startingPort) + " already has " +
+        std::to_string(hub->numNodes) + " nodes, not " +
+        std::to_string(numNodes));
+    }
+    return hub;
+  }
+
+  /**
+   * Makes the node reachable.  Nodes that terminated before it attached
+   * are counted right away.
+   * \throws TransportException if the node is already attached.
+   */
+  void attach(size_t node, NodeTransport* transport)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nodes[node] != nullptr) {
+      throw TransportException("Node " + std::to_string(node) +
+        " is already attached to this in-process transport");
+    }
+    nodes[node] = transport;
+    for (size_t i = 0; i < numNodes; i++) {
+      if (i != node && terminatedNodes[i]) {
+        transport->numPeersTerminated.fetch_add(1);
+      }
+    }
+    attachedChanged.notify_all();
+  }
+
+  /**
+   * Makes the node unreachable and waits for deliveries to it that are
+   * under way to finish.
+   */
+  void detach(size_t node)
+  {
+    NodeTransport* transport;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      transport = nodes[node];
+      nodes[node] = nullptr;
+    }
+    if (transport) {
+      while (transport->numInFlight.load() > 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  /**
+   * Gives the message to the node, waiting up to timeout ms (forever if
+   * negative) for the node to attach.
+   */
+  bool deliver(size_t node, MessageType const& message, int timeout)
+  {
+    NodeTransport* transport = enter(node, timeout);
+    if (!transport) return false;
+    bool received = transport->receive(message, timeout);
+    transport->numInFlight.fetch_sub(1);
+    return received;
+  }
+
+  /**
+   * Records that the node is done sending and tells the others.
+   */
+  void markTerminated(size_t node)
+  {
+    std::vector<NodeTransport*> others;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (terminatedNodes[node]) return;
+      terminatedNodes[node] = true;
+      for (size_t i = 0; i < numNodes; i++) {
+        if (i != node && nodes[i]) {
+          nodes[i]->numInFlight.fetch_add(1);
+          others.push_back(nodes[i]);
+        }
+      }
+    }
+    for (auto transport : others) {
+      transport->peerTerminated();
+      transport->numInFlight.fetch_sub(1);
+    }
+  }
+
+private:
+  /**
+   * Finds the node's transport and counts a delivery to it as under way,
+   * so it can't be detached until the delivery is done.
+   */
+  NodeTransport* enter(size_t node, int timeout)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto attached = [this, node]() { return nodes[node] != nullptr; };
+    if (timeout < 0) {
+      attachedChanged.wait(lock, attached);
+    } else if (!attachedChanged.wait_for(lock,
+                 std::chrono::milliseconds(timeout), attached)) {
+      return nullptr;
+    }
+    nodes[node]->numInFlight.fetch_add(1);
+    return nodes[node];
+  }
+};
+
+/**
+ * Calls the other node's callbacks on the sending thread.  There are no
+ * threads or queues, so this is the cheapest transport, but the callbacks
+ * of a node can run on several threads at once and a send doesn't return
+ * until the other node has handled the message.  Each message is followed
+ * by the drain callbacks.
+ */
+template <typename MessageType>
+class DirectTransport : public InProcessTransport<MessageType>
+{
+public:
+  typedef typename InProcessTransport<MessageType>::FunctionType
+    FunctionType;
+  typedef typename InProcessTransport<MessageType>::DrainFunctionType
+    DrainFunctionType;
+
+  /**
+   * \param numNodes The number of nodes.
+   * \param nodeId The id of this node.
+   * \param callbacks Called with each message sent to this node.
+   * \param startingPort Identifies the communicator; the nodes of a
+   *   communicator use the same one.
+   * \param timeout How long in ms send waits for the other node to be
+   *   created.  If -1, waits forever.
+   * \param drainCallbacks Called after each message.
+   * \param pullThreadTimeout How long in ms terminate waits for other nodes
+   *   to terminate once nothing arrives.  If negative, waits until they do.
+   */
+  DirectTransport(size_t numNodes,
+                  size_t nodeId,
+                  std::vector<FunctionType> callbacks,
+                  size_t startingPort,
+                  int timeout,
+                  std::vector<DrainFunctionType> drainCallbacks =
+                    std::vector<DrainFunctionType>(),
+                  int pullThreadTimeout = PUSH_PULL_PULL_THREAD_TIMEOUT) :
+    InProcessTransport<MessageType>(numNodes, nodeId, callbacks,
+      drainCallbacks, startingPort, timeout, pullThreadTimeout)
+  {
+    this->hub->attach(nodeId, this);
+  }
+
+  ~DirectTransport()
+  {
+    terminate();
+  }
+
+  void terminate()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->stateMutex);
+      if (this->terminated) return;
+      this->terminated = true;
+    }
+    this->hub->markTerminated(this->nodeId);
+
+    std::unique_lock<std::mutex> lock(this->stateMutex);
+    while (!this->othersTerminated() && !this->silent()) {
+      this->stateChanged.wait_for(lock, std::chrono::milliseconds(10));
+    }
+    lock.unlock();
+    this->hub->detach(this->nodeId);
+  }
+
+  bool callsBackOnSender() const { return true; }
+
+protected:
+  bool receive(MessageType const& message, int)
+  {
+    this->lastReceived = this->now();
+    this->handOn(message);
+    this->drained();
+    this->totalMessagesReceived.fetch_add(1);
+    return true;
+  }
+};
+
+/**
+ * Puts messages on queues drained by this node's receive threads, like
+ * PushPull's pull threads without the sockets.  Senders return as soon as
+ * the message is queued, and the callbacks of a receive thread never run
+ * concurrently; receiveThreadId tells the threads apart.  A receive
+ * thread takes everything on its queue at once, hands it to the
+ * callbacks, then calls the drain callbacks.
+ */
+template <typename MessageType>
+class QueueTransport : public InProcessTransport<MessageType>
+{
+public:
+  typedef typename InProcessTransport<MessageType>::FunctionType
+    FunctionType;
+  typedef typename InProcessTransport<MessageType>::DrainFunctionType
+    DrainFunctionType;
+
+private:
+  struct ReceiveQueue
+  {
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<MessageType> messages;
+    bool closed = false; ///> No receive thread is left to make room
+    std::atomic<size_t> depth; ///> messages.size(), readable without mutex
+
+    ReceiveQueue() : depth(0) {}
+  };
+
+  size_t hwm; ///> The most messages a queue holds; 0 is unbounded
+  std::vector<std::unique_ptr<ReceiveQueue>> queues; ///> One per thread
+  std::atomic<size_t> nextQueue; ///> Spreads senders over the queues
+  std::vector<std::thread> receiveThreads;
+  std::vector<std::unique_ptr<CallbackMetric>> callbackMetrics;
+
+public:
+  /**
+   * \param numNodes The number of nodes.
+   * \param nodeId The id of this node.
+   * \param numReceiveThreads How many threads call the callbacks.
+   * \param hwm The most messages a receive thread's queue holds before
+   *   senders wait.  0 means no limit.
+   * \param callbacks Called with each message sent to this node.
+   * \param startingPort Identifies the communicator; the nodes of a
+   *   communicator use the same one.
+   * \param timeout How long in ms send waits for the other node to be
+   *   created or for room on its queue.  If -1, waits forever.
+   * \param drainCallbacks Called by a receive thread after each batch.
+   * \param pullThreadTimeout A receive thread exits if it receives nothing
+   *   for this many ms.  If negative, receive threads only exit once
+   *   every other node has terminated.
+   */
+  QueueTransport(size_t numNodes,
+                 size_t nodeId,
+                 size_t numReceiveThreads,
+                 size_t hwm,
+                 std::vector<FunctionType> callbacks,
+                 size_t startingPort,
+                 int timeout,
+                 std::vector<DrainFunctionType> drainCallbacks =
+                   std::vector<DrainFunctionType>(),
+                 int pullThreadTimeout = PUSH_PULL_PULL_THREAD_TIMEOUT) :
+    InProcessTransport<MessageType>(numNodes, nodeId, callbacks,
+      drainCallbacks, startingPort, timeout, pullThreadTimeout),
+    hwm(hwm), nextQueue(0)
+  {
+    if (numReceiveThreads == 0) {
+      throw TransportException("QueueTransport needs a receive thread");
+    }
+    for (size_t i = 0; i < numReceiveThreads; i++) {
+      queues.push_back(std::unique_ptr<ReceiveQueue>(new ReceiveQueue()));
+      ReceiveQueue* queue = queues.back().get();
+      callbackMetrics.push_back(MetricsRegistry::instance().callback(
+        "sam_queue_transport_depth",
+        metricLabels({{"node", std::to_string(nodeId)},
+                      {"port", std::to_string(startingPort)},
+                      {"thread", std::to_string(i)}}),
+        "Messages waiting for a receive thread", MetricKind::Gauge,
+        [queue]() { return (double) queue->depth.load(); }));
+    }
+    this->hub->attach(nodeId, this);
+    for (size_t i = 0; i < numReceiveThreads; i++) {
+      receiveThreads.push_back(std::thread([this, i]() { receiveLoop(i); }));
+    }
+  }
+
+  ~QueueTransport()
+  {
+    terminate();
+  }
+
+  void terminate()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->stateMutex);
+      if (this->terminated) return;
+      this->terminated = true;
+    }
+    this->hub->markTerminated(this->nodeId);
+    for (auto& thread : receiveThreads) {
+      thread.join();
+    }
+
+    // Senders waiting for room would wait forever.
+    for (auto& queue : queues) {
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->closed = true;
+      queue->notFull.notify_all();
+    }
+    this->hub->detach(this->nodeId);
+  }
+
+protected:
+  bool receive(MessageType const& message, int timeout)
+  {
+    ReceiveQueue& queue = *queues[nextQueue.fetch_add(1) % queues.size()];
+    std::unique_lock<std::mutex> lock(queue.mutex);
+    auto hasRoom = [this, &queue]() {
+      return queue.closed || hwm == 0 || queue.messages.size() < hwm;
+    };
+    if (timeout < 0) {
+      queue.notFull.wait(lock, hasRoom);
+    } else if (!queue.notFull.wait_for(lock,
+                 std::chrono::milliseconds(timeout), hasRoom)) {
+      return false;
+    }
+    if (queue.closed && hwm != 0 && queue.messages.size() >= hwm) {
+      return false;
+    }
+    queue.messages.push_back(message);
+    queue.depth.store(queue.messages.size(), std::memory_order_relaxed);
+    queue.notEmpty.notify_one();
+    return true;
+  }
+
+  void peerTerminated()
+  {
+    InProcessTransport<MessageType>::peerTerminated();
+    for (auto& queue : queues) {
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->notEmpty.notify_all();
+    }
+  }
+
+private:
+  void receiveLoop(size_t threadId)
+  {
+    receiveThreadId() = threadId;
+    ReceiveQueue& queue = *queues[threadId];
+    std::deque<MessageType> batch;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        while (queue.messages.empty()) {
+          if (this->othersTerminated() || this->silent()) {
+            lock.unlock();
+            this->drained();
+            return;
+          }
+          queue.notEmpty.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        batch.swap(queue.messages);
+        queue.depth.store(0, std::memory_order_relaxed);
+        queue.notFull.notify_all();
+      }
+
+      this->lastReceived = this->now();
+      for (auto const& message : batch) {
+        this->handOn(message);
+      }
+      this->totalMessagesReceived.fetch_add(batch.size());
+      batch.clear();
+      this->drained();
+    }
+  }
+};
+
+}
+
+#endif
@@ -2,13 +2,18 @@
 #define JACCARD_INDEX_HPP
 
 /**
- * This is a simple implementation of Jaccard index that is not space
- * efficient (i.e. O(N) where N is the size of the sliding window).
+ * Computes the Jaccard index between the older half and the newer half of
+ * a sliding window.  The distinct values of each half, and of their
+ * intersection, are maintained incrementally with multiset counters, so
+ * each insert is O(1) expected regardless of the window size.  This is not
+ * space efficient (i.e. O(N) where N is the size of the sliding window),
+ * since the window is needed to know which values leave each half.
  */
 
 #include <iostream>
 #include <map>
-#include <set>
+#include <unordered_map>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 #include <sam/AbstractConsumer.hpp>
@@ -23,80 +28,104 @@ namespace sam
 
 namespace JaccardIndexDetails {
 
+/**
+ * Let number of elements in set A & B be size_A & size_B respectively, and
+ * the number of elements in the intersection of sets A & B be size_intAB,
+ * then the Jaccard index can be computed by:
+ * size_intAB / (size_A + size_B - size_intAB)
+ *
+ * Ref: (https://en.wikipedia.org/wiki/Jaccard_index)
+ *
+ * Set A is the set of values in the older half of the window and set B is
+ * the set of values in the newer half.  When an item arrives, the oldest
+ * item leaves A, the oldest item of B moves to A, and the new item joins B.
+ * Each of those steps is a counter update that can change size_A, size_B
+ * and size_intAB by at most one.
+ */
 template <typename T>
 class JaccardIndexDataStructure {
 private:
   size_t N;
-  T* array;
-  int current = 0;
+  size_t half; ///> Number of items in the older half (N/2)
+  std::vector<T> array; ///> Ring buffer, oldest item at current
+  size_t current = 0;
+
+  std::unordered_map<T, size_t> countsA; ///> Multiplicities in older half
+  std::unordered_map<T, size_t> countsB; ///> Multiplicities in newer half
+  size_t sizeA = 0;
+  size_t sizeB = 0;
+  size_t sizeIntAB = 0;
 
 public:
-  JaccardIndexDataStructure(size_t N) {
-    // Allocate and initialize the data strcutures
+  JaccardIndexDataStructure(size_t N) : array(N, 0) {
     this->N = N;
-    array = new T[N]();
-    for (int i = 0; i < N; i++) array[i] = 0;
-  }
+    half = N / 2;
 
-  ~JaccardIndexDataStructure() {
-    delete[] array;
+    // The window starts out full of zeros.
+    for (size_t i = 0; i < half; i++) add(countsA, countsB, sizeA, 0);
+    for (size_t i = half; i < N; i++) add(countsB, countsA, sizeB, 0);
   }
 
   /**
-   * Adds an item, removing an item if need be.
+   * Adds an item, removing the oldest item.
    */
   void insert(T item) {
+    T oldest = array[current];
+    if (half > 0) {
+      remove(countsA, countsB, sizeA, oldest);
+
+      // The oldest item in B moves to A.
+      T middle = array[(current + half) % N];
+      remove(countsB, countsA, sizeB, middle);
+      add(countsA, countsB, sizeA, middle);
+    } else {
+      remove(countsB, countsA, sizeB, oldest);
+    }
+
     array[current] = item;
+    add(countsB, countsA, sizeB, item);
     current++;
     if (current >= N) {
       current = 0;
     }
   }
 
-  double getJaccardIndex() {
-    // sets used for calculating the Jaccard index
-    std::set<T> setA;
-    std::set<T> setB;
-
-    /**
-     * Let number of elements in set A & B be size_A & size_B respectively, and
-     * the number of elements in the intersection of sets A & B be size_intAB,
-     * then the Jaccard index can be computed by:
-     * size_intAB / (size_A + size_B - size_intAB)
-     *
-     * Ref: (https://en.wikipedia.org/wiki/Jaccard_index)
-     */
-
-    /**
-     * To create the two sets we walk through array and put all values from
-     * first half into setA and the values from the second half into setB.
-     *
-     * If this is called with an empty array it generates a memory access error;
-     * Need to add error handling to catch that case.
-     *
-     */
-    for (int i = 0; i < N; i++) {
-      if (i <= ((N/2)-1)) {
-        setA.insert(array[i]);
-      }
-      else {
-        setB.insert(array[i]);
-      }
-    }
-
-    double size_A = setA.size();
-    double size_B = setB.size();
-    std::set<T> intersectAB;
-
-    // Find the intersection of the two sets
-    set_intersection(setA.begin(), setA.end(), setB.begin(), setB.end(),
-                     inserter(intersectAB, intersectAB.begin()));
-    double size_intAB = intersectAB.size();
+  double getJaccardIndex() const {
+    double denominator = static_cast<double>(sizeA + sizeB - sizeIntAB);
+    if (denominator == 0) return 0;
+    return sizeIntAB / denominator;
+  }
 
-    // Compute the Jaccard index
-    double jaccardIndex = size_intAB / (size_A + size_B - size_intAB);
+private:
+  /**
+   * Adds a value to one half of the window.
+   * \param counts The multiplicities of the half being added to.
+   * \param other The multiplicities of the other half.
+   * \param size The number of distinct values in the half being added to.
+   */
+  void add(std::unordered_map<T, size_t>& counts,
+           std::unordered_map<T, size_t> const& other,
+           size_t& size, T const& value)
+  {
+    if (counts[value]++ == 0) {
+      size++;
+      if (other.count(value) > 0) sizeIntAB++;
+    }
+  }
 
-    return jaccardIndex;
+  /**
+   * Removes a value from one half of the window.
+   */
+  void remove(std::unordered_map<T, size_t>& counts,
+              std::unordered_map<T, size_t> const& other,
+              size_t& size, T const& value)
+  {
+    auto it = counts.find(value);
+    if (--(it->second) == 0) {
+      counts.erase(it);
+      size--;
+      if (other.count(value) > 0) sizeIntAB--;
+    }
   }
 };
 
@@ -129,6 +158,7 @@ public:
                std::string identifier) :
     BaseComputation(nodeId, featureMap, identifier)
   {
+    this->registerMetrics(this->feedCount);
     this->N = N;
   }
 
@@ -140,7 +170,7 @@ public:
 
   bool consume(EdgeType const& edge)
   {
-    TupleType tuple = edge.tuple;
+    TupleType const& tuple = edge.tuple;
 
     this->feedCount++;
     if (this->feedCount % this->metricInterval == 0) {
@@ -150,9 +180,10 @@ public:
 
     // Generates unique key from key fields
     std::string key = generateKey<keyFields...>(tuple);
-    if (allWindows.count(key) == 0) {
-      auto value = new value_t(N);
-      allWindows[key] = value;
+    auto it = allWindows.find(key);
+    if (it == allWindows.end()) {
+      it = allWindows.emplace(key, new value_t(N)).first;
+      this->numKeys = allWindows.size();
     }
 
     std::string sValue =
@@ -167,14 +198,14 @@ public:
       value = 0;
     }
 
-    allWindows[key]->insert(value);
+    it->second->insert(value);
 
     // Getting the current Jaccard Index and providing that to the featureMap.
-    double currentJaccardIndex = allWindows[key]->getJaccardIndex();
+    double currentJaccardIndex = it->second->getJaccardIndex();
     SingleFeature feature(currentJaccardIndex);
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    notifySubscribers(edge.id, currentJaccardIndex);
+    notifySubscribers(edge, currentJaccardIndex);
 
     return true;
   }
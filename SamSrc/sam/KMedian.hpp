@@ -6,8 +6,15 @@
  * 
  * Author: Dan Allen
  * 
- * Description: Iterate over a sliding window to calculate
- *  "k" disjoint cluster centroids. 
+ * Description: Maintains "k" disjoint cluster centroids over a sliding
+ *  window of the last N values seen for each key.
+ *
+ *  The window is kept in an OrderStatisticTree alongside a ring buffer, so
+ *  adding the newest value and evicting the oldest is O(log N), and any
+ *  order statistic of the window can be read in O(log N).  In one
+ *  dimension we partition the sorted window into k bands of (nearly) equal
+ *  size and use the median of each band as its centroid.  For k = 1 this is
+ *  the median of the window.
  * 
  * Issues:
  *  - Current implementation is only going to work with 1D values.
@@ -21,6 +28,8 @@
 
 #include <iostream>
 #include <map>
+#include <stdexcept>
+#include <vector>
 #include <cmath>
 #include <boost/lexical_cast.hpp>
 #include <sam/AbstractConsumer.hpp>
@@ -28,6 +37,7 @@
 #include <sam/Features.hpp>
 #include <sam/Util.hpp>
 #include <sam/FeatureProducer.hpp>
+#include <sam/OrderStatisticTree.hpp>
 #include <sam/tuples/Edge.hpp>
 
 namespace sam 
@@ -35,43 +45,42 @@ namespace sam
 
   namespace KMedianDetails {
 
+    /**
+     * \throws std::invalid_argument unless 1 <= k <= N, i.e. unless each
+     *   of the k clusters gets at least one item of the window.
+     */
+    inline void checkParameters(size_t N, size_t k) {
+      if (k == 0 || k > N) {
+        throw std::invalid_argument("KMedian: k must be between 1 and N " +
+          boost::lexical_cast<std::string>(N) + ", got " +
+          boost::lexical_cast<std::string>(k));
+      }
+    }
+
     template <typename T>
     class KMedianDataStructure {
     private:
       size_t N;
       size_t k;
-      T* array; // Sliding window of fixed length N
-      T* sortedArray; // Sliding window sorted so median is easy to find
-      T* clusterLabel; // Cluster Label for array[i] is clusterLabel[i]
-      float* kMedianCentroids; // 1 centroid per cluster
-      int current = 0;
-      int kIndex = 0;
+      std::vector<T> array; // Sliding window of fixed length N
+      OrderStatisticTree<T> sorted; // Same items as array, ordered
+      size_t current = 0;
 
     public:
-      KMedianDataStructure(size_t N, size_t k) {
+      KMedianDataStructure(size_t N, size_t k) : array(N, 0) {
+        checkParameters(N, k);
         this->N = N;
         this->k = k;
-        int i;
-        array = new T[N]();
-        for (i = 0; i < N; i++) array[i] = 0;
-        sortedArray = new T[N]();
-        for (i = 0; i < N; i++) sortedArray[i] = 0;
-        kMedianCentroids = new float[k]();
-        for (i = 0; i < k; i++) kMedianCentroids[i] = 0;
-      }
-
-      ~KMedianDataStructure() {
-        delete[] array;
-        delete[] kMedianCentroids;
+        // The window starts out full of zeros.
+        sorted.insert(0, N);
       }
 
       /**
-       * Adds an item, removing an item if need be, and
-       * updating the median
+       * Adds an item, removing the oldest item.
        */
       void insert(T item) {
-        // Debug
-        std::cout << "Insert Item: " << item << std::endl;
+        sorted.erase(array[current]);
+        sorted.insert(item);
 
         // Insert item, overwriting the oldest
         array[current] = item;
@@ -79,35 +88,41 @@ namespace sam
         if (current >= N) {
           current = 0;
         }
+      }
 
-        // TODO: Calculate k-median
-        // 1. Select initial centroid values
-        // 2. Label Nodes based on which centroid is closest
-        // 3. Calculate the next set of centroids
-        // 4. Repeat at step 2 for a fixed amount of iterations
-        //     or until less than some error.
-        // int n = sizeof(sortedArray) / sizeof(sortedArray[0]);
-        // TODO: can we optimize each k separately?
-        int c1, c2;
-        for (kIndex = 0; kIndex < k; kIndex++) {
-          // Sort the array to easily find the median
-          sortedArray = array;
-          std::cout << "Length of Sliding Window: " << N << std::endl;
-          std::sort(sortedArray, sortedArray + N);
-          // Use the average of the middle 2 values if even number elements
-          if (N % 2 == 0) {
-            c1 = sortedArray[(N / 2) - 1];
-            c2 = sortedArray[N / 2]; 
-            kMedianCentroids[kIndex] = (c1 + c2) / 2;
-          } else {
-            kMedianCentroids[kIndex] = sortedArray[(int)(N / 2)];
-          }
-        }    
+      /**
+       * Returns the median of the items with rank in [beg, end).  Uses the 
+       * average of the middle two values if there are an even number 
+       * of elements.
+       */
+      T median(size_t beg, size_t end) const {
+        size_t n = end - beg;
+        if (n % 2 == 0) {
+          T c1 = sorted.select(beg + n / 2 - 1);
+          T c2 = sorted.select(beg + n / 2);
+          return (c1 + c2) / 2;
+        }
+        return sorted.select(beg + n / 2);
+      }
+
+      /**
+       * Returns the centroid of the ith cluster, where clusters are 
+       * numbered in increasing order of their values.
+       */
+      T getCentroid(size_t i) const {
+        return median(i * N / k, (i + 1) * N / k);
+      }
+
+      std::vector<T> getCentroids() const {
+        std::vector<T> centroids;
+        for (size_t i = 0; i < k; i++) {
+          centroids.push_back(getCentroid(i));
+        }
+        return centroids;
       }
 
-      T getKMedian() {
-        // Testing (only works for one k)
-        return kMedianCentroids[0];
+      T getKMedian() const {
+        return median(0, N);
       }
     };
   }
@@ -127,8 +142,18 @@ namespace sam
       size_t N; ///> Size of sliding window
       size_t k; ///> Number of disjoint clusters
       typedef KMedianDetails::KMedianDataStructure<T> value_t;
-      // Store the single sliding window
-      value_t* slidingWindow;
+
+      /// Mapping from the key (e.g. an ip field) to the sliding window
+      /// of values seen for that key.
+      std::map<std::string, value_t*> allWindows;
+
+      value_t const* window(std::string const& key) const {
+        auto it = allWindows.find(key);
+        if (it == allWindows.end()) {
+          throw std::out_of_range("KMedian has no window for key " + key);
+        }
+        return it->second;
+      }
       
     public:
       KMedian(size_t N,
@@ -138,19 +163,21 @@ namespace sam
               std::string identifier) :
         BaseComputation(nodeId, featureMap, identifier) 
       {
+        KMedianDetails::checkParameters(N, k);
+        this->registerMetrics(this->feedCount);
         this->N = N;
         this->k = k;
-        // Build the value type to add to the window
-        slidingWindow = new value_t(N, k); 
       }
 
       ~KMedian()   {
-        delete slidingWindow;
+        for (auto p : allWindows) {
+          delete p.second;
+        }
       }
 
       bool consume(EdgeType const& edge) 
       {
-        TupleType tuple = edge.tuple;
+        TupleType const& tuple = edge.tuple;
 
         this->feedCount++;
         if (this->feedCount % this->metricInterval == 0) {
@@ -160,12 +187,14 @@ namespace sam
 
         // Generates unique key from key fields 
         std::string key = generateKey<keyField>(tuple);
-        std::cout << "Key: " << key << std::endl;
-        
+        auto it = allWindows.find(key);
+        if (it == allWindows.end()) {
+          it = allWindows.emplace(key, new value_t(N, k)).first;
+          this->numKeys = allWindows.size();
+        }
 
         std::string sValue = 
           boost::lexical_cast<std::string>(std::get<valueField>(tuple));
-        std::cout << "Value to Insert: " << sValue << std::endl;
         T value;
         try {
           value = boost::lexical_cast<T>(sValue);
@@ -176,30 +205,41 @@ namespace sam
           value = 0;
         }
 
-        std::cout << "Insert value into slidingWindow" << std::endl;
-        slidingWindow->insert(value);
+        it->second->insert(value);
         
         // Getting the current kmedian and providing that to the featureMap.
-        T currentKMedian = slidingWindow->getKMedian();
+        T currentKMedian = it->second->getKMedian();
         SingleFeature feature(currentKMedian);
         this->featureMap->updateInsert(key, this->identifier, feature);
 
-        notifySubscribers(edge.id, currentKMedian);
+        notifySubscribers(edge, currentKMedian);
 
         return true;
       }
 
-      T getKMedian() {
-        return slidingWindow->getKMedian();
+      /**
+       * Returns the median of the sliding window for the given key.
+       * \throws std::out_of_range If the key has not been seen.
+       */
+      T getKMedian(std::string key) const {
+        return window(key)->getKMedian();
       }
 
-      // std::vector<std::string> keys() const {
-      //   std::vector<std::string> theKeys;
-      //   for (auto p : allWindows) {
-      //     theKeys.push_back(p.first);
-      //   }
-      //   return theKeys;
-      // }
+      /**
+       * Returns the k centroids for the given key in increasing order.
+       * \throws std::out_of_range If the key has not been seen.
+       */
+      std::vector<T> getCentroids(std::string key) const {
+        return window(key)->getCentroids();
+      }
+
+      std::vector<std::string> keys() const {
+        std::vector<std::string> theKeys;
+        for (auto p : allWindows) {
+          theKeys.push_back(p.first);
+        }
+        return theKeys;
+      }
 
       void terminate() {}
   };
@@ -39,7 +39,9 @@ public:
            std::shared_ptr<FeatureMap> featureMap,
            std::string identifier) :
            BaseComputation(nodeId, featureMap, identifier) 
-  {}
+  {
+    this->registerMetrics(this->feedCount);
+  }
 
   bool consume(EdgeType const& edge) 
   {
@@ -52,7 +54,7 @@ public:
     SingleFeature feature(value);
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    this->notifySubscribers(edge.id, value);
+    this->notifySubscribers(edge, value);
     
     return true;
   }
@@ -0,0 +1,162 @@
+#ifndef SAM_LATENCY_TRACING_HPP
+#define SAM_LATENCY_TRACING_HPP
+
+/**
+ * End-to-end latency tracing of sampled edges.
+ *
+ * A data source stamps one in every N edges it reads with the time it
+ * arrived (Edge::ingestTime, nanoseconds since the epoch); the other edges
+ * keep an ingest time of 0 and cost each stage a compare.  The stamp
+ * travels with the edge through ZeroMQPushPull, including across nodes,
+ * and each stage records the time since ingest in the histogram
+ * sam_ingest_latency_seconds{stage="..."}:
+ *  - partition: the edge reaches the consumers of ZeroMQPushPull on the
+ *    node it was partitioned to,
+ *  - operator: an operator computed a feature from the edge,
+ *  - feature_write: FeatureSubscriber wrote the row of the edge,
+ *  - graph_add: GraphStore added the edge to its graph,
+ *  - result_complete: a subgraph query result was completed by the edge,
+ *  - result_print: the printer returned from printing that result,
+ *  - alert: a model scored the row of the edge at or above its threshold
+ *    (ModelScorer).
+ *
+ * Stages on other nodes than the ingest compare clocks of different
+ * machines, so they are only as accurate as the clocks are synchronized.
+ *
+ * Tracing is off until LatencyTracer::setSampleInterval is called with a
+ * non-zero interval, or the SAM_TRACE_INTERVAL environment variable is
+ * set.  The histograms only record while metrics are on (Metrics.hpp), and
+ * edges are only stamped then.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sam/Metrics.hpp>
+
+namespace sam {
+
+enum class TraceStage
+{
+  Partition,
+  Operator,
+  FeatureWrite,
+  GraphAdd,
+  ResultComplete,
+  ResultPrint,
+  Alert,
+  NumStages
+};
+
+namespace LatencyTracingDetails {
+
+static size_t const NumStages = static_cast<size_t>(TraceStage::NumStages);
+
+inline std::atomic<size_t>& sampleInterval()
+{
+  static std::atomic<size_t> interval([]() -> size_t {
+    char const* value = std::getenv("SAM_TRACE_INTERVAL");
+    return value != nullptr ? std::strtoul(value, nullptr, 10) : 0;
+  }());
+  return interval;
+}
+
+inline char const* stageName(TraceStage stage)
+{
+  switch (stage) {
+    case TraceStage::Partition: return "partition";
+    case TraceStage::Operator: return "operator";
+    case TraceStage::FeatureWrite: return "feature_write";
+    case TraceStage::GraphAdd: return "graph_add";
+    case TraceStage::ResultComplete: return "result_complete";
+    case TraceStage::ResultPrint: return "result_print";
+    case TraceStage::Alert: return "alert";
+    default: return "unknown";
+  }
+}
+
+/**
+ * The histograms of the stages.  They live as long as the process.
+ */
+inline std::shared_ptr<LatencyHistogram>* histograms()
+{
+  static std::shared_ptr<LatencyHistogram> stages[NumStages];
+  static std::once_flag once;
+  std::call_once(once, []() {
+    for (size_t i = 0; i < NumStages; i++) {
+      stages[i] = MetricsRegistry::instance().histogram(
+        "sam_ingest_latency_seconds",
+        metricLabels({{"stage", stageName(static_cast<TraceStage>(i))}}),
+        "Time from when a sampled edge was read to each stage");
+    }
+  });
+  return stages;
+}
+
+}
+
+class LatencyTracer
+{
+public:
+  /**
+   * Traces one in every interval edges; 0 traces none.
+   */
+  static void setSampleInterval(size_t interval)
+  {
+    LatencyTracingDetails::sampleInterval().store(interval);
+  }
+
+  static size_t getSampleInterval()
+  {
+    return LatencyTracingDetails::sampleInterval().load(
+      std::memory_order_relaxed);
+  }
+
+  /**
+   * The time in nanoseconds since the epoch.
+   */
+  static int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  /**
+   * Called by a data source for each edge it reads.  Counts the edges per
+   * thread, and returns the ingest time for the edges that are sampled and
+   * 0 for the others.
+   */
+  static int64_t stamp()
+  {
+    size_t interval = getSampleInterval();
+    if (interval == 0 || !metricsEnabled()) return 0;
+    static thread_local size_t count = 0;
+    if (count++ % interval != 0) return 0;
+    return now();
+  }
+
+  /**
+   * Records the time since ingestTime for a stage, unless the edge wasn't
+   * sampled (ingestTime is 0).
+   */
+  static void record(TraceStage stage, int64_t ingestTime)
+  {
+    if (ingestTime == 0) return;
+    int64_t elapsed = now() - ingestTime;
+    histogram(stage).record(elapsed > 0 ? elapsed : 0);
+  }
+
+  static LatencyHistogram& histogram(TraceStage stage)
+  {
+    return *LatencyTracingDetails::histograms()[static_cast<size_t>(stage)];
+  }
+};
+
+}
+
+#endif
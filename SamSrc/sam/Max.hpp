@@ -48,6 +48,7 @@ public:
                           BaseComputation(nodeId, featureMap, identifier) 
                                           
   {
+    this->registerMetrics(this->feedCount);
     this->N = N; 
   }
 
@@ -74,6 +75,7 @@ public:
       auto eh = std::shared_ptr<std::vector<T>>(N); //**
       allWindows[key] = eh;
       position[key] = 0; // empty vector
+      this->numKeys = allWindows.size();
     }
 
     // Update the data structure 
@@ -96,7 +98,7 @@ public:
     // identify the feature.
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    this->notifySubscribers(edge.id, currentMax);
+    this->notifySubscribers(edge, currentMax);
 
     return true;
   }
@@ -0,0 +1,671 @@
+#ifndef SAM_METRICS_HPP
+#define SAM_METRICS_HPP
+
+/**
+ * A registry of runtime metrics: counters, latency histograms and values
+ * read through a function when the metrics are scraped.
+ *
+ * Components create their metrics through MetricsRegistry::instance() and
+ * keep the shared_ptr that comes back.  The registry only holds weak
+ * pointers, so metrics go away with their component, and scrape() sums
+ * the live metrics that share a name and labels (e.g. the GraphStores of
+ * one node created one after the other).
+ *
+ * Metrics are switched on and off at runtime with
+ * MetricsRegistry::setEnabled(), and start out on if the SAM_METRICS
+ * environment variable is set to something other than 0.  While off,
+ * recording a metric is a relaxed atomic load and a branch; a
+ * ScopedTimer doesn't even read the clock.  While on, updates go to one
+ * of METRICS_NUM_SHARDS cache-line sized shards picked per thread, so
+ * threads rarely touch the same cache line, and the shards are only
+ * summed when the metrics are scraped.
+ *
+ * MetricsServer (MetricsServer.hpp) serves scrape() over HTTP in the
+ * Prometheus text format.
+ *
+ * Histograms are HDR-style: values (nanoseconds) below 16 have a bucket
+ * each, and every power of two above is split into 16 buckets, so a
+ * quantile is off by at most 1/16 of its value.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sam/AlignedArray.hpp>
+
+/// The number of shards each counter and histogram is split into.
+#define METRICS_NUM_SHARDS 16
+
+/// Powers of two of nanoseconds a histogram covers; larger values land in
+/// the last bucket.  2^40 ns is about 18 minutes.
+#define METRICS_HISTOGRAM_MAX_EXPONENT 40
+
+namespace sam {
+
+class MetricsException : public std::runtime_error {
+public:
+  MetricsException(char const * message) : std::runtime_error(message) {}
+  MetricsException(std::string message) : std::runtime_error(message) {}
+};
+
+namespace MetricsDetails {
+
+static size_t const CacheLine = 64;
+static size_t const SubBucketBits = 4;
+static size_t const SubBuckets = 1 << SubBucketBits;
+static size_t const NumBuckets =
+  (METRICS_HISTOGRAM_MAX_EXPONENT - SubBucketBits + 2) * SubBuckets;
+
+inline std::atomic<bool>& enabledFlag()
+{
+  static std::atomic<bool> enabled([]() {
+    char const* value = std::getenv("SAM_METRICS");
+    return value != nullptr && std::string(value) != "0";
+  }());
+  return enabled;
+}
+
+/**
+ * The shard of the calling thread.  Threads get the shards round-robin.
+ */
+inline size_t threadShard()
+{
+  static std::atomic<size_t> nextShard(0);
+  static thread_local size_t shard =
+    nextShard.fetch_add(1, std::memory_order_relaxed) % METRICS_NUM_SHARDS;
+  return shard;
+}
+
+inline size_t bucketIndex(uint64_t value)
+{
+  if (value < SubBuckets) return value;
+  size_t exponent = 63 - __builtin_clzll(value);
+  if (exponent > METRICS_HISTOGRAM_MAX_EXPONENT) return NumBuckets - 1;
+  size_t sub = (value >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+  return (exponent - SubBucketBits + 1) * SubBuckets + sub;
+}
+
+/**
+ * The smallest value that lands in the bucket.
+ */
+inline uint64_t bucketLowerBound(size_t index)
+{
+  if (index < SubBuckets) return index;
+  size_t exponent = index / SubBuckets + SubBucketBits - 1;
+  uint64_t sub = index % SubBuckets;
+  return (SubBuckets + sub) << (exponent - SubBucketBits);
+}
+
+/**
+ * The smallest value that lands in the next bucket.
+ */
+inline uint64_t bucketUpperBound(size_t index)
+{
+  return index + 1 < NumBuckets ? bucketLowerBound(index + 1) :
+    bucketLowerBound(index) * 2;
+}
+
+}
+
+/**
+ * Whether metrics are being recorded.
+ */
+inline bool metricsEnabled()
+{
+  return MetricsDetails::enabledFlag().load(std::memory_order_relaxed);
+}
+
+/**
+ * The labels of a metric, formatted as Prometheus does, e.g.
+ * metricLabels({{"node", "0"}}) is node="0".
+ */
+inline std::string metricLabels(
+  std::vector<std::pair<std::string, std::string>> const& labels)
+{
+  std::string str;
+  for (auto const& label : labels) {
+    if (!str.empty()) str += ",";
+    str += label.first + "=\"";
+    for (char c : label.second) {
+      if (c == '\n') {
+        str += "\\n";
+      } else {
+        if (c == '\\' || c == '"') str += '\\';
+        str += c;
+      }
+    }
+    str += "\"";
+  }
+  return str;
+}
+
+/**
+ * A count kept by a single thread and read by others, e.g. by a scrape.
+ * Unlike Counter it counts whether metrics are on or not, and adding to
+ * it is a plain load and store, no more than adding to a size_t.
+ */
+class SingleWriterCounter
+{
+private:
+  std::atomic<size_t> count;
+
+public:
+  SingleWriterCounter(size_t count = 0) : count(count) {}
+  SingleWriterCounter(SingleWriterCounter const& other) :
+    count(other.value()) {}
+
+  SingleWriterCounter& operator=(SingleWriterCounter const& other)
+  {
+    count.store(other.value(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  SingleWriterCounter& operator+=(size_t n)
+  {
+    count.store(count.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    return *this;
+  }
+
+  SingleWriterCounter& operator++() { return *this += 1; }
+
+  size_t operator++(int)
+  {
+    size_t before = value();
+    *this += 1;
+    return before;
+  }
+
+  size_t value() const { return count.load(std::memory_order_relaxed); }
+
+  operator size_t() const { return value(); }
+};
+
+/**
+ * A count that only goes up.
+ */
+class Counter
+{
+private:
+  struct alignas(MetricsDetails::CacheLine) Shard
+  {
+    std::atomic<uint64_t> value;
+    Shard() : value(0) {}
+  };
+  AlignedArray<Shard> shards;
+
+public:
+  Counter() : shards(makeAlignedArray<Shard>(METRICS_NUM_SHARDS)) {}
+
+  void add(uint64_t n = 1)
+  {
+    if (!metricsEnabled()) return;
+    shards[MetricsDetails::threadShard()].value.fetch_add(n,
+      std::memory_order_relaxed);
+  }
+
+  uint64_t value() const
+  {
+    uint64_t total = 0;
+    for (size_t s = 0; s < METRICS_NUM_SHARDS; s++) {
+      total += shards[s].value.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+};
+
+/**
+ * The contents of a histogram at one point in time.  Values are in
+ * nanoseconds.
+ */
+struct HistogramSnapshot
+{
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  std::vector<uint64_t> buckets =
+    std::vector<uint64_t>(MetricsDetails::NumBuckets, 0);
+
+  HistogramSnapshot& operator+=(HistogramSnapshot const& other)
+  {
+    count += other.count;
+    sum += other.sum;
+    for (size_t i = 0; i < buckets.size(); i++) {
+      buckets[i] += other.buckets[i];
+    }
+    return *this;
+  }
+
+  /**
+   * Takes away an earlier snapshot of the same histogram, leaving what was
+   * recorded in between.
+   */
+  HistogramSnapshot& operator-=(HistogramSnapshot const& earlier)
+  {
+    count -= earlier.count;
+    sum -= earlier.sum;
+    for (size_t i = 0; i < buckets.size(); i++) {
+      buckets[i] -= earlier.buckets[i];
+    }
+    return *this;
+  }
+
+  double mean() const { return count == 0 ? 0 : sum / (double) count; }
+
+  /**
+   * The value below which fraction q of the values fall, as the middle
+   * of the bucket holding it.  0 if the histogram is empty.
+   */
+  double quantile(double q) const
+  {
+    if (count == 0) return 0;
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(q * count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+      seen += buckets[i];
+      if (seen >= rank) {
+        return (MetricsDetails::bucketLowerBound(i) +
+                MetricsDetails::bucketUpperBound(i) - 1) / 2.0;
+      }
+    }
+    return MetricsDetails::bucketLowerBound(buckets.size() - 1);
+  }
+
+  /**
+   * The upper bound of the highest non-empty bucket.
+   */
+  double max() const
+  {
+    for (size_t i = buckets.size(); i > 0; i--) {
+      if (buckets[i - 1] > 0) {
+        return MetricsDetails::bucketUpperBound(i - 1);
+      }
+    }
+    return 0;
+  }
+};
+
+/**
+ * A histogram of durations in nanoseconds.
+ */
+class LatencyHistogram
+{
+private:
+  struct alignas(MetricsDetails::CacheLine) Shard
+  {
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> buckets[MetricsDetails::NumBuckets];
+
+    Shard() : sum(0) {
+      for (auto& bucket : buckets) bucket.store(0);
+    }
+  };
+  AlignedArray<Shard> shards;
+
+public:
+  LatencyHistogram() : shards(makeAlignedArray<Shard>(METRICS_NUM_SHARDS)) {}
+
+  void record(uint64_t nanos)
+  {
+    if (!metricsEnabled()) return;
+    Shard& shard = shards[MetricsDetails::threadShard()];
+    shard.buckets[MetricsDetails::bucketIndex(nanos)].fetch_add(1,
+      std::memory_order_relaxed);
+    shard.sum.fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+  HistogramSnapshot snapshot() const
+  {
+    HistogramSnapshot snapshot;
+    for (size_t s = 0; s < METRICS_NUM_SHARDS; s++) {
+      snapshot.sum += shards[s].sum.load(std::memory_order_relaxed);
+      for (size_t i = 0; i < MetricsDetails::NumBuckets; i++) {
+        uint64_t n = shards[s].buckets[i].load(std::memory_order_relaxed);
+        snapshot.buckets[i] += n;
+        snapshot.count += n;
+      }
+    }
+    return snapshot;
+  }
+
+  /**
+   * The sum of the durations recorded, in seconds.
+   */
+  double totalSeconds() const
+  {
+    uint64_t sum = 0;
+    for (size_t s = 0; s < METRICS_NUM_SHARDS; s++) {
+      sum += shards[s].sum.load(std::memory_order_relaxed);
+    }
+    return sum / 1e9;
+  }
+};
+
+/**
+ * Records the time from its construction to its destruction (or to
+ * stop()) in a histogram.  If metrics are off when it is constructed, it
+ * does nothing.
+ */
+class ScopedTimer
+{
+private:
+  LatencyHistogram* histogram;
+  std::chrono::steady_clock::time_point begin;
+
+public:
+  ScopedTimer(LatencyHistogram& histogram) :
+    histogram(metricsEnabled() ? &histogram : nullptr)
+  {
+    if (this->histogram) begin = std::chrono::steady_clock::now();
+  }
+
+  ScopedTimer(std::shared_ptr<LatencyHistogram> const& histogram) :
+    ScopedTimer(*histogram) {}
+
+  ~ScopedTimer() { stop(); }
+
+  /**
+   * Records the time now rather than on destruction.
+   */
+  void stop()
+  {
+    if (histogram) {
+      histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count());
+      histogram = nullptr;
+    }
+  }
+
+  ScopedTimer(ScopedTimer const&) = delete;
+  ScopedTimer& operator=(ScopedTimer const&) = delete;
+};
+
+enum class MetricKind
+{
+  Counter,  ///> Only goes up
+  Gauge,    ///> Goes up and down
+  Histogram ///> Durations in nanoseconds
+};
+
+/**
+ * A value that is read with a function when the metrics are scraped, for
+ * counts a component keeps anyway.  Such values are reported whether
+ * metrics are on or not.  The value stops being reported when this object
+ * is destroyed, which waits for a scrape calling the function to finish,
+ * so the function may use the component that owns this object.
+ */
+class CallbackMetric
+{
+private:
+  friend class MetricsRegistry;
+
+  struct State
+  {
+    std::mutex mutex;
+    std::function<double()> function; ///> Empty once unregistered
+  };
+  std::shared_ptr<State> state;
+
+  CallbackMetric(std::function<double()> function) : state(new State())
+  {
+    state->function = function;
+  }
+
+public:
+  ~CallbackMetric()
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->function = nullptr;
+  }
+
+  CallbackMetric(CallbackMetric const&) = delete;
+  CallbackMetric& operator=(CallbackMetric const&) = delete;
+};
+
+/**
+ * One metric as scraped: the sum over the live metrics with its name and
+ * labels.
+ */
+struct MetricSnapshot
+{
+  std::string name;
+  std::string labels; ///> As formatted by metricLabels
+  std::string help;
+  MetricKind kind;
+  double value = 0; ///> For counters and gauges
+  HistogramSnapshot histogram; ///> For histograms
+};
+
+class MetricsRegistry
+{
+private:
+  struct Entry
+  {
+    std::string name;
+    std::string labels;
+    std::string help;
+    MetricKind kind;
+    std::weak_ptr<Counter> counter;
+    std::weak_ptr<LatencyHistogram> histogram;
+    std::shared_ptr<CallbackMetric::State> callback;
+
+    Entry(std::string const& name, std::string const& labels,
+          std::string const& help, MetricKind kind) :
+      name(name), labels(labels), help(help), kind(kind) {}
+  };
+
+  mutable std::mutex mutex;
+  mutable std::vector<Entry> entries;
+
+  MetricsRegistry() {}
+
+  void add(Entry entry)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto const& other : entries) {
+      if (other.name == entry.name && other.kind != entry.kind) {
+        throw MetricsException("Metric " + entry.name +
+          " is already registered as another kind");
+      }
+    }
+    entries.push_back(entry);
+  }
+
+public:
+  static MetricsRegistry& instance()
+  {
+    static MetricsRegistry registry;
+    return registry;
+  }
+
+  static void setEnabled(bool enabled)
+  {
+    MetricsDetails::enabledFlag().store(enabled);
+  }
+
+  static bool isEnabled() { return metricsEnabled(); }
+
+  /**
+   * Creates a counter.
+   * \param name The name, e.g. sam_graph_store_edges_total.
+   * \param labels The labels as formatted by metricLabels.
+   * \param help What it counts.
+   * \throws MetricsException if the name is taken by another kind of
+   *   metric.
+   */
+  std::shared_ptr<Counter> counter(std::string const& name,
+                                   std::string const& labels,
+                                   std::string const& help)
+  {
+    auto counter = std::make_shared<Counter>();
+    Entry entry(name, labels, help, MetricKind::Counter);
+    entry.counter = counter;
+    add(entry);
+    return counter;
+  }
+
+  /**
+   * Creates a latency histogram.  The parameters are those of counter().
+   */
+  std::shared_ptr<LatencyHistogram> histogram(std::string const& name,
+                                              std::string const& labels,
+                                              std::string const& help)
+  {
+    auto histogram = std::make_shared<LatencyHistogram>();
+    Entry entry(name, labels, help, MetricKind::Histogram);
+    entry.histogram = histogram;
+    add(entry);
+    return histogram;
+  }
+
+  /**
+   * Registers a counter or gauge read with function when scraped.  It is
+   * reported as long as the returned object is alive.  The other
+   * parameters are those of counter().
+   */
+  std::unique_ptr<CallbackMetric> callback(std::string const& name,
+                                           std::string const& labels,
+                                           std::string const& help,
+                                           MetricKind kind,
+                                           std::function<double()> function)
+  {
+    if (kind == MetricKind::Histogram) {
+      throw MetricsException("Callback metric " + name +
+        " can't be a histogram");
+    }
+    std::unique_ptr<CallbackMetric> callback(new CallbackMetric(function));
+    Entry entry(name, labels, help, kind);
+    entry.callback = callback->state;
+    add(entry);
+    return callback;
+  }
+
+  /**
+   * Reads every live metric, summing those with the same name and labels.
+   * The result is sorted by name and labels.
+   */
+  std::vector<MetricSnapshot> scrape() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::pair<std::string, std::string>, MetricSnapshot> merged;
+    std::vector<Entry> live;
+    for (auto const& entry : entries) {
+      auto counter = entry.counter.lock();
+      auto histogram = entry.histogram.lock();
+      double callbackValue = 0;
+      bool callback = false;
+      if (entry.callback) {
+        std::lock_guard<std::mutex> callbackLock(entry.callback->mutex);
+        if (entry.callback->function) {
+          callbackValue = entry.callback->function();
+          callback = true;
+        }
+      }
+      if (!counter && !histogram && !callback) continue;
+      live.push_back(entry);
+
+      auto key = std::make_pair(entry.name, entry.labels);
+      auto it = merged.find(key);
+      if (it == merged.end()) {
+        MetricSnapshot snapshot;
+        snapshot.name = entry.name;
+        snapshot.labels = entry.labels;
+        snapshot.help = entry.help;
+        snapshot.kind = entry.kind;
+        it = merged.insert(std::make_pair(key, snapshot)).first;
+      }
+      if (counter) it->second.value += counter->value();
+      if (callback) it->second.value += callbackValue;
+      if (histogram) it->second.histogram += histogram->snapshot();
+    }
+    entries.swap(live);
+
+    std::vector<MetricSnapshot> snapshots;
+    for (auto& pair : merged) snapshots.push_back(std::move(pair.second));
+    return snapshots;
+  }
+
+  /**
+   * scrape() in the Prometheus text format.  Histograms are reported in
+   * seconds, with a bucket per power of two nanoseconds.
+   */
+  std::string prometheus() const
+  {
+    using namespace MetricsDetails;
+    std::ostringstream out;
+    out.precision(15);
+    std::string previousName;
+    for (auto const& metric : scrape()) {
+      if (metric.name != previousName) {
+        char const* type = metric.kind == MetricKind::Counter ? "counter" :
+          metric.kind == MetricKind::Gauge ? "gauge" : "histogram";
+        out << "# HELP " << metric.name << " " << metric.help << "\n"
+            << "# TYPE " << metric.name << " " << type << "\n";
+        previousName = metric.name;
+      }
+      std::string labels = metric.labels.empty() ? "" :
+        "{" + metric.labels + "}";
+      if (metric.kind != MetricKind::Histogram) {
+        out << metric.name << labels << " " << metric.value << "\n";
+        continue;
+      }
+
+      HistogramSnapshot const& h = metric.histogram;
+      std::string prefix = metric.labels.empty() ? "{" :
+        "{" + metric.labels + ",";
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i + 1 < NumBuckets; i++) {
+        cumulative += h.buckets[i];
+        if ((i + 1) % SubBuckets == 0) {
+          out << metric.name << "_bucket" << prefix << "le=\""
+              << bucketUpperBound(i) / 1e9 << "\"} " << cumulative << "\n";
+        }
+      }
+      out << metric.name << "_bucket" << prefix << "le=\"+Inf\"} "
+          << h.count << "\n"
+          << metric.name << "_sum" << labels << " " << h.sum / 1e9 << "\n"
+          << metric.name << "_count" << labels << " " << h.count << "\n";
+    }
+    return out.str();
+  }
+
+  /**
+   * A human readable dump of scrape(): one line per metric, with the
+   * count, mean, median, 99th percentile and max of histograms in
+   * microseconds.
+   */
+  std::string report() const
+  {
+    std::ostringstream out;
+    for (auto const& metric : scrape()) {
+      out << metric.name;
+      if (!metric.labels.empty()) out << "{" << metric.labels << "}";
+      if (metric.kind == MetricKind::Histogram) {
+        HistogramSnapshot const& h = metric.histogram;
+        out << " count " << h.count
+            << " mean_us " << h.mean() / 1e3
+            << " p50_us " << h.quantile(0.5) / 1e3
+            << " p99_us " << h.quantile(0.99) / 1e3
+            << " max_us " << h.max() / 1e3;
+      } else {
+        out << " " << metric.value;
+      }
+      out << "\n";
+    }
+    return out.str();
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef SAM_METRICS_SERVER_HPP
+#define SAM_METRICS_SERVER_HPP
+
+/**
+ * A minimal HTTP server that lets Prometheus (or curl) scrape the metrics
+ * of a running node.  GET /metrics returns MetricsRegistry::prometheus().
+ *
+ * The server has a single thread that accepts one connection at a time,
+ * answers it and closes it.  It only reads the metrics, which are atomics
+ * or callbacks reading atomics, so serving doesn't slow down the threads
+ * processing tuples.  By default it listens on 127.0.0.1 only.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <sam/Metrics.hpp>
+
+/// How often in ms the server thread checks whether it was stopped.
+#define METRICS_SERVER_POLL_TIMEOUT 100
+
+/// The longest request, in bytes, the server reads.
+#define METRICS_SERVER_MAX_REQUEST 8192
+
+/// How long in ms a client has to send its request and take the response.
+/// A client that is slower, e.g. one that stops reading, is dropped, so it
+/// can't hold up the server thread or stop.
+#define METRICS_SERVER_CONNECTION_TIMEOUT 1000
+
+namespace sam {
+
+class MetricsServer
+{
+private:
+  std::string ip; ///> Address to listen on
+  int port; ///> Requested port; 0 picks a free port
+  int boundPort = 0; ///> The port actually listened on
+  int sockfd = -1;
+  std::atomic<bool> running;
+  std::atomic<size_t> numRequests; ///> Requests answered
+  std::thread thread;
+
+public:
+  /**
+   * \param port The port to listen on.  0 listens on a free port; see
+   *   getPort.
+   * \param ip The address to listen on.
+   */
+  MetricsServer(int port, std::string ip = "127.0.0.1") :
+    ip(ip), port(port), running(false), numRequests(0)
+  {}
+
+  ~MetricsServer()
+  {
+    stop();
+  }
+
+  MetricsServer(MetricsServer const&) = delete;
+  MetricsServer& operator=(MetricsServer const&) = delete;
+
+  /**
+   * Binds the socket and starts the server thread.
+   * \throws MetricsException if the socket couldn't be created or bound.
+   */
+  void start()
+  {
+    if (running) return;
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) != 1) {
+      throw MetricsException("MetricsServer: invalid address " + ip);
+    }
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+      throw MetricsException(std::string("MetricsServer: error opening "
+        "socket: ") + strerror(errno));
+    }
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(sockfd, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+        listen(sockfd, 16) < 0)
+    {
+      std::string error = strerror(errno);
+      close(sockfd);
+      sockfd = -1;
+      throw MetricsException("MetricsServer: couldn't listen on " + ip + ":" +
+        std::to_string(port) + ": " + error);
+    }
+
+    struct sockaddr_in bound;
+    socklen_t boundLength = sizeof(bound);
+    getsockname(sockfd, (struct sockaddr *) &bound, &boundLength);
+    boundPort = ntohs(bound.sin_port);
+
+    running = true;
+    thread = std::thread([this]() { serve(); });
+  }
+
+  /**
+   * Stops the server thread and closes the socket.  Returns within
+   * METRICS_SERVER_POLL_TIMEOUT ms, or once the request being answered is
+   * done, which takes at most METRICS_SERVER_CONNECTION_TIMEOUT ms.
+   */
+  void stop()
+  {
+    running = false;
+    if (thread.joinable()) thread.join();
+    if (sockfd >= 0) {
+      close(sockfd);
+      sockfd = -1;
+    }
+  }
+
+  /**
+   * The port listened on.  Only valid after start.
+   */
+  int getPort() const { return boundPort; }
+
+  size_t getNumRequests() const { return numRequests; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  void serve()
+  {
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    while (running) {
+      if (poll(&pfd, 1, METRICS_SERVER_POLL_TIMEOUT) <= 0) continue;
+      int connection = accept(sockfd, nullptr, nullptr);
+      if (connection < 0) continue;
+      answer(connection);
+      close(connection);
+    }
+  }
+
+  /**
+   * Reads the request line and headers of one request and answers it.
+   */
+  void answer(int connection)
+  {
+    Clock::time_point deadline = Clock::now() +
+      std::chrono::milliseconds(METRICS_SERVER_CONNECTION_TIMEOUT);
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < METRICS_SERVER_MAX_REQUEST &&
+           waitFor(connection, POLLIN, deadline))
+    {
+      ssize_t n = recv(connection, buffer, sizeof(buffer), MSG_DONTWAIT);
+      if (n <= 0) break;
+      request.append(buffer, n);
+    }
+
+    std::string line = request.substr(0, request.find("\r\n"));
+    std::string method = line.substr(0, line.find(' '));
+    std::string path = line.size() > method.size() ?
+      line.substr(method.size() + 1) : "";
+    path = path.substr(0, path.find(' '));
+    path = path.substr(0, path.find('?'));
+
+    if (method != "GET" && method != "HEAD") {
+      respond(connection, "405 Method Not Allowed", "text/plain",
+              "Only GET is supported\n", true, deadline);
+    } else if (path == "/metrics") {
+      respond(connection, "200 OK", "text/plain; version=0.0.4",
+              MetricsRegistry::instance().prometheus(), method == "GET",
+              deadline);
+    } else {
+      respond(connection, "404 Not Found", "text/plain",
+              "Metrics are at /metrics\n", method == "GET", deadline);
+    }
+    numRequests++;
+  }
+
+  void respond(int connection, std::string const& status,
+               std::string const& contentType, std::string const& body,
+               bool withBody, Clock::time_point deadline)
+  {
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+      "Content-Type: " + contentType + "\r\n"
+      "Content-Length: " + std::to_string(body.size()) + "\r\n"
+      "Connection: close\r\n\r\n";
+    if (withBody) response += body;
+
+    size_t sent = 0;
+    while (sent < response.size() && waitFor(connection, POLLOUT, deadline)) {
+      ssize_t n = send(connection, response.data() + sent,
+                       response.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (n <= 0) return;
+      sent += n;
+    }
+  }
+
+  /**
+   * Waits until the connection is ready for events (POLLIN or POLLOUT).
+   * \return Returns false if the deadline passed first or the connection
+   *   failed.
+   */
+  static bool waitFor(int connection, short events,
+                      Clock::time_point deadline)
+  {
+    struct pollfd pfd;
+    pfd.fd = connection;
+    pfd.events = events;
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - Clock::now()).count();
+    return remaining > 0 && poll(&pfd, 1, remaining) > 0 &&
+           (pfd.revents & events);
+  }
+};
+
+}
+
+#endif
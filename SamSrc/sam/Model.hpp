@@ -0,0 +1,530 @@
+#ifndef SAM_MODEL_HPP
+#define SAM_MODEL_HPP
+
+/**
+ * Models that score feature rows, loaded from a text file written by
+ * scripts/export_model.py.  The file starts with the kind of model, and
+ * each further line is a keyword followed by its values; lines starting
+ * with # are comments.  For example:
+ *
+ *   logistic_regression
+ *   features aveSrcBytes varSrcBytes numDests
+ *   threshold 0.9
+ *   intercept -4.2
+ *   weights 0.01 0.002 1.5
+ *
+ *   naive_bayes
+ *   features aveSrcBytes varSrcBytes
+ *   threshold 0.5
+ *   priors 0.99 0.01
+ *   means0 120 3000
+ *   variances0 40 900
+ *   means1 5000 10
+ *   variances1 2000 5
+ *
+ *   tree_ensemble
+ *   features aveSrcBytes numDests
+ *   link logistic
+ *   base_score -2.1
+ *   roots 0 3
+ *   nodes 1 4.5 1 2
+ *   nodes -1 -0.3 -1 -1
+ *   nodes -1 0.8 -1 -1
+ *   nodes -1 0.1 -1 -1
+ *
+ * The nodes of a tree ensemble are "feature threshold left right", where
+ * feature is an index into features and a row goes left when its value is
+ * at most the threshold, or "-1 value -1 -1" for a leaf.  The score is the
+ * link function (identity or logistic) of base_score plus the values of the
+ * leaves the row reaches.
+ *
+ * A score is the probability that the row is of the positive class (1).
+ * Models score a batch at a time, with the batch stored column by column
+ * so that the loops over rows read contiguous memory.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Rows a tree ensemble walks down its trees together.
+#define TREE_ENSEMBLE_BLOCK_ROWS 64
+
+namespace sam {
+
+class ModelException : public std::runtime_error {
+public:
+  ModelException(char const * message) : std::runtime_error(message) { }
+  ModelException(std::string message) : std::runtime_error(message) { }
+};
+
+/**
+ * The keyword lines of a model file.
+ */
+class ModelDescription
+{
+public:
+  std::string kind;
+
+  /**
+   * Reads a model file.  Throws ModelException if it can't be read.
+   */
+  explicit ModelDescription(std::string const& path);
+
+  /**
+   * Reads a model from a stream.
+   * \param in The model.
+   * \param name What error messages call the model.
+   */
+  ModelDescription(std::istream& in, std::string const& name);
+
+  bool has(std::string const& keyword) const
+  {
+    return lines.count(keyword) > 0;
+  }
+
+  std::vector<std::string> const& strings(std::string const& keyword) const;
+
+  std::vector<double> numbers(std::string const& keyword) const;
+
+  /**
+   * The numbers of a keyword, which must have exactly n of them.
+   */
+  std::vector<double> numbers(std::string const& keyword, size_t n) const;
+
+  double number(std::string const& keyword) const
+  {
+    return numbers(keyword, 1)[0];
+  }
+
+private:
+  std::string path;
+  /// The values of each keyword; a repeated keyword appends to them.
+  std::map<std::string, std::vector<std::string>> lines;
+
+  void read(std::istream& in);
+};
+
+inline
+ModelDescription::ModelDescription(std::string const& path) : path(path)
+{
+  std::ifstream in(path);
+  if (!in) {
+    throw ModelException("Could not open model file " + path);
+  }
+  read(in);
+}
+
+inline
+ModelDescription::ModelDescription(std::istream& in, std::string const& name)
+  : path(name)
+{
+  read(in);
+}
+
+inline
+void ModelDescription::read(std::istream& in)
+{
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream tokens(line);
+    std::string keyword;
+    if (!(tokens >> keyword) || keyword[0] == '#') continue;
+    if (kind.empty()) {
+      kind = keyword;
+      continue;
+    }
+    std::vector<std::string>& values = lines[keyword];
+    std::string value;
+    while (tokens >> value) values.push_back(value);
+  }
+  if (kind.empty()) {
+    throw ModelException("Model file " + path + " is empty");
+  }
+}
+
+inline
+std::vector<std::string> const&
+ModelDescription::strings(std::string const& keyword) const
+{
+  auto it = lines.find(keyword);
+  if (it == lines.end()) {
+    throw ModelException("Model file " + path + " has no " + keyword);
+  }
+  return it->second;
+}
+
+inline
+std::vector<double> ModelDescription::numbers(std::string const& keyword) const
+{
+  std::vector<double> values;
+  for (auto const& value : strings(keyword)) {
+    try {
+      values.push_back(std::stod(value));
+    } catch (std::exception const&) {
+      throw ModelException("Model file " + path + ": " + keyword +
+        " has a value that is not a number: " + value);
+    }
+  }
+  return values;
+}
+
+inline
+std::vector<double> ModelDescription::numbers(std::string const& keyword,
+                                              size_t n) const
+{
+  std::vector<double> values = numbers(keyword);
+  if (values.size() != n) {
+    throw ModelException("Model file " + path + ": " + keyword + " has " +
+      std::to_string(values.size()) + " values, expected " +
+      std::to_string(n));
+  }
+  return values;
+}
+
+class AbstractModel
+{
+public:
+  explicit AbstractModel(ModelDescription const& description) :
+    featureNames(description.strings("features")),
+    threshold(description.has("threshold") ?
+              description.number("threshold") : 0.5)
+  {
+    if (featureNames.empty()) {
+      throw ModelException("A model needs at least one feature");
+    }
+  }
+
+  virtual ~AbstractModel() {}
+
+  /**
+   * The features the model uses, in the order score expects them.
+   */
+  std::vector<std::string> const& getFeatureNames() const
+  {
+    return featureNames;
+  }
+
+  size_t getNumFeatures() const { return featureNames.size(); }
+
+  /**
+   * Rows scoring at or above the threshold are alerts.
+   */
+  double getThreshold() const { return threshold; }
+  void setThreshold(double threshold) { this->threshold = threshold; }
+
+  /**
+   * Scores a batch of n rows.
+   * \param columns Feature j of row i is at columns[j * stride + i].
+   * \param stride The distance between the columns, at least n.
+   * \param n The number of rows.
+   * \param scores Gets the n scores.
+   */
+  virtual void score(double const* columns, size_t stride, size_t n,
+                     double* scores) const = 0;
+
+protected:
+  std::vector<std::string> featureNames;
+  double threshold;
+};
+
+/**
+ * Binary logistic regression: 1 / (1 + exp(-(intercept + weights . x))).
+ */
+class LogisticRegressionModel : public AbstractModel
+{
+public:
+  explicit LogisticRegressionModel(ModelDescription const& description) :
+    AbstractModel(description),
+    intercept(description.number("intercept")),
+    weights(description.numbers("weights", featureNames.size()))
+  {}
+
+  void score(double const* columns, size_t stride, size_t n,
+             double* scores) const
+  {
+    for (size_t i = 0; i < n; i++) {
+      scores[i] = intercept;
+    }
+    for (size_t j = 0; j < weights.size(); j++) {
+      double w = weights[j];
+      double const* column = columns + j * stride;
+      for (size_t i = 0; i < n; i++) {
+        scores[i] += w * column[i];
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      scores[i] = 1 / (1 + std::exp(-scores[i]));
+    }
+  }
+
+private:
+  double intercept;
+  std::vector<double> weights;
+};
+
+/**
+ * Gaussian naive Bayes with two classes.
+ */
+class NaiveBayesModel : public AbstractModel
+{
+public:
+  explicit NaiveBayesModel(ModelDescription const& description) :
+    AbstractModel(description)
+  {
+    size_t numFeatures = featureNames.size();
+    std::vector<double> priors = description.numbers("priors", 2);
+    for (size_t c = 0; c < 2; c++) {
+      std::vector<double> means = description.numbers(
+        "means" + std::to_string(c), numFeatures);
+      std::vector<double> variances = description.numbers(
+        "variances" + std::to_string(c), numFeatures);
+      if (priors[c] <= 0) {
+        throw ModelException("Naive Bayes priors must be positive");
+      }
+      // log p(x_j | c) = scale_j * (x_j - mean_j)^2 + log(1/sqrt(2 pi var))
+      logConstant[c] = std::log(priors[c]);
+      for (size_t j = 0; j < numFeatures; j++) {
+        if (variances[j] <= 0) {
+          throw ModelException("Naive Bayes variances must be positive");
+        }
+        this->means[c].push_back(means[j]);
+        scales[c].push_back(-0.5 / variances[j]);
+        logConstant[c] -= 0.5 * std::log(2 * M_PI * variances[j]);
+      }
+    }
+  }
+
+  void score(double const* columns, size_t stride, size_t n,
+             double* scores) const
+  {
+    // scores holds log p(1, x) - log p(0, x) until the end.
+    for (size_t i = 0; i < n; i++) {
+      scores[i] = logConstant[1] - logConstant[0];
+    }
+    for (size_t j = 0; j < featureNames.size(); j++) {
+      double const* column = columns + j * stride;
+      double mean0 = means[0][j], mean1 = means[1][j];
+      double scale0 = scales[0][j], scale1 = scales[1][j];
+      for (size_t i = 0; i < n; i++) {
+        double d0 = column[i] - mean0;
+        double d1 = column[i] - mean1;
+        scores[i] += scale1 * d1 * d1 - scale0 * d0 * d0;
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      scores[i] = 1 / (1 + std::exp(-scores[i]));
+    }
+  }
+
+private:
+  std::vector<double> means[2];
+  std::vector<double> scales[2];
+  double logConstant[2];
+};
+
+/**
+ * An ensemble of decision trees (a random forest or gradient boosted trees),
+ * compiled into flat arrays for scoring batches.
+ *
+ * The nodes of all trees are stored tree by tree in breadth-first order,
+ * with the two children of a node next to each other, so a row at node k
+ * moves to lefts[k] + (x > thresholds[k]) without a branch.  A leaf points
+ * to itself with an infinite threshold, which lets every row take the same
+ * number of steps down a tree (its depth).  A block of rows walks a tree
+ * level by level.  The steps of different rows don't depend on one
+ * another, so the CPU overlaps their loads, but each step is a scalar
+ * indirect load: the loop doesn't vectorize without gathers, and with
+ * AVX2 gathers (-march=native) it measured slower than the scalar loop.
+ *
+ * The cost per row is about the number of trees times their depth.
+ * BM_TreeEnsembleScore, on one core with batches of 64 rows, gives roughly
+ *   100 trees of depth 4: 1.05 to 1.15 million rows/s
+ *   100 trees of depth 8: 0.65 million rows/s
+ *   500 trees: 0.1 to 0.25 million rows/s, depending on depth
+ * ModelScorer scores each batch on the thread that fills it, so more
+ * feature threads score more rows; beyond that, fewer or shallower trees
+ * are the way to keep up with a fast stream.
+ */
+class TreeEnsembleModel : public AbstractModel
+{
+public:
+  explicit TreeEnsembleModel(ModelDescription const& description);
+
+  void score(double const* columns, size_t stride, size_t n,
+             double* scores) const;
+
+  size_t getNumTrees() const { return roots.size(); }
+  size_t getNumNodes() const { return lefts.size(); }
+
+private:
+  std::vector<int32_t> features;
+  std::vector<double> thresholds;
+  std::vector<int32_t> lefts;
+  std::vector<double> values; ///> The value of each leaf, 0 for the others
+
+  std::vector<int32_t> roots;
+  std::vector<size_t> depths; ///> Steps from the root to the deepest leaf
+
+  double baseScore;
+  bool logistic; ///> Whether the link function is logistic or identity
+};
+
+inline
+TreeEnsembleModel::TreeEnsembleModel(ModelDescription const& description) :
+  AbstractModel(description),
+  baseScore(description.has("base_score") ?
+            description.number("base_score") : 0)
+{
+  std::string link = description.has("link") ?
+                     description.strings("link").at(0) : "identity";
+  if (link != "identity" && link != "logistic") {
+    throw ModelException("Unknown link " + link +
+                         "; expected identity or logistic");
+  }
+  logistic = (link == "logistic");
+
+  std::vector<double> nodes = description.numbers("nodes");
+  if (nodes.empty() || nodes.size() % 4 != 0) {
+    throw ModelException("The nodes of a tree ensemble need four values "
+                         "each");
+  }
+  long numNodes = nodes.size() / 4;
+  std::vector<bool> visited(numNodes, false);
+
+  auto checkIndex = [numNodes](double index) {
+    if (index < 0 || index >= numNodes || index != (long) index) {
+      throw ModelException("Tree node " + std::to_string(index) +
+                           " does not exist");
+    }
+    return (long) index;
+  };
+
+  // Lays out each tree breadth first.  Each queued node has its place in the
+  // compiled arrays already, so its children can be given two places next
+  // to each other.
+  for (double root : description.numbers("roots")) {
+    struct Queued { long node; size_t place; size_t depth; };
+    std::deque<Queued> queue;
+    queue.push_back({checkIndex(root), lefts.size(), 0});
+    roots.push_back(lefts.size());
+    lefts.push_back(0);
+    features.push_back(0);
+    thresholds.push_back(0);
+    values.push_back(0);
+    size_t depth = 0;
+
+    while (!queue.empty()) {
+      Queued queued = queue.front();
+      queue.pop_front();
+      if (visited[queued.node]) {
+        throw ModelException("Tree node " + std::to_string(queued.node) +
+                             " is reached more than once");
+      }
+      visited[queued.node] = true;
+      depth = std::max(depth, queued.depth);
+
+      double const* node = &nodes[4 * queued.node];
+      size_t place = queued.place;
+      if (node[0] == -1) {
+        features[place] = 0;
+        thresholds[place] = std::numeric_limits<double>::infinity();
+        lefts[place] = place;
+        values[place] = node[1];
+      } else {
+        if (node[0] < 0 || node[0] >= featureNames.size() ||
+            node[0] != (long) node[0]) {
+          throw ModelException("Tree node " + std::to_string(queued.node) +
+                               " splits on a feature that does not exist");
+        }
+        size_t left = lefts.size();
+        features[place] = node[0];
+        thresholds[place] = node[1];
+        lefts[place] = left;
+        lefts.resize(left + 2);
+        features.resize(left + 2);
+        thresholds.resize(left + 2);
+        values.resize(left + 2);
+        queue.push_back({checkIndex(node[2]), left, queued.depth + 1});
+        queue.push_back({checkIndex(node[3]), left + 1, queued.depth + 1});
+      }
+    }
+    depths.push_back(depth);
+  }
+  if (roots.empty()) {
+    throw ModelException("A tree ensemble needs at least one tree");
+  }
+}
+
+inline
+void TreeEnsembleModel::score(double const* columns, size_t stride, size_t n,
+                              double* scores) const
+{
+  int32_t const* lefts = this->lefts.data();
+  int32_t const* features = this->features.data();
+  double const* thresholds = this->thresholds.data();
+  double const* values = this->values.data();
+
+  int32_t at[TREE_ENSEMBLE_BLOCK_ROWS];
+  for (size_t begin = 0; begin < n; begin += TREE_ENSEMBLE_BLOCK_ROWS) {
+    size_t m = std::min<size_t>(n - begin, TREE_ENSEMBLE_BLOCK_ROWS);
+    double const* block = columns + begin;
+    double* blockScores = scores + begin;
+    for (size_t i = 0; i < m; i++) {
+      blockScores[i] = baseScore;
+    }
+
+    for (size_t t = 0; t < roots.size(); t++) {
+      for (size_t i = 0; i < m; i++) {
+        at[i] = roots[t];
+      }
+      for (size_t level = 0; level < depths[t]; level++) {
+        for (size_t i = 0; i < m; i++) {
+          int32_t k = at[i];
+          double x = block[features[k] * stride + i];
+          at[i] = lefts[k] + (x > thresholds[k]);
+        }
+      }
+      for (size_t i = 0; i < m; i++) {
+        blockScores[i] += values[at[i]];
+      }
+    }
+  }
+
+  if (logistic) {
+    for (size_t i = 0; i < n; i++) {
+      scores[i] = 1 / (1 + std::exp(-scores[i]));
+    }
+  }
+}
+
+/**
+ * Loads a model file written by scripts/export_model.py.
+ */
+inline std::shared_ptr<AbstractModel> loadModel(std::string const& path)
+{
+  ModelDescription description(path);
+  if (description.kind == "logistic_regression") {
+    return std::make_shared<LogisticRegressionModel>(description);
+  } else if (description.kind == "naive_bayes") {
+    return std::make_shared<NaiveBayesModel>(description);
+  } else if (description.kind == "tree_ensemble") {
+    return std::make_shared<TreeEnsembleModel>(description);
+  }
+  throw ModelException("Model file " + path + " has unknown kind " +
+    description.kind + "; expected logistic_regression, naive_bayes or "
+    "tree_ensemble");
+}
+
+}
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef SAM_MODEL_SCORER_HPP
+#define SAM_MODEL_SCORER_HPP
+
+/**
+ * Scores the rows of FeatureSubscriber with a model as they complete (the
+ * test mode of FeatureSubscriber), and sends the rows scoring at or above
+ * the model's threshold to an alert sink.
+ *
+ * Rows are gathered into mini-batches, one per shard so that threads rarely
+ * share a lock, and a batch is scored by the thread that fills it.  A batch
+ * size of 1 scores every row as soon as it completes; larger batches score
+ * faster but hold rows back until the batch fills.  So that a slow trickle
+ * of rows still gets scored, a batch is also scored once its first row has
+ * waited maxDelay ms: by the next row that comes to the batch, or else by
+ * a timer thread that looks at the batches every quarter of maxDelay.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sam/AbstractRowConsumer.hpp>
+#include <sam/AlignedArray.hpp>
+#include <sam/LatencyTracing.hpp>
+#include <sam/Metrics.hpp>
+#include <sam/Model.hpp>
+
+/// Rows scored together.
+#define MODEL_SCORER_BATCH_SIZE 64
+
+/// How long in ms rows may wait for their batch to fill.
+#define MODEL_SCORER_MAX_DELAY 100
+
+/// How many mini-batches rows are spread over.
+#define MODEL_SCORER_NUM_SHARDS 8
+
+namespace sam {
+
+/**
+ * Where alerts go.
+ */
+class AbstractAlertSink
+{
+public:
+  virtual ~AbstractAlertSink() {}
+
+  /**
+   * Called for each row scoring at or above the threshold.  May be called
+   * from several threads at once.
+   * \param key The key (SamGeneratedId) of the item the row describes.
+   * \param score The score of the row.
+   */
+  virtual void alert(std::size_t key, double score) = 0;
+};
+
+/**
+ * Writes each alert as a "key,score" line to a file, or to stdout if no
+ * file is given, flushing after each so alerts are seen right away.
+ */
+class StreamAlertSink : public AbstractAlertSink
+{
+public:
+  StreamAlertSink(std::string const& path = "")
+  {
+    if (path == "") {
+      file = stdout;
+    } else {
+      file = fopen(path.c_str(), "w");
+      if (file == nullptr) {
+        throw ModelException("Could not open alert file " + path);
+      }
+    }
+  }
+
+  ~StreamAlertSink()
+  {
+    if (file != stdout) {
+      fclose(file);
+    }
+  }
+
+  void alert(std::size_t key, double score)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    fprintf(file, "%lu,%g\n", key, score);
+    fflush(file);
+  }
+
+private:
+  FILE* file;
+  std::mutex mutex;
+};
+
+class ModelScorer : public AbstractRowConsumer
+{
+public:
+  /**
+   * \param model The model rows are scored with.
+   * \param sink Where the rows at or above the threshold go.
+   * \param batchSize How many rows are scored together.
+   * \param maxDelay How long in ms the first row of a batch waits before
+   *   the batch is scored anyway.  0 waits for the batch to fill or for
+   *   terminate, and starts no timer thread.
+   */
+  ModelScorer(std::shared_ptr<AbstractModel> model,
+              std::shared_ptr<AbstractAlertSink> sink,
+              size_t batchSize = MODEL_SCORER_BATCH_SIZE,
+              size_t maxDelay = MODEL_SCORER_MAX_DELAY);
+
+  ~ModelScorer();
+
+  void init(std::vector<std::string> const& names);
+
+  void consumeRow(std::size_t key, double const* values, int64_t ingestTime);
+
+  void terminate();
+
+  size_t getNumScored() const { return numScored; }
+  size_t getNumAlerts() const { return numAlerts; }
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct alignas(64) Batch
+  {
+    std::mutex mutex;
+    std::vector<double> columns; ///> Feature j of row i at j * batchSize + i
+    std::vector<std::size_t> keys;
+    std::vector<int64_t> ingestTimes;
+    std::vector<double> scores;
+    size_t numRows = 0;
+    Clock::time_point deadline; ///> When the batch is scored if not full
+  };
+
+  std::shared_ptr<AbstractModel> model;
+  std::shared_ptr<AbstractAlertSink> sink;
+  size_t batchSize;
+  Clock::duration maxDelay;
+
+  /// For each feature of the model, its column in the rows.
+  std::vector<size_t> columnOfFeature;
+
+  AlignedArray<Batch> batches;
+
+  std::atomic<size_t> numScored;
+  std::atomic<size_t> numAlerts;
+  std::vector<std::unique_ptr<CallbackMetric>> callbackMetrics;
+
+  std::mutex timerMutex;
+  std::condition_variable timerStopping;
+  bool timerStopped = false;
+  std::thread timerThread;
+
+  /**
+   * Scores the rows of the batch and empties it.  Called with the batch
+   * locked.
+   */
+  void scoreBatch(Batch& batch);
+
+  /**
+   * Run by the timer thread until stopTimer; scores the batches that are
+   * past their deadline.
+   */
+  void timerLoop();
+
+  void stopTimer();
+};
+
+inline
+ModelScorer::ModelScorer(std::shared_ptr<AbstractModel> model,
+                         std::shared_ptr<AbstractAlertSink> sink,
+                         size_t batchSize,
+                         size_t maxDelay) :
+  model(model), sink(sink), batchSize(std::max<size_t>(1, batchSize)),
+  maxDelay(std::chrono::milliseconds(maxDelay)),
+  batches(makeAlignedArray<Batch>(MODEL_SCORER_NUM_SHARDS)),
+  numScored(0), numAlerts(0)
+{
+  size_t numFeatures = model->getNumFeatures();
+  for (size_t s = 0; s < MODEL_SCORER_NUM_SHARDS; s++) {
+    Batch& batch = batches[s];
+    batch.columns.resize(numFeatures * this->batchSize);
+    batch.keys.resize(this->batchSize);
+    batch.ingestTimes.resize(this->batchSize);
+    batch.scores.resize(this->batchSize);
+  }
+
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  callbackMetrics.push_back(registry.callback(
+    "sam_model_rows_scored_total", "", "Feature rows scored by the model",
+    MetricKind::Counter, [this]() { return (double) getNumScored(); }));
+  callbackMetrics.push_back(registry.callback(
+    "sam_model_alerts_total", "", "Rows scoring at or above the threshold",
+    MetricKind::Counter, [this]() { return (double) getNumAlerts(); }));
+
+  if (maxDelay > 0 && this->batchSize > 1) {
+    timerThread = std::thread(&ModelScorer::timerLoop, this);
+  }
+}
+
+inline
+ModelScorer::~ModelScorer()
+{
+  stopTimer();
+}
+
+inline
+void ModelScorer::init(std::vector<std::string> const& names)
+{
+  columnOfFeature.clear();
+  for (auto const& feature : model->getFeatureNames()) {
+    auto it = std::find(names.begin(), names.end(), feature);
+    if (it == names.end()) {
+      throw ModelException("The model uses feature " + feature +
+        ", which the pipeline does not produce");
+    }
+    columnOfFeature.push_back(it - names.begin());
+  }
+}
+
+inline
+void ModelScorer::consumeRow(std::size_t key, double const* values,
+                             int64_t ingestTime)
+{
+  size_t shard = std::hash<std::thread::id>()(std::this_thread::get_id())
+                 % MODEL_SCORER_NUM_SHARDS;
+  Batch& batch = batches[shard];
+  std::lock_guard<std::mutex> lock(batch.mutex);
+
+  size_t i = batch.numRows;
+  for (size_t j = 0; j < columnOfFeature.size(); j++) {
+    batch.columns[j * batchSize + i] = values[columnOfFeature[j]];
+  }
+  batch.keys[i] = key;
+  batch.ingestTimes[i] = ingestTime;
+  batch.numRows++;
+
+  if (batch.numRows == batchSize) {
+    scoreBatch(batch);
+  } else if (maxDelay != Clock::duration::zero()) {
+    Clock::time_point now = Clock::now();
+    if (i == 0) {
+      batch.deadline = now + maxDelay;
+    } else if (now >= batch.deadline) {
+      scoreBatch(batch);
+    }
+  }
+}
+
+inline
+void ModelScorer::terminate()
+{
+  stopTimer();
+  for (size_t s = 0; s < MODEL_SCORER_NUM_SHARDS; s++) {
+    Batch& batch = batches[s];
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (batch.numRows > 0) {
+      scoreBatch(batch);
+    }
+  }
+}
+
+inline
+void ModelScorer::timerLoop()
+{
+  Clock::duration period = std::max<Clock::duration>(maxDelay / 4,
+    std::chrono::milliseconds(1));
+  std::unique_lock<std::mutex> timerLock(timerMutex);
+  while (!timerStopping.wait_for(timerLock, period,
+                                 [this]() { return timerStopped; }))
+  {
+    Clock::time_point now = Clock::now();
+    for (size_t s = 0; s < MODEL_SCORER_NUM_SHARDS; s++) {
+      Batch& batch = batches[s];
+      std::lock_guard<std::mutex> lock(batch.mutex);
+      if (batch.numRows > 0 && now >= batch.deadline) {
+        scoreBatch(batch);
+      }
+    }
+  }
+}
+
+inline
+void ModelScorer::stopTimer()
+{
+  {
+    std::lock_guard<std::mutex> lock(timerMutex);
+    timerStopped = true;
+  }
+  timerStopping.notify_all();
+  if (timerThread.joinable()) {
+    timerThread.join();
+  }
+}
+
+inline
+void ModelScorer::scoreBatch(Batch& batch)
+{
+  size_t n = batch.numRows;
+  model->score(batch.columns.data(), batchSize, n, batch.scores.data());
+
+  double threshold = model->getThreshold();
+  for (size_t i = 0; i < n; i++) {
+    if (batch.scores[i] >= threshold) {
+      LatencyTracer::record(TraceStage::Alert, batch.ingestTimes[i]);
+      sink->alert(batch.keys[i], batch.scores[i]);
+      numAlerts.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  numScored.fetch_add(n, std::memory_order_relaxed);
+  batch.numRows = 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,443 @@
+#ifndef SAM_NETFLOW_DECODER_HPP
+#define SAM_NETFLOW_DECODER_HPP
+
+/**
+ * Decodes NetFlow export packets straight into NetflowV5 tuples, without
+ * going through a text representation.
+ *
+ * Version 5 packets have a fixed layout.  Version 9 and IPFIX (version 10)
+ * packets describe their records with templates that are sent by the
+ * exporter every so often; the decoder remembers them per exporter and
+ * observation domain.  Records of v9/IPFIX are mapped onto the v5 fields
+ * they share (addresses, ports, counters, AS numbers, ...).  Fields that
+ * have no v5 counterpart are skipped and v5 fields without a v9/IPFIX
+ * counterpart are left as zero (or empty for addresses).
+ *
+ * For IPFIX, which has no system uptime in its header, SysUptime is 0 and
+ * absolute flow start/end times are stored in First/Last relative to the
+ * export time, so that UnixSecs * 1000 - SysUptime + First is the start of
+ * the flow in milliseconds for all versions.
+ *
+ * Packets come from the network, so malformed ones are counted and dropped
+ * rather than throwing.
+ */
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include <sam/tuples/NetflowV5.hpp>
+
+namespace sam {
+
+namespace NetflowDetails {
+
+static uint16_t const V5HeaderSize = 24;
+static uint16_t const V5RecordSize = 48;
+static uint16_t const V9HeaderSize = 20;
+static uint16_t const IpfixHeaderSize = 16;
+
+static uint16_t const V9TemplateSet = 0;
+static uint16_t const V9OptionsTemplateSet = 1;
+static uint16_t const IpfixTemplateSet = 2;
+static uint16_t const IpfixOptionsTemplateSet = 3;
+static uint16_t const MinDataSet = 256;
+
+static uint16_t const VariableLength = 65535;
+
+/// Information element ids shared by v9 and IPFIX.
+enum FieldType : uint16_t {
+  InBytes = 1,
+  InPkts = 2,
+  ProtocolField = 4,
+  SrcTos = 5,
+  TcpFlagsField = 6,
+  L4SrcPort = 7,
+  Ipv4SrcAddr = 8,
+  SrcMask = 9,
+  InputSnmp = 10,
+  L4DstPort = 11,
+  Ipv4DstAddr = 12,
+  DstMask = 13,
+  OutputSnmp = 14,
+  Ipv4NextHop = 15,
+  SrcAs = 16,
+  DstAs = 17,
+  LastSwitched = 21,
+  FirstSwitched = 22,
+  Ipv6SrcAddr = 27,
+  Ipv6DstAddr = 28,
+  Ipv6NextHop = 62,
+  EngineTypeField = 38,
+  EngineIdField = 39,
+  FlowStartSeconds = 150,
+  FlowEndSeconds = 151,
+  FlowStartMilliseconds = 152,
+  FlowEndMilliseconds = 153
+};
+
+struct FieldSpec
+{
+  uint16_t type;
+  uint16_t length; ///> VariableLength for IPFIX variable-length fields
+  bool enterprise; ///> Enterprise-specific fields are always skipped
+};
+
+/**
+ * Reads a big-endian unsigned integer of 1 to 8 bytes.
+ */
+inline
+uint64_t readUnsigned(unsigned char const* p, size_t length)
+{
+  uint64_t value = 0;
+  for (size_t i = 0; i < length && i < 8; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+inline
+std::string ipToString(unsigned char const* p, size_t length)
+{
+  char buffer[INET6_ADDRSTRLEN];
+  if (length == 4) {
+    inet_ntop(AF_INET, p, buffer, sizeof(buffer));
+  } else if (length == 16) {
+    inet_ntop(AF_INET6, p, buffer, sizeof(buffer));
+  } else {
+    return "";
+  }
+  return std::string(buffer);
+}
+
+}
+
+class NetflowDecoder
+{
+public:
+  typedef netflowv5::NetflowV5 NetflowV5;
+
+private:
+  typedef std::tuple<std::string, uint32_t, uint16_t> TemplateKey;
+  typedef std::vector<NetflowDetails::FieldSpec> Template;
+
+  /// Templates by exporter, source id/observation domain and template id.
+  std::map<TemplateKey, Template> templates;
+
+  size_t numPackets = 0;
+  size_t numMalformed = 0; ///> Packets that were truncated or inconsistent
+  size_t numMissingTemplate = 0; ///> Data sets whose template wasn't known
+  size_t numUnsupported = 0; ///> Packets of an unknown version
+
+public:
+  /**
+   * Decodes one export packet and appends its flow records to flows.
+   * \param packet The payload of the UDP datagram.
+   * \param length The number of bytes in packet.
+   * \param exporter The address of the exporter, used as the Exaddr field
+   *   and to tell apart templates of different exporters.
+   * \return The number of flows appended.
+   */
+  size_t decode(char const* packet, size_t length, std::string const& exporter,
+                std::vector<NetflowV5>& flows)
+  {
+    numPackets++;
+    auto p = reinterpret_cast<unsigned char const*>(packet);
+    if (length < 2) {
+      numMalformed++;
+      return 0;
+    }
+
+    size_t before = flows.size();
+    bool ok;
+    switch (NetflowDetails::readUnsigned(p, 2)) {
+      case 5: ok = decodeV5(p, length, exporter, flows); break;
+      case 9: ok = decodeV9(p, length, exporter, flows); break;
+      case 10: ok = decodeIpfix(p, length, exporter, flows); break;
+      default:
+        numUnsupported++;
+        return 0;
+    }
+    if (!ok) numMalformed++;
+    return flows.size() - before;
+  }
+
+  size_t getNumPackets() const { return numPackets; }
+  size_t getNumMalformed() const { return numMalformed; }
+  size_t getNumMissingTemplate() const { return numMissingTemplate; }
+  size_t getNumUnsupported() const { return numUnsupported; }
+  size_t getNumTemplates() const { return templates.size(); }
+
+private:
+  bool decodeV5(unsigned char const* p, size_t length,
+                std::string const& exporter, std::vector<NetflowV5>& flows)
+  {
+    using NetflowDetails::readUnsigned;
+    using NetflowDetails::ipToString;
+    using NetflowDetails::V5HeaderSize;
+    using NetflowDetails::V5RecordSize;
+
+    if (length < V5HeaderSize) return false;
+    size_t count = readUnsigned(p + 2, 2);
+    if (length < V5HeaderSize + count * V5RecordSize) return false;
+
+    long sysUptime = readUnsigned(p + 4, 4);
+    long unixSecs = readUnsigned(p + 8, 4);
+    long unixNsecs = readUnsigned(p + 12, 4);
+    size_t engineType = p[20];
+    size_t engineId = p[21];
+
+    for (size_t i = 0; i < count; i++) {
+      unsigned char const* r = p + V5HeaderSize + i * V5RecordSize;
+      flows.push_back(NetflowV5(
+        unixSecs, unixNsecs, sysUptime, exporter,
+        readUnsigned(r + 16, 4),    // Dpkts
+        readUnsigned(r + 20, 4),    // Doctets
+        readUnsigned(r + 24, 4),    // First
+        readUnsigned(r + 28, 4),    // Last
+        engineType, engineId,
+        ipToString(r, 4),           // SourceIp
+        ipToString(r + 4, 4),       // DestIp
+        ipToString(r + 8, 4),       // NextHop
+        readUnsigned(r + 12, 2),    // SnmpInput
+        readUnsigned(r + 14, 2),    // SnmpOutput
+        readUnsigned(r + 32, 2),    // SourcePort
+        readUnsigned(r + 34, 2),    // DestPort
+        r[38],                      // Protocol
+        r[39],                      // Tos
+        r[37],                      // TcpFlags
+        r[44],                      // SourceMask
+        r[45],                      // DestMask
+        readUnsigned(r + 40, 2),    // SourceAS
+        readUnsigned(r + 42, 2)));  // DestAS
+    }
+    return true;
+  }
+
+  bool decodeV9(unsigned char const* p, size_t length,
+                std::string const& exporter, std::vector<NetflowV5>& flows)
+  {
+    using NetflowDetails::readUnsigned;
+
+    if (length < NetflowDetails::V9HeaderSize) return false;
+    long sysUptime = readUnsigned(p + 4, 4);
+    long unixSecs = readUnsigned(p + 8, 4);
+    uint32_t sourceId = readUnsigned(p + 16, 4);
+
+    return decodeSets(p + NetflowDetails::V9HeaderSize,
+                      p + length, false, exporter, sourceId,
+                      unixSecs, sysUptime, flows);
+  }
+
+  bool decodeIpfix(unsigned char const* p, size_t length,
+                   std::string const& exporter, std::vector<NetflowV5>& flows)
+  {
+    using NetflowDetails::readUnsigned;
+
+    if (length < NetflowDetails::IpfixHeaderSize) return false;
+    size_t messageLength = readUnsigned(p + 2, 2);
+    if (messageLength < NetflowDetails::IpfixHeaderSize ||
+        messageLength > length)
+    {
+      return false;
+    }
+    long exportTime = readUnsigned(p + 4, 4);
+    uint32_t domainId = readUnsigned(p + 12, 4);
+
+    return decodeSets(p + NetflowDetails::IpfixHeaderSize,
+                      p + messageLength, true, exporter, domainId,
+                      exportTime, 0, flows);
+  }
+
+  /**
+   * Decodes the flowsets (v9) or sets (IPFIX) of a packet.  Both have a
+   * 2 byte id and a 2 byte length that includes the 4 byte set header.
+   */
+  bool decodeSets(unsigned char const* p, unsigned char const* end,
+                  bool ipfix, std::string const& exporter, uint32_t domain,
+                  long unixSecs, long sysUptime,
+                  std::vector<NetflowV5>& flows)
+  {
+    using NetflowDetails::readUnsigned;
+
+    while (end - p >= 4) {
+      uint16_t setId = readUnsigned(p, 2);
+      size_t setLength = readUnsigned(p + 2, 2);
+      if (setLength < 4 || setLength > static_cast<size_t>(end - p)) {
+        return false;
+      }
+      unsigned char const* body = p + 4;
+      unsigned char const* setEnd = p + setLength;
+
+      uint16_t templateSet = ipfix ? NetflowDetails::IpfixTemplateSet
+                                   : NetflowDetails::V9TemplateSet;
+      if (setId == templateSet) {
+        if (!decodeTemplates(body, setEnd, ipfix, exporter, domain)) {
+          return false;
+        }
+      } else if (setId >= NetflowDetails::MinDataSet) {
+        auto it = templates.find(TemplateKey(exporter, domain, setId));
+        if (it == templates.end()) {
+          numMissingTemplate++;
+        } else if (!decodeRecords(body, setEnd, it->second, exporter,
+                                  unixSecs, sysUptime, flows))
+        {
+          return false;
+        }
+      }
+      // Options templates and options data are not needed for flows.
+
+      p = setEnd;
+    }
+    return true;
+  }
+
+  bool decodeTemplates(unsigned char const* p, unsigned char const* end,
+                       bool ipfix, std::string const& exporter,
+                       uint32_t domain)
+  {
+    using NetflowDetails::readUnsigned;
+
+    // Anything shorter than a template header is padding.
+    while (end - p >= 4) {
+      uint16_t templateId = readUnsigned(p, 2);
+      size_t fieldCount = readUnsigned(p + 2, 2);
+      p += 4;
+
+      Template fields;
+      for (size_t i = 0; i < fieldCount; i++) {
+        if (end - p < 4) return false;
+        NetflowDetails::FieldSpec field;
+        field.type = readUnsigned(p, 2);
+        field.length = readUnsigned(p + 2, 2);
+        field.enterprise = false;
+        p += 4;
+        if (ipfix && (field.type & 0x8000)) {
+          if (end - p < 4) return false;
+          field.type &= 0x7fff;
+          field.enterprise = true;
+          p += 4;
+        }
+        if (!ipfix && field.length == NetflowDetails::VariableLength) {
+          return false;
+        }
+        fields.push_back(field);
+      }
+
+      if (templateId < NetflowDetails::MinDataSet) return false;
+      templates[TemplateKey(exporter, domain, templateId)] = fields;
+    }
+    return true;
+  }
+
+  bool decodeRecords(unsigned char const* p, unsigned char const* end,
+                     Template const& fields, std::string const& exporter,
+                     long unixSecs, long sysUptime,
+                     std::vector<NetflowV5>& flows)
+  {
+    using NetflowDetails::readUnsigned;
+
+    // The smallest possible record, used to tell records from padding.
+    size_t minRecordSize = 0;
+    for (auto const& field : fields) {
+      minRecordSize += field.length == NetflowDetails::VariableLength ?
+                       1 : field.length;
+    }
+    if (minRecordSize == 0) return true;
+
+    while (static_cast<size_t>(end - p) >= minRecordSize) {
+      NetflowV5 flow;
+      std::get<netflowv5::UnixSecs>(flow) = unixSecs;
+      std::get<netflowv5::SysUptime>(flow) = sysUptime;
+      std::get<netflowv5::Exaddr>(flow) = exporter;
+
+      for (auto const& field : fields) {
+        size_t length = field.length;
+        if (length == NetflowDetails::VariableLength) {
+          if (end - p < 1) return false;
+          length = *p++;
+          if (length == 255) {
+            if (end - p < 2) return false;
+            length = readUnsigned(p, 2);
+            p += 2;
+          }
+        }
+        if (static_cast<size_t>(end - p) < length) return false;
+        if (!field.enterprise) {
+          setField(flow, field.type, p, length, unixSecs);
+        }
+        p += length;
+      }
+      flows.push_back(flow);
+    }
+    return true;
+  }
+
+  static void setField(NetflowV5& flow, uint16_t type,
+                       unsigned char const* p, size_t length, long unixSecs)
+  {
+    using namespace netflowv5;
+    using namespace NetflowDetails;
+
+    switch (type) {
+      case InBytes: std::get<Doctets>(flow) = readUnsigned(p, length); break;
+      case InPkts: std::get<Dpkts>(flow) = readUnsigned(p, length); break;
+      case ProtocolField:
+        std::get<Protocol>(flow) = readUnsigned(p, length); break;
+      case SrcTos: std::get<Tos>(flow) = readUnsigned(p, length); break;
+      case TcpFlagsField:
+        std::get<TcpFlags>(flow) = readUnsigned(p, length); break;
+      case L4SrcPort:
+        std::get<SourcePort>(flow) = readUnsigned(p, length); break;
+      case L4DstPort:
+        std::get<DestPort>(flow) = readUnsigned(p, length); break;
+      case Ipv4SrcAddr: case Ipv6SrcAddr:
+        std::get<SourceIp>(flow) = ipToString(p, length); break;
+      case Ipv4DstAddr: case Ipv6DstAddr:
+        std::get<DestIp>(flow) = ipToString(p, length); break;
+      case Ipv4NextHop: case Ipv6NextHop:
+        std::get<NextHop>(flow) = ipToString(p, length); break;
+      case SrcMask: std::get<SourceMask>(flow) = readUnsigned(p, length); break;
+      case DstMask: std::get<DestMask>(flow) = readUnsigned(p, length); break;
+      case InputSnmp:
+        std::get<SnmpInput>(flow) = readUnsigned(p, length); break;
+      case OutputSnmp:
+        std::get<SnmpOutput>(flow) = readUnsigned(p, length); break;
+      case SrcAs: std::get<SourceAS>(flow) = readUnsigned(p, length); break;
+      case DstAs: std::get<DestAS>(flow) = readUnsigned(p, length); break;
+      case EngineTypeField:
+        std::get<EngineType>(flow) = readUnsigned(p, length); break;
+      case EngineIdField:
+        std::get<EngineId>(flow) = readUnsigned(p, length); break;
+      case FirstSwitched: std::get<First1>(flow) = readUnsigned(p, length);
+        break;
+      case LastSwitched: std::get<Last1>(flow) = readUnsigned(p, length);
+        break;
+      case FlowStartSeconds:
+        std::get<First1>(flow) =
+          (static_cast<long>(readUnsigned(p, length)) - unixSecs) * 1000;
+        break;
+      case FlowEndSeconds:
+        std::get<Last1>(flow) =
+          (static_cast<long>(readUnsigned(p, length)) - unixSecs) * 1000;
+        break;
+      case FlowStartMilliseconds:
+        std::get<First1>(flow) =
+          static_cast<long>(readUnsigned(p, length)) - unixSecs * 1000;
+        break;
+      case FlowEndMilliseconds:
+        std::get<Last1>(flow) =
+          static_cast<long>(readUnsigned(p, length)) - unixSecs * 1000;
+        break;
+      default: break;
+    }
+  }
+};
+
+}
+
+#endif
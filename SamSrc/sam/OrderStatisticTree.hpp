@@ -0,0 +1,239 @@
+#ifndef SAM_ORDER_STATISTIC_TREE_HPP
+#define SAM_ORDER_STATISTIC_TREE_HPP
+
+/**
+ * A multiset that supports rank queries, implemented as a treap where every
+ * node keeps the number of items in its subtree.  Insert, erase, and
+ * select (the ith smallest item) are all O(log n) expected.  This is what
+ * lets the sliding window operators that need order statistics (e.g.
+ * KMedian) add the newest item and evict the oldest without re-sorting
+ * the window.
+ *
+ * Nodes live in a contiguous vector and refer to each other by index, with
+ * erased slots put on a free list, so a window of fixed size stops
+ * allocating once it is full.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+#include <string>
+#include <boost/lexical_cast.hpp>
+
+namespace sam {
+
+template <typename T>
+class OrderStatisticTree
+{
+private:
+  static int const NIL = -1;
+
+  struct Node {
+    T value;
+    size_t count; ///> Number of copies of value
+    size_t size;  ///> Number of items (including copies) in this subtree
+    uint32_t priority;
+    int left;
+    int right;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<int> freeList; ///> Indices of nodes that can be reused
+  int root = NIL;
+  uint32_t seed = 2463534242; ///> State of the xorshift priority generator
+
+public:
+  OrderStatisticTree() {}
+
+  /**
+   * Adds count copies of value to the tree.
+   */
+  void insert(T const& value, size_t count = 1)
+  {
+    if (count == 0) return;
+    insert(root, value, count);
+  }
+
+  /**
+   * Removes one copy of value from the tree.
+   * \return Returns true if the value was found, false otherwise.
+   */
+  bool erase(T const& value)
+  {
+    return erase(root, value);
+  }
+
+  /**
+   * Returns the ith smallest item (starting at 0), counting duplicates.
+   */
+  T const& select(size_t i) const
+  {
+    if (i >= size()) {
+      throw std::out_of_range("OrderStatisticTree::select index " +
+        boost::lexical_cast<std::string>(i) + " >= size " +
+        boost::lexical_cast<std::string>(size()));
+    }
+
+    int t = root;
+    while (true) {
+      Node const& node = nodes[t];
+      size_t leftSize = sizeOf(node.left);
+      if (i < leftSize) {
+        t = node.left;
+      } else if (i < leftSize + node.count) {
+        return node.value;
+      } else {
+        i -= leftSize + node.count;
+        t = node.right;
+      }
+    }
+  }
+
+  /**
+   * Returns the number of items strictly less than value.
+   */
+  size_t rank(T const& value) const
+  {
+    size_t r = 0;
+    int t = root;
+    while (t != NIL) {
+      Node const& node = nodes[t];
+      if (value < node.value) {
+        t = node.left;
+      } else if (node.value < value) {
+        r += sizeOf(node.left) + node.count;
+        t = node.right;
+      } else {
+        return r + sizeOf(node.left);
+      }
+    }
+    return r;
+  }
+
+  /**
+   * The total number of items, counting duplicates.
+   */
+  size_t size() const { return sizeOf(root); }
+
+  bool empty() const { return root == NIL; }
+
+  void clear()
+  {
+    nodes.clear();
+    freeList.clear();
+    root = NIL;
+  }
+
+private:
+  size_t sizeOf(int t) const { return t == NIL ? 0 : nodes[t].size; }
+
+  void update(int t)
+  {
+    Node& node = nodes[t];
+    node.size = sizeOf(node.left) + sizeOf(node.right) + node.count;
+  }
+
+  uint32_t nextPriority()
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  }
+
+  int newNode(T const& value, size_t count)
+  {
+    Node node = {value, count, count, nextPriority(), NIL, NIL};
+    if (!freeList.empty()) {
+      int t = freeList.back();
+      freeList.pop_back();
+      nodes[t] = node;
+      return t;
+    }
+    nodes.push_back(node);
+    return static_cast<int>(nodes.size() - 1);
+  }
+
+  void rotateRight(int& t)
+  {
+    int l = nodes[t].left;
+    nodes[t].left = nodes[l].right;
+    nodes[l].right = t;
+    update(t);
+    update(l);
+    t = l;
+  }
+
+  void rotateLeft(int& t)
+  {
+    int r = nodes[t].right;
+    nodes[t].right = nodes[r].left;
+    nodes[r].left = t;
+    update(t);
+    update(r);
+    t = r;
+  }
+
+  void insert(int& t, T const& value, size_t count)
+  {
+    if (t == NIL) {
+      t = newNode(value, count);
+      return;
+    }
+
+    if (value < nodes[t].value) {
+      // Indices are used rather than references because newNode may
+      // reallocate the vector.
+      int child = nodes[t].left;
+      insert(child, value, count);
+      nodes[t].left = child;
+      if (nodes[child].priority > nodes[t].priority) rotateRight(t);
+    } else if (nodes[t].value < value) {
+      int child = nodes[t].right;
+      insert(child, value, count);
+      nodes[t].right = child;
+      if (nodes[child].priority > nodes[t].priority) rotateLeft(t);
+    } else {
+      nodes[t].count += count;
+    }
+    update(t);
+  }
+
+  bool erase(int& t, T const& value)
+  {
+    if (t == NIL) return false;
+
+    bool found;
+    if (value < nodes[t].value) {
+      found = erase(nodes[t].left, value);
+    } else if (nodes[t].value < value) {
+      found = erase(nodes[t].right, value);
+    } else if (nodes[t].count > 1) {
+      nodes[t].count--;
+      found = true;
+    } else {
+      // Rotate the node down until it is a leaf, then unlink it.
+      int l = nodes[t].left;
+      int r = nodes[t].right;
+      if (l == NIL && r == NIL) {
+        freeList.push_back(t);
+        t = NIL;
+        return true;
+      }
+      if (r == NIL || (l != NIL && nodes[l].priority > nodes[r].priority)) {
+        rotateRight(t);
+        found = erase(nodes[t].right, value);
+      } else {
+        rotateLeft(t);
+        found = erase(nodes[t].left, value);
+      }
+    }
+    update(t);
+    return found;
+  }
+};
+
+}
+
+#endif
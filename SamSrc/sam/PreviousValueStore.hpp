@@ -0,0 +1,111 @@
+#ifndef SAM_PREVIOUS_VALUE_STORE_HPP
+#define SAM_PREVIOUS_VALUE_STORE_HPP
+
+/**
+ * Remembers the previous value of a field for each key, which is what
+ * PrevToken needs (e.g. TimeSeconds - Prev.TimeSeconds).
+ *
+ * Each PrevToken that uses the store is given a slot.  For every key the
+ * store keeps one array with an entry per slot, so getting the previous
+ * value and replacing it with the current one is a single hash lookup and
+ * a swap.  TransformProducer owns one store and gives it to all the
+ * PrevTokens in its expressions.
+ *
+ * The keys are spread over PREVIOUS_VALUE_STORE_NUM_SHARDS shards by hash,
+ * each with its own lock, so producers feeding the same consumer only
+ * contend when their keys land in the same shard.
+ */
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define PREVIOUS_VALUE_STORE_NUM_SHARDS 64
+
+namespace sam {
+
+class PreviousValueStore
+{
+private:
+  struct Entry {
+    double value = 0;
+    bool exists = false;
+  };
+
+  struct Shard {
+    /// Mapping from key to the previous value of each slot.
+    std::unordered_map<std::string, std::vector<Entry>> values;
+
+    /// Consumers can be fed by more than one producer.
+    std::mutex mutex;
+  };
+
+  std::atomic<size_t> numSlots{0};
+
+  Shard shards[PREVIOUS_VALUE_STORE_NUM_SHARDS];
+
+  Shard& shard(std::string const& key)
+  {
+    return shards[std::hash<std::string>()(key) %
+                  PREVIOUS_VALUE_STORE_NUM_SHARDS];
+  }
+
+public:
+  /**
+   * Reserves a slot, i.e. one value per key.  The arrays of keys that
+   * already exist grow when the slot is first used.
+   * \return Returns the index of the slot.
+   */
+  size_t addSlot()
+  {
+    return numSlots++;
+  }
+
+  /**
+   * Stores current as the value of the slot for the key and hands back
+   * the value it replaces.
+   * \param key The key generated from the tuple.
+   * \param slot The slot returned by addSlot.
+   * \param current The new value.
+   * \param previous Set to the old value if there was one.
+   * \return Returns true if there was a previous value, false if this is
+   *   the first value of the slot for this key.
+   */
+  bool exchange(std::string const& key, size_t slot,
+                double current, double& previous)
+  {
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::vector<Entry>& entries = s.values[key];
+    if (slot >= entries.size()) {
+      entries.resize(numSlots);
+    }
+
+    Entry& entry = entries[slot];
+    bool exists = entry.exists;
+    previous = entry.value;
+    entry.value = current;
+    entry.exists = true;
+    return exists;
+  }
+
+  /**
+   * The number of keys that have a value.
+   */
+  size_t size()
+  {
+    size_t count = 0;
+    for (Shard& s : shards) {
+      std::lock_guard<std::mutex> lock(s.mutex);
+      count += s.values.size();
+    }
+    return count;
+  }
+};
+
+}
+
+#endif
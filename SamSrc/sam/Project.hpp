@@ -30,10 +30,13 @@ public:
           std::string identifier) :
           identifiers(_identifiers),
           BaseComputation(nodeId, featureMap, identifier)
-  {} 
+  {
+    this->registerMetrics(this->feedCount);
+  } 
 
   bool consume(EdgeType const& edge)
   {
+    this->feedCount++;
     //std::cout << "in project" << std::endl;
     std::string origKey = generateKey<keyFields...>(edge.tuple); 
     std::string newKey = generateKey<keepField>(edge.tuple);
@@ -53,20 +56,19 @@ public:
     // TODO: Right now, all features throughout time are kept.  So any
     // time a DestIp talks to a SrcIp, that stays around forever, no matter
     // how long ago it took place.  
-    for (auto id : identifiers) {
+    for (auto const& id : identifiers) {
       DEBUG_PRINT("Project::consume processing id %s\n", id.c_str())
       DEBUG_PRINT("Project::consume looking for origkey %s\n", origKey.c_str())
       if (featureMap->exists(origKey, id)) {
         std::shared_ptr<const Feature> origFeature = 
           featureMap->at(origKey, id);
-        std::map<std::string, std::shared_ptr<Feature>> localFeatureMap;
-        localFeatureMap[projectKey] = origFeature->createCopy();
-        MapFeature mapFeature(localFeatureMap);
+        MapFeature mapFeature(projectKey, origFeature->createCopy());
 
         // We update the global feature map with the MapFeature.  If there is
         // no MapFeature associated with the newkey, then we simply add it.
         // If there is a MapFeature, the original MapFeature and the new 
-        // MapFeature are unioned.
+        // MapFeature are unioned, which updates the running aggregates of
+        // the original in O(log n).
         DEBUG_PRINT("Project::consume Inserting map feature with key %s\n", 
           newKey.c_str())
         this->featureMap->updateInsert(newKey, id, mapFeature);
@@ -0,0 +1,335 @@
+#ifndef SAM_QUANTILE_HPP
+#define SAM_QUANTILE_HPP
+
+/**
+ * Calculates a quantile (e.g. the median or the 99th percentile) of a field
+ * over a sliding window, using bounded memory per key.
+ *
+ * Following the basic window approach used by TopK, the sliding window of N
+ * items is split into numBasicWindows basic windows of N / numBasicWindows
+ * items.  Each basic window is summarized with a mergeable QuantileSketch.
+ * The newest basic window is the active one and receives new items.  When
+ * it fills up it becomes a dormant window, the oldest dormant window is
+ * dropped, and the dormant windows are merged into one sorted summary.  The
+ * window therefore covers between N - N / numBasicWindows and N of the most
+ * recent items.
+ *
+ * A quantile is answered from the dormant summary and the active sketch
+ * together: one binary search over the summary, then a short merge of the
+ * active items that fall in the gap it leaves (see getQuantile).  Memory
+ * and time per tuple depend on the number of items the sketches retain,
+ * which grows only logarithmically with N.
+ */
+
+#include <iostream>
+#include <map>
+#include <deque>
+#include <vector>
+#include <stdexcept>
+
+#include <boost/lexical_cast.hpp>
+#include <sam/AbstractConsumer.hpp>
+#include <sam/BaseComputation.hpp>
+#include <sam/Features.hpp>
+#include <sam/Util.hpp>
+#include <sam/FeatureProducer.hpp>
+#include <sam/QuantileSketch.hpp>
+#include <sam/tuples/Edge.hpp>
+
+namespace sam {
+
+namespace QuantileDetails {
+
+/**
+ * \throws std::invalid_argument unless there are at least two basic windows,
+ *   each holds at least one item, and the sketches have k of at least 2.
+ */
+inline void checkParameters(size_t N, size_t numBasicWindows, size_t k)
+{
+  if (numBasicWindows < 2) {
+    throw std::invalid_argument("Quantile: the number of basic windows "
+      "must be at least 2");
+  }
+  if (N < numBasicWindows) {
+    throw std::invalid_argument("Quantile: N " +
+      boost::lexical_cast<std::string>(N) + " is less than the number of "
+      "basic windows " + boost::lexical_cast<std::string>(numBasicWindows));
+  }
+  if (k < 2) {
+    throw std::invalid_argument("Quantile: k must be at least 2");
+  }
+}
+
+template <typename T>
+class QuantileDataStructure {
+private:
+  size_t numBasicWindows;
+  size_t basicWindowSize; ///> Number of items in a basic window
+  size_t k; ///> Accuracy parameter of the sketches
+
+  QuantileSketch<T> active; ///> Sketch of the newest basic window
+  std::deque<QuantileSketch<T>> dormant; ///> Sketches of full basic windows
+
+  /// All the items retained by the dormant sketches in sorted order, along
+  /// with the cumulative weight (i.e. rank) of each item.
+  std::vector<T> summaryItems;
+  std::vector<size_t> summaryRanks;
+
+public:
+  QuantileDataStructure(size_t N, size_t numBasicWindows, size_t k) :
+    active(k)
+  {
+    checkParameters(N, numBasicWindows, k);
+    this->numBasicWindows = numBasicWindows;
+    this->basicWindowSize = N / numBasicWindows;
+    this->k = k;
+  }
+
+  /**
+   * Adds an item, rotating the basic windows when the active one is full.
+   */
+  void insert(T item) {
+    active.add(item);
+    if (active.getN() >= basicWindowSize) {
+      dormant.push_back(std::move(active));
+      active = QuantileSketch<T>(k);
+      if (dormant.size() > numBasicWindows - 1) {
+        dormant.pop_front();
+      }
+      rebuildSummary();
+    }
+  }
+
+  /**
+   * Returns the approximate q-quantile of the items in the window, or 0 if
+   * the window is empty.
+   */
+  T getQuantile(double q) const {
+    size_t n = getNumItems();
+    if (n == 0) return 0;
+    size_t target = QuantileSketch<T>::rankTarget(q, n);
+
+    // The answer is the smallest retained item whose combined rank reaches
+    // the target.  One binary search over the summary finds the first
+    // summary item that reaches it, summaryItems[i].  Between
+    // summaryItems[i - 1] and summaryItems[i] the summary's part of the
+    // rank doesn't change, so the only other candidates are the items of
+    // the active window in that gap, which are few.  They are walked in
+    // order, adding up their weights, until the target is reached.
+    size_t i = std::partition_point(summaryItems.begin(), summaryItems.end(),
+      [&](T const& item) { return rank(item) < target; }) -
+      summaryItems.begin();
+    bool hasLow = i > 0;
+    bool hasHigh = i < summaryItems.size();
+    T low = hasLow ? summaryItems[i - 1] : T();
+    T high = hasHigh ? summaryItems[i] : T();
+    size_t r = hasLow ? summaryRanks[i - 1] + active.rank(low) : 0;
+
+    // The range of each active level in the gap (low, high).
+    size_t numLevels = active.getNumLevels();
+    std::vector<std::pair<T const*, T const*>> ranges(numLevels);
+    for (size_t h = 0; h < numLevels; h++) {
+      std::vector<T> const& level = active.getLevel(h);
+      T const* begin = level.data();
+      T const* end = level.data() + level.size();
+      if (hasLow) begin = std::upper_bound(begin, end, low);
+      if (hasHigh) end = std::lower_bound(begin, end, high);
+      ranges[h] = std::make_pair(begin, end);
+    }
+
+    while (true) {
+      size_t next = numLevels;
+      for (size_t h = 0; h < numLevels; h++) {
+        if (ranges[h].first != ranges[h].second &&
+            (next == numLevels || *ranges[h].first < *ranges[next].first))
+        {
+          next = h;
+        }
+      }
+      if (next == numLevels) break;
+      r += size_t(1) << next;
+      if (r >= target) return *ranges[next].first;
+      ranges[next].first++;
+    }
+    return hasHigh ? high : 0;
+  }
+
+  /**
+   * The number of items currently covered by the window.
+   */
+  size_t getNumItems() const {
+    size_t n = active.getN();
+    for (auto const& sketch : dormant) n += sketch.getN();
+    return n;
+  }
+
+private:
+  /**
+   * Combined approximate rank of item over the dormant windows and the
+   * active window.
+   */
+  size_t rank(T const& item) const {
+    size_t index = std::upper_bound(summaryItems.begin(), summaryItems.end(),
+                                    item) - summaryItems.begin();
+    size_t r = index == 0 ? 0 : summaryRanks[index - 1];
+    return r + active.rank(item);
+  }
+
+  void rebuildSummary() {
+    std::vector<std::pair<T, size_t>> items;
+    for (auto const& sketch : dormant) sketch.weightedItems(items);
+    std::sort(items.begin(), items.end());
+
+    summaryItems.resize(items.size());
+    summaryRanks.resize(items.size());
+    size_t cumulative = 0;
+    for (size_t i = 0; i < items.size(); i++) {
+      cumulative += items[i].second;
+      summaryItems[i] = items[i].first;
+      summaryRanks[i] = cumulative;
+    }
+  }
+};
+
+}
+
+template <typename T, typename EdgeType,
+          size_t valueField, size_t... keyFields>
+class Quantile: public AbstractConsumer<EdgeType>,
+                public BaseComputation,
+                public FeatureProducer
+{
+public:
+  typedef typename EdgeType::LocalTupleType TupleType;
+private:
+  size_t N; ///> Size of sliding window
+  double q; ///> The quantile to compute, in [0, 1]
+  size_t numBasicWindows; ///> Number of basic windows in the sliding window
+  size_t k; ///> Accuracy parameter of the sketches
+  typedef QuantileDetails::QuantileDataStructure<T> value_t;
+
+  /// Mapping from the key (e.g. an ip field) to the data structure that
+  /// is keeping track of the values seen.
+  std::map<std::string, value_t*> allWindows;
+
+  value_t const* window(std::string const& key) const {
+    auto it = allWindows.find(key);
+    if (it == allWindows.end()) {
+      throw std::out_of_range("Quantile has no window for key " + key);
+    }
+    return it->second;
+  }
+
+public:
+  /**
+   * Constructor.
+   * \param N The number of elements in the sliding window.
+   * \param q The quantile to compute, e.g. 0.5 for the median.
+   * \param nodeId The nodeId of the node that is running this operator.
+   * \param featureMap The global featureMap that holds the features produced
+   *                   by this operator.
+   * \param identifier A unique identifier associated with this operator.
+   * \param numBasicWindows The number of basic windows the sliding window
+   *                   is divided into.
+   * \param k Accuracy parameter of the sketches.  The normalized rank error
+   *          is roughly 1.7 / k.
+   * \throws std::invalid_argument If q isn't in [0, 1], or N,
+   *          numBasicWindows or k are rejected by checkParameters.
+   */
+  Quantile(size_t N,
+           double q,
+           size_t nodeId,
+           std::shared_ptr<FeatureMap> featureMap,
+           std::string identifier,
+           size_t numBasicWindows = 8,
+           size_t k = 200) :
+    BaseComputation(nodeId, featureMap, identifier)
+  {
+    if (q < 0 || q > 1) {
+      throw std::invalid_argument("Quantile: q must be in [0, 1], got " +
+        boost::lexical_cast<std::string>(q));
+    }
+    QuantileDetails::checkParameters(N, numBasicWindows, k);
+    this->N = N;
+    this->q = q;
+    this->numBasicWindows = numBasicWindows;
+    this->k = k;
+    this->registerMetrics(this->feedCount);
+  }
+
+  ~Quantile() {
+    for (auto p : allWindows) {
+      delete p.second;
+    }
+  }
+
+  bool consume(EdgeType const& edge)
+  {
+    this->feedCount++;
+    if (this->feedCount % this->metricInterval == 0) {
+      std::cout << "Quantile: NodeId " << this->nodeId << " number of keys "
+                << allWindows.size() << " feedCount " << this->feedCount
+                << std::endl;
+    }
+
+    // Generates unique key from key fields
+    std::string key = generateKey<keyFields...>(edge.tuple);
+    auto it = allWindows.find(key);
+    if (it == allWindows.end()) {
+      it = allWindows.emplace(key,
+        new value_t(N, numBasicWindows, k)).first;
+      this->numKeys = allWindows.size();
+    }
+
+    T value = std::get<valueField>(edge.tuple);
+    it->second->insert(value);
+
+    // Getting the current quantile and providing that to the featureMap.
+    T currentQuantile = it->second->getQuantile(q);
+    SingleFeature feature(currentQuantile);
+    this->featureMap->updateInsert(key, this->identifier, feature);
+
+    notifySubscribers(edge, currentQuantile);
+
+    return true;
+  }
+
+  /**
+   * Returns the quantile this operator was configured with for the given
+   * key.
+   * \throws std::out_of_range If the key has not been seen.
+   */
+  T getQuantile(std::string key) const {
+    return window(key)->getQuantile(q);
+  }
+
+  /**
+   * Returns other quantiles for the given key from the same window, e.g.
+   * the 50th and 99th percentile together.
+   * \throws std::out_of_range If the key has not been seen.
+   */
+  std::vector<T> getQuantiles(std::string key,
+                             std::vector<double> const& qs) const
+  {
+    std::vector<T> results;
+    value_t const* keyWindow = window(key);
+    for (double q : qs) {
+      results.push_back(keyWindow->getQuantile(q));
+    }
+    return results;
+  }
+
+  std::vector<std::string> keys() const {
+    std::vector<std::string> theKeys;
+    for (auto p : allWindows) {
+      theKeys.push_back(p.first);
+    }
+    return theKeys;
+  }
+
+  void terminate() {}
+};
+
+}
+
+#endif
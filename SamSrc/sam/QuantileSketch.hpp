@@ -0,0 +1,238 @@
+#ifndef SAM_QUANTILE_SKETCH_HPP
+#define SAM_QUANTILE_SKETCH_HPP
+
+/**
+ * A mergeable quantile sketch based on the KLL sketch of Karnin, Lang, and
+ * Liberty ("Optimal Quantile Approximation in Streams", FOCS 2016).
+ *
+ * The sketch is a stack of compactors.  Items in level h each represent 2^h
+ * of the original items.  When a level fills up, it is compacted: every
+ * other item (starting at a random offset) is promoted to the next level
+ * and the rest are discarded.  Level capacities shrink geometrically by a
+ * factor of 2/3 going down from the top level, so the space is O(k) and the
+ * rank error is O(n/k) with high probability.
+ *
+ * Unlike the textbook version, every level (including level 0) is kept
+ * sorted.  Adding an item is then an insertion into a short sorted array,
+ * compaction is a strided copy plus a merge, and rank queries are binary
+ * searches, which is what the sliding window quantile operator needs to
+ * answer a query for every tuple.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace sam {
+
+template <typename T>
+class QuantileSketch
+{
+private:
+  size_t k; ///> Capacity of the top level; determines the accuracy.
+  size_t n = 0; ///> Number of items represented by the sketch.
+
+  /// levels[h] holds sorted items that each have weight 2^h.
+  std::vector<std::vector<T>> levels;
+
+  /// capacities[h] is the number of items level h can hold before it is
+  /// compacted.  Recomputed whenever a level is added.
+  std::vector<size_t> capacities;
+
+  uint32_t seed = 2463534242; ///> State of the xorshift coin flips
+
+public:
+  /**
+   * \param k Determines the accuracy and the size of the sketch.  The
+   *   normalized rank error is roughly 1.7 / k.
+   */
+  QuantileSketch(size_t k = 200)
+  {
+    if (k < 2) {
+      throw std::invalid_argument("QuantileSketch k must be at least 2");
+    }
+    this->k = k;
+    levels.resize(1);
+    computeCapacities();
+  }
+
+  /**
+   * Adds an item to the sketch.
+   */
+  void add(T const& item)
+  {
+    std::vector<T>& level0 = levels[0];
+    level0.insert(std::upper_bound(level0.begin(), level0.end(), item), item);
+    n++;
+    if (level0.size() >= capacities[0]) compress();
+  }
+
+  /**
+   * Merges another sketch into this one.  The result summarizes the
+   * union of both streams.
+   */
+  void merge(QuantileSketch<T> const& other)
+  {
+    while (levels.size() < other.levels.size()) levels.emplace_back();
+    for (size_t h = 0; h < other.levels.size(); h++) {
+      mergeInto(levels[h], other.levels[h]);
+    }
+    n += other.n;
+    computeCapacities();
+    compress();
+  }
+
+  /**
+   * Returns the (approximate) number of items less than or equal to item.
+   */
+  size_t rank(T const& item) const
+  {
+    size_t r = 0;
+    for (size_t h = 0; h < levels.size(); h++) {
+      size_t count = std::upper_bound(levels[h].begin(), levels[h].end(),
+                                      item) - levels[h].begin();
+      r += count << h;
+    }
+    return r;
+  }
+
+  /**
+   * Returns the (approximate) q-quantile, i.e. the smallest item whose
+   * rank is at least q * n.  Returns 0 if the sketch is empty.
+   */
+  T quantile(double q) const
+  {
+    std::vector<std::pair<T, size_t>> items;
+    weightedItems(items);
+    if (items.empty()) return 0;
+    std::sort(items.begin(), items.end());
+
+    size_t target = rankTarget(q, n);
+    size_t cumulative = 0;
+    for (auto const& p : items) {
+      cumulative += p.second;
+      if (cumulative >= target) return p.first;
+    }
+    return items.back().first;
+  }
+
+  /**
+   * Appends every retained item along with its weight.
+   */
+  void weightedItems(std::vector<std::pair<T, size_t>>& out) const
+  {
+    for (size_t h = 0; h < levels.size(); h++) {
+      for (T const& item : levels[h]) {
+        out.push_back(std::make_pair(item, size_t(1) << h));
+      }
+    }
+  }
+
+  /**
+   * The number of items that have been added (including via merge).
+   */
+  size_t getN() const { return n; }
+
+  /**
+   * The number of items the sketch is currently storing.
+   */
+  size_t getNumRetained() const
+  {
+    size_t retained = 0;
+    for (auto const& level : levels) retained += level.size();
+    return retained;
+  }
+
+  size_t getNumLevels() const { return levels.size(); }
+
+  /**
+   * The sorted items of level h, each representing 2^h items.
+   */
+  std::vector<T> const& getLevel(size_t h) const { return levels[h]; }
+
+  /**
+   * The 1-based rank that the q-quantile of n items must reach.
+   */
+  static size_t rankTarget(double q, size_t n)
+  {
+    if (q <= 0) return 1;
+    if (q >= 1) return n;
+    size_t target = static_cast<size_t>(std::ceil(q * n));
+    return target == 0 ? 1 : target;
+  }
+
+private:
+  void computeCapacities()
+  {
+    size_t numLevels = levels.size();
+    capacities.resize(numLevels);
+    double capacity = k;
+    for (size_t depth = 0; depth < numLevels; depth++) {
+      size_t h = numLevels - 1 - depth;
+      capacities[h] = std::max<size_t>(2,
+        static_cast<size_t>(std::ceil(capacity)));
+      capacity *= 2.0 / 3.0;
+    }
+  }
+
+  /**
+   * Compacts every level that is at or over capacity, from the bottom up.
+   */
+  void compress()
+  {
+    for (size_t h = 0; h < levels.size(); h++) {
+      if (levels[h].size() >= capacities[h]) {
+        if (h + 1 == levels.size()) {
+          levels.emplace_back();
+          computeCapacities();
+        }
+        compact(h);
+      }
+    }
+  }
+
+  /**
+   * Promotes every other item of level h to level h + 1.  If the level has
+   * an odd number of items, the largest one stays behind.
+   */
+  void compact(size_t h)
+  {
+    std::vector<T>& level = levels[h];
+    size_t numPaired = level.size() - level.size() % 2;
+
+    std::vector<T> promoted;
+    promoted.reserve(numPaired / 2);
+    for (size_t i = coinFlip(); i < numPaired; i += 2) {
+      promoted.push_back(level[i]);
+    }
+    level.erase(level.begin(), level.begin() + numPaired);
+
+    mergeInto(levels[h + 1], promoted);
+  }
+
+  static void mergeInto(std::vector<T>& target, std::vector<T> const& source)
+  {
+    if (source.empty()) return;
+    std::vector<T> merged;
+    merged.reserve(target.size() + source.size());
+    std::merge(target.begin(), target.end(), source.begin(), source.end(),
+               std::back_inserter(merged));
+    target.swap(merged);
+  }
+
+  size_t coinFlip()
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed & 1;
+  }
+};
+
+}
+
+#endif
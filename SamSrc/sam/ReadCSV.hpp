@@ -49,6 +49,7 @@ public:
      
       size_t id = idGenerator->generate(); 
       EdgeType edge = tuplizer(id, line); 
+      edge.ingestTime = LatencyTracer::stamp();
       for (auto consumer: this->consumers) {
         DEBUG_PRINT("ReadCSV::receive feeding edge to consumer id %lu line"
           " %s\n", id, line.c_str())
@@ -57,7 +58,7 @@ public:
       }
       DEBUG_PRINT_SIMPLE("ReadCSV::receive finished feeding line to consumers")
 
-      this->notifySubscribers(edge.id, std::get<0>(edge.label));
+      this->notifySubscribers(edge, std::get<0>(edge.label));
       
       i++;
     }
@@ -0,0 +1,323 @@
+#ifndef SAM_READ_CAPTURE_HPP
+#define SAM_READ_CAPTURE_HPP
+
+/**
+ * Replays a binary capture written by CaptureWriter (see CaptureFormat.hpp).
+ *
+ * The file is memory-mapped and each block is decoded a column at a time
+ * straight into a batch of edges that is given to the consumers with
+ * consumeBatch.  There is no text parsing, so replay is limited by disk
+ * and memory bandwidth.  The time index in the footer lets a replay start
+ * at a given time without reading the blocks before it.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sam/AbstractDataSource.hpp>
+#include <sam/BaseProducer.hpp>
+#include <sam/CaptureFormat.hpp>
+#include <sam/IdGenerator.hpp>
+#include <sam/LatencyTracing.hpp>
+
+namespace sam {
+
+/**
+ * \tparam EdgeType The type of edges in the capture.  It must match the
+ *   type the capture was written with.
+ * \tparam timeField The index of the tuple field holding the time of the
+ *   edge.
+ */
+template <typename EdgeType, size_t timeField>
+class ReadCapture : public BaseProducer<EdgeType>, public AbstractDataSource
+{
+public:
+  typedef typename EdgeType::LocalLabelType LabelType;
+  typedef typename EdgeType::LocalTupleType TupleType;
+
+private:
+  typedef CaptureDetails::TupleColumns<LabelType> LabelColumns;
+  typedef CaptureDetails::TupleColumns<TupleType> TupleColumns;
+
+  std::string filename;
+  int fd = -1;
+  char const* data = nullptr; ///> Start of the mapping
+  size_t fileSize = 0;
+
+  CaptureDetails::Dictionary dictionary;
+  std::vector<CaptureDetails::BlockInfo> blocks;
+
+  size_t currentBlock = 0; ///> The block receive starts at
+  bool seeking = false; ///> Whether records before seekTime are skipped
+  double seekTime = 0;
+
+  // Generates unique id for each tuple
+  SimpleIdGenerator* idGenerator = idGenerator->getInstance();
+
+public:
+  /**
+   * \param nodeId The id of the node running this data source.
+   * \param filename The capture file to replay.
+   */
+  ReadCapture(size_t nodeId, std::string filename) :
+    BaseProducer<EdgeType>(nodeId, 1),
+    filename(filename)
+  {}
+
+  ~ReadCapture()
+  {
+    unmap();
+  }
+
+  /**
+   * Maps the file and reads the dictionary and the time index.
+   * \return Returns false if the file couldn't be opened or mapped.
+   * \throws CaptureException if the file isn't a capture of EdgeType.
+   */
+  bool connect()
+  {
+    unmap();
+
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "ReadCapture: couldn't open " << filename << ": "
+                << strerror(errno) << std::endl;
+      return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+      std::cerr << "ReadCapture: couldn't stat " << filename << " or it is "
+                << "empty" << std::endl;
+      unmap();
+      return false;
+    }
+    fileSize = sb.st_size;
+
+    void* addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      std::cerr << "ReadCapture: couldn't mmap " << filename << ": "
+                << strerror(errno) << std::endl;
+      unmap();
+      return false;
+    }
+    data = static_cast<char const*>(addr);
+    madvise(addr, fileSize, MADV_SEQUENTIAL);
+
+    readHeader();
+    readFooter();
+    currentBlock = 0;
+    seeking = false;
+    return true;
+  }
+
+  /**
+   * Makes the next receive start at the first edge whose time is at least
+   * time.  Blocks that end before time are skipped using the index, so
+   * this doesn't read them.  The capture is expected to be in time order.
+   */
+  void seek(double time)
+  {
+    auto it = std::find_if(blocks.begin(), blocks.end(),
+      [time](CaptureDetails::BlockInfo const& block) {
+        return block.maxTime >= time;
+      });
+    currentBlock = it - blocks.begin();
+    seeking = true;
+    seekTime = time;
+  }
+
+  /**
+   * Replays the capture from the start (or from where seek put it) to the
+   * end.
+   */
+  void receive()
+  {
+    std::vector<EdgeType> edges;
+    for (; currentBlock < blocks.size(); currentBlock++) {
+      decodeBlock(blocks[currentBlock], edges);
+
+      size_t first = 0;
+      if (seeking) {
+        while (first < edges.size() &&
+               std::get<timeField>(edges[first].tuple) < seekTime)
+        {
+          first++;
+        }
+        seeking = false;
+      }
+
+      // The edges enter the pipeline now, not when they were captured.
+      for (size_t i = first; i < edges.size(); i++) {
+        edges[i].id = idGenerator->generate();
+        edges[i].ingestTime = LatencyTracer::stamp();
+      }
+
+      if (first < edges.size()) {
+        for (auto consumer : this->consumers) {
+          consumer->consumeBatch(edges.data() + first, edges.size() - first);
+        }
+      }
+    }
+  }
+
+  size_t getNumBlocks() const { return blocks.size(); }
+
+  /**
+   * The number of edges in the capture.
+   */
+  size_t getNumRecords() const
+  {
+    size_t n = 0;
+    for (auto const& block : blocks) n += block.numRecords;
+    return n;
+  }
+
+  /**
+   * The smallest time in the capture.
+   */
+  double getStartTime() const
+  {
+    double time = std::numeric_limits<double>::max();
+    for (auto const& block : blocks) time = std::min(time, block.minTime);
+    return time;
+  }
+
+  /**
+   * The largest time in the capture.
+   */
+  double getEndTime() const
+  {
+    double time = std::numeric_limits<double>::lowest();
+    for (auto const& block : blocks) time = std::max(time, block.maxTime);
+    return time;
+  }
+
+private:
+  /**
+   * Checks that the bytes [position, position + n) are in the file.
+   */
+  void check(char const* position, size_t n) const
+  {
+    if (position < data || position + n > data + fileSize) {
+      throw CaptureException("ReadCapture: " + filename + " is truncated "
+        "or corrupt");
+    }
+  }
+
+  void readHeader()
+  {
+    char const* position = data;
+    check(position, CaptureDetails::MagicSize + sizeof(uint32_t));
+    if (memcmp(position, CaptureDetails::HeaderMagic,
+               CaptureDetails::MagicSize) != 0)
+    {
+      throw CaptureException("ReadCapture: " + filename +
+        " is not a capture file");
+    }
+    position += CaptureDetails::MagicSize;
+
+    auto expected = CaptureDetails::EdgeColumns<EdgeType>::describe();
+    uint32_t numColumns = CaptureDetails::read<uint32_t>(position);
+    check(position, 2 * numColumns);
+    bool matches = numColumns == expected.size();
+    for (uint32_t i = 0; matches && i < numColumns; i++) {
+      uint8_t kind = CaptureDetails::read<uint8_t>(position);
+      uint8_t width = CaptureDetails::read<uint8_t>(position);
+      matches = kind == expected[i].first && width == expected[i].second;
+    }
+    if (!matches) {
+      throw CaptureException("ReadCapture: the columns of " + filename +
+        " don't match the edge type");
+    }
+  }
+
+  void readFooter()
+  {
+    size_t trailerSize = sizeof(uint64_t) + CaptureDetails::MagicSize;
+    char const* position = data + fileSize - trailerSize;
+    check(position, trailerSize);
+    uint64_t footerOffset = CaptureDetails::read<uint64_t>(position);
+    if (memcmp(position, CaptureDetails::TrailerMagic,
+               CaptureDetails::MagicSize) != 0)
+    {
+      throw CaptureException("ReadCapture: " + filename + " has no footer;"
+        " the capture may not have been closed");
+    }
+
+    position = data + footerOffset;
+    dictionary = CaptureDetails::Dictionary();
+    check(position, sizeof(uint64_t));
+    uint64_t numStrings = CaptureDetails::read<uint64_t>(position);
+    for (uint64_t i = 0; i < numStrings; i++) {
+      check(position, sizeof(uint32_t));
+      uint32_t length = CaptureDetails::read<uint32_t>(position);
+      check(position, length);
+      dictionary.add(std::string(position, length));
+      position += length;
+    }
+
+    blocks.clear();
+    check(position, sizeof(uint64_t));
+    uint64_t numBlocks = CaptureDetails::read<uint64_t>(position);
+    for (uint64_t i = 0; i < numBlocks; i++) {
+      check(position, 2 * sizeof(uint64_t) + sizeof(uint32_t) +
+                      sizeof(double));
+      CaptureDetails::BlockInfo block;
+      block.offset = CaptureDetails::read<uint64_t>(position);
+      block.numRecords = CaptureDetails::read<uint32_t>(position);
+      block.minTime = CaptureDetails::read<double>(position);
+      block.maxTime = CaptureDetails::read<double>(position);
+      blocks.push_back(block);
+    }
+  }
+
+  void decodeBlock(CaptureDetails::BlockInfo const& block,
+                   std::vector<EdgeType>& edges)
+  {
+    char const* position = data + block.offset;
+    check(position, sizeof(uint32_t));
+    uint32_t numRecords = CaptureDetails::read<uint32_t>(position);
+    size_t rowWidth = 0;
+    for (auto const& column : CaptureDetails::EdgeColumns<EdgeType>::describe())
+    {
+      rowWidth += column.second;
+    }
+    check(position, numRecords * rowWidth);
+
+    edges.resize(numRecords);
+    LabelColumns::decode(edges,
+      [](EdgeType& edge) -> LabelType& { return edge.label; },
+      position, dictionary);
+    TupleColumns::decode(edges,
+      [](EdgeType& edge) -> TupleType& { return edge.tuple; },
+      position, dictionary);
+  }
+
+  void unmap()
+  {
+    if (data) {
+      munmap(const_cast<char*>(data), fileSize);
+      data = nullptr;
+    }
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+    fileSize = 0;
+  }
+};
+
+}
+
+#endif
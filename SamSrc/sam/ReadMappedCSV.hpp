@@ -0,0 +1,333 @@
+#ifndef SAM_READ_MAPPED_CSV_HPP
+#define SAM_READ_MAPPED_CSV_HPP
+
+/**
+ * Reads a CSV file for replaying large captures (e.g. VAST or CTU netflows)
+ * as fast as the machine allows.
+ *
+ * The file is memory-mapped and split into chunks whose boundaries fall
+ * just after a newline.  A pool of threads turns chunks into batches of
+ * edges, handing each line to the tuplizer as a boost::string_view that
+ * points into the mapping.  The batches are then given to the consumers
+ * with consumeBatch from the thread that called receive, so consumers never
+ * see concurrent calls.  By default batches are delivered in file order;
+ * if the pipeline doesn't depend on order, batches can be delivered as
+ * soon as they are parsed.
+ *
+ * Ids are assigned as the edges are delivered, so in ordered mode they
+ * increase with the position in the file, just like ReadCSV.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/utility/string_view.hpp>
+
+#include <sam/BaseProducer.hpp>
+#include <sam/AbstractDataSource.hpp>
+#include <sam/FeatureProducer.hpp>
+#include <sam/IdGenerator.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/Features.hpp>
+
+#define READ_MAPPED_CSV_CHUNK_SIZE (4 * 1024 * 1024)
+
+namespace sam {
+
+template <typename EdgeType, typename Tuplizer>
+class ReadMappedCSV : public BaseProducer<EdgeType>,
+  public AbstractDataSource, public FeatureProducer
+{
+private:
+  std::string filename; ///> File to read
+  size_t numThreads; ///> Number of threads parsing chunks
+  bool ordered; ///> Whether batches are delivered in file order
+  size_t chunkSize; ///> Approximate number of bytes in a chunk
+
+  int fd = -1; ///> File descriptor of the mapped file
+  char const* data = nullptr; ///> Start of the mapping
+  size_t fileSize = 0;
+
+  /// Offsets of the chunk boundaries.  Chunk i is
+  /// [boundaries[i], boundaries[i + 1]).
+  std::vector<size_t> boundaries;
+
+  // Generates unique id for each tuple
+  SimpleIdGenerator* idGenerator = idGenerator->getInstance();
+
+public:
+  /**
+   * \param nodeId The id of the node running this data source.
+   * \param filename The location of a CSV file.
+   * \param numThreads The number of threads parsing the file.
+   * \param ordered If true, edges are delivered in file order.  Otherwise
+   *   chunks are delivered in the order they finish parsing.
+   * \param chunkSize The approximate number of bytes each thread parses at
+   *   a time.  A chunk is also the unit handed to consumers.
+   */
+  ReadMappedCSV(size_t nodeId,
+                std::string filename,
+                size_t numThreads = std::thread::hardware_concurrency(),
+                bool ordered = true,
+                size_t chunkSize = READ_MAPPED_CSV_CHUNK_SIZE) :
+    BaseProducer<EdgeType>(nodeId, 1),
+    filename(filename),
+    numThreads(std::max<size_t>(1, numThreads)),
+    ordered(ordered),
+    chunkSize(std::max<size_t>(1, chunkSize)),
+    boundaries(1, 0)
+  {}
+
+  ~ReadMappedCSV() {
+    unmap();
+  }
+
+  /**
+   * Maps the file and works out the chunk boundaries.
+   * \return Returns false if the file couldn't be opened or mapped.
+   */
+  bool connect()
+  {
+    unmap();
+
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "ReadMappedCSV: couldn't open " << filename << ": "
+                << strerror(errno) << std::endl;
+      return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+      std::cerr << "ReadMappedCSV: couldn't stat " << filename << ": "
+                << strerror(errno) << std::endl;
+      unmap();
+      return false;
+    }
+    fileSize = sb.st_size;
+
+    if (fileSize > 0) {
+      void* addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        std::cerr << "ReadMappedCSV: couldn't mmap " << filename << ": "
+                  << strerror(errno) << std::endl;
+        unmap();
+        return false;
+      }
+      data = static_cast<char const*>(addr);
+
+      // Each chunk is read front to back, so let the kernel read ahead.
+      madvise(addr, fileSize, MADV_SEQUENTIAL);
+    }
+
+    computeBoundaries();
+    return true;
+  }
+
+  void receive()
+  {
+    size_t numChunks = boundaries.size() - 1;
+    if (numChunks == 0) return;
+
+    std::vector<std::vector<EdgeType>> batches(numChunks);
+    std::vector<bool> parsed(numChunks, false);
+    std::vector<size_t> finishedOrder; ///> Chunks in the order they finished
+    std::mutex mutex;
+    std::condition_variable parsedCondition;
+    std::condition_variable deliveredCondition;
+    std::atomic<size_t> nextChunk(0);
+    size_t numDelivered = 0;
+    std::exception_ptr error; ///> The first exception thrown while parsing
+
+    // At most this many chunks are parsed but not delivered, which bounds
+    // the memory used for edges.
+    size_t maxInFlight = 2 * numThreads;
+
+    auto worker = [&]() {
+      while (true) {
+        size_t chunk = nextChunk.fetch_add(1);
+        if (chunk >= numChunks) return;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          deliveredCondition.wait(lock, [&]() {
+            return error || chunk < numDelivered + maxInFlight;
+          });
+          if (error) return;
+        }
+
+        std::vector<EdgeType> batch;
+        std::exception_ptr parseError;
+        try {
+          parseChunk(chunk, batch);
+        } catch (...) {
+          parseError = std::current_exception();
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (parseError && !error) error = parseError;
+          batches[chunk].swap(batch);
+          parsed[chunk] = true;
+          finishedOrder.push_back(chunk);
+        }
+        parsedCondition.notify_one();
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numThreads; i++) {
+      threads.push_back(std::thread(worker));
+    }
+
+    size_t nextOrdered = 0;
+    for (size_t i = 0; i < numChunks; i++) {
+      std::vector<EdgeType> batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t chunk;
+        if (ordered) {
+          parsedCondition.wait(lock, [&]() {
+            return error || parsed[nextOrdered];
+          });
+          chunk = nextOrdered++;
+        } else {
+          parsedCondition.wait(lock, [&]() {
+            return error || finishedOrder.size() > i;
+          });
+          chunk = error ? 0 : finishedOrder[i];
+        }
+        if (error) break;
+        batch.swap(batches[chunk]);
+      }
+
+      // A consumer that throws stops the workers like a parse error does,
+      // so that they are joined before the exception leaves receive.
+      std::exception_ptr deliverError;
+      try {
+        deliver(batch);
+      } catch (...) {
+        deliverError = std::current_exception();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (deliverError && !error) error = deliverError;
+        numDelivered++;
+      }
+      deliveredCondition.notify_all();
+      if (deliverError) break;
+    }
+
+    deliveredCondition.notify_all();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // E.g. a malformed line that the tuplizer couldn't parse, or an
+    // exception from a consumer.
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  size_t getNumChunks() const { return boundaries.size() - 1; }
+
+private:
+  /**
+   * Splits the file into chunks of about chunkSize bytes, each ending just
+   * after a newline (or at the end of the file).
+   */
+  void computeBoundaries()
+  {
+    boundaries.clear();
+    boundaries.push_back(0);
+    size_t position = 0;
+    while (position < fileSize) {
+      size_t end = position + chunkSize;
+      if (end >= fileSize) {
+        end = fileSize;
+      } else {
+        void const* newline = memchr(data + end - 1, '\n', fileSize - end + 1);
+        end = newline ? static_cast<char const*>(newline) - data + 1
+                      : fileSize;
+      }
+      boundaries.push_back(end);
+      position = end;
+    }
+  }
+
+  /**
+   * Turns the lines of a chunk into edges.  Empty lines are skipped.
+   */
+  void parseChunk(size_t chunk, std::vector<EdgeType>& batch)
+  {
+    Tuplizer tuplizer;
+    char const* position = data + boundaries[chunk];
+    char const* end = data + boundaries[chunk + 1];
+
+    while (position < end) {
+      char const* newline = static_cast<char const*>(
+        memchr(position, '\n', end - position));
+      char const* lineEnd = newline ? newline : end;
+      size_t length = lineEnd - position;
+      if (length > 0 && position[length - 1] == '\r') {
+        length--;
+      }
+      if (length > 0) {
+        batch.push_back(tuplizer(0, boost::string_view(position, length)));
+      }
+      position = lineEnd + 1;
+    }
+  }
+
+  void deliver(std::vector<EdgeType>& batch)
+  {
+    for (auto& edge : batch) {
+      edge.id = idGenerator->generate();
+      edge.ingestTime = LatencyTracer::stamp();
+    }
+
+    if (!batch.empty()) {
+      for (auto consumer : this->consumers) {
+        consumer->consumeBatch(batch.data(), batch.size());
+      }
+    }
+
+    for (auto const& edge : batch) {
+      this->notifySubscribers(edge, std::get<0>(edge.label));
+    }
+  }
+
+  void unmap()
+  {
+    if (data) {
+      munmap(const_cast<char*>(data), fileSize);
+      data = nullptr;
+    }
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+    fileSize = 0;
+    boundaries.clear();
+    boundaries.push_back(0);
+  }
+};
+
+}
+#endif
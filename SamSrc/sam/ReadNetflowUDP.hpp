@@ -0,0 +1,292 @@
+#ifndef SAM_READ_NETFLOW_UDP_HPP
+#define SAM_READ_NETFLOW_UDP_HPP
+
+/**
+ * A NetFlow collector.  Routers and probes export NetFlow v5, v9 or IPFIX
+ * over UDP; this data source listens on one or more UDP ports and decodes
+ * the packets directly into NetflowV5 tuples (see NetflowDecoder.hpp), so
+ * there is no conversion to CSV and back.
+ *
+ * Each port has its own socket and its own thread, which reads datagrams
+ * in batches with recvmmsg and decodes them.  The decoded edges are handed
+ * to the consumers with consumeBatch, one thread at a time, so consumers
+ * never see concurrent calls.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <sam/AbstractDataSource.hpp>
+#include <sam/BaseProducer.hpp>
+#include <sam/IdGenerator.hpp>
+#include <sam/LatencyTracing.hpp>
+#include <sam/NetflowDecoder.hpp>
+#include <sam/tuples/NetflowV5.hpp>
+
+#define NETFLOW_UDP_BATCH_SIZE 64
+#define NETFLOW_UDP_MAX_DATAGRAM 65535
+
+namespace sam {
+
+/**
+ * \tparam EdgeType An edge whose tuple is a NetflowV5.  The label is
+ *   default constructed since exported flows are unlabeled.
+ */
+template <typename EdgeType>
+class ReadNetflowUDP : public BaseProducer<EdgeType>,
+  public AbstractDataSource
+{
+public:
+  typedef typename EdgeType::LocalLabelType LabelType;
+  typedef typename EdgeType::LocalTupleType TupleType;
+
+  static_assert(std::is_same<TupleType, netflowv5::NetflowV5>::value,
+    "ReadNetflowUDP produces NetflowV5 tuples");
+
+private:
+  std::string ip; ///> Address to listen on
+  std::vector<int> ports; ///> Requested ports; 0 picks a free port
+  std::vector<int> boundPorts; ///> The ports actually listened on
+  std::vector<int> sockets;
+  size_t batchSize; ///> Datagrams read with one recvmmsg
+  int timeoutMs; ///> How often the threads check for stop
+
+  std::atomic<bool> running;
+  std::mutex deliverMutex; ///> Serializes calls to the consumers
+
+  std::atomic<size_t> numReceived; ///> Number of flows delivered
+  std::atomic<size_t> numPackets; ///> Number of datagrams read
+  std::atomic<size_t> numMalformed; ///> Datagrams that couldn't be decoded
+
+  // Generates unique id for each tuple
+  SimpleIdGenerator* idGenerator = idGenerator->getInstance();
+
+public:
+  /**
+   * \param nodeId The id of the node running this data source.
+   * \param ip The address to listen on, e.g. "0.0.0.0".
+   * \param ports The UDP ports to listen on, one socket and one decode
+   *   thread per port.  A port of 0 listens on a free port; see getPort.
+   * \param batchSize The most datagrams read with one recvmmsg.
+   * \param timeoutMs How long a thread waits for datagrams before checking
+   *   whether stop was called.
+   */
+  ReadNetflowUDP(size_t nodeId,
+                 std::string ip,
+                 std::vector<int> ports,
+                 size_t batchSize = NETFLOW_UDP_BATCH_SIZE,
+                 int timeoutMs = 100) :
+    BaseProducer<EdgeType>(nodeId, 1),
+    ip(ip),
+    ports(ports),
+    batchSize(std::max<size_t>(1, batchSize)),
+    timeoutMs(std::max(1, timeoutMs)),
+    running(false),
+    numReceived(0),
+    numPackets(0),
+    numMalformed(0)
+  {}
+
+  ReadNetflowUDP(size_t nodeId, std::string ip, int port) :
+    ReadNetflowUDP(nodeId, ip, std::vector<int>(1, port))
+  {}
+
+  ~ReadNetflowUDP()
+  {
+    closeSockets();
+  }
+
+  /**
+   * Creates and binds the sockets.  A stop after this, even one before
+   * receive starts, makes receive return.
+   * \return Returns false if a socket couldn't be created or bound, in
+   *   which case no socket is left open and receive returns at once.
+   */
+  bool connect()
+  {
+    closeSockets();
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) != 1) {
+      std::cerr << "ReadNetflowUDP: invalid address " << ip << std::endl;
+      return false;
+    }
+
+    for (int port : ports) {
+      int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+      if (sockfd < 0) {
+        std::cerr << "ReadNetflowUDP: error opening socket: "
+                  << strerror(errno) << std::endl;
+        closeSockets();
+        return false;
+      }
+      sockets.push_back(sockfd);
+
+      struct timeval timeout;
+      timeout.tv_sec = timeoutMs / 1000;
+      timeout.tv_usec = (timeoutMs % 1000) * 1000;
+      setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+      address.sin_port = htons(port);
+      if (bind(sockfd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        std::cerr << "ReadNetflowUDP: couldn't bind " << ip << ":" << port
+                  << ": " << strerror(errno) << std::endl;
+        closeSockets();
+        return false;
+      }
+
+      struct sockaddr_in bound;
+      socklen_t boundLength = sizeof(bound);
+      getsockname(sockfd, (struct sockaddr *) &bound, &boundLength);
+      boundPorts.push_back(ntohs(bound.sin_port));
+    }
+    running = true;
+    return true;
+  }
+
+  /**
+   * Reads and decodes datagrams until stop is called.
+   */
+  void receive()
+  {
+    std::vector<std::thread> threads;
+    for (int sockfd : sockets) {
+      threads.push_back(std::thread([this, sockfd]() { readSocket(sockfd); }));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Makes receive return once the threads notice, which is within
+   * timeoutMs.  Can be called from any thread.
+   */
+  void stop()
+  {
+    running = false;
+  }
+
+  /**
+   * The port the i-th socket is bound to.  Only valid after connect.
+   */
+  int getPort(size_t i = 0) const { return boundPorts.at(i); }
+
+  size_t getNumReceived() const { return numReceived; }
+  size_t getNumPackets() const { return numPackets; }
+  size_t getNumMalformed() const { return numMalformed; }
+
+private:
+  void readSocket(int sockfd)
+  {
+    // The decoder keeps the templates of the exporters sending to this
+    // socket, so it belongs to this thread.
+    NetflowDecoder decoder;
+
+    std::vector<std::vector<char>> buffers(batchSize,
+      std::vector<char>(NETFLOW_UDP_MAX_DATAGRAM));
+    std::vector<struct iovec> iovecs(batchSize);
+    std::vector<struct sockaddr_storage> senders(batchSize);
+    std::vector<struct mmsghdr> messages(batchSize);
+
+    std::vector<TupleType> flows;
+    std::vector<EdgeType> edges;
+
+    while (running) {
+      for (size_t i = 0; i < batchSize; i++) {
+        iovecs[i].iov_base = buffers[i].data();
+        iovecs[i].iov_len = buffers[i].size();
+        memset(&messages[i].msg_hdr, 0, sizeof(messages[i].msg_hdr));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &senders[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+      }
+
+      // Waits (up to the receive timeout) for the first datagram and then
+      // takes whatever else is already queued.
+      int n = recvmmsg(sockfd, messages.data(), batchSize, MSG_WAITFORONE,
+                       NULL);
+      if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+          continue;
+        }
+        std::cerr << "ReadNetflowUDP: recvmmsg failed: " << strerror(errno)
+                  << std::endl;
+        break;
+      }
+
+      flows.clear();
+      size_t malformedBefore = decoder.getNumMalformed();
+      for (int i = 0; i < n; i++) {
+        decoder.decode(buffers[i].data(), messages[i].msg_len,
+                       senderAddress(senders[i]), flows);
+      }
+      numPackets += n;
+      numMalformed += decoder.getNumMalformed() - malformedBefore;
+
+      edges.clear();
+      for (auto& flow : flows) {
+        edges.push_back(EdgeType(0, LabelType(), flow));
+      }
+      deliver(edges);
+    }
+  }
+
+  void deliver(std::vector<EdgeType>& edges)
+  {
+    if (edges.empty()) return;
+
+    std::lock_guard<std::mutex> lock(deliverMutex);
+    for (auto& edge : edges) {
+      edge.id = idGenerator->generate();
+      edge.ingestTime = LatencyTracer::stamp();
+    }
+    for (auto consumer : this->consumers) {
+      consumer->consumeBatch(edges.data(), edges.size());
+    }
+    numReceived += edges.size();
+  }
+
+  static std::string senderAddress(struct sockaddr_storage const& sender)
+  {
+    char buffer[INET6_ADDRSTRLEN] = "";
+    if (sender.ss_family == AF_INET) {
+      auto address = reinterpret_cast<struct sockaddr_in const*>(&sender);
+      inet_ntop(AF_INET, &address->sin_addr, buffer, sizeof(buffer));
+    } else if (sender.ss_family == AF_INET6) {
+      auto address = reinterpret_cast<struct sockaddr_in6 const*>(&sender);
+      inet_ntop(AF_INET6, &address->sin6_addr, buffer, sizeof(buffer));
+    }
+    return std::string(buffer);
+  }
+
+  void closeSockets()
+  {
+    running = false;
+    for (int sockfd : sockets) {
+      ::close(sockfd);
+    }
+    sockets.clear();
+    boundPorts.clear();
+  }
+};
+
+}
+
+#endif
@@ -9,6 +9,8 @@
 #define READSOCKET_HPP
 
 #include <string>
+#include <vector>
+#include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netdb.h>
@@ -18,8 +20,10 @@
 #include <sam/tuples/VastNetflow.hpp>
 #include <sam/AbstractDataSource.hpp>
 #include <sam/tuples/Edge.hpp>
+#include <sam/LatencyTracing.hpp>
 
 #define READ_SOCKET_BUFFER_SIZE 4096 
+#define READ_SOCKET_LARGE_BUFFER_SIZE (4 * 1024 * 1024)
 
 namespace sam {
 
@@ -34,12 +38,12 @@ private:
 	std::string ip;
 	int sockfd;
 	char buffer[READ_SOCKET_BUFFER_SIZE];
-	char buffer2[2048];
 	std::string bufferStr;
 	int readCount;
 	std::string previous = "";
   int metricInterval = 100000;
   Tuplizer tuplizer;
+  size_t numReceived = 0; ///> Number of tuples received so far
 
   // Generates unique id for each tuple
   SimpleIdGenerator* idGenerator = idGenerator->getInstance(); 
@@ -51,9 +55,29 @@ public:
 	std::string readline();
   std::string readline2();
   void receive();
-	/*string readline3();
-	string readline4();
-	string readline5();*/
+
+  /**
+   * A higher throughput alternative to receive.  Data is read with recv
+   * into one large buffer and split into lines in place with memchr.
+   * Each line is handed to the tuplizer as a boost::string_view that points
+   * into the buffer, and the edges are given to the consumers with
+   * consumeBatch.  Empty lines are skipped rather than ending the stream.
+   * \param batchSize The largest number of edges handed to consumers at
+   *   once.  Edges are also handed over whenever the buffer has been
+   *   processed, so a slow stream doesn't wait for a full batch.
+   * \param bufferSize The size of the receive buffer.  The buffer grows if
+   *   a single line doesn't fit.
+   *
+   * getNumReceived() counts the edges of a batch as the batch is handed to
+   * the consumers, so while lines are parsed it lags by up to batchSize.
+   */
+  void receiveBatched(size_t batchSize = 1024,
+                      size_t bufferSize = READ_SOCKET_LARGE_BUFFER_SIZE);
+
+  size_t getNumReceived() const { return numReceived; }
+
+private:
+  void feedBatch(std::vector<EdgeType>& edges);
 };
 
 template <typename EdgeType, typename Tuplizer>
@@ -107,123 +131,6 @@ ReadSocket<EdgeType, Tuplizer>::connect()
 
 	return true;
 }
-/*
-string ReadSocket::readline2()
-{
-	readCount++;
-	//std::cout << "read count " << readCount << std::endl;
-
-	string line;
-
-	string::iterator pos;
-	while ((pos = std::find(bufferStr.begin(), bufferStr.end(), '\n')) == bufferStr.end()) {
-		int numRead = read(sockfd, buffer, READ_SOCKET_BUFFER_SIZE);
-		if (numRead <= 0) {
-			line = "";
-			return line;
-		}
-		buffer[numRead] = 0;
-		bufferStr += buffer;
-	}
-
-	line = string(bufferStr.begin(), pos);
-	bufferStr = string(pos + 1, bufferStr.end());
-	//std::cout << " line " << line << std::endl;
-	return line;
-
-}
-
-string ReadSocket::readline4()
-{
-	ssize_t numRead;
-	size_t totRead;
-	char *buf;
-	char ch;
-
-	if (buffer == NULL) {
-		return "";
-	}
-
-	buf = buffer;
-
-	totRead = 0;
-	for (;;) {
-		numRead = read(sockfd, &ch, 1);
-
-		if (numRead == -1) {
-			return "";
-
-		} else if (numRead == 0) {
-			if (totRead == 0)
-				return "";
-			else
-				break;
-
-		} else {
-			if (totRead < READ_SOCKET_BUFFER_SIZE) {
-				totRead++;
-				*buf++ = ch;
-			}
-
-			if (ch == '\n')
-				break;
-		}
-	}
-
-	*buf = '\0';
-	return string(buffer);
-}
-
-string ReadSocket::readline5()
-{
-	int n = 100;
-	ssize_t numRead;
-	size_t totRead;
-	char *buf;
-	char ch;
-
-	if (buffer == NULL) {
-		return "";
-	}
-
-	buf = buffer;
-
-	totRead = 0;
-	for (;;) {
-		numRead = read(sockfd, buffer2, n);
-
-		if (numRead == -1) {
-			return "";
-
-		} else if (numRead == 0) {
-			if (totRead == 0)
-				return "";
-			else
-				break;
-
-		} else {
-			if (totRead < READ_SOCKET_BUFFER_SIZE) {
-				int i = 0;
-				for (i = 0; i < numRead && buffer2[i] != '\n'; i++) {
-					*buf++ = buffer2[i];
-				}
-				totRead += i;
-				if (buffer2[i] == '\n') {
-					buffer2[numRead] = '\0';
-					previous = string(&buffer2[i+1]);
-					break;
-				}
-			}
-
-		}
-	}
-
-	*buf = '\0';
-	return string(buffer);
-}
-
-
-*/
 template <typename EdgeType, typename Tuplizer>
 std::string 
 ReadSocket<EdgeType, Tuplizer>::readline()
@@ -324,18 +231,113 @@ ReadSocket<EdgeType, Tuplizer>::receive()
       return;
     }
     i++;
+    numReceived++;
     //if (i % metricInterval == 0) {
     //  std::cout << "ReadSocket received " << i << std::endl;
     //}
 
     size_t id = idGenerator->generate();
     EdgeType edge = tuplizer(id, s);
+    edge.ingestTime = LatencyTracer::stamp();
     for (auto consumer : this->consumers) {
       consumer->consume(edge);
     }
   }
 }
 
+template <typename EdgeType, typename Tuplizer>
+void 
+ReadSocket<EdgeType, Tuplizer>::receiveBatched(size_t batchSize,
+                                               size_t bufferSize)
+{
+  // Ask the kernel for a receive buffer of the same size so that it can
+  // keep up while we are parsing.  This is only a hint.
+  int rcvbuf = static_cast<int>(bufferSize);
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  std::vector<char> largeBuffer(bufferSize);
+  std::vector<EdgeType> edges;
+  edges.reserve(batchSize);
+
+  // The unprocessed bytes are in [begin, end).
+  size_t begin = 0;
+  size_t end = 0;
+  size_t i = 0;
+
+  while (true) {
+    // Move the partial line at the end of the buffer to the front.
+    if (begin > 0) {
+      memmove(largeBuffer.data(), largeBuffer.data() + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+    if (end == largeBuffer.size()) {
+      largeBuffer.resize(2 * largeBuffer.size());
+    }
+
+    ssize_t numRead = recv(sockfd, largeBuffer.data() + end,
+                           largeBuffer.size() - end, 0);
+    if (numRead <= 0) {
+      break;
+    }
+    end += numRead;
+
+    char* data = largeBuffer.data();
+    char* newline;
+    while ((newline = static_cast<char*>(
+              memchr(data + begin, '\n', end - begin))) != NULL)
+    {
+      size_t length = newline - (data + begin);
+      if (length > 0 && data[begin + length - 1] == '\r') {
+        length--;
+      }
+      if (length > 0) {
+        size_t id = idGenerator->generate();
+        edges.push_back(tuplizer(id, boost::string_view(data + begin, length)));
+        edges.back().ingestTime = LatencyTracer::stamp();
+        i++;
+        if (edges.size() >= batchSize) {
+          feedBatch(edges);
+        }
+      }
+      begin = newline - data + 1;
+    }
+    feedBatch(edges);
+  }
+
+  // The stream may not end with a newline.
+  if (end > begin) {
+    size_t length = end - begin;
+    if (largeBuffer[end - 1] == '\r') {
+      length--;
+    }
+    if (length > 0) {
+      size_t id = idGenerator->generate();
+      edges.push_back(tuplizer(id,
+        boost::string_view(largeBuffer.data() + begin, length)));
+      edges.back().ingestTime = LatencyTracer::stamp();
+      i++;
+      feedBatch(edges);
+    }
+  }
+
+  std::cout << "total in ReadSocket receiveBatched " << i << std::endl;
+}
+
+template <typename EdgeType, typename Tuplizer>
+void 
+ReadSocket<EdgeType, Tuplizer>::feedBatch(std::vector<EdgeType>& edges)
+{
+  if (edges.empty()) {
+    return;
+  }
+  numReceived += edges.size();
+  for (auto consumer : this->consumers) {
+    consumer->consumeBatch(edges.data(), edges.size());
+  }
+  edges.clear();
+}
+
 
 }
 
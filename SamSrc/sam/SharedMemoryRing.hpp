@@ -0,0 +1,340 @@
+#ifndef SAM_SHARED_MEMORY_RING_HPP
+#define SAM_SHARED_MEMORY_RING_HPP
+
+/**
+ * Lock-free single-producer single-consumer rings in POSIX shared memory
+ * (shm_open + mmap), used by PushPull to talk to nodes running on the same
+ * host without going through TCP and ZeroMQ.
+ *
+ * A receiving node creates one segment per PushPull, named after the
+ * starting port and its node id.  The segment starts with a doorbell and
+ * holds one ring per (sending node, push socket) pair.  A sender writes a
+ * message into its ring and rings the doorbell; the receiver's pull threads
+ * sleep on the doorbell with a futex while all their rings are empty, so
+ * they neither spin nor add latency.
+ *
+ * Each ring has exactly one writer thread at a time (PushPull holds the
+ * push socket mutex while writing) and one reader thread.  Messages are a
+ * uint32 length, 4 bytes of padding and the bytes, rounded up to 8 bytes.
+ * A zero length message is the terminate message, as with ZeroMQ.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHARED_MEMORY_RING_SIZE (1 << 20)
+
+namespace sam {
+
+class SharedMemoryException : public std::runtime_error {
+public:
+  SharedMemoryException(char const * message) : std::runtime_error(message) {}
+  SharedMemoryException(std::string message) : std::runtime_error(message) {}
+};
+
+namespace SharedMemoryDetails {
+
+static uint32_t const WrapMarker = 0xffffffff;
+static size_t const RecordHeaderSize = 8;
+static size_t const CacheLine = 64;
+
+inline size_t roundUp(size_t n, size_t multiple)
+{
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+/**
+ * Wakes or waits on a futex that may be shared between processes.
+ */
+inline void futexWake(std::atomic<uint32_t>* word)
+{
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX,
+          NULL, NULL, 0);
+}
+
+inline void futexWait(std::atomic<uint32_t>* word, uint32_t expected,
+                      int timeoutMs)
+{
+  struct timespec timeout;
+  struct timespec* timeoutPtr = NULL;
+  if (timeoutMs >= 0) {
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    timeoutPtr = &timeout;
+  }
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected,
+          timeoutPtr, NULL, 0);
+}
+
+}
+
+/**
+ * Lets readers sleep until a writer has put something in one of the rings
+ * of a segment.
+ */
+struct SharedMemoryDoorbell
+{
+  std::atomic<uint32_t> signal; ///> Bumped after every write
+  std::atomic<uint32_t> waiting; ///> Number of readers about to sleep
+
+  /**
+   * Called by a reader before checking its rings.  Pass the result to wait.
+   */
+  uint32_t prepare() const { return signal.load(); }
+
+  /**
+   * Sleeps until a writer rings after prepare returned seen, or timeoutMs
+   * passes (negative waits forever).  Returns right away if a writer rang
+   * in between, so no write is missed.
+   */
+  void wait(uint32_t seen, int timeoutMs)
+  {
+    waiting.fetch_add(1);
+    SharedMemoryDetails::futexWait(&signal, seen, timeoutMs);
+    waiting.fetch_sub(1);
+  }
+
+  void ring()
+  {
+    signal.fetch_add(1);
+    if (waiting.load() > 0) {
+      SharedMemoryDetails::futexWake(&signal);
+    }
+  }
+};
+
+/**
+ * A view of one ring inside a mapped segment.  The memory starts out
+ * zeroed (ftruncate does that), which is an empty ring.
+ */
+class SharedMemoryRing
+{
+private:
+  struct Header
+  {
+    std::atomic<uint64_t> head; ///> Total bytes written
+    char pad1[SharedMemoryDetails::CacheLine - sizeof(uint64_t)];
+    std::atomic<uint64_t> tail; ///> Total bytes read
+    char pad2[SharedMemoryDetails::CacheLine - sizeof(uint64_t)];
+  };
+
+  Header* header = nullptr;
+  char* data = nullptr;
+  size_t capacity = 0; ///> Bytes of data; a multiple of 8
+
+public:
+  SharedMemoryRing() {}
+
+  SharedMemoryRing(char* base, size_t capacity) :
+    header(reinterpret_cast<Header*>(base)),
+    data(base + sizeof(Header)),
+    capacity(capacity)
+  {}
+
+  /// The bytes of a segment taken by a ring of the given capacity.
+  static size_t footprint(size_t capacity)
+  {
+    return sizeof(Header) + capacity;
+  }
+
+  /// The largest message that fits in the ring.
+  size_t maxMessageSize() const
+  {
+    return capacity - SharedMemoryDetails::RecordHeaderSize;
+  }
+
+  bool empty() const
+  {
+    return header->tail.load(std::memory_order_relaxed) ==
+           header->head.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Appends a message if there is room.
+   * \return Returns false if the ring is full.
+   */
+  bool tryWrite(char const* bytes, size_t length)
+  {
+    using namespace SharedMemoryDetails;
+
+    size_t recordSize = RecordHeaderSize + roundUp(length, RecordHeaderSize);
+    if (recordSize > capacity) {
+      throw SharedMemoryException("Message of " + std::to_string(length) +
+        " bytes is larger than the shared memory ring");
+    }
+
+    uint64_t head = header->head.load(std::memory_order_relaxed);
+    uint64_t tail = header->tail.load(std::memory_order_acquire);
+    size_t offset = head % capacity;
+    size_t contiguous = capacity - offset;
+
+    // Records don't wrap; the rest of the ring is skipped instead.
+    size_t needed = contiguous < recordSize ? contiguous + recordSize
+                                            : recordSize;
+    if (capacity - (head - tail) < needed) return false;
+
+    if (contiguous < recordSize) {
+      uint32_t marker = WrapMarker;
+      memcpy(data + offset, &marker, sizeof(marker));
+      head += contiguous;
+      offset = 0;
+    }
+
+    uint32_t length32 = static_cast<uint32_t>(length);
+    memcpy(data + offset, &length32, sizeof(length32));
+    memcpy(data + offset + RecordHeaderSize, bytes, length);
+    header->head.store(head + recordSize, std::memory_order_seq_cst);
+    return true;
+  }
+
+  /**
+   * Takes the oldest message.
+   * \return Returns false if the ring is empty.
+   */
+  bool tryRead(std::string& message)
+  {
+    using namespace SharedMemoryDetails;
+
+    uint64_t tail = header->tail.load(std::memory_order_relaxed);
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    if (tail == head) return false;
+
+    size_t offset = tail % capacity;
+    uint32_t length;
+    memcpy(&length, data + offset, sizeof(length));
+    if (length == WrapMarker) {
+      tail += capacity - offset;
+      offset = 0;
+      memcpy(&length, data, sizeof(length));
+    }
+
+    message.assign(data + offset + RecordHeaderSize, length);
+    header->tail.store(tail + RecordHeaderSize +
+                       roundUp(length, RecordHeaderSize),
+                       std::memory_order_release);
+    return true;
+  }
+};
+
+/**
+ * A shared memory segment holding a doorbell and numRings rings.  The
+ * receiving side creates it and removes the name when destroyed; senders
+ * open it once it exists.
+ */
+class SharedMemorySegment
+{
+private:
+  std::string name;
+  size_t numRings;
+  size_t ringCapacity;
+  size_t size;
+  bool owner = false;
+  char* base = nullptr;
+
+public:
+  /**
+   * \param name The POSIX shared memory name, starting with '/'.
+   * \param numRings The number of rings in the segment.
+   * \param ringCapacity The bytes of data in each ring.
+   */
+  SharedMemorySegment(std::string name, size_t numRings,
+                      size_t ringCapacity = SHARED_MEMORY_RING_SIZE) :
+    name(name), numRings(numRings),
+    ringCapacity(SharedMemoryDetails::roundUp(ringCapacity,
+                   SharedMemoryDetails::RecordHeaderSize))
+  {
+    size = SharedMemoryDetails::CacheLine +
+           numRings * SharedMemoryRing::footprint(this->ringCapacity);
+  }
+
+  ~SharedMemorySegment()
+  {
+    if (base) munmap(base, size);
+    if (owner) shm_unlink(name.c_str());
+  }
+
+  SharedMemorySegment(SharedMemorySegment const&) = delete;
+  SharedMemorySegment& operator=(SharedMemorySegment const&) = delete;
+
+  /**
+   * Creates the segment, replacing any left over from an earlier run.
+   * \throws SharedMemoryException if it can't be created.
+   */
+  void create()
+  {
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      throw SharedMemoryException("Couldn't create shared memory " + name +
+        ": " + strerror(errno));
+    }
+    owner = true;
+    if (ftruncate(fd, size) < 0) {
+      ::close(fd);
+      throw SharedMemoryException("Couldn't size shared memory " + name +
+        ": " + strerror(errno));
+    }
+    map(fd);
+  }
+
+  /**
+   * Opens a segment created by the receiving side.
+   * \return Returns false if it doesn't exist (or isn't sized) yet.
+   */
+  bool open()
+  {
+    if (base) return true;
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) return false;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || static_cast<size_t>(sb.st_size) != size) {
+      ::close(fd);
+      return false;
+    }
+    map(fd);
+    return true;
+  }
+
+  bool isOpen() const { return base != nullptr; }
+
+  SharedMemoryDoorbell& doorbell()
+  {
+    return *reinterpret_cast<SharedMemoryDoorbell*>(base);
+  }
+
+  SharedMemoryRing ring(size_t i)
+  {
+    return SharedMemoryRing(base + SharedMemoryDetails::CacheLine +
+                            i * SharedMemoryRing::footprint(ringCapacity),
+                            ringCapacity);
+  }
+
+private:
+  void map(int fd)
+  {
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      throw SharedMemoryException("Couldn't map shared memory " + name +
+        ": " + strerror(errno));
+    }
+    base = static_cast<char*>(addr);
+  }
+};
+
+}
+
+#endif
@@ -8,6 +8,8 @@
 
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <boost/lexical_cast.hpp>
 #include <sam/AbstractConsumer.hpp>
 #include <sam/BaseComputation.hpp>
@@ -89,6 +91,7 @@ public:
             std::string identifier) :
     BaseComputation(nodeId, featureMap, identifier) 
   {
+    this->registerMetrics(this->feedCount);
     this->N = N;
   }
 
@@ -100,7 +103,7 @@ public:
 
   bool consume(EdgeType const& edge) 
   {
-    TupleType tuple = edge.tuple;
+    TupleType const& tuple = edge.tuple;
 
     this->feedCount++;
     if (this->feedCount % this->metricInterval == 0) {
@@ -110,31 +113,56 @@ public:
 
     // Generates unique key from key fields 
     std::string key = generateKey<keyFields...>(tuple);
-    if (allWindows.count(key) == 0) {
-      auto value = new value_t(N); 
-      allWindows[key] = value;
-    }
-
-    std::string sValue = 
-      boost::lexical_cast<std::string>(std::get<valueField>(tuple));
-    T value;
-    try {
-      value = boost::lexical_cast<T>(sValue);
-    } catch (std::exception e) {
-      std::cerr << "SimpleSum::consume Caught exception trying to cast string "
-                << "value of " << sValue << std::endl;
-      std::cerr << e.what() << std::endl;
-      value = 0;
-    }
-
-    allWindows[key]->insert(value);
+    value_t* window = getWindow(key);
+    window->insert(getValue(tuple));
     
     // Getting the current sum and providing that to the featureMap.
-    T currentSum = allWindows[key]->getSum();
+    T currentSum = window->getSum();
     SingleFeature feature(currentSum);
     this->featureMap->updateInsert(key, this->identifier, feature);
 
-    notifySubscribers(edge.id, currentSum);
+    notifySubscribers(edge, currentSum);
+
+    return true;
+  }
+
+  /**
+   * Processes a batch of tuples.  Each distinct key in the batch is looked
+   * up in allWindows once, and the feature map is updated once per key with
+   * the sum after the last tuple of that key.  Subscribers are still 
+   * notified for every tuple.
+   */
+  bool consumeBatch(EdgeType const* edges, size_t numEdges) 
+  {
+    size_t before = this->feedCount;
+    this->feedCount += numEdges;
+    if (this->feedCount / this->metricInterval > 
+        before / this->metricInterval) 
+    {
+      std::cout << "SimpleSum: NodeId " << this->nodeId << " feedCount " 
+                << this->feedCount << std::endl;
+    }
+
+    std::unordered_map<std::string, value_t*> batchWindows;
+    std::vector<value_t*> windows(numEdges);
+    for (size_t i = 0; i < numEdges; i++) {
+      std::string key = generateKey<keyFields...>(edges[i].tuple);
+      auto it = batchWindows.find(key);
+      if (it == batchWindows.end()) {
+        it = batchWindows.emplace(key, getWindow(key)).first;
+      }
+      windows[i] = it->second;
+    }
+
+    for (size_t i = 0; i < numEdges; i++) {
+      windows[i]->insert(getValue(edges[i].tuple));
+      notifySubscribers(edges[i], windows[i]->getSum());
+    }
+
+    for (auto const& p : batchWindows) {
+      SingleFeature feature(p.second->getSum());
+      this->featureMap->updateInsert(p.first, this->identifier, feature);
+    }
 
     return true;
   }
@@ -152,6 +180,36 @@ public:
   }
 
   void terminate() {}
+
+private:
+  /**
+   * Returns the window for the key, creating it if it doesn't exist.
+   */
+  value_t* getWindow(std::string const& key)
+  {
+    auto it = allWindows.find(key);
+    if (it == allWindows.end()) {
+      it = allWindows.emplace(key, new value_t(N)).first;
+      this->numKeys = allWindows.size();
+    }
+    return it->second;
+  }
+
+  T getValue(TupleType const& tuple)
+  {
+    std::string sValue = 
+      boost::lexical_cast<std::string>(std::get<valueField>(tuple));
+    T value;
+    try {
+      value = boost::lexical_cast<T>(sValue);
+    } catch (std::exception e) {
+      std::cerr << "SimpleSum::consume Caught exception trying to cast string "
+                << "value of " << sValue << std::endl;
+      std::cerr << e.what() << std::endl;
+      value = 0;
+    }
+    return value;
+  }
 };
 
 }
@@ -267,6 +267,15 @@ public:
     return resultEdges[i];
   }
 
+  /**
+   * The ingest time of the last edge of the result, which is usually the
+   * edge that completed it.  0 if that edge wasn't sampled for latency
+   * tracing.
+   */
+  int64_t getIngestTime() const {
+    return resultEdges.empty() ? 0 : resultEdges.back().ingestTime;
+  }
+
 private:
 
   void addTimeInfoFromCurrent(EdgeRequestType & edgeRequest,
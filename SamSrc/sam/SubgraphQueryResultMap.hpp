@@ -3,6 +3,8 @@
 
 #include <sam/SubgraphQueryResult.hpp>
 #include <sam/CompressedSparse.hpp>
+#include <sam/LatencyTracing.hpp>
+#include <sam/Metrics.hpp>
 #include <sam/AbstractSubgraphPrinter.hpp>
 #include <limits>
 
@@ -81,21 +83,16 @@ private:
 
   std::shared_ptr<PrinterType> printer;
 
-  #ifdef DETAIL_TIMING
-  double totalTimeProcessAgainstGraph = 0;
-  double totalAddSimpleTime = 0;
-  double totalTimeProcessSource = 0;
-  double totalTimeProcessTarget = 0;
-  double totalTimeProcessSourceTarget = 0;
-  double totalTimeProcessProcessAgainstGraph = 0;
-  double totalTimeProcessLoop1 = 0;
-  double totalTimeProcessLoop2 = 0;
-  #endif
-
-  #ifdef METRICS
-  size_t totalResultsDeleted = 0;
-  size_t totalResultsCreated = 0;
-  #endif
+  // Only recorded while metrics are enabled (see Metrics.hpp).
+  std::shared_ptr<LatencyHistogram> timeAdd;
+  std::shared_ptr<LatencyHistogram> timeProcessSource;
+  std::shared_ptr<LatencyHistogram> timeProcessTarget;
+  std::shared_ptr<LatencyHistogram> timeProcessSourceTarget;
+  std::shared_ptr<LatencyHistogram> timeProcessProcessAgainstGraph;
+  std::shared_ptr<LatencyHistogram> timeProcessLoop1;
+  std::shared_ptr<LatencyHistogram> timeProcessLoop2;
+  std::shared_ptr<Counter> totalResultsDeleted;
+  std::shared_ptr<Counter> totalResultsCreated;
 
 public:
   /**
@@ -181,51 +178,42 @@ public:
     this->printer = printer;
   }
 
-  #ifdef DETAIL_TIMING
-  // A number of methods that are only defined if we are collecting 
-  // detailed timing information.
+  // A number of methods that return the time in seconds spent in parts
+  // of the computation while metrics were enabled.
 
   /**
-   * The total amount of time spent in processAgainstGraph.
+   * The total amount of time spent in add(result, edgeRequests), which
+   * is mostly processAgainstGraph.
    */
   double getTotalTimeProcessAgainstGraph() const {
-    return totalTimeProcessAgainstGraph;
+    return timeAdd->totalSeconds();
   }
 
-  /**
-   * Total time spend in add(result, edgeRequests).
-   */
-  double getTotalAddSimpleTime() const {
-    return totalAddSimpleTime;
-  }
   double getTotalTimeProcessSource() const {
-    return totalTimeProcessSource;
+    return timeProcessSource->totalSeconds();
   }
   double getTotalTimeProcessTarget() const {
-    return totalTimeProcessTarget;
+    return timeProcessTarget->totalSeconds();
   }
   double getTotalTimeProcessSourceTarget() const {
-    return totalTimeProcessSourceTarget;
+    return timeProcessSourceTarget->totalSeconds();
   }
   double getTotalTimeProcessProcessAgainstGraph() const {
-    return totalTimeProcessProcessAgainstGraph;
+    return timeProcessProcessAgainstGraph->totalSeconds();
   }
   double getTotalTimeProcessLoop1() const {
-    return totalTimeProcessLoop1;
+    return timeProcessLoop1->totalSeconds();
   }
   double getTotalTimeProcessLoop2() const {
-    return totalTimeProcessLoop2;
+    return timeProcessLoop2->totalSeconds();
   }
 
-  #endif
-
-
-  #ifdef METRICS
-
-  size_t getTotalResultsDeleted() const { return totalResultsDeleted; }
-  size_t getTotalResultsCreated() const { return totalResultsCreated; }
-
-  #endif
+  size_t getTotalResultsDeleted() const {
+    return totalResultsDeleted->value();
+  }
+  size_t getTotalResultsCreated() const {
+    return totalResultsCreated->value();
+  }
 
 private:
 
@@ -269,6 +257,25 @@ SubgraphQueryResultMap<EdgeType, source, target, time, duration,
                          CscType const& _csc) :
                          csc(_csc), csr(_csr)
 {
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  auto stage = [&registry, nodeId](std::string const& name) {
+    return registry.histogram("sam_result_map_seconds",
+      metricLabels({{"node", std::to_string(nodeId)}, {"stage", name}}),
+      "Time spent in a stage of SubgraphQueryResultMap");
+  };
+  timeAdd = stage("add");
+  timeProcessSource = stage("process_source");
+  timeProcessTarget = stage("process_target");
+  timeProcessSourceTarget = stage("process_source_target");
+  timeProcessProcessAgainstGraph = stage("process_against_graph");
+  timeProcessLoop1 = stage("process_loop1");
+  timeProcessLoop2 = stage("process_loop2");
+  std::string labels = metricLabels({{"node", std::to_string(nodeId)}});
+  totalResultsCreated = registry.counter("sam_result_map_results_created_total",
+    labels, "Intermediate query results stored");
+  totalResultsDeleted = registry.counter("sam_result_map_results_deleted_total",
+    labels, "Intermediate query results removed because they expired");
+
   sourceIndexFunction = [this](TupleType const& tuple) {
     SourceType src = std::get<source>(tuple);
     size_t index = this->sourceHash(src) % this->tableCapacity;
@@ -348,7 +355,7 @@ SubgraphQueryResultMap<EdgeType, source, target, time, duration,
 add(QueryResultType const& result, 
     std::list<EdgeRequestType>& edgeRequests)
 {
-  DETAIL_TIMING_BEG1
+  ScopedTimer timer(timeAdd);
 
   DEBUG_PRINT("Node %lu SubgraphQueryResultMap::add "
     " edge request size %lu\n", nodeId, edgeRequests.size())
@@ -398,7 +405,7 @@ add(QueryResultType const& result,
       alr[newIndex].push_back(localQueryResult);
       mutexes[newIndex].unlock();
 
-      METRICS_INCREMENT(totalResultsCreated)
+      totalResultsCreated->add();
  
     } else {
       DEBUG_PRINT("Node %lu Complete query! %s\n", nodeId, 
@@ -406,15 +413,16 @@ add(QueryResultType const& result,
       size_t index = numQueryResults.fetch_add(1);
       index = index % resultCapacity;
       queryResults[index] = localQueryResult;
+      int64_t ingestTime = localQueryResult.getIngestTime();
+      LatencyTracer::record(TraceStage::ResultComplete, ingestTime);
       if (printer) {
         printer->print(localQueryResult);
+        LatencyTracer::record(TraceStage::ResultPrint, ingestTime);
       }
     }
   }
   DEBUG_PRINT("Node %lu exiting SubgraphQueryResultMap::add(result, csr, csc, "
     "edgeRequests)\n", nodeId);
-
-  DETAIL_TIMING_END1(totalTimeProcessAgainstGraph);
 }
 
 
@@ -464,7 +472,7 @@ add_nocheck(QueryResultType const& result,
     alr[newIndex].push_back(result);
     mutexes[newIndex].unlock(); 
 
-    METRICS_INCREMENT(totalResultsCreated)
+    totalResultsCreated->add();
 
   } else {
     DEBUG_PRINT("Node %lu Complete query! %s\n", nodeId, 
@@ -472,8 +480,10 @@ add_nocheck(QueryResultType const& result,
     size_t index = numQueryResults.fetch_add(1);
     index = index % resultCapacity;
     queryResults[index] = result;
+    LatencyTracer::record(TraceStage::ResultComplete, result.getIngestTime());
     if (printer) {
       printer->print(result);
+      LatencyTracer::record(TraceStage::ResultPrint, result.getIngestTime());
     }
   }
 
@@ -497,20 +507,20 @@ process(EdgeType const& edge,
    "tuple, edgeRequests) tuple %s\n", nodeId,
    sam::toString(edge.tuple).c_str())
 
-  DETAIL_TIMING_BEG1
+  ScopedTimer sourceTimer(timeProcessSource);
   size_t workProcessSource = process(edge, edgeRequests, 
                                    sourceIndexFunction, sourceCheckFunction);
-  DETAIL_TIMING_END1(totalTimeProcessSource)
+  sourceTimer.stop();
 
-  DETAIL_TIMING_BEG2
+  ScopedTimer targetTimer(timeProcessTarget);
   size_t workProcessTarget = process(edge, edgeRequests,
                                    targetIndexFunction, targetCheckFunction);
-  DETAIL_TIMING_END2(totalTimeProcessTarget)
+  targetTimer.stop();
   
-  DETAIL_TIMING_BEG2
+  ScopedTimer sourceTargetTimer(timeProcessSourceTarget);
   size_t workProcessSourceTarget = process(edge, edgeRequests, 
                           sourceTargetIndexFunction, sourceTargetCheckFunction);
-  DETAIL_TIMING_END2(totalTimeProcessSourceTarget)
+  sourceTargetTimer.stop();
 
   DEBUG_PRINT("Node %lu End of SubgraphQueryResultMap edgeRequests.size()"
     " %lu\n", nodeId, edgeRequests.size())
@@ -676,7 +686,7 @@ process(EdgeType const& edge,
         std::function<size_t(TupleType const&)> indexFunction,
         std::function<bool(QueryResultType const&)> checkFunction )
 {
-  DETAIL_TIMING_BEG1
+  ScopedTimer loop1Timer(timeProcessLoop1);
 
   size_t index = indexFunction(edge.tuple);
 
@@ -703,7 +713,7 @@ process(EdgeType const& edge,
       "edgeRequests, indexFunction, checkFunction) tuple %s deleting "
       "result %s", nodeId, toString(edge.tuple).c_str(), l->toString().c_str());
       l = this->alr[index].erase(l);
-      METRICS_INCREMENT(this->totalResultsDeleted)
+      totalResultsDeleted->add();
     } else {
       if (checkFunction(*l)) {
         DEBUG_PRINT("Node %lu SubgraphQueryResultMap::process "
@@ -740,17 +750,17 @@ process(EdgeType const& edge,
   DEBUG_PRINT("Node %lu SubgraphQueryResultMap::process total work after for "
     "loop %lu\n", nodeId, totalWork);
  
-  DETAIL_TIMING_END1(totalTimeProcessLoop1)
+  loop1Timer.stop();
  
   // See if the graph can further the queries
-  DETAIL_TIMING_BEG2
+  ScopedTimer graphTimer(timeProcessProcessAgainstGraph);
   size_t graphWork = processAgainstGraph(rehash);
   DEBUG_PRINT("Node %lu SubgraphQueryResultMap::process work from process"
     "AgainstGraph: %lu\n", this->nodeId, graphWork);
   totalWork += graphWork;
-  DETAIL_TIMING_END2(totalTimeProcessProcessAgainstGraph)
+  graphTimer.stop();
 
-  DETAIL_TIMING_BEG2
+  ScopedTimer loop2Timer(timeProcessLoop2);
   size_t addWork = 0;
   for (QueryResultType& result : rehash) {
     DEBUG_PRINT("Node %lu SubgraphQueryResultMap::process rehashing " 
@@ -760,7 +770,7 @@ process(EdgeType const& edge,
   }
   DEBUG_PRINT("Node %lu SubgraphQueryResultMap::process addWork %lu"
     " rehash size %lu\n", nodeId, addWork, rehash.size());
-  DETAIL_TIMING_END2(totalTimeProcessLoop2)
+  loop2Timer.stop();
 
   totalWork += addWork;
   DEBUG_PRINT("Node %lu SubgraphQueryResultMap::process at end, total work"
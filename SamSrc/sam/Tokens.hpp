@@ -11,6 +11,7 @@
 #include <stack>
 
 #include <sam/FeatureMap.hpp>
+#include <sam/PreviousValueStore.hpp>
 
 namespace sam {
 
@@ -21,10 +22,41 @@ public:
 };
 
 
+/**
+ * The operations of a compiled Expression.  Each token compiles to exactly
+ * one instruction (see ExpressionToken::compile).
+ */
+enum class ExpressionOpCode {
+  PUSH_NUMBER,   ///> Pushes a constant.
+  LOAD_FIELD,    ///> Pushes a field of the input tuple.
+  CALL,          ///> Pushes the value of a token, e.g. one that reads the
+                 ///> feature map.
+  ADD,
+  SUB,
+  MULT,
+  LESS_THAN,
+  GREATER_THAN,
+  NOT_COMPILABLE ///> The token can only be evaluated on the token stack.
+};
+
 template <typename... Ts>
 class ExpressionToken
 {};
 
+/**
+ * A single instruction of a compiled Expression.
+ */
+template <typename TupleType>
+struct ExpressionInstruction
+{
+  ExpressionOpCode opCode;
+  double number = 0; ///> The constant for PUSH_NUMBER
+  double (*loadField)(TupleType const&) = nullptr; ///> Loader for LOAD_FIELD
+  ExpressionToken<TupleType>* token = nullptr; ///> The token for CALL
+
+  ExpressionInstruction(ExpressionOpCode opCode) : opCode(opCode) {}
+};
+
 template <typename... Ts>
 class ExpressionToken<std::tuple<Ts...>>
 {
@@ -65,6 +97,47 @@ public:
                         std::tuple<Ts...> const& input) 
   { return false; }
 
+  /**
+   * Evaluates a token that produces a single value, e.g. a number or a
+   * feature.  This is what compiled expressions call for CALL
+   * instructions.  The default goes through evaluate with a scratch stack;
+   * tokens that are evaluated often should override it.
+   * \param key The key that is used to find relevant entries in the feature
+   *  map.
+   * \param value Set to the value of the token if evaluation succeeds.
+   * \return Returns true if the token evaluated correctly.  False otherwise.
+   */
+  virtual bool evaluateValue(std::string const& key,
+                             std::tuple<Ts...> const& input,
+                             double& value)
+  {
+    std::stack<double> mystack;
+    if (!evaluate(mystack, key, input) || mystack.size() != 1) {
+      return false;
+    }
+    value = mystack.top();
+    return true;
+  }
+
+  /**
+   * Returns the instruction that this token compiles to.  By default
+   * tokens are treated as values and compile to a CALL of evaluateValue.
+   */
+  virtual ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    ExpressionInstruction<std::tuple<Ts...>> instruction(
+      ExpressionOpCode::CALL);
+    instruction.token = this;
+    return instruction;
+  }
+
+  /**
+   * Gives the token the store to keep per-key state in.  Only tokens that
+   * remember previous values (PrevToken) use it.
+   */
+  virtual void setPreviousValueStore(
+    std::shared_ptr<PreviousValueStore> store) {}
+
   /**
    * Returns true if the token is an operator.  False otherwise
    */
@@ -105,6 +178,14 @@ public:
     return true;
   }
 
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    ExpressionInstruction<std::tuple<Ts...>> instruction(
+      ExpressionOpCode::PUSH_NUMBER);
+    instruction.number = number;
+    return instruction;
+  }
+
   bool isOperator() const { return false; }
 };
 
@@ -136,6 +217,16 @@ public:
   bool isRightAssociative() const { return associativity == RIGHT_ASSOCIATIVE; }
   int getPrecedence() const { return precedence; }
 
+  /**
+   * Operators that don't have an opcode of their own make the whole
+   * expression fall back to the token stack.
+   */
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    return ExpressionInstruction<std::tuple<Ts...>>(
+      ExpressionOpCode::NOT_COMPILABLE);
+  }
+
 };
 
 template <typename... Ts>
@@ -148,12 +239,17 @@ class AddOperator<std::tuple<Ts...>> :
 {
 public:
   AddOperator(std::shared_ptr<FeatureMap> featureMap) : 
-    OperatorToken<std::tuple<Ts...>>(featureMap, 2, this->LEFT_ASSOCIATIVE) {}
+    OperatorToken<std::tuple<Ts...>>(featureMap, this->LEFT_ASSOCIATIVE, 2) {}
 
   std::string toString() const {
     return "AddOperator";
   }
 
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    return ExpressionInstruction<std::tuple<Ts...>>(ExpressionOpCode::ADD);
+  }
+
   bool evaluate(std::stack<double> & mystack,
                 std::string const& key,
                 std::tuple<Ts...> const& input)
@@ -182,12 +278,17 @@ class SubOperator<std::tuple<Ts...>> :
 {
 public:
   SubOperator(std::shared_ptr<FeatureMap> featureMap) : 
-    OperatorToken<std::tuple<Ts...>>(featureMap, 2, this->LEFT_ASSOCIATIVE) {}
+    OperatorToken<std::tuple<Ts...>>(featureMap, this->LEFT_ASSOCIATIVE, 2) {}
 
   std::string toString() const {
     return "SubOperator";
   }
 
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    return ExpressionInstruction<std::tuple<Ts...>>(ExpressionOpCode::SUB);
+  }
+
   bool evaluate(std::stack<double> & mystack,
                 std::string const& key,
                 std::tuple<Ts...> const& input)
@@ -216,12 +317,17 @@ class MultOperator<std::tuple<Ts...>> :
 {
 public:
   MultOperator(std::shared_ptr<FeatureMap> featureMap) : 
-    OperatorToken<std::tuple<Ts...>>(featureMap, 3, this->LEFT_ASSOCIATIVE) {}
+    OperatorToken<std::tuple<Ts...>>(featureMap, this->LEFT_ASSOCIATIVE, 3) {}
 
   std::string toString() const {
     return "MultOperator";
   }
 
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    return ExpressionInstruction<std::tuple<Ts...>>(ExpressionOpCode::MULT);
+  }
+
   bool evaluate(std::stack<double> & mystack,
                 std::string const& key,
                 std::tuple<Ts...> const& input)
@@ -250,12 +356,17 @@ class LessThanOperator<std::tuple<Ts...>> :
 {
 public:
   LessThanOperator(std::shared_ptr<FeatureMap> featureMap) : 
-    OperatorToken<std::tuple<Ts...>>(featureMap, 1, this->LEFT_ASSOCIATIVE) {}
+    OperatorToken<std::tuple<Ts...>>(featureMap, this->LEFT_ASSOCIATIVE, 1) {}
 
   std::string toString() const {
     return "LessThanOperator";
   }
 
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    return ExpressionInstruction<std::tuple<Ts...>>(ExpressionOpCode::LESS_THAN);
+  }
+
   bool evaluate(std::stack<double> & mystack,
                 std::string const& key,
                 std::tuple<Ts...> const& input)
@@ -284,12 +395,17 @@ class GreaterThanOperator<std::tuple<Ts...>> :
 {
 public:
   GreaterThanOperator(std::shared_ptr<FeatureMap> featureMap) : 
-    OperatorToken<std::tuple<Ts...>>(featureMap, 1, this->LEFT_ASSOCIATIVE) {}
+    OperatorToken<std::tuple<Ts...>>(featureMap, this->LEFT_ASSOCIATIVE, 1) {}
 
   std::string toString() const {
     return "GreaterThanOperator";
   }
 
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    return ExpressionInstruction<std::tuple<Ts...>>(ExpressionOpCode::GREATER_THAN);
+  }
+
   bool evaluate(std::stack<double> & mystack,
                 std::string const& key,
                 std::tuple<Ts...> const& input)
@@ -345,6 +461,23 @@ public:
     }
   }
 
+  /**
+   * Compiles to a load of the field with its static type, so there is no
+   * virtual call or stack traffic per tuple.
+   */
+  ExpressionInstruction<std::tuple<Ts...>> compile()
+  {
+    ExpressionInstruction<std::tuple<Ts...>> instruction(
+      ExpressionOpCode::LOAD_FIELD);
+    instruction.loadField = &FieldToken::load;
+    return instruction;
+  }
+
+  static double load(std::tuple<Ts...> const& input)
+  {
+    return std::get<field>(input);
+  }
+
   bool isOperator() const { return false; }
 };
 
@@ -382,17 +515,25 @@ public:
                 std::tuple<Ts...> const& input)
   {
     //std::cout << "FuncToken evaluate " << std::endl;
+    double d;
+    if (evaluateValue(key, input, d)) {
+      mystack.push(d);
+      return true;
+    }
+    return false;
+  }
+
+  bool evaluateValue(std::string const& key,
+                     std::tuple<Ts...> const& input,
+                     double& value)
+  {
     if (this->featureMap->exists(key, identifier)) {
-      //std::cout << "Key identifier exists in feature map " << key << " "
-      //          << identifier << std::endl;
       try {
-        double d = this->featureMap->at(key, identifier)->evaluate(function);
-        //std::cout << "Got d " << d << std::endl;
-        mystack.push(d);
+        value = this->featureMap->at(key, identifier)->evaluate(function);
+        return true;
       } catch (std::exception e) {
         printf("Caught exception %s\n", e.what());
       }
-      return true;
     }
     return false;
   }
@@ -413,63 +554,56 @@ private:
   // The identifier used to uniquely identify features produced by this
   // ExpressionToken.
   std::string identifier;
+
+  // Where the previous value for each key is kept, and our slot in it.
+  std::shared_ptr<PreviousValueStore> store;
+  size_t slot;
 public:
  
   PrevToken(std::shared_ptr<FeatureMap> featureMap) : 
     ExpressionToken<std::tuple<Ts...>>(featureMap) 
   {
     identifier = createPreviousIdentifierString();
+    setPreviousValueStore(std::make_shared<PreviousValueStore>());
   }
 
   std::string getIdentifier() {
     return identifier;
   }
 
+  /**
+   * By default each PrevToken has its own store.  TransformProducer
+   * replaces it with the store shared by all of its expressions.
+   */
+  void setPreviousValueStore(std::shared_ptr<PreviousValueStore> store)
+  {
+    this->store = store;
+    this->slot = store->addSlot();
+  }
+
   bool evaluate(std::stack<double> & mystack, 
                   std::string const& key,
                   std::tuple<Ts...> const& input) 
   {
-    //std::cout << "PrevToken evaluate " << std::endl;
-    // Get the current value of the field.
-    double currentData;
-    try {
-      auto item = std::get<field>(input);
-      currentData = boost::lexical_cast<double>(item);
-    } catch (std::exception e) {
-      std::string message = std::string("In PrevToken::evaluate, tried to") +
-        " convert " + boost::lexical_cast<std::string>(std::get<field>(input)) +
-        " to double and failed.";
-      throw ExpressionTokenException(message);
+    double previous;
+    if (evaluateValue(key, input, previous)) {
+      mystack.push(previous);
+      return true;
     }
-    
-    // Create a feature out of the current data
-    std::shared_ptr<Feature> feature 
-      = std::make_shared<SingleFeature>(currentData);
-
-    // Check to see if the feature has been added before
-    bool exists = false;
-    if (this->featureMap->exists(key, identifier)) { 
-
-      // If the feature exists, we can return previous value
-      exists = true;
-      auto feature = this->featureMap->at(key, identifier);
-      
-      // Getting the value of the feature through this function
-      auto valueFunc = [](Feature const * feature)->double { 
-        return feature->getValue(); 
-      };
-
-      // Pushing back the previous value onto the stack.
-      double result = feature->template evaluate<double>(valueFunc); 
-      mystack.push(result);
-    } 
-
-    // Inserting the current data to become the past data
-    feature = std::make_shared<SingleFeature>(currentData);
-    this->featureMap->updateInsert(key, identifier, *feature);
+    return false;
+  }
 
-    return exists;
-     
+  /**
+   * Records the current value of the field for the key and provides the
+   * value it had the last time the key was seen.
+   * \return Returns false the first time the key is seen.
+   */
+  bool evaluateValue(std::string const& key,
+                     std::tuple<Ts...> const& input,
+                     double& value)
+  {
+    double currentData = toDouble(std::get<field>(input));
+    return store->exchange(key, slot, currentData, value);
   }
 
   bool isOperator() const { return false; }
@@ -486,6 +620,23 @@ private:
     return "previous_" + boost::lexical_cast<std::string>(field) + "_" +
             boost::uuids::to_string(a);
   }
+
+  template <typename T>
+  static double toDouble(T const& item)
+  {
+    return item;
+  }
+
+  static double toDouble(std::string const& item)
+  {
+    try {
+      return boost::lexical_cast<double>(item);
+    } catch (std::exception e) {
+      std::string message = std::string("In PrevToken::evaluate, tried to") +
+        " convert " + item + " to double and failed.";
+      throw ExpressionTokenException(message);
+    }
+  }
 };
 
 
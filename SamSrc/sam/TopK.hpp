@@ -70,6 +70,7 @@ TopK<EdgeType, valueField, keyFields...>::TopK(
       std::string identifier) :
       BaseComputation(nodeId, featureMap, identifier)
 {
+  this->registerMetrics(this->feedCount);
   this->N = N;
   this->b = b;
   this->k = k;
@@ -98,6 +99,7 @@ bool TopK<EdgeType, valueField, keyFields...>::consume(
     std::pair<std::string, std::shared_ptr<
               SlidingWindow<ValueType>>> p(key, sw);
     allWindows[key] = sw;    
+    this->numKeys = allWindows.size();
   }
   
   ValueType value = std::get<valueField>(edge.tuple);
@@ -115,7 +117,7 @@ bool TopK<EdgeType, valueField, keyFields...>::consume(
     this->featureMap->updateInsert(key, this->identifier, feature);
 
     // notifySubscribers only takes doubles right now
-    notifySubscribers(edge.id, frequencies[0]);
+    notifySubscribers(edge, frequencies[0]);
 
   }
 
@@ -5,6 +5,7 @@
 #include <sam/TupleExpression.hpp>
 #include <sam/FeatureMap.hpp>
 #include <sam/Tokens.hpp>
+#include <sam/PreviousValueStore.hpp>
 #include <sam/AbstractConsumer.hpp>
 #include <sam/BaseComputation.hpp>
 #include <sam/BaseProducer.hpp>
@@ -29,6 +30,9 @@ public:
 private:
   std::shared_ptr<const TupleExpression<InputTupleType>> transformExpressions;
 
+  /// Per-key state for the PrevTokens in transformExpressions.
+  std::shared_ptr<PreviousValueStore> previousValues;
+
 public:
   TransformProducer(std::shared_ptr<const TupleExpression<InputTupleType>> 
                       _expression,
@@ -67,8 +71,13 @@ TransformProducer(
   :
   BaseComputation(nodeId, featureMap, identifier),
   BaseProducer<OutputEdgeType>(nodeId, queueLength),
-  transformExpressions(expression) 
+  transformExpressions(expression),
+  previousValues(std::make_shared<PreviousValueStore>())
 {
+  this->registerMetrics(this->feedCount);
+  for (size_t i = 0; i < transformExpressions->size(); i++) {
+    transformExpressions->get(i)->setPreviousValueStore(previousValues);
+  }
 }
 
 template <typename InputEdgeType, 
@@ -84,6 +93,7 @@ bool
 TransformProducer<InputEdgeType, OutputEdgeType, keyFields...>::
 consume(InputEdgeType const& edge)
 {
+  this->feedCount++;
   std::string key = generateKey<keyFields...>(edge.tuple);
 
   // Generate a subtuple with just the key fields
@@ -99,6 +109,7 @@ consume(InputEdgeType const& edge)
   auto finalTuple = std::tuple_cat(outTuple, resultTuple);
 
   OutputEdgeType outputEdgeType(edge.id, edge.label, finalTuple);
+  outputEdgeType.ingestTime = edge.ingestTime;
 
   this->parallelFeed(outputEdgeType);
 
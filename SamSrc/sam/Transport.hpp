@@ -0,0 +1,125 @@
+#ifndef SAM_TRANSPORT_HPP
+#define SAM_TRANSPORT_HPP
+
+/**
+ * The interface GraphStore, EdgeRequestMap and ZeroMQPushPull use to move
+ * messages between nodes.  A transport carries messages of one type; the
+ * ZeroMQ backend serializes them, while the in-process backends hand the
+ * objects over as they are, so on a single node or in a unit test they
+ * never leave memory or get turned into strings.
+ *
+ * The backends are:
+ *  - ZeroMQ (ZeroMQTransport.hpp): PushPull underneath, for nodes in
+ *    different processes or on different hosts.
+ *  - Direct (InProcessTransport.hpp): send calls the callbacks of the
+ *    other node right away, on the sending thread.
+ *  - Queue (InProcessTransport.hpp): send puts the message on a queue of
+ *    the other node, which its receive threads drain like pull threads.
+ *
+ * All of them follow PushPull's termination protocol: terminate tells the
+ * other nodes this node is done sending, then waits until every other
+ * node has done the same (or nothing arrives for pullThreadTimeout ms),
+ * so no callback runs after terminate returns.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+/// How long in ms receive threads (and PushPull's pull threads) wait for
+/// a message before giving up on the other nodes.
+#define PUSH_PULL_PULL_THREAD_TIMEOUT 10000
+
+namespace sam {
+
+class TransportException : public std::runtime_error {
+public:
+  TransportException(char const * message) : std::runtime_error(message) {}
+  TransportException(std::string message) : std::runtime_error(message) {}
+};
+
+enum class TransportType
+{
+  ZeroMQ,
+  Direct,
+  Queue
+};
+
+/**
+ * Parses the name of a transport as given on the command line: "zeromq",
+ * "direct" or "queue".
+ * \throws TransportException if the name is unknown.
+ */
+inline TransportType transportTypeFromString(std::string const& name)
+{
+  if (name == "zeromq") return TransportType::ZeroMQ;
+  if (name == "direct") return TransportType::Direct;
+  if (name == "queue")  return TransportType::Queue;
+  throw TransportException("Unknown transport " + name +
+    "; expected zeromq, direct or queue");
+}
+
+/**
+ * The index of the receive thread running the calling code, set by every
+ * backend that has receive threads (PushPull's pull threads included).
+ * Callbacks use it to keep per-thread state without locking.
+ */
+inline size_t& receiveThreadId()
+{
+  static thread_local size_t id = 0;
+  return id;
+}
+
+template <typename MessageType>
+class Transport
+{
+public:
+  typedef std::function<void(MessageType const&)> FunctionType;
+  typedef std::function<void()> DrainFunctionType;
+
+  virtual ~Transport() {}
+
+  /**
+   * Sends the message to the specified node, which must not be this node.
+   * \return Returns true if the message was sent, false otherwise.
+   */
+  virtual bool send(MessageType const& message, size_t node) = 0;
+
+  /**
+   * Sends the messages to the specified node, in order.  The default calls
+   * send on each; the ZeroMQ backend puts them in one frame, which is what
+   * gets compressed.
+   * \return Returns true if all the messages were sent, false otherwise.
+   */
+  virtual bool sendBatch(MessageType const* messages, size_t numMessages,
+                         size_t node)
+  {
+    bool sent = true;
+    for (size_t i = 0; i < numMessages; i++) {
+      sent = send(messages[i], node) && sent;
+    }
+    return sent;
+  }
+
+  /**
+   * Stops sending and waits for the other nodes to stop too.  Calling it
+   * more than once is fine.
+   */
+  virtual void terminate() = 0;
+
+  /**
+   * True if the callbacks run on the thread calling send, possibly on
+   * several threads at once, rather than on this node's receive threads.
+   * receiveThreadId doesn't identify the caller then.
+   */
+  virtual bool callsBackOnSender() const { return false; }
+
+  virtual size_t getTotalMessagesSent() const = 0;
+  virtual size_t getTotalMessagesReceived() const = 0;
+  virtual size_t getTotalMessagesFailed() const = 0;
+};
+
+}
+
+#endif
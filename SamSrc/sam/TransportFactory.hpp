@@ -0,0 +1,64 @@
+#ifndef SAM_TRANSPORT_FACTORY_HPP
+#define SAM_TRANSPORT_FACTORY_HPP
+
+#include <sam/Transport.hpp>
+#include <sam/InProcessTransport.hpp>
+#include <sam/ZeroMQTransport.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sam {
+
+/**
+ * Creates a transport of the given type.  The parameters are those of
+ * PushPull plus the functions the ZeroMQ backend uses to turn messages
+ * into strings and back; each backend ignores what it has no use for.
+ * The queue backend uses numPullThreads receive threads and hwm as the
+ * length of their queues.  Only the ZeroMQ backend compresses.
+ */
+template <typename MessageType>
+std::unique_ptr<Transport<MessageType>> createTransport(
+  TransportType type,
+  size_t numNodes,
+  size_t nodeId,
+  size_t numPushSockets,
+  size_t numPullThreads,
+  std::vector<std::string> hostnames,
+  uint32_t hwm,
+  std::vector<typename Transport<MessageType>::FunctionType> callbacks,
+  size_t startingPort,
+  int timeout,
+  bool local,
+  typename ZeroMQTransport<MessageType>::SerializeFunction serialize,
+  typename ZeroMQTransport<MessageType>::DeserializeFunction deserialize,
+  std::vector<typename Transport<MessageType>::DrainFunctionType>
+    drainCallbacks =
+      std::vector<typename Transport<MessageType>::DrainFunctionType>(),
+  int pullThreadTimeout = PUSH_PULL_PULL_THREAD_TIMEOUT,
+  CompressionConfig compression = CompressionConfig())
+{
+  Transport<MessageType>* transport = nullptr;
+  switch (type) {
+    case TransportType::ZeroMQ:
+      transport = new ZeroMQTransport<MessageType>(numNodes, nodeId,
+        numPushSockets, numPullThreads, hostnames, hwm, callbacks,
+        startingPort, timeout, local, serialize, deserialize, drainCallbacks,
+        pullThreadTimeout, compression);
+      break;
+    case TransportType::Direct:
+      transport = new DirectTransport<MessageType>(numNodes, nodeId,
+        callbacks, startingPort, timeout, drainCallbacks, pullThreadTimeout);
+      break;
+    case TransportType::Queue:
+      transport = new QueueTransport<MessageType>(numNodes, nodeId,
+        numPullThreads, hwm, callbacks, startingPort, timeout,
+        drainCallbacks, pullThreadTimeout);
+      break;
+  }
+  return std::unique_ptr<Transport<MessageType>>(transport);
+}
+
+}
+
+#endif
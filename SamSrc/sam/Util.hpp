@@ -3,6 +3,7 @@
 
 #include <boost/lexical_cast.hpp>
 #include <boost/tokenizer.hpp>
+#include <boost/utility/string_view.hpp>
 #include <numeric>
 #include <iostream>
 #include <queue>
@@ -89,6 +90,40 @@ namespace sam {
 #endif
 
 
+/**
+ * Splits a comma-separated line in place.  Each call to next returns a view
+ * of the next field.
+ */
+class FieldSplitter
+{
+private:
+  boost::string_view s;
+public:
+  FieldSplitter(boost::string_view s) : s(s) {}
+
+  boost::string_view next()
+  {
+    size_t found = s.find(',');
+    boost::string_view field = s.substr(0, found);
+    s.remove_prefix(found == boost::string_view::npos ? s.size() : found + 1);
+    return field;
+  }
+
+  template <typename T>
+  T nextAs()
+  {
+    boost::string_view field = next();
+    return boost::lexical_cast<T>(field.data(), field.size());
+  }
+
+  std::string nextString()
+  {
+    boost::string_view field = next();
+    return std::string(field.data(), field.size());
+  }
+};
+
+
 class UtilException : public std::runtime_error {
 public:
   UtilException(char const * message) : std::runtime_error(message) { } 
@@ -8,9 +8,11 @@
 #ifndef ZEROMQ_PUSH_PULL_H
 #define ZEROMQ_PUSH_PULL_H
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <set>
 #include <sys/socket.h>
@@ -18,8 +20,10 @@
 
 #include <sam/AbstractConsumer.hpp>
 #include <sam/BaseProducer.hpp>
+#include <sam/LatencyTracing.hpp>
+#include <sam/Metrics.hpp>
 #include <sam/Util.hpp>
-#include <sam/ZeroMQUtil.hpp>
+#include <sam/TransportFactory.hpp>
 #include <sam/tuples/Edge.hpp>
 
 
@@ -40,6 +44,22 @@ public:
  * Class for partitioning tuples across the cluster.  The consumer takes
  * as input strings (both tuple and label.  The producer creates 
  * TupleType and LabelType objects.
+ *
+ * Tuples from other nodes arrive on numPullThreads pull threads.  Each
+ * pull thread has its own lane: its own tuplizer and a batch of edges that
+ * it hands on once it holds queueLength edges or the thread runs out of
+ * messages.  By default a lane hands its batch to the consumers of this
+ * producer with parallelFeed, which takes the producer lock once per
+ * batch.  Consumers registered with registerLaneConsumer instead get the
+ * batches of one lane only, always from the same thread, without any lock
+ * shared between the lanes.
+ *
+ * The tuples travel over a Transport (see Transport.hpp).  With the ZeroMQ
+ * transport they are sent as strings; the in-process transports hand the
+ * edges over as they are.  The direct transport calls back on the sending
+ * thread, so its edges skip the lanes and go straight to parallelFeed.
+ * consumeBatch sorts a batch of edges by destination and sends each node
+ * its share with one sendBatch, which the ZeroMQ transport can compress.
  * @tparam TupleType The type of tuple.
  * @tparam LabelType The label type that can appear with the rest of the 
  *                   tuple.
@@ -51,10 +71,25 @@ class ZeroMQPushPull : public AbstractConsumer<EdgeType>,
                        public BaseProducer<EdgeType>
 {
 public:
-  typedef typename PushPull::FunctionType FunctionType;
+  typedef Transport<EdgeType> CommunicatorType;
+  typedef typename CommunicatorType::FunctionType FunctionType;
+  typedef typename CommunicatorType::DrainFunctionType DrainFunctionType;
 
 private:
-  Tuplizer tuplizer; ///> Converts from string to tuple
+  /**
+   * The state a pull thread uses to turn strings into edges and hand them
+   * on.  Only that pull thread touches it once data is flowing.
+   */
+  struct Lane
+  {
+    Tuplizer tuplizer;
+    std::vector<EdgeType> edges; ///> Edges waiting to be handed on
+    std::vector<std::shared_ptr<AbstractConsumer<EdgeType>>> consumers;
+    std::atomic<size_t> numPulled; ///> Edges handed on by this lane
+
+    Lane() : numPulled(0) {}
+  };
+
   size_t numNodes; ///> How many total nodes there are
   size_t nodeId; ///> The node id of this node
   std::vector<std::string> hostnames; ///> The hostnames of all the nodes
@@ -62,12 +97,17 @@ private:
   bool local; ///> Indicates that we are running on one node.
   uint32_t hwm;  ///> The high water mark
   std::atomic<bool> terminated;
+  size_t batchSize; ///> Edges a lane collects before handing them on
+  std::vector<std::unique_ptr<Lane>> lanes; ///> One per pull thread
 
-  size_t consumeCount = 0; ///> How many items this node has seen through feed()
+  /// How many items this node has seen through consume()
+  SingleWriterCounter consumeCount;
   size_t metricInterval = 100000; ///> How many seen before spitting metrics out
 
   // Generates unique id for each tuple
   SimpleIdGenerator* idGenerator = idGenerator->getInstance(); 
+
+  std::vector<std::unique_ptr<CallbackMetric>> callbackMetrics;
     
 
 public:
@@ -86,6 +126,15 @@ public:
    *                 trying to send a message to a socket.
    * \param local Specifies that we aren't actually talking to any other nodes.
    * \param hwm The high water mark.
+   * \param numPushSockets The number of push sockets created for each of
+   *   the other nodes.  More sockets ease contention between threads
+   *   calling consume.
+   * \param numPullThreads The number of threads pulling tuples from the
+   *   other nodes, each with its own lane.
+   * \param transportType How tuples get to the other nodes.  With a single
+   *   node the direct transport is always used, since nothing is sent.
+   * \param compression How the ZeroMQ transport compresses the batches
+   *   sent by consumeBatch.
    */
   ZeroMQPushPull(size_t queueLength,
                  size_t numNodes, 
@@ -94,16 +143,26 @@ public:
                  size_t startingPort,
                  size_t timeout,
                  bool local,
-                 std::size_t hwm);
+                 std::size_t hwm,
+                 size_t numPushSockets = 1,
+                 size_t numPullThreads = 1,
+                 TransportType transportType = TransportType::ZeroMQ,
+                 CompressionConfig compression = CompressionConfig());
 
   virtual ~ZeroMQPushPull()
   {
     terminate();
-    delete communicator;
+    communicator.reset();
     DEBUG_PRINT("Node %lu end of ~ZeroMQPushPull\n", nodeId);
   }
   
   virtual bool consume(EdgeType const& edge);
+
+  /**
+   * Partitions the edges like consume, but sends each other node the
+   * edges that go to it as one batch.
+   */
+  virtual bool consumeBatch(EdgeType const* edges, size_t numEdges);
                        
 
   /** 
@@ -117,18 +176,49 @@ public:
 
   size_t getConsumeCount() const { return consumeCount; }
 
+  /**
+   * Registers a consumer that gets the edges pulled by one pull thread.
+   * It is always called from that thread, so it needs no locking of its
+   * own.  Consumers must be registered before other nodes send data.
+   * \param lane The index of the pull thread, less than numPullThreads.
+   * \param consumer The consumer.
+   */
+  void registerLaneConsumer(size_t lane,
+    std::shared_ptr<AbstractConsumer<EdgeType>> consumer)
+  {
+    lanes.at(lane)->consumers.push_back(consumer);
+  }
+
+  size_t getNumLanes() const { return lanes.size(); }
+
+  /**
+   * The number of edges received from other nodes and handed on by the
+   * lanes.
+   */
+  size_t getNumPulled() const
+  {
+    size_t n = 0;
+    for (auto const& lane : lanes) n += lane->numPulled;
+    return n;
+  }
+
+  /**
+   * The number of edges that could not be sent to other nodes.
+   */
+  size_t getNumSendFailures() const
+  {
+    return communicator->getTotalMessagesFailed();
+  }
+
 private:
   bool acceptingData = false;
-  PushPull* communicator;
+  std::unique_ptr<CommunicatorType> communicator;
 
   /**
    * Compile-time base function of recursion for sending tuples along all
-   * partition dimensions.  There is a tuple version to send locally and a
-   * string version to send via zeromq.
+   * partition dimensions.
    *
    * \param edge The edge to send.
-   * \param s The tuple, label in string form (inside TupleLabelCombined
-   *          object).
    * \param seenNodes Keeps track of which nodes have seen the tuple already.
    *
    * \tparam PlaceHolder - Just helps us determine that we are calling the base
@@ -136,7 +226,6 @@ private:
    */
   template<typename PlaceHolder>
   void sendTuple(EdgeType const& edge,
-                 std::string const& s, 
                  std::set<int> seenNodes);
 
   /**
@@ -145,8 +234,7 @@ private:
    * which govern how the tuples are sent across the cluster.  The recursive
    * nature of this compile-time function allows each to be called.  
    *
-   * \param tuple The tuple to send.
-   * \param s The tuple in string form.
+   * \param edge The edge to send.
    * \param seenNodes Keeps track of which nodes have seen the tuple already.
    * 
    * \tparam PlaceHolder - Just helps us disambiguate base instance from recurssive call.
@@ -155,9 +243,32 @@ private:
    */
   template<typename PlaceHolder, typename First, typename... Rest>
   void sendTuple(EdgeType const& edge,
-                 std::string const& s,
                  std::set<int> seenNodes);
 
+  /**
+   * Base of the recursion of partition.
+   */
+  template<typename PlaceHolder>
+  void partition(EdgeType const&, std::set<size_t>&) {}
+
+  /**
+   * Adds the nodes the edge goes to along all partition dimensions to
+   * nodes, like sendTuple but without sending.
+   */
+  template<typename PlaceHolder, typename First, typename... Rest>
+  void partition(EdgeType const& edge, std::set<size_t>& nodes)
+  {
+    First first;
+    nodes.insert(first(edge.tuple) % numNodes);
+    partition<PlaceHolder, Rest...>(edge, nodes);
+  }
+
+  /**
+   * Hands the edges collected by a lane to its consumers, or to the
+   * consumers of this producer if the lane has none.
+   */
+  void flushLane(Lane& lane);
+
 };
 
 template <typename EdgeType, typename Tuplizer, typename... HF>
@@ -169,7 +280,11 @@ ZeroMQPushPull<EdgeType, Tuplizer, HF...>::ZeroMQPushPull(
                  size_t startingPort,
                  size_t timeout,
                  bool local,
-                 size_t hwm)
+                 size_t hwm,
+                 size_t numPushSockets,
+                 size_t numPullThreads,
+                 TransportType transportType,
+                 CompressionConfig compression)
   : 
   BaseProducer<EdgeType>(nodeId, queueLength)
 {
@@ -180,30 +295,115 @@ ZeroMQPushPull<EdgeType, Tuplizer, HF...>::ZeroMQPushPull(
   this->local     = local;
   this->hwm       = hwm;
   terminated.store(false);
+  this->batchSize = std::max<size_t>(1, queueLength);
 
-  auto callbackFunction = [this](std::string str)
-  {
+  if (numPushSockets == 0 || numPullThreads == 0) {
+    throw ZeroMQPushPullException("ZeroMQPushPull needs at least one push "
+      "socket and one pull thread");
+  }
+
+  // The lanes must exist before the pull threads start.
+  for (size_t i = 0; i < numPullThreads; i++) {
+    lanes.push_back(std::unique_ptr<Lane>(new Lane()));
+    lanes.back()->edges.reserve(batchSize);
+  }
 
+  if (numNodes == 1) {
+    transportType = TransportType::Direct;
+  }
+  bool direct = transportType == TransportType::Direct;
+
+  auto callbackFunction = [this, direct](EdgeType const& received)
+  {
     DEBUG_PRINT("Node %lu ZeroMQPushPull pullThread received tuple "
-      "%s\n", this->nodeId, str.c_str());
-   
+      "%s\n", this->nodeId, received.toString().c_str());
+
+    LatencyTracer::record(TraceStage::Partition, received.ingestTime);
+
     // Since we are receiving this from another node, we need to assign an
     // id to the edge. 
-    size_t id = idGenerator->generate(); 
-    EdgeType edge = tuplizer(id, str);
-    this->parallelFeed(edge);
+    if (direct) {
+      EdgeType edge = received;
+      edge.id = idGenerator->generate();
+      this->parallelFeed(edge);
+      return;
+    }
+
+    Lane& lane = *lanes[receiveThreadId()];
+    lane.edges.push_back(received);
+    lane.edges.back().id = idGenerator->generate(); 
+    if (lane.edges.size() >= batchSize) {
+      flushLane(lane);
+    }
   };
 
-  // TODO make parameters of constructor
-  size_t numPushSockets = 1;
-  size_t numPullThreads = 1;
+  auto drainFunction = [this, direct]()
+  {
+    if (!direct) {
+      flushLane(*lanes[receiveThreadId()]);
+    }
+  };
+
+  // Used by the ZeroMQ transport only.  Strings are turned back into edges
+  // by the tuplizer of the pull thread's lane.  Edges sampled for latency
+  // tracing carry their ingest time as "@<ns>," in front of the tuple.
+  auto serialize = [](EdgeType const& edge) {
+    if (edge.ingestTime != 0) {
+      return "@" + std::to_string(edge.ingestTime) + "," +
+        edge.toStringNoId();
+    }
+    return edge.toStringNoId();
+  };
+  auto deserialize = [this](std::string const& str) {
+    Tuplizer& tuplizer = lanes[receiveThreadId()]->tuplizer;
+    if (!str.empty() && str[0] == '@') {
+      size_t comma = str.find(',');
+      EdgeType edge = tuplizer(0, boost::string_view(str).substr(comma + 1));
+      edge.ingestTime = std::strtoll(str.c_str() + 1, nullptr, 10);
+      return edge;
+    }
+    return tuplizer(0, str);
+  };
 
   std::vector<FunctionType> communicatorFunctions;
   communicatorFunctions.push_back(callbackFunction);
+  std::vector<DrainFunctionType> drainFunctions;
+  drainFunctions.push_back(drainFunction);
 
-  communicator = new PushPull(numNodes, nodeId, numPushSockets, numPullThreads,
+  communicator = createTransport<EdgeType>(transportType, numNodes, nodeId,
+                              numPushSockets, numPullThreads,
                               hostnames, hwm, communicatorFunctions,
-                              startingPort, timeout, local); 
+                              startingPort, timeout, local, serialize,
+                              deserialize, drainFunctions,
+                              PUSH_PULL_PULL_THREAD_TIMEOUT, compression); 
+
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  std::string labels = metricLabels({{"node", std::to_string(nodeId)},
+    {"port", std::to_string(startingPort)}});
+  callbackMetrics.push_back(registry.callback(
+    "sam_zeromq_push_pull_edges_consumed_total", labels,
+    "Edges partitioned by this node", MetricKind::Counter,
+    [this]() { return (double) consumeCount.value(); }));
+  callbackMetrics.push_back(registry.callback(
+    "sam_zeromq_push_pull_edges_pulled_total", labels,
+    "Edges received from other nodes and handed on", MetricKind::Counter,
+    [this]() { return (double) getNumPulled(); }));
+}
+
+template <typename EdgeType, typename Tuplizer, typename ...HF>
+void ZeroMQPushPull<EdgeType, Tuplizer, HF...>::flushLane(Lane& lane)
+{
+  if (lane.edges.empty()) return;
+
+  if (lane.consumers.empty()) {
+    this->parallelFeed(lane.edges.data(), lane.edges.size());
+  } else {
+    for (auto consumer : lane.consumers) {
+      consumer->consumeBatch(lane.edges.data(), lane.edges.size());
+    }
+  }
+  lane.numPulled += lane.edges.size();
+  lane.edges.clear();
 }
 
 template <typename EdgeType, typename Tuplizer, typename ...HF>
@@ -217,6 +417,11 @@ void ZeroMQPushPull<EdgeType, Tuplizer, HF...>::terminate()
     for (auto consumer : this->consumers) {
       consumer->terminate();
     }
+    for (auto const& lane : lanes) {
+      for (auto consumer : lane->consumers) {
+        consumer->terminate();
+      }
+    }
 
   }
 
@@ -227,7 +432,6 @@ template <typename EdgeType, typename Tuplizer, typename ...HF>
 template<typename PlaceHolder>
 void ZeroMQPushPull<EdgeType, Tuplizer, HF...>::sendTuple(
   EdgeType const& edge,
-  std::string const& s,
   std::set<int> seenNodes)
 {
 }
@@ -236,7 +440,6 @@ template <typename EdgeType, typename Tuplizer, typename ...HF>
 template<typename PlaceHolder, typename First, typename... Rest>
 void ZeroMQPushPull<EdgeType, Tuplizer, HF...>::sendTuple(
   EdgeType const& edge,
-  std::string const& s,
   std::set<int> seenNodes)
 {
   First first;
@@ -247,10 +450,10 @@ void ZeroMQPushPull<EdgeType, Tuplizer, HF...>::sendTuple(
     if (seenNodes.count(node1) == 0) {
       
       DEBUG_PRINT("Node %lu ZeroMQPushPull::consume because of source "
-             "sending to %lu %s\n", nodeId, node1, s.c_str());
+             "sending to %lu %s\n", nodeId, node1, edge.toString().c_str());
 
       seenNodes.insert(node1);
-      communicator->send(s, node1);
+      communicator->send(edge, node1);
 
     }
   } else {
@@ -258,14 +461,15 @@ void ZeroMQPushPull<EdgeType, Tuplizer, HF...>::sendTuple(
     if (seenNodes.count(this->nodeId) == 0) {
 
       DEBUG_PRINT("Node %lu ZeroMQPushPull::consume sending to parallel "
-        "feed %s\n", nodeId, s.c_str());
+        "feed %s\n", nodeId, edge.toString().c_str());
 
       seenNodes.insert(this->nodeId);
+      LatencyTracer::record(TraceStage::Partition, edge.ingestTime);
       this->parallelFeed(edge);
     }
   }
 
-  sendTuple<PlaceHolderClass, Rest...>(edge, s, seenNodes);
+  sendTuple<PlaceHolderClass, Rest...>(edge, seenNodes);
 }
 
 
@@ -274,10 +478,8 @@ bool ZeroMQPushPull<EdgeType, Tuplizer, HF...>::
 consume(EdgeType const& edge)
 {
 
-  std::string s = edge.toStringNoId();
-
-  DEBUG_PRINT("Node %lu ZeroMQPushPull::consume string %s\n",
-   nodeId, s.c_str());
+  DEBUG_PRINT("Node %lu ZeroMQPushPull::consume edge %s\n",
+   nodeId, edge.toString().c_str());
 
   // Keep track how many netflows have come through this method.
   consumeCount++;
@@ -292,8 +494,44 @@ consume(EdgeType const& edge)
   
   // Compile time recursive call to send the tuple along all partition
   // dimensions.
-  sendTuple<PlaceHolderClass, HF...>(edge, s, seenNodes);  
+  sendTuple<PlaceHolderClass, HF...>(edge, seenNodes);  
+
+  return true;
+}
 
+template <typename EdgeType, typename Tuplizer, typename ...HF>
+bool ZeroMQPushPull<EdgeType, Tuplizer, HF...>::
+consumeBatch(EdgeType const* edges, size_t numEdges)
+{
+  size_t before = consumeCount;
+  consumeCount += numEdges;
+  if (before / metricInterval != (before + numEdges) / metricInterval) {
+    printf("NodeId %lu consumeCount %lu\n", nodeId, before + numEdges);
+  }
+
+  // The edges for each node, in the order they came in.
+  std::vector<std::vector<EdgeType>> outgoing(numNodes);
+  std::set<size_t> nodes;
+  for (size_t i = 0; i < numEdges; i++) {
+    nodes.clear();
+    partition<PlaceHolderClass, HF...>(edges[i], nodes);
+    for (size_t node : nodes) {
+      outgoing[node].push_back(edges[i]);
+    }
+  }
+
+  for (size_t node = 0; node < numNodes; node++) {
+    std::vector<EdgeType> const& batch = outgoing[node];
+    if (batch.empty()) continue;
+    if (node == this->nodeId) {
+      for (auto const& edge : batch) {
+        LatencyTracer::record(TraceStage::Partition, edge.ingestTime);
+      }
+      this->parallelFeed(batch.data(), batch.size());
+    } else {
+      communicator->sendBatch(batch.data(), batch.size(), node);
+    }
+  }
   return true;
 }
 
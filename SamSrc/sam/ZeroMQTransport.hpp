@@ -0,0 +1,129 @@
+#ifndef SAM_ZEROMQ_TRANSPORT_HPP
+#define SAM_ZEROMQ_TRANSPORT_HPP
+
+#include <sam/Transport.hpp>
+#include <sam/ZeroMQUtil.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sam {
+
+/**
+ * A transport over PushPull.  Messages are turned into strings with
+ * serialize before they are sent, and back with deserialize on the pull
+ * thread that receives them, once per message no matter how many
+ * callbacks there are.
+ *
+ * Neither function may produce or expect an empty string, since PushPull
+ * uses the empty message to signal terminate.
+ *
+ * With a compression codec, sendBatch hands the serialized messages to
+ * PushPull as one frame, which is compressed while the link is busy.
+ */
+template <typename MessageType>
+class ZeroMQTransport : public Transport<MessageType>
+{
+public:
+  typedef typename Transport<MessageType>::FunctionType FunctionType;
+  typedef typename Transport<MessageType>::DrainFunctionType
+    DrainFunctionType;
+  typedef std::function<std::string(MessageType const&)> SerializeFunction;
+  typedef std::function<MessageType(std::string const&)> DeserializeFunction;
+
+private:
+  SerializeFunction serialize;
+  std::unique_ptr<PushPull> pushPull;
+
+public:
+  /**
+   * The parameters besides serialize and deserialize are those of
+   * PushPull.
+   * \param serialize Turns a message into the string that is sent.
+   * \param deserialize Turns a received string back into a message.  It is
+   *   called from the pull threads, possibly at the same time.
+   * \param compression The codec and threshold of PushPull.  Every node
+   *   must use the same codec.
+   */
+  ZeroMQTransport(size_t numNodes,
+                  size_t nodeId,
+                  size_t numPushSockets,
+                  size_t numPullThreads,
+                  std::vector<std::string> hostnames,
+                  uint32_t hwm,
+                  std::vector<FunctionType> callbacks,
+                  size_t startingPort,
+                  int timeout,
+                  bool local,
+                  SerializeFunction serialize,
+                  DeserializeFunction deserialize,
+                  std::vector<DrainFunctionType> drainCallbacks =
+                    std::vector<DrainFunctionType>(),
+                  int pullThreadTimeout = PUSH_PULL_PULL_THREAD_TIMEOUT,
+                  CompressionConfig compression = CompressionConfig()) :
+    serialize(serialize)
+  {
+    auto stringCallback = [callbacks, deserialize](std::string const& str) {
+      MessageType message = deserialize(str);
+      for (auto const& callback : callbacks) {
+        callback(message);
+      }
+    };
+    std::vector<PushPull::FunctionType> stringCallbacks;
+    stringCallbacks.push_back(stringCallback);
+
+    pushPull = std::unique_ptr<PushPull>(new PushPull(numNodes, nodeId,
+      numPushSockets, numPullThreads, hostnames, hwm, stringCallbacks,
+      startingPort, timeout, local, drainCallbacks, pullThreadTimeout, true,
+      compression.codec, compression.threshold));
+  }
+
+  ~ZeroMQTransport()
+  {
+    terminate();
+  }
+
+  bool send(MessageType const& message, size_t node)
+  {
+    return pushPull->send(serialize(message), node);
+  }
+
+  bool sendBatch(MessageType const* messages, size_t numMessages,
+                 size_t node)
+  {
+    std::vector<std::string> strings;
+    strings.reserve(numMessages);
+    for (size_t i = 0; i < numMessages; i++) {
+      strings.push_back(serialize(messages[i]));
+    }
+    return pushPull->sendBatch(strings, node);
+  }
+
+  void terminate()
+  {
+    pushPull->terminate();
+  }
+
+  size_t getTotalMessagesSent() const
+  {
+    return pushPull->getTotalMessagesSent();
+  }
+
+  size_t getTotalMessagesReceived() const
+  {
+    return pushPull->getTotalMessagesReceived();
+  }
+
+  size_t getTotalMessagesFailed() const
+  {
+    return pushPull->getTotalMessagesFailed();
+  }
+
+  /// The PushPull underneath, for its ZeroMQ specific metrics.
+  PushPull const& getPushPull() const { return *pushPull; }
+};
+
+}
+
+#endif
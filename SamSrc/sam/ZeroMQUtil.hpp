@@ -2,8 +2,17 @@
 #define SAM_PUSH_PULL_HPP
 
 #include <sam/Util.hpp>
+#include <sam/Compression.hpp>
+#include <sam/Metrics.hpp>
+#include <sam/SharedMemoryRing.hpp>
+#include <sam/Transport.hpp>
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <random>
 
+#define PUSH_PULL_MAX_DRAIN_BATCH 1024
+
 namespace sam {
 
 class ZeroMQUtilException : public std::runtime_error {
@@ -60,6 +69,17 @@ bool isTerminateMessage(zmq::message_t& message)
   return false;
 }
 
+/**
+ * The name of the shared memory inbox of a node.  The starting port tells
+ * apart the PushPull objects of a node, as it does for the TCP ports.
+ */
+inline
+std::string sharedMemoryName(size_t startingPort, size_t nodeId)
+{
+  return "/sam_pushpull_" + boost::lexical_cast<std::string>(startingPort) +
+    "_" + boost::lexical_cast<std::string>(nodeId);
+}
+
 /**
  * This gives the correct hostname for the ith pull socket.
  * The total number of pull sockets to create is (numNodes - 1) *
@@ -164,11 +184,23 @@ size_t getPortForPull(size_t i,
  * requirement is that it can be serialized as an std::string.  send()
  * accepts strings as input, and the pull threads creates strings from 
  * the data it gets and sends those strings to the callback functions.
+ *
+ * Nodes on the same host (the same hostname, or all nodes when local is
+ * set) talk through shared memory rings (see SharedMemoryRing.hpp) instead
+ * of ZeroMQ over loopback TCP, unless sharedMemory is turned off.  Each
+ * ZeroMQ push socket to such a node is replaced by a ring, so the same
+ * numPushSockets and numPullThreads apply.
+ *
+ * With a compression codec, messages sent over ZeroMQ go in frames (see
+ * Compression.hpp) that sendBatch fills with many messages at once, and
+ * that are compressed while the link to a node is busy.  All nodes must use
+ * the same codec setting.  Shared memory is never compressed.
  */
 class PushPull
 {
 public:
   typedef std::function<void(std::string const&)> FunctionType;
+  typedef std::function<void()> DrainFunctionType;
 
 private:
   size_t numNodes; ///> How many nodes in the cluster
@@ -185,9 +217,17 @@ private:
   size_t startingPort; ///> The starting port
   int timeout; ///> The timeout in ms for send() calls
 
-  /// If the pull thread receives no data for a while, it exits.
-  /// TODO add this to constructor
-  size_t pullThreadTimeout = 10000; 
+  /// If a pull thread receives nothing for this many ms, it exits.  If
+  /// negative, pull threads only exit once every node sent terminate.
+  int pullThreadTimeout;
+
+  /// The most messages read from one socket before the other sockets of
+  /// the pull thread get a turn.
+  size_t maxDrainBatch = PUSH_PULL_MAX_DRAIN_BATCH;
+
+  std::atomic<size_t> totalBatches; ///> Times a pull thread woke with data
+  std::atomic<uint64_t> totalIdleNanos; ///> Time pull threads waited
+  std::atomic<uint64_t> totalBusyNanos; ///> Time pull threads handled data
 
   std::vector<std::shared_ptr<zmq::socket_t>> pushers;
 
@@ -211,11 +251,66 @@ private:
   /// pull threads.
   std::vector<FunctionType> callbacks;
 
+  /// These are called by a pull thread once it has handed every message
+  /// that was ready to the callbacks, and before it exits.
+  std::vector<DrainFunctionType> drainCallbacks;
+
   std::mt19937 myRand;
   std::uniform_int_distribution<size_t> dist;
 
   bool local = false;
 
+  /// Whether nodes on the same host talk through shared memory.
+  bool sharedMemory;
+
+  /// For each node, whether it is reached through shared memory.
+  std::vector<bool> colocated;
+
+  /// The segment the nodes on this host write to this node through.
+  std::unique_ptr<SharedMemorySegment> inbox;
+
+  /// For each co-located node, its inbox.  Opened on first use, since
+  /// the other node may not have created it yet.
+  std::vector<std::unique_ptr<SharedMemorySegment>> outboxes;
+
+  /// The codec batches sent over ZeroMQ may be compressed with.  If None,
+  /// messages go out one per ZeroMQ message, unframed.
+  CompressionCodec compression;
+
+  /// For each node, whether the batches sent to it are compressed right
+  /// now.  Shared by the push sockets to the node.
+  std::vector<std::unique_ptr<AdaptiveCompression>> adaptiveCompression;
+
+  /// Byte counts of the frames exchanged with one other node.
+  struct CompressionCounters
+  {
+    std::atomic<uint64_t> bytesSent; ///> Payload bytes before compression
+    std::atomic<uint64_t> wireBytesSent; ///> Frame bytes handed to ZeroMQ
+    std::atomic<uint64_t> bytesReceived; ///> Payload bytes after decompression
+    std::atomic<uint64_t> wireBytesReceived; ///> Frame bytes received
+
+    CompressionCounters() : bytesSent(0), wireBytesSent(0), bytesReceived(0),
+                            wireBytesReceived(0) {}
+  };
+
+  /// One per node, indexed by node id.
+  std::unique_ptr<CompressionCounters[]> compressionCounters;
+
+  std::atomic<size_t> totalCompressedBatches; ///> Frames sent compressed
+  std::atomic<uint64_t> totalCompressNanos; ///> Time spent compressing
+  std::atomic<uint64_t> totalDecompressNanos; ///> Time spent decompressing
+  std::atomic<size_t> totalMalformedFrames; ///> Frames received and dropped
+
+  /// How long send calls take and how long pull threads spend handing
+  /// what they woke up to to the callbacks.  Only recorded while metrics
+  /// are enabled (see Metrics.hpp).
+  std::shared_ptr<LatencyHistogram> sendTime;
+  std::shared_ptr<LatencyHistogram> batchTime;
+
+  /// Reports the counters above when the metrics are scraped.  Declared
+  /// last so it is destroyed first.
+  std::vector<std::unique_ptr<CallbackMetric>> callbackMetrics;
+
 public:
   /**
    * Constructor.
@@ -243,6 +338,21 @@ public:
    * \param timeout The amount of time in ms that a send() call waits before
    *  timing out.  If -1, blocks until completed.
    * \param local Flag indicating that all the nodes are local
+   * \param drainCallbacks Called by a pull thread whenever it runs out of
+   *   messages to hand to the callbacks, and before it exits.  This lets
+   *   callbacks that batch what they receive hand the batch on.
+   * \param pullThreadTimeout A pull thread exits if it receives nothing
+   *   for this many ms.  If negative, pull threads only exit once every
+   *   other node has sent terminate.
+   * \param sharedMemory If true, nodes with the same hostname as this node
+   *   (all nodes if local) are reached through shared memory.
+   * \param compression The codec batches sent over ZeroMQ are compressed
+   *   with.  If not None, messages are sent in frames, which the other
+   *   nodes only understand if they use a codec too.
+   * \param compressionThreshold The rate in bytes per second offered to a
+   *   node, over all its push sockets, above which the batches sent to it
+   *   are compressed.  If 0, every batch is.
+   * \throws ZeroMQUtilException if the codec wasn't compiled in.
    */
   PushPull(   
     size_t numNodes,
@@ -254,7 +364,13 @@ public:
     std::vector<FunctionType> callbacks,
     size_t startingPort,
     int timeout,
-    bool local = false);
+    bool local = false,
+    std::vector<DrainFunctionType> drainCallbacks =
+      std::vector<DrainFunctionType>(),
+    int pullThreadTimeout = PUSH_PULL_PULL_THREAD_TIMEOUT,
+    bool sharedMemory = true,
+    CompressionCodec compression = CompressionCodec::None,
+    double compressionThreshold = PUSH_PULL_COMPRESSION_THRESHOLD);
 
   ~PushPull();
 
@@ -264,6 +380,14 @@ public:
    */
   bool send(std::string data, size_t node);
 
+  /**
+   * Sends the messages to the specified node, in order.  With a codec they
+   * go out in a single frame, compressed if the link to the node is busy;
+   * otherwise this is the same as calling send() on each.
+   * \return Returns true if all the messages were sent, false otherwise.
+   */
+  bool sendBatch(std::vector<std::string> const& messages, size_t node);
+
   /**
    * Terminates accepting data and prevents more data from being sent.
    */
@@ -289,8 +413,109 @@ public:
     return startingPort + (numNodes - 1) * numPushSockets - 1;
   }
 
+  size_t getNumPullThreads() const { return numPullThreads; }
 
+  /**
+   * Whether messages to the given node go through shared memory.
+   */
+  bool isColocated(size_t node) const { return colocated.at(node); }
 
+  /**
+   * The number of times a pull thread woke up with messages.  
+   * getTotalMessagesReceived() / getTotalBatches() is the average number
+   * of messages handled per wake up.
+   */
+  size_t getTotalBatches() const { return totalBatches; }
+
+  /**
+   * The time in seconds, summed over the pull threads, spent waiting for
+   * messages.
+   */
+  double getTotalIdleTime() const { return totalIdleNanos / 1e9; }
+
+  /**
+   * The time in seconds, summed over the pull threads, spent handing
+   * messages to the callbacks.  Divided by getTotalMessagesReceived() it
+   * is the mean time a message spends in the receive path.
+   */
+  double getTotalBusyTime() const { return totalBusyNanos / 1e9; }
+
+  /**
+   * When called from a callback, returns the index (0 to
+   * numPullThreads - 1) of the pull thread calling it.  Callbacks can use
+   * it to keep per-thread state without locking.
+   */
+  static size_t getPullThreadId() { return receiveThreadId(); }
+
+  CompressionCodec getCompression() const { return compression; }
+
+  /**
+   * The bytes of the messages sent to a node in frames, before
+   * compression.  Only frames are counted, so it is 0 without a codec and
+   * for co-located nodes.
+   */
+  uint64_t getBytesSent(size_t node) const
+  {
+    return compressionCounters[node].bytesSent;
+  }
+
+  /**
+   * The bytes of the frames sent to a node, after compression.
+   */
+  uint64_t getWireBytesSent(size_t node) const
+  {
+    return compressionCounters[node].wireBytesSent;
+  }
+
+  /**
+   * The bytes of the messages received in frames from a node, after
+   * decompression.
+   */
+  uint64_t getBytesReceived(size_t node) const
+  {
+    return compressionCounters[node].bytesReceived;
+  }
+
+  /**
+   * The bytes of the frames received from a node.
+   */
+  uint64_t getWireBytesReceived(size_t node) const
+  {
+    return compressionCounters[node].wireBytesReceived;
+  }
+
+  /**
+   * getBytesSent(node) / getWireBytesSent(node), or 1 if nothing was sent.
+   */
+  double getCompressionRatio(size_t node) const
+  {
+    uint64_t wire = getWireBytesSent(node);
+    return wire == 0 ? 1.0 : getBytesSent(node) / static_cast<double>(wire);
+  }
+
+  /**
+   * The number of frames that were sent compressed.
+   */
+  size_t getTotalCompressedBatches() const { return totalCompressedBatches; }
+
+  /**
+   * The time in seconds, summed over the sending threads, spent
+   * compressing frames (including ones that didn't get smaller).
+   */
+  double getTotalCompressTime() const { return totalCompressNanos / 1e9; }
+
+  /**
+   * The time in seconds, summed over the pull threads, spent decompressing
+   * frames.
+   */
+  double getTotalDecompressTime() const { return totalDecompressNanos / 1e9; }
+
+  /**
+   * The number of frames received that couldn't be decoded, e.g. because
+   * they were corrupt or the sender used another codec.  They are dropped
+   * with the messages in them.
+   */
+  size_t getTotalMalformedFrames() const { return totalMalformedFrames; }
 
 private:
 
@@ -303,6 +528,49 @@ private:
    * Starts the pull threads. 
    */
   void initializePullThreads();
+
+  /**
+   * The node that the ith push socket (out of totalNumPushSockets) talks
+   * to.
+   */
+  size_t nodeForSocket(size_t i) const
+  {
+    size_t node = i / numPushSockets;
+    return node >= nodeId ? node + 1 : node;
+  }
+
+  /**
+   * The ring in the inbox of a node that this node writes to with its
+   * pushSocket-th socket.
+   */
+  size_t ringIndex(size_t sender, size_t pushSocket) const
+  {
+    return sender * numPushSockets + pushSocket;
+  }
+
+  /**
+   * Writes a message into the ring of a co-located node, waiting up to
+   * timeout ms for the node to create its inbox and for room in the ring.
+   * The push mutex of the socket must be held.
+   */
+  bool sendShared(char const* data, size_t length, size_t otherNode,
+                  size_t pushSocket);
+
+  /**
+   * Sends the messages to a node that isn't co-located in one frame.
+   */
+  bool sendFrame(std::string const* messages, size_t numMessages,
+                 size_t otherNode);
+
+  /**
+   * Sends one message, to be called when it doesn't go in a frame.
+   */
+  bool sendUnframed(std::string const& str, size_t otherNode);
+
+  /**
+   * Registers the metrics of this object with the MetricsRegistry.
+   */
+  void registerMetrics();
 };
 
 // Constructor
@@ -316,7 +584,12 @@ PushPull::PushPull(
   std::vector<FunctionType> callbacks,
   size_t startingPort,
   int timeout,
-  bool local)
+  bool local,
+  std::vector<DrainFunctionType> drainCallbacks,
+  int pullThreadTimeout,
+  bool sharedMemory,
+  CompressionCodec compression,
+  double compressionThreshold)
 {
   DEBUG_PRINT("Node %lu Entering PushPull Constructor", nodeId)
   this->numNodes       = numNodes;
@@ -326,17 +599,65 @@ PushPull::PushPull(
   this->hostnames      = hostnames;
   this->hwm            = hwm;
   this->callbacks      = callbacks;
+  this->drainCallbacks = drainCallbacks;
+  this->pullThreadTimeout = pullThreadTimeout;
+  this->sharedMemory   = sharedMemory;
   this->startingPort   = startingPort;
   this->timeout        = timeout;
   this->local          = local;
+  this->compression    = compression;
   totalNumPushSockets = (numNodes - 1) * numPushSockets; 
 
+  if (!isCompressionAvailable(compression)) {
+    throw ZeroMQUtilException("PushPull: compression codec " +
+      boost::lexical_cast<std::string>(static_cast<int>(compression)) +
+      " wasn't compiled in");
+  }
+  for (size_t i = 0; i < numNodes; i++) {
+    adaptiveCompression.push_back(std::unique_ptr<AdaptiveCompression>(
+      new AdaptiveCompression(compressionThreshold)));
+  }
+  compressionCounters = std::unique_ptr<CompressionCounters[]>(
+    new CompressionCounters[numNodes]);
+  totalCompressedBatches = 0;
+  totalCompressNanos     = 0;
+  totalDecompressNanos   = 0;
+  totalMalformedFrames   = 0;
+
   totalMessagesReceived = 0;
   totalMessagesSent     = 0;
   totalMessagesFailed   = 0;
+  totalBatches          = 0;
+  totalIdleNanos        = 0;
+  totalBusyNanos        = 0;
   
   pushMutexes = new std::mutex[totalNumPushSockets];
 
+  colocated.resize(numNodes, false);
+  outboxes.resize(numNodes);
+  bool anyColocated = false;
+  for (size_t node = 0; node < numNodes; node++) {
+    if (node != nodeId && sharedMemory &&
+        (local || hostnames[node] == hostnames[nodeId]))
+    {
+      colocated[node] = true;
+      anyColocated = true;
+      outboxes[node] = std::unique_ptr<SharedMemorySegment>(
+        new SharedMemorySegment(sharedMemoryName(startingPort, node),
+                                numNodes * numPushSockets));
+    }
+  }
+
+  // The inbox must exist before the pull threads start.
+  if (anyColocated) {
+    inbox = std::unique_ptr<SharedMemorySegment>(
+      new SharedMemorySegment(sharedMemoryName(startingPort, nodeId),
+                              numNodes * numPushSockets));
+    inbox->create();
+  }
+
+  registerMetrics();
+
   createPushSockets();
 
   std::random_device rd;
@@ -361,10 +682,15 @@ void PushPull::terminate()
     for (size_t i = 0; i < totalNumPushSockets; i++) 
     {
       bool sent = false;
+      size_t otherNode = nodeForSocket(i);
       //while (!sent) {
         //printf("Node %lu Sending terminate to %lu\n", nodeId, i);
         pushMutexes[i].lock();
-        sent = pushers[i]->send(terminateZmqMessage());
+        if (colocated[otherNode]) {
+          sent = sendShared("", 0, otherNode, i % numPushSockets);
+        } else {
+          sent = pushers[i]->send(terminateZmqMessage());
+        }
         pushMutexes[i].unlock();
         if (!sent) {
           printf("Node %lu PullPull::terminate failed to send terminate "
@@ -380,6 +706,60 @@ void PushPull::terminate()
   }
 }
 
+void PushPull::registerMetrics()
+{
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  std::string node = boost::lexical_cast<std::string>(nodeId);
+  std::string port = boost::lexical_cast<std::string>(startingPort);
+  std::string labels = metricLabels({{"node", node}, {"port", port}});
+
+  sendTime = registry.histogram("sam_push_pull_send_seconds", labels,
+    "Time spent in PushPull::send and sendBatch");
+  batchTime = registry.histogram("sam_push_pull_batch_seconds", labels,
+    "Time a pull thread spent handling the messages of one wake up");
+
+  auto add = [&](std::string const& name, std::string const& metricLabels,
+                 std::string const& help, std::function<double()> function) {
+    callbackMetrics.push_back(registry.callback(name, metricLabels, help,
+      MetricKind::Counter, function));
+  };
+  add("sam_push_pull_messages_sent_total", labels, "Messages sent",
+    [this]() { return (double) totalMessagesSent; });
+  add("sam_push_pull_messages_received_total", labels, "Messages received",
+    [this]() { return (double) totalMessagesReceived; });
+  add("sam_push_pull_messages_failed_total", labels,
+    "Messages that couldn't be sent",
+    [this]() { return (double) totalMessagesFailed; });
+  add("sam_push_pull_idle_seconds_total", labels,
+    "Time pull threads waited for messages",
+    [this]() { return getTotalIdleTime(); });
+  add("sam_push_pull_busy_seconds_total", labels,
+    "Time pull threads spent handing messages to the callbacks",
+    [this]() { return getTotalBusyTime(); });
+
+  if (compression == CompressionCodec::None) return;
+  add("sam_push_pull_compress_seconds_total", labels,
+    "Time spent compressing frames",
+    [this]() { return getTotalCompressTime(); });
+  add("sam_push_pull_decompress_seconds_total", labels,
+    "Time spent decompressing frames",
+    [this]() { return getTotalDecompressTime(); });
+  add("sam_push_pull_malformed_frames_total", labels,
+    "Frames received that couldn't be decoded and were dropped",
+    [this]() { return (double) getTotalMalformedFrames(); });
+  for (size_t other = 0; other < numNodes; other++) {
+    if (other == nodeId) continue;
+    std::string peerLabels = metricLabels({{"node", node}, {"port", port},
+      {"peer", boost::lexical_cast<std::string>(other)}});
+    add("sam_push_pull_bytes_sent_total", peerLabels,
+      "Bytes of the messages sent in frames, before compression",
+      [this, other]() { return (double) getBytesSent(other); });
+    add("sam_push_pull_wire_bytes_sent_total", peerLabels,
+      "Bytes of the frames sent, after compression",
+      [this, other]() { return (double) getWireBytesSent(other); });
+  }
+}
+
 void PushPull::createPushSockets()
 {
   pushers.resize(totalNumPushSockets);
@@ -392,6 +772,9 @@ void PushPull::createPushSockets()
   DEBUG_PRINT("totalNumPushSockets %lu \n", totalNumPushSockets);
   for (size_t i = 0; i < totalNumPushSockets; i++) 
   {
+    // Co-located nodes are written to through shared memory.
+    if (colocated[nodeForSocket(i)]) continue;
+
     zmqLock.lock();
     auto pusher = std::shared_ptr<zmq::socket_t>(
       new zmq::socket_t(context, ZMQ_PUSH));
@@ -428,6 +811,7 @@ void PushPull::initializePullThreads()
     size_t numPullThreads = this->numPullThreads;
     size_t numPushSockets = this->numPushSockets;
     size_t receivedMessages = 0;
+    receiveThreadId() = threadId;
 
     size_t beg = get_begin_index(totalNumPushSockets, threadId, numPullThreads);
     size_t end = get_end_index(totalNumPushSockets, threadId, numPullThreads);
@@ -441,9 +825,14 @@ void PushPull::initializePullThreads()
 
     zmq::pollitem_t pollItems[numVisiblePushSockets];
     std::vector<zmq::socket_t*> sockets;
+    std::vector<size_t> socketNodes; ///> The node each socket pulls from
+
+    // The rings of the co-located nodes this thread covers.
+    std::vector<SharedMemoryRing> rings;
 
     // When a node sends a terminate flag, the corresponding entry is
     // turned to true.  When all flags are true, the thread terminates.
+    // Sockets come first, then rings.
     bool terminate[numVisiblePushSockets];
 
     // All sockets passed to zmq_poll() function must belong to the same
@@ -452,6 +841,12 @@ void PushPull::initializePullThreads()
 
     size_t numAdded = 0;
     for( size_t i = beg; i < end; i++) {
+      size_t otherNode = nodeForSocket(i);
+      if (colocated[otherNode]) {
+        rings.push_back(inbox->ring(ringIndex(otherNode, i % numPushSockets)));
+        continue;
+      }
+
       std::string hostname = getHostnameForPull(i, nodeId, numPushSockets,
                                                 numNodes, hostnames);
       size_t port = getPortForPull(i, nodeId, numPushSockets,
@@ -487,67 +882,159 @@ void PushPull::initializePullThreads()
         throw std::runtime_error(message);
       }
       sockets.push_back(socket);
+      socketNodes.push_back(otherNode);
 
       pollItems[numAdded].socket = *socket;
       pollItems[numAdded].events = ZMQ_POLLIN;
-      terminate[numAdded] = false;
       numAdded++;
     }
     this->zmqLock.unlock();
 
-    bool stop = false;
+    size_t numSockets = sockets.size();
+    for (size_t i = 0; i < numVisiblePushSockets; i++) {
+      terminate[i] = false;
+    }
 
-    auto timeDataArrived = std::chrono::high_resolution_clock::now();
+    size_t numStop = 0; ///> Number of sockets that sent terminate
+    bool stop = numVisiblePushSockets == 0;
+
+    // Hands a message to the callbacks or notes that a source terminated.
+    size_t batch = 0;
+    auto handle = [&](std::string const& str, size_t source) {
+      if (str.empty()) {
+        DEBUG_PRINT("Node %lu PushPull pullThread received terminate "
+          "from %lu\n", nodeId, source);
+        if (!terminate[source]) {
+          terminate[source] = true;
+          numStop++;
+        }
+      } else {
+        DEBUG_PRINT("Node %lu PushPull pullThread received message of"
+          " size %lu from %lu %s\n", nodeId, str.size(), source, 
+           str.c_str());
+        batch++;
+        for (auto callback : callbacks) {
+          callback(str);              
+        }
+      }
+    };
+
+    // With only sockets, zmq::poll blocks until a message is ready, so the
+    // thread uses no CPU while idle and wakes up as soon as data arrives.
+    // With only rings, the thread sleeps on the inbox doorbell instead.  A
+    // ZeroMQ socket can't ring the doorbell, so a thread with both checks
+    // its sockets every millisecond while it waits.
+    long pollTimeout = pullThreadTimeout < 0 ? -1 : pullThreadTimeout;
+    auto idleBegin = std::chrono::steady_clock::now();
+    std::string str;
+    std::string scratch; ///> Decompressed payloads
+
+    // Hands the messages of a frame from the ith socket to handle.  A frame
+    // that can't be decoded is counted and dropped, so that a corrupt frame
+    // or a peer with another codec doesn't bring down the thread.
+    auto handleFrame = [&](zmq::message_t const& message, size_t i) {
+      char const* data = static_cast<char const*>(message.data());
+      bool compressed = message.size() > 0 &&
+        data[0] != static_cast<char>(CompressionCodec::None);
+      auto begin = std::chrono::steady_clock::now();
+      try {
+        auto payload = decodeFrame(data, message.size(), scratch);
+        if (compressed) {
+          this->totalDecompressNanos.fetch_add(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - begin).count());
+        }
+        // Checks the whole batch before handing on any of it.
+        forEachInBatch(payload.first, payload.second,
+          [&](std::string const& str) { handle(str, i); });
+        CompressionCounters& counters = compressionCounters[socketNodes[i]];
+        counters.wireBytesReceived.fetch_add(message.size());
+        counters.bytesReceived.fetch_add(payload.second);
+      } catch (CompressionException const& e) {
+        DEBUG_PRINT("Node %lu PushPull pullThread dropped a frame of size "
+          "%lu from %lu: %s\n", nodeId, message.size(), i, e.what());
+        this->totalMalformedFrames.fetch_add(1);
+      }
+    };
 
     while (!stop) {
-      zmq::message_t message;
-      // Third parameter is the timeout in milliseconds to wait for input.
-      size_t numStop = 0;
-      int rValue = zmq::poll(pollItems, numVisiblePushSockets, 1);
-      for (size_t i = 0; i < numVisiblePushSockets; i++) {
-        if (pollItems[i].revents & ZMQ_POLLIN) {
-
-          sockets[i]->recv(&message);
-          if (isTerminateMessage(message)) {
-
-            DEBUG_PRINT("Node %lu PushPull pullThread received terminate "
-              "from %lu\n", nodeId, i);
-            terminate[i] = true;
-
-            timeDataArrived = std::chrono::high_resolution_clock::now();
-
-          } else if (message.size() > 0) {
-            
-            std::string str = getStringFromZmqMessage(message);
-            receivedMessages++;
-
-            DEBUG_PRINT("Node %lu PushPull pullThread received message of"
-              " size %lu from %lu %s\n", nodeId, message.size(), i, 
-               str.c_str());
+      bool ready;
+      if (rings.empty()) {
+        ready = zmq::poll(pollItems, numSockets, pollTimeout) > 0;
+      } else {
+        ready = false;
+        while (true) {
+          uint32_t seen = inbox->doorbell().prepare();
+          for (auto const& ring : rings) {
+            if (!ring.empty()) ready = true;
+          }
+          if (numSockets > 0 && zmq::poll(pollItems, numSockets, 0) > 0) {
+            ready = true;
+          }
+          if (ready) break;
+
+          auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - idleBegin).count();
+          if (pullThreadTimeout >= 0 && waited >= pullThreadTimeout) break;
+          int waitTimeout = pullThreadTimeout < 0 ? -1 :
+                            pullThreadTimeout - waited;
+          if (numSockets > 0) waitTimeout = 1;
+          inbox->doorbell().wait(seen, waitTimeout);
+        }
+      }
 
-            for (auto callback : callbacks) {
-              callback(str);              
-            }
+      auto wakeTime = std::chrono::steady_clock::now();
+      this->totalIdleNanos.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          wakeTime - idleBegin).count());
 
-            timeDataArrived = std::chrono::high_resolution_clock::now();
+      if (!ready) {
+        DEBUG_PRINT("Node %lu PullPull::pullThread stop set to true because"
+          " of timeout\n", nodeId);
+        break;
+      }
 
+      ScopedTimer batchTimer(batchTime);
+
+      // Drain every ready socket and ring (up to maxDrainBatch messages 
+      // each, so that one busy source can't starve the others) before 
+      // waiting again.
+      batch = 0;
+      for (size_t i = 0; i < numSockets; i++) {
+        if (!(pollItems[i].revents & ZMQ_POLLIN)) continue;
+
+        for (size_t j = 0; j < maxDrainBatch; j++) {
+          zmq::message_t message;
+          if (!sockets[i]->recv(&message, ZMQ_DONTWAIT)) break;
+          if (compression == CompressionCodec::None ||
+              isTerminateMessage(message))
+          {
+            handle(getStringFromZmqMessage(message), i);
           } else {
-            
-            printf("Node %lu pullThread received mystery"
-              " message %s\n", nodeId,
-              getStringFromZmqMessage(message).c_str());
+            handleFrame(message, i);
           }
         }
-        if (terminate[i]) numStop++;
       }
-      
-      // Exit if we haven't received data for a while
-      auto timeNow = std::chrono::high_resolution_clock::now();
-      size_t timeDiff = 
-        std::chrono::duration_cast<std::chrono::milliseconds>(
-                        timeNow - timeDataArrived).count();
-     
-      //printf("Node %lu timeDiff %lu\n", nodeId, timeDiff);
+      for (size_t i = 0; i < rings.size(); i++) {
+        for (size_t j = 0; j < maxDrainBatch && rings[i].tryRead(str); j++) {
+          handle(str, numSockets + i);
+        }
+      }
+
+      if (batch > 0) {
+        for (auto drain : drainCallbacks) {
+          drain();
+        }
+        receivedMessages += batch;
+        this->totalMessagesReceived.fetch_add(batch);
+        this->totalBatches.fetch_add(1);
+      }
+
+      batchTimer.stop();
+      idleBegin = std::chrono::steady_clock::now();
+      this->totalBusyNanos.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          idleBegin - wakeTime).count());
 
       if (numStop == numVisiblePushSockets) {
         DEBUG_PRINT("Node %lu PullPull::pullThread stop set to true because"
@@ -555,21 +1042,18 @@ void PushPull::initializePullThreads()
           numVisiblePushSockets, numStop);
          stop = true;
       }
-      if (timeDiff > pullThreadTimeout) {
-        DEBUG_PRINT("Node %lu PullPull::pullThread stop set to true because"
-          " of timeout\n", nodeId);
-        stop = true;
-      }
     }
 
     for (auto socket : sockets) {
       delete socket;
     }
-    
-    this->totalMessagesReceived.fetch_add(receivedMessages);
 
+    for (auto drain : drainCallbacks) {
+      drain();
+    }
+    
     DEBUG_PRINT("Node %lu PushPull::pullThread exiting, received "
-      "messages %lu\n", this->nodeId, this->totalMessagesReceived.load());
+      "messages %lu\n", this->nodeId, receivedMessages);
 
   };
 
@@ -578,19 +1062,126 @@ void PushPull::initializePullThreads()
   }
 }
 
+bool PushPull::sendShared(char const* data, size_t length, size_t otherNode,
+                          size_t pushSocket)
+{
+  SharedMemorySegment& outbox = *outboxes[otherNode];
+  auto begin = std::chrono::steady_clock::now();
+  auto timedOut = [this, begin]() {
+    return timeout >= 0 && 
+      std::chrono::steady_clock::now() - begin > 
+      std::chrono::milliseconds(timeout);
+  };
+
+  // The other node creates its inbox when it starts.
+  while (!outbox.open()) {
+    if (timedOut()) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  SharedMemoryRing ring = outbox.ring(ringIndex(nodeId, pushSocket));
+  if (length > ring.maxMessageSize()) {
+    printf("Node %lu PushPull::send message of %lu bytes is too large for "
+      "shared memory\n", nodeId, length);
+    return false;
+  }
+  while (!ring.tryWrite(data, length)) {
+    if (timedOut()) return false;
+    std::this_thread::yield();
+  }
+  outbox.doorbell().ring();
+  return true;
+}
+
 bool PushPull::send(std::string str, size_t otherNode)
 {
-  DEBUG_PRINT("Node %lu->%lu PushPull::send sending %s\n", nodeId, 
-    otherNode, str.c_str());
+  if (compression != CompressionCodec::None && !colocated[otherNode]) {
+    return sendFrame(&str, 1, otherNode);
+  }
+  return sendUnframed(str, otherNode);
+}
+
+bool PushPull::sendBatch(std::vector<std::string> const& messages,
+                         size_t otherNode)
+{
+  if (messages.empty()) return true;
+  if (compression != CompressionCodec::None && !colocated[otherNode]) {
+    return sendFrame(messages.data(), messages.size(), otherNode);
+  }
+  bool sent = true;
+  for (auto const& message : messages) {
+    sent = sendUnframed(message, otherNode) && sent;
+  }
+  return sent;
+}
+
+bool PushPull::sendFrame(std::string const* messages, size_t numMessages,
+                         size_t otherNode)
+{
+  ScopedTimer timer(sendTime);
+  std::string payload;
+  for (size_t i = 0; i < numMessages; i++) {
+    appendToBatch(payload, messages[i].data(), messages[i].size());
+  }
 
   size_t pushSocket = dist(myRand);
   size_t offset = otherNode < nodeId ? otherNode : otherNode - 1;
   size_t index = offset * numPushSockets + pushSocket;
-  zmq::message_t message = fillZmqMessage(str);
-  
+
+  bool compress = adaptiveCompression[otherNode]->offer(payload.size());
+
+  // Compress outside the lock so other threads can use the socket.
+  std::string frame;
+  auto begin = std::chrono::steady_clock::now();
+  bool compressed = encodeFrame(compress ? compression : 
+                                CompressionCodec::None, payload, frame);
+  if (compress) {
+    totalCompressNanos.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - begin).count());
+  }
+
+  zmq::message_t message(frame.data(), frame.size());
   pushMutexes[index].lock();
   bool sent = pushers[index]->send(message);
   pushMutexes[index].unlock();
+
+  if (!sent) {
+    printf("Node %lu PushPull::send couldn't send batch of %lu messages to "
+      "%luth socket failedNodeId %lu\n", nodeId, numMessages, index,
+      otherNode);
+    totalMessagesFailed.fetch_add(numMessages);
+  } else {
+    CompressionCounters& counters = compressionCounters[otherNode];
+    counters.bytesSent.fetch_add(payload.size());
+    counters.wireBytesSent.fetch_add(frame.size());
+    if (compressed) totalCompressedBatches.fetch_add(1);
+    totalMessagesSent.fetch_add(numMessages);
+  }
+  return sent;
+}
+
+bool PushPull::sendUnframed(std::string const& str, size_t otherNode)
+{
+  ScopedTimer timer(sendTime);
+  DEBUG_PRINT("Node %lu->%lu PushPull::send sending %s\n", nodeId, 
+    otherNode, str.c_str());
+
+  size_t pushSocket = dist(myRand);
+  size_t offset = otherNode < nodeId ? otherNode : otherNode - 1;
+  size_t index = offset * numPushSockets + pushSocket;
+  bool sent;
+  
+  if (colocated[otherNode]) {
+    pushMutexes[index].lock();
+    sent = sendShared(str.data(), str.size(), otherNode, pushSocket);
+    pushMutexes[index].unlock();
+  } else {
+    zmq::message_t message = fillZmqMessage(str);
+    pushMutexes[index].lock();
+    sent = pushers[index]->send(message);
+    pushMutexes[index].unlock();
+  }
   
   DEBUG_PRINT("Node %lu->%lu sent %s rvalue %d\n", nodeId, otherNode, 
     str.c_str(), sent);
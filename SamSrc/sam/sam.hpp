@@ -21,14 +21,24 @@
 #include <sam/Identity.hpp>
 #include <sam/JaccardIndex.hpp>
 #include <sam/LabelProducer.hpp>
+#include <sam/LatencyTracing.hpp>
+#include <sam/Metrics.hpp>
+#include <sam/MetricsServer.hpp>
+#include <sam/ModelScorer.hpp>
 #include <sam/Project.hpp>
+#include <sam/Quantile.hpp>
 #include <sam/ReadSocket.hpp>
 #include <sam/ReadCSV.hpp>
+#include <sam/ReadMappedCSV.hpp>
+#include <sam/CaptureWriter.hpp>
+#include <sam/ReadCapture.hpp>
+#include <sam/ReadNetflowUDP.hpp>
 #include <sam/SimpleSum.hpp>
 #include <sam/SubgraphQuery.hpp>
 #include <sam/SubgraphDiskPrinter.hpp>
 #include <sam/TopK.hpp>
 #include <sam/TransformProducer.hpp>
+#include <sam/TransportFactory.hpp>
 #include <sam/TupleExpression.hpp>
 #include <sam/ZeroMQPushPull.hpp>
 
@@ -1,7 +1,9 @@
 #ifndef SAM_EDGE_HPP
 #define SAM_EDGE_HPP
 
+#include <cstdint>
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/string_view.hpp>
 #include <sam/Util.hpp>
 
 namespace sam {
@@ -27,6 +29,10 @@ public:
   LabelType label;
   TupleType tuple;
 
+  /// When the edge was read, in ns since the epoch, if it was sampled for
+  /// latency tracing (see LatencyTracing.hpp).  0 otherwise.
+  int64_t ingestTime = 0;
+
   Edge(IdType id, LabelType label, TupleType tuple)
   {
     this->id = id;
@@ -104,6 +110,27 @@ public:
     ExtractLabel<LabelType, N-1>::extract(s, label);
 
   }
+
+  /**
+   * Same as above but works on a view of the string, so nothing is copied.
+   */
+  static void extract(boost::string_view& s, LabelType& label)
+  {
+    size_t found = s.find(',');
+    if (found == boost::string_view::npos) {
+      throw LabelException("Looking for delimiter but found none in string " +
+         std::string(s.data(), s.size()));
+    }
+
+    typedef typename std::tuple_element<std::tuple_size<LabelType>::value - N, 
+      LabelType>::type fieldType; 
+    std::get<std::tuple_size<LabelType>::value - N>(label) = 
+      boost::lexical_cast<fieldType>(s.data(), found);
+
+    s.remove_prefix(found + 1);
+
+    ExtractLabel<LabelType, N-1>::extract(s, label);
+  }
 };
 
 /**
@@ -117,6 +144,11 @@ public:
   {
 
   }
+
+  static void extract(boost::string_view& s, LabelType& label)
+  {
+
+  }
 };
 
 /**
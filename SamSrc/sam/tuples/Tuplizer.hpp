@@ -1,6 +1,8 @@
 #ifndef SAM_TUPLIZER_HPP
 #define SAM_TUPLIZER_HPP
 
+#include <string>
+#include <boost/utility/string_view.hpp>
 #include <sam/tuples/Edge.hpp>
 
 namespace sam {
@@ -29,6 +31,36 @@ public:
     
     return edge;
   }
+
+  /**
+   * Creates an edge from a view of a line, e.g. one that points into the
+   * receive buffer of ReadSocket.  If the function can parse a
+   * boost::string_view the line is never copied, otherwise it is copied
+   * into a std::string once.
+   */
+  EdgeType operator()(size_t id, boost::string_view s) {
+    LabelType label;
+    ExtractLabel<LabelType, std::tuple_size<LabelType>::value>::extract(s,
+                                                                     label);
+    TupleType tuple = parse(function, s, 0);
+
+    EdgeType edge(id, label, tuple);
+
+    return edge;
+  }
+
+private:
+  template <typename F>
+  static auto parse(F& f, boost::string_view s, int) -> decltype(f(s))
+  {
+    return f(s);
+  }
+
+  template <typename F>
+  static TupleType parse(F& f, boost::string_view s, long)
+  {
+    return f(std::string(s.data(), s.size()));
+  }
 };
 
 } // End namespace sam
@@ -12,6 +12,7 @@
 #include <boost/tokenizer.hpp>
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/fusion/algorithm/iteration/for_each.hpp>
 #include <zmq.hpp>
@@ -77,63 +78,32 @@ typedef std::tuple<double,       //TimeSeconds
 
 
 /**
- * Converts a string that is in csv vast format into a tuple.
+ * Converts a view of a string that is in csv vast format into a tuple.
+ * The fields are parsed in place rather than copied out of a stringstream.
  */
 inline
-VastNetflow makeVastNetflow(std::string const& s) 
+VastNetflow makeVastNetflow(boost::string_view s)
 {
-  // All the fields that need to be populated.
-  // These values aren't used.
-  double timeSeconds = 1;
-  std::string parsedDate = "blah"; 
-  std::string dateTimeStr = "blah";
-  std::string ipLayerProtocol = "blah";
-  std::string ipLayerProtocolCode = "blah";
-  std::string sourceIP = "192.168.0.1"; 
-  std::string destIP = "192.168.0.1";
-  int sourcePort = 55;
-  int destPort = 66;
-  std::string moreFragments = "0";
-  int countFragments = 1;
-  int durationSeconds = 1;
-  int firstSeenSrcPayloadBytes = 1;
-  int firstSeenDestPayloadBytes = 1;
-  int firstSeenSrcTotalBytes = 1;
-  int firstSeenDestTotalBytes = 1;
-  int firstSeenSrcPacketCount = 1;
-  int firstSeenDestPacketCount = 1;
-  int recordForceOut = 0; 
-
-  std::stringstream ss(s);
-  std::string item;
-  std::getline(ss, item, ',');
-  timeSeconds = boost::lexical_cast<double>(item); std::getline(ss, item, ','); 
-  parsedDate = item; std::getline(ss, item, ',');
-  dateTimeStr = item; std::getline(ss, item, ',');
-  ipLayerProtocol = item; std::getline(ss, item, ',');
-  ipLayerProtocolCode = item; std::getline(ss, item, ',');
-  sourceIP = item; std::getline(ss, item, ',');                                          
-  destIP = item; std::getline(ss, item, ',');
-  sourcePort = boost::lexical_cast<int>(item); std::getline(ss, item, ',');
-  destPort = boost::lexical_cast<int>(item); std::getline(ss, item, ',');
-  moreFragments = item; std::getline(ss, item, ',');
-  countFragments = boost::lexical_cast<int>(item); std::getline(ss, item, ',');
-  durationSeconds = boost::lexical_cast<double>(item); 
-  std::getline(ss, item, ',');
-  firstSeenSrcPayloadBytes = boost::lexical_cast<long>(item); 
-  std::getline(ss, item, ',');
-  firstSeenDestPayloadBytes = boost::lexical_cast<long>(item); 
-  std::getline(ss, item, ',');
-  firstSeenSrcTotalBytes = boost::lexical_cast<long>(item); 
-  std::getline(ss, item, ',');
-  firstSeenDestTotalBytes = boost::lexical_cast<long>(item); 
-  std::getline(ss, item, ',');
-  firstSeenSrcPacketCount = boost::lexical_cast<long>(item); 
-  std::getline(ss, item, ',');
-  firstSeenDestPacketCount = boost::lexical_cast<long>(item); 
-  std::getline(ss, item, ',');
-  recordForceOut = boost::lexical_cast<int>(item); std::getline(ss, item, ',');
-  
+  FieldSplitter fields(s);
+  double timeSeconds = fields.nextAs<double>();
+  std::string parsedDate = fields.nextString();
+  std::string dateTimeStr = fields.nextString();
+  std::string ipLayerProtocol = fields.nextString();
+  std::string ipLayerProtocolCode = fields.nextString();
+  std::string sourceIP = fields.nextString();
+  std::string destIP = fields.nextString();
+  int sourcePort = fields.nextAs<int>();
+  int destPort = fields.nextAs<int>();
+  std::string moreFragments = fields.nextString();
+  int countFragments = fields.nextAs<int>();
+  double durationSeconds = fields.nextAs<double>();
+  long firstSeenSrcPayloadBytes = fields.nextAs<long>();
+  long firstSeenDestPayloadBytes = fields.nextAs<long>();
+  long firstSeenSrcTotalBytes = fields.nextAs<long>();
+  long firstSeenDestTotalBytes = fields.nextAs<long>();
+  long firstSeenSrcPacketCount = fields.nextAs<long>();
+  long firstSeenDestPacketCount = fields.nextAs<long>();
+  int recordForceOut = fields.nextAs<int>();
 
   return std::make_tuple(timeSeconds,
                          parsedDate, 
@@ -157,6 +127,15 @@ VastNetflow makeVastNetflow(std::string const& s)
                          );
 }
 
+/**
+ * Converts a string that is in csv vast format into a tuple.
+ */
+inline
+VastNetflow makeVastNetflow(std::string const& s) 
+{
+  return makeVastNetflow(boost::string_view(s));
+}
+
 class MakeVastNetflow
 {
 public:
@@ -164,6 +143,11 @@ public:
   {
     return makeVastNetflow(s); 
   }
+
+  VastNetflow operator()(boost::string_view s)
+  {
+    return makeVastNetflow(s); 
+  }
 };
 
 
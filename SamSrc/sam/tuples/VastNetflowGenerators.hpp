@@ -66,6 +66,14 @@ public:
    * \param epochTime The time in seconds since the epoch. 
    */
   virtual std::string generate(double epochTime) = 0;
+
+  /**
+   * Seeds the random engine of the generator so that runs can be repeated.
+   * The helpers generateRandomIp and generateRandomPort use rand(), so
+   * srand needs to be called as well.  By default there is nothing to seed.
+   * \param seed The seed.
+   */
+  virtual void seed(unsigned int seed) {}
 };
 
 inline  
@@ -103,6 +111,8 @@ public:
   
 
   std::string generate() { return AbstractVastNetflowGenerator::generate(); }
+
+  void seed(unsigned int seed) { myRand.seed(seed); }
     
 
   /**
@@ -329,7 +339,7 @@ private:
 
   /// Even with different random seeds, still seeing similar output.  
   /// Adding a little offset based on the random seed.
-  double timeOffset;
+  double timeOffset = 0;
 
   std::random_device rd;
   std::mt19937 myRand; 
@@ -352,6 +362,8 @@ public:
   {
   }
 
+  void seed(unsigned int seed) { myRand.seed(seed); }
+
   /**
    * Uses AbstractVastNetflowGenerator::generate, which calls generate(epochTime)
    * with the current clock time.
@@ -454,6 +466,8 @@ public:
   ~OnePairSizeDist() {
   }
 
+  void seed(unsigned int seed) { gen.seed(seed); }
+
   std::string generate() {
     return AbstractVastNetflowGenerator::generate();
   }
@@ -111,6 +111,9 @@ BOOST_AUTO_TEST_CASE( test_sample )
     receiver->receive();
     //delete consumer;
 
+    // Writes out the buffered rows.
+    subscriber->close();
+
     int numPosFound = 0;
     int numNegFound = 0;
 
@@ -0,0 +1,124 @@
+#define BOOST_TEST_MAIN TestCapture
+#include <boost/test/unit_test.hpp>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sam/CaptureWriter.hpp>
+#include <sam/ReadCapture.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/VastNetflowGenerators.hpp>
+#include <sam/tuples/Edge.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+
+typedef Edge<size_t, SingleBoolLabel, VastNetflow> EdgeType;
+typedef Edge<size_t, EmptyLabel, VastNetflow> UnlabeledEdgeType;
+
+/**
+ * Consumer that keeps the edges it is given.
+ */
+template <typename E>
+class CollectingConsumer : public AbstractConsumer<E>
+{
+public:
+  std::vector<E> edges;
+
+  bool consume(E const& edge) {
+    edges.push_back(edge);
+    return true;
+  }
+
+  void terminate() {}
+};
+
+struct F {
+  std::string filename = "testcapture.samcap";
+  std::vector<EdgeType> edges;
+
+  /// Creates numEdges netflows, one second apart.
+  F(size_t numEdges = 1000) {
+    UniformDestPort generator("192.168.0.1", 10);
+    for (size_t i = 0; i < numEdges; i++) {
+      VastNetflow netflow = makeVastNetflow(generator.generate(1000.0 + i));
+      edges.push_back(EdgeType(i, std::make_tuple(i % 3 == 0), netflow));
+    }
+  }
+
+  ~F() {
+    std::remove(filename.c_str());
+  }
+
+  void write(size_t blockSize) {
+    CaptureWriter<EdgeType, TimeSeconds> writer(filename, blockSize);
+    writer.consumeBatch(edges.data(), 500);
+    for (size_t i = 500; i < edges.size(); i++) {
+      writer.consume(edges[i]);
+    }
+    writer.terminate();
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE( test_round_trip, F )
+{
+  write(64);
+
+  ReadCapture<EdgeType, TimeSeconds> reader(0, filename);
+  auto consumer = std::make_shared<CollectingConsumer<EdgeType>>();
+  reader.registerConsumer(consumer);
+  BOOST_CHECK(reader.connect());
+  BOOST_CHECK_EQUAL(reader.getNumRecords(), edges.size());
+  BOOST_CHECK_EQUAL(reader.getNumBlocks(), 16);
+  BOOST_CHECK_EQUAL(reader.getStartTime(), 1000.0);
+  BOOST_CHECK_EQUAL(reader.getEndTime(), 1999.0);
+
+  reader.receive();
+  BOOST_CHECK_EQUAL(consumer->edges.size(), edges.size());
+  for (size_t i = 0; i < edges.size(); i++) {
+    BOOST_CHECK(consumer->edges[i].label == edges[i].label);
+    BOOST_CHECK(consumer->edges[i].tuple == edges[i].tuple);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE( test_seek, F )
+{
+  write(64);
+
+  ReadCapture<EdgeType, TimeSeconds> reader(0, filename);
+  auto consumer = std::make_shared<CollectingConsumer<EdgeType>>();
+  reader.registerConsumer(consumer);
+  BOOST_CHECK(reader.connect());
+
+  // Starts in the middle of a block.
+  reader.seek(1700.5);
+  reader.receive();
+  BOOST_CHECK_EQUAL(consumer->edges.size(), 299);
+  BOOST_CHECK(consumer->edges.front().tuple == edges[701].tuple);
+  BOOST_CHECK(consumer->edges.back().tuple == edges.back().tuple);
+
+  // Past the end there is nothing to replay.
+  consumer->edges.clear();
+  reader.seek(5000);
+  reader.receive();
+  BOOST_CHECK_EQUAL(consumer->edges.size(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_wrong_edge_type, F )
+{
+  write(64);
+
+  ReadCapture<UnlabeledEdgeType, TimeSeconds> reader(0, filename);
+  BOOST_CHECK_THROW(reader.connect(), CaptureException);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_unclosed_capture, F )
+{
+  {
+    // Simulates a writer that died before writing the footer.
+    std::ofstream file(filename, std::ios::binary);
+    file.write(CaptureDetails::HeaderMagic, CaptureDetails::MagicSize);
+  }
+
+  ReadCapture<EdgeType, TimeSeconds> reader(0, filename);
+  BOOST_CHECK_THROW(reader.connect(), CaptureException);
+}
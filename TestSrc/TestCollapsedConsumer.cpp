@@ -0,0 +1,101 @@
+#define BOOST_TEST_MAIN TestCollapsedConsumer
+#include <boost/test/unit_test.hpp>
+#include <sam/CollapsedConsumer.hpp>
+#include <sam/Project.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/VastNetflowGenerators.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+
+typedef Edge<size_t, EmptyLabel, VastNetflow> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+typedef Project<EdgeType, DestIp, SourceIp, DestIp, SourceIp> ProjectType;
+typedef CollapsedConsumer<EdgeType, DestIp> CollapsedType;
+
+/**
+ * A per source-dest feature is projected to the dest and collapsed, both
+ * with the running aggregations and with functions over the whole list.
+ */
+BOOST_AUTO_TEST_CASE( test_aggregations_match_functions )
+{
+  auto featureMap = std::make_shared<FeatureMap>(10000);
+  std::list<std::string> identifiers = {"bytes"};
+  ProjectType project(identifiers, 0, featureMap, "project");
+
+  auto values = [](std::list<std::shared_ptr<Feature>> const& features) {
+    std::vector<double> values;
+    for (auto const& feature : features) {
+      values.push_back(feature->getValue());
+    }
+    return values;
+  };
+  std::vector<Aggregation> aggregations = {Aggregation::Sum,
+    Aggregation::Average, Aggregation::Variance, Aggregation::Min,
+    Aggregation::Max};
+  std::vector<std::function<double(std::list<std::shared_ptr<Feature>>)>>
+  functions = {
+    [&](std::list<std::shared_ptr<Feature>> features) {
+      double sum = 0;
+      for (double value : values(features)) sum += value;
+      return sum;
+    },
+    [&](std::list<std::shared_ptr<Feature>> features) {
+      double sum = 0;
+      for (double value : values(features)) sum += value;
+      return sum / features.size();
+    },
+    [&](std::list<std::shared_ptr<Feature>> features) {
+      double sum = 0, squares = 0;
+      for (double value : values(features)) {
+        sum += value;
+        squares += value * value;
+      }
+      double mean = sum / features.size();
+      return squares / features.size() - mean * mean;
+    },
+    [&](std::list<std::shared_ptr<Feature>> features) {
+      auto v = values(features);
+      return *std::min_element(v.begin(), v.end());
+    },
+    [&](std::list<std::shared_ptr<Feature>> features) {
+      auto v = values(features);
+      return *std::max_element(v.begin(), v.end());
+    }
+  };
+
+  std::vector<std::shared_ptr<CollapsedType>> incremental, full;
+  for (size_t i = 0; i < aggregations.size(); i++) {
+    std::string id = std::to_string(i);
+    incremental.push_back(std::make_shared<CollapsedType>(aggregations[i],
+      "bytes", 0, featureMap, "incremental" + id));
+    full.push_back(std::make_shared<CollapsedType>(functions[i],
+      "bytes", 0, featureMap, "full" + id));
+  }
+
+  srand(0);
+  RandomPoolGenerator generator(10);
+  Tuplizer tuplizer;
+  for (size_t i = 0; i < 1000; i++) {
+    EdgeType edge = tuplizer(i, generator.generate(i));
+    // The feature of the source-dest pair, here just its latest bytes.
+    std::string key = generateKey<DestIp, SourceIp>(edge.tuple);
+    featureMap->updateInsert(key, "bytes",
+      SingleFeature(std::get<SrcTotalBytes>(edge.tuple) % 1000));
+
+    project.consume(edge);
+    std::string dest = generateKey<DestIp>(edge.tuple);
+    for (size_t a = 0; a < aggregations.size(); a++) {
+      BOOST_CHECK(incremental[a]->consume(edge));
+      BOOST_CHECK(full[a]->consume(edge));
+      double expected = featureMap->at(dest, "full" + std::to_string(a))->
+        getValue();
+      double actual = featureMap->at(dest, "incremental" + std::to_string(a))->
+        getValue();
+      // Shifted so that variances of zero compare.
+      BOOST_CHECK_CLOSE(actual + 1, expected + 1, 1e-6);
+    }
+  }
+}
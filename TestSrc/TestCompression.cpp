@@ -0,0 +1,331 @@
+#define BOOST_TEST_MAIN TestCompression
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/Compression.hpp>
+#include <sam/ZeroMQUtil.hpp>
+
+using namespace sam;
+
+namespace {
+
+std::vector<std::string> decodeAll(std::string const& frame)
+{
+  std::vector<std::string> messages;
+  std::string scratch;
+  auto payload = decodeFrame(frame.data(), frame.size(), scratch);
+  forEachInBatch(payload.first, payload.second,
+    [&messages](std::string const& str) { messages.push_back(str); });
+  return messages;
+}
+
+std::vector<CompressionCodec> availableCodecs()
+{
+  std::vector<CompressionCodec> codecs;
+  for (auto codec : {CompressionCodec::None, CompressionCodec::LZ4,
+                     CompressionCodec::Zstd}) {
+    if (isCompressionAvailable(codec)) codecs.push_back(codec);
+  }
+  return codecs;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_frame_round_trip )
+{
+  std::string netflow = "1,1,1365582756.384094,2013-04-10 08:32:36,"
+    "20130410083236.384094,17,UDP,172.20.2.18,239.255.255.250,29986,1900,0,"
+    "0,0,133,0,1,0,1,0,0";
+  std::vector<std::string> messages;
+  std::string payload;
+  for (size_t i = 0; i < 100; i++) {
+    messages.push_back(std::to_string(i) + netflow);
+    appendToBatch(payload, messages.back().data(), messages.back().size());
+  }
+  messages.push_back("");
+  appendToBatch(payload, "", 0);
+
+  for (auto codec : availableCodecs()) {
+    std::string frame;
+    bool compressed = encodeFrame(codec, payload, frame);
+    BOOST_CHECK_EQUAL(compressed, codec != CompressionCodec::None);
+    if (compressed) {
+      BOOST_CHECK(frame.size() < payload.size() / 2);
+    } else {
+      BOOST_CHECK_EQUAL(frame.size(), payload.size() + 1);
+    }
+    std::vector<std::string> decoded = decodeAll(frame);
+    BOOST_CHECK(decoded == messages);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_incompressible_frame )
+{
+  // Random bytes don't get smaller, so they go out uncompressed.
+  std::mt19937 rand(7);
+  std::string message(1000, 'x');
+  for (auto& c : message) c = static_cast<char>(rand());
+  std::string payload;
+  appendToBatch(payload, message.data(), message.size());
+
+  for (auto codec : availableCodecs()) {
+    std::string frame;
+    BOOST_CHECK(!encodeFrame(codec, payload, frame));
+    BOOST_CHECK_EQUAL(frame[0], static_cast<char>(CompressionCodec::None));
+    std::vector<std::string> decoded = decodeAll(frame);
+    BOOST_REQUIRE_EQUAL(decoded.size(), 1);
+    BOOST_CHECK_EQUAL(decoded[0], message);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_malformed_frame )
+{
+  std::string scratch;
+  BOOST_CHECK_THROW(decodeFrame("", 0, scratch), CompressionException);
+
+  std::string payload;
+  appendToBatch(payload, "abcdef", 6);
+  std::string frame;
+  encodeFrame(CompressionCodec::None, payload, frame);
+  frame.resize(frame.size() - 1);
+  auto decoded = decodeFrame(frame.data(), frame.size(), scratch);
+  BOOST_CHECK_THROW(forEachInBatch(decoded.first, decoded.second,
+                      [](std::string const&) {}), CompressionException);
+
+  if (isCompressionAvailable(CompressionCodec::LZ4)) {
+    std::string garbage(25, '\xff');
+    garbage[0] = static_cast<char>(CompressionCodec::LZ4);
+    garbage.replace(1, 4, std::string("\x64\0\0\0", 4));
+    BOOST_CHECK_THROW(decodeFrame(garbage.data(), garbage.size(), scratch),
+                      CompressionException);
+  }
+
+  // A header claiming more than PUSH_PULL_MAX_FRAME_PAYLOAD bytes is
+  // rejected before anything is allocated, whatever the codec.
+  std::string huge(25, '\0');
+  huge[0] = static_cast<char>(CompressionCodec::LZ4);
+  huge.replace(1, 4, std::string("\xff\xff\xff\xff", 4));
+  BOOST_CHECK_THROW(decodeFrame(huge.data(), huge.size(), scratch),
+                    CompressionException);
+
+  BOOST_CHECK_THROW(compressionCodecFromString("gzip"), CompressionException);
+  BOOST_CHECK(compressionCodecFromString("zstd") == CompressionCodec::Zstd);
+}
+
+BOOST_AUTO_TEST_CASE( test_adaptive_compression )
+{
+  size_t big = PUSH_PULL_COMPRESSION_MIN_BYTES;
+
+  AdaptiveCompression always(0);
+  BOOST_CHECK(always.offer(big));
+  BOOST_CHECK(!always.offer(big - 1));
+
+  // 10 MB in the first 20 ms window is well above 1 MB/s.
+  AdaptiveCompression adaptive(1e6, 20);
+  BOOST_CHECK(!adaptive.offer(big));
+  for (size_t i = 0; i < 10; i++) adaptive.offer(1000000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  BOOST_CHECK(adaptive.offer(big));
+  BOOST_CHECK(adaptive.isCompressing());
+
+  // A quiet window turns it off again.
+  std::this_thread::sleep_for(std::chrono::milliseconds(25));
+  BOOST_CHECK(!adaptive.offer(big));
+  BOOST_CHECK(!adaptive.isCompressing());
+}
+
+/**
+ * Two nodes exchanging compressed batches over TCP.
+ */
+BOOST_AUTO_TEST_CASE( test_pushpull_compressed_batches )
+{
+  std::vector<CompressionCodec> codecs = availableCodecs();
+  size_t startingPort = 12000;
+  for (auto codec : codecs) {
+    if (codec == CompressionCodec::None) continue;
+
+    std::vector<std::string> hostnames = {"localhost", "localhost"};
+    size_t numBatches = 50;
+    size_t batchSize = 100;
+    std::atomic<size_t> received(0);
+    std::atomic<bool> ordered(true);
+    std::vector<PushPull::FunctionType> callbacks;
+    callbacks.push_back([&](std::string const& str) {
+      if (str != "message " + std::to_string(received)) ordered = false;
+      received++;
+    });
+
+    // Threshold 0, so every batch is compressed.
+    PushPull node0(2, 0, 1, 1, hostnames, 1000,
+                   std::vector<PushPull::FunctionType>(), startingPort, -1,
+                   true, std::vector<PushPull::DrainFunctionType>(), -1, false,
+                   codec, 0);
+    PushPull node1(2, 1, 1, 1, hostnames, 1000, callbacks, startingPort, -1,
+                   true, std::vector<PushPull::DrainFunctionType>(), -1, false,
+                   codec, 0);
+    BOOST_CHECK(!node0.isColocated(1));
+
+    size_t n = 0;
+    for (size_t i = 0; i < numBatches; i++) {
+      std::vector<std::string> batch;
+      for (size_t j = 0; j < batchSize; j++) {
+        batch.push_back("message " + std::to_string(n++));
+      }
+      BOOST_CHECK(node0.sendBatch(batch, 1));
+    }
+    // A single message is a batch of one, too small to compress.
+    BOOST_CHECK(node0.send("message " + std::to_string(n++), 1));
+
+    for (size_t i = 0; i < 500 && received < n; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::thread terminate0([&node0]() { node0.terminate(); });
+    node1.terminate();
+    terminate0.join();
+
+    BOOST_CHECK_EQUAL(received, n);
+    BOOST_CHECK(ordered);
+    BOOST_CHECK_EQUAL(node0.getTotalMessagesSent(), n);
+    BOOST_CHECK_EQUAL(node1.getTotalMessagesReceived(), n);
+    BOOST_CHECK_EQUAL(node0.getTotalCompressedBatches(), numBatches);
+    BOOST_CHECK(node0.getCompressionRatio(1) > 2);
+    BOOST_CHECK_EQUAL(node0.getBytesSent(1), node1.getBytesReceived(0));
+    BOOST_CHECK_EQUAL(node0.getWireBytesSent(1),
+                      node1.getWireBytesReceived(0));
+    BOOST_CHECK(node0.getTotalCompressTime() > 0);
+    BOOST_CHECK(node1.getTotalDecompressTime() > 0);
+    BOOST_CHECK_EQUAL(node1.getWireBytesSent(0), 0);
+
+    startingPort += 100;
+  }
+}
+
+/**
+ * The rate that turns compression on is that offered to a node over all of
+ * its push sockets.  Each of the four sockets to node 1 sees about a
+ * quarter of 2.5 MB/s, below the 1 MB/s threshold, but together they are
+ * well above it.
+ */
+BOOST_AUTO_TEST_CASE( test_pushpull_threshold_per_node )
+{
+  std::vector<CompressionCodec> codecs = availableCodecs();
+  if (codecs.back() == CompressionCodec::None) return;
+  CompressionCodec codec = codecs.back();
+
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t startingPort = 12200;
+  std::atomic<size_t> received(0);
+  std::vector<PushPull::FunctionType> callbacks;
+  callbacks.push_back([&](std::string const&) { received++; });
+
+  PushPull node0(2, 0, 1, 4, hostnames, 1000,
+                 std::vector<PushPull::FunctionType>(), startingPort, -1,
+                 true, std::vector<PushPull::DrainFunctionType>(), -1, false,
+                 codec, 1e6);
+  PushPull node1(2, 1, 1, 4, hostnames, 1000, callbacks, startingPort, -1,
+                 true, std::vector<PushPull::DrainFunctionType>(), -1, false,
+                 codec, 1e6);
+
+  // Batches of 2.5 KB every ms for 400 ms.
+  size_t n = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < 400; i++) {
+    std::vector<std::string> batch;
+    for (size_t j = 0; j < 100; j++) {
+      batch.push_back("message " + std::to_string(n++) +
+                      std::string(12, 'x'));
+    }
+    BOOST_CHECK(node0.sendBatch(batch, 1));
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(i + 1));
+  }
+
+  for (size_t i = 0; i < 500 && received < n; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::thread terminate0([&node0]() { node0.terminate(); });
+  node1.terminate();
+  terminate0.join();
+
+  BOOST_CHECK_EQUAL(received, n);
+  BOOST_CHECK(node0.getTotalCompressedBatches() > 0);
+}
+
+/**
+ * Node 0 sends without a codec, so node 1, which expects frames, takes each
+ * message as it is for a frame.  Those that aren't valid frames are counted
+ * and dropped, and the pull thread carries on with the next one.
+ */
+BOOST_AUTO_TEST_CASE( test_pushpull_malformed_frames )
+{
+  std::vector<CompressionCodec> codecs = availableCodecs();
+  if (codecs.back() == CompressionCodec::None) return;
+  CompressionCodec codec = codecs.back();
+
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t startingPort = 12400;
+  std::vector<std::string> messages;
+  std::mutex mutex;
+  std::vector<PushPull::FunctionType> callbacks;
+  callbacks.push_back([&](std::string const& str) {
+    std::lock_guard<std::mutex> lock(mutex);
+    messages.push_back(str);
+  });
+
+  PushPull node0(2, 0, 1, 1, hostnames, 1000,
+                 std::vector<PushPull::FunctionType>(), startingPort, -1,
+                 true, std::vector<PushPull::DrainFunctionType>(), -1, false);
+  PushPull node1(2, 1, 1, 1, hostnames, 1000, callbacks, startingPort, -1,
+                 true, std::vector<PushPull::DrainFunctionType>(), -1, false,
+                 codec, 0);
+
+  std::string valid;
+  appendToBatch(valid, "hello", 5);
+  appendToBatch(valid, "world", 5);
+  std::string truncated = valid.substr(0, valid.size() - 1);
+  std::string header(1, static_cast<char>(CompressionCodec::None));
+  std::string huge(1, static_cast<char>(codec));
+  huge += std::string("\xff\xff\xff\xff", 4) + std::string(20, 'x');
+  std::string badLength = std::string(1, static_cast<char>(codec)) +
+                          std::string("\x64\0\0\0", 4) +
+                          std::string(20, '\xff');
+
+  BOOST_CHECK(node0.send("not a frame", 1));
+  BOOST_CHECK(node0.send(huge, 1));
+  BOOST_CHECK(node0.send(badLength, 1));
+  BOOST_CHECK(node0.send(header + truncated, 1));
+  BOOST_CHECK(node0.send(header + valid, 1));
+
+  for (size_t i = 0; i < 500; i++) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (messages.size() >= 2) break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::thread terminate0([&node0]() { node0.terminate(); });
+  node1.terminate();
+  terminate0.join();
+
+  BOOST_REQUIRE_EQUAL(messages.size(), 2);
+  BOOST_CHECK_EQUAL(messages[0], "hello");
+  BOOST_CHECK_EQUAL(messages[1], "world");
+  BOOST_CHECK_EQUAL(node1.getTotalMalformedFrames(), 4);
+  BOOST_CHECK_EQUAL(node1.getTotalMessagesReceived(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_pushpull_unavailable_codec )
+{
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  for (auto codec : {CompressionCodec::LZ4, CompressionCodec::Zstd}) {
+    if (isCompressionAvailable(codec)) continue;
+    BOOST_CHECK_THROW(PushPull(2, 0, 1, 1, hostnames, 1000,
+                        std::vector<PushPull::FunctionType>(), 12300, 100,
+                        true, std::vector<PushPull::DrainFunctionType>(), 100,
+                        false, codec),
+                      ZeroMQUtilException);
+  }
+}
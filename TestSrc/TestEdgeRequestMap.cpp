@@ -1,10 +1,11 @@
 #define BOOST_TEST_MAIN TestEdgeRequestList
 
 #define DEBUG
-#define METRICS
 
 #include <boost/test/unit_test.hpp>
 #include <sam/EdgeRequestMap.hpp>
+#include <sam/InProcessTransport.hpp>
+#include <sam/ZeroMQTransport.hpp>
 #include <sam/tuples/VastNetflowGenerators.hpp>
 #include <thread>
 
@@ -19,9 +20,11 @@ typedef EdgeRequestMap<VastNetflow, SourceIp, DestIp, TimeSeconds,
   StringEqualityFunction, StringEqualityFunction> MapType;
 
 typedef MapType::EdgeRequestType EdgeRequestType;
+typedef MapType::EdgeTransportType EdgeTransportType;
 
 BOOST_AUTO_TEST_CASE( test_edge_request_map )
 {
+  MetricsRegistry::setEnabled(true);
   size_t numNodes = 2;
   size_t nodeId0 = 0;
   size_t nodeId1 = 1;
@@ -35,23 +38,31 @@ BOOST_AUTO_TEST_CASE( test_edge_request_map )
   size_t numPushSockets = 1;
   size_t numPullThreads = 1;
 
-	// PushPull needs a list of callback functions.  Here we create a list
-  // and add a function that doesn't do anything.	
-	auto noopFunction = [](std::string const& str) {
+	// The transport needs a list of callback functions.  Here we create a
+  // list and add a function that doesn't do anything.	
+	auto noopFunction = [](VastNetflow const& netflow) {
   };
-  typedef PushPull::FunctionType FunctionType;
+  typedef EdgeTransportType::FunctionType FunctionType;
   std::vector<FunctionType> functions;
   functions.push_back(noopFunction);
 
-  PushPull* edgeCommunicator0 = new PushPull(numNodes, 0, numPushSockets,
-                                             numPullThreads, hostnames, hwm,
-                                             functions, startingPort, timeout,
-                                             true);
-  PushPull* edgeCommunicator1 = new PushPull(numNodes, 1, numPushSockets,
-                                             numPullThreads, hostnames, hwm,
-                                             functions, 
-                                             startingPort, 
-                                             timeout, true);
+  auto serialize = [](VastNetflow const& netflow) {
+    return toString(netflow);
+  };
+  auto deserialize = [](std::string const& str) {
+    return makeVastNetflow(str);
+  };
+
+  EdgeTransportType* edgeCommunicator0 = 
+    new ZeroMQTransport<VastNetflow>(numNodes, 0, numPushSockets,
+                                     numPullThreads, hostnames, hwm,
+                                     functions, startingPort, timeout,
+                                     true, serialize, deserialize);
+  EdgeTransportType* edgeCommunicator1 = 
+    new ZeroMQTransport<VastNetflow>(numNodes, 1, numPushSockets,
+                                     numPullThreads, hostnames, hwm,
+                                     functions, startingPort, timeout,
+                                     true, serialize, deserialize);
  
   MapType map0(numNodes, nodeId0, tableCapacity, edgeCommunicator0);
   MapType map1(numNodes, nodeId1, tableCapacity, edgeCommunicator1);
@@ -172,3 +183,134 @@ BOOST_AUTO_TEST_CASE( test_edge_request_map )
   delete edgeCommunicator1;
 
 }
+
+/**
+ * The same exchange over the direct in-process transport.  The tuples
+ * arrive as they were sent, without a trip through strings.
+ */
+BOOST_AUTO_TEST_CASE( test_edge_request_map_direct )
+{
+  MetricsRegistry::setEnabled(true);
+  size_t numNodes = 2;
+  size_t tableCapacity = 1000;
+  size_t startingPort = 10000;
+  int timeout = 1000;
+
+  std::atomic<size_t> received0(0);
+  std::atomic<size_t> received1(0);
+  std::atomic<bool> fromOtherNode(true);
+  LastOctetHashFunction hash;
+
+  // Node 1 asks for edges with targets owned by node 0 and vice versa, so
+  // each node receives tuples whose source hashes to the other node.
+  auto callback = [&](std::atomic<size_t>& received, size_t id) {
+    return [&received, &fromOtherNode, &hash, id](VastNetflow const& netflow) {
+      if (hash(std::get<SourceIp>(netflow)) % 2 == id) fromOtherNode = false;
+      received++;
+    };
+  };
+  std::vector<EdgeTransportType::FunctionType> functions0;
+  functions0.push_back(callback(received0, 0));
+  std::vector<EdgeTransportType::FunctionType> functions1;
+  functions1.push_back(callback(received1, 1));
+
+  DirectTransport<VastNetflow> edgeCommunicator0(numNodes, 0, functions0,
+                                                 startingPort, timeout);
+  DirectTransport<VastNetflow> edgeCommunicator1(numNodes, 1, functions1,
+                                                 startingPort, timeout);
+
+  MapType map0(numNodes, 0, tableCapacity, &edgeCommunicator0);
+  MapType map1(numNodes, 1, tableCapacity, &edgeCommunicator1);
+
+  EdgeRequestType edgeRequest0;
+  edgeRequest0.setTarget("192.168.0.0");
+  edgeRequest0.setReturn(1);
+  EdgeRequestType edgeRequest1;
+  edgeRequest1.setTarget("192.168.0.1");
+  edgeRequest1.setReturn(0);
+  map0.addRequest(edgeRequest0);
+  map1.addRequest(edgeRequest1);
+
+  UniformDestPort generator0("192.168.0.0", 1);
+  UniformDestPort generator1("192.168.0.1", 1);
+  size_t n = 100;
+  size_t sent0 = 0;
+  size_t sent1 = 0;
+  while (sent0 < n || sent1 < n) {
+    VastNetflow netflow0 = makeVastNetflow(generator0.generate());
+    VastNetflow netflow1 = makeVastNetflow(generator1.generate());
+    if (sent0 < n) {
+      map0.process(netflow0);
+      if (hash(std::get<SourceIp>(netflow0)) % 2 == 0) sent0++;
+    }
+    if (sent1 < n) {
+      map1.process(netflow1);
+      if (hash(std::get<SourceIp>(netflow1)) % 2 == 1) sent1++;
+    }
+  }
+
+  // Nothing is queued, so everything has arrived by now.
+  BOOST_CHECK(map0.getTotalEdgePushes() > 0);
+  BOOST_CHECK(map1.getTotalEdgePushes() > 0);
+  BOOST_CHECK_EQUAL(received1, map0.getTotalEdgePushes());
+  BOOST_CHECK_EQUAL(received0, map1.getTotalEdgePushes());
+  BOOST_CHECK_EQUAL(edgeCommunicator0.getTotalMessagesReceived(), 
+                    map1.getTotalEdgePushes());
+  BOOST_CHECK(fromOtherNode);
+
+  std::thread terminate0([&]() { map0.terminate(); });
+  map1.terminate();
+  terminate0.join();
+}
+
+/**
+ * With the direct transport the receiving node handles the tuple on the
+ * sending thread.  Here its handler adds a request to the bucket the tuple
+ * was found in, which must not deadlock.
+ */
+BOOST_AUTO_TEST_CASE( test_edge_request_map_direct_reentrant )
+{
+  size_t numNodes = 2;
+  size_t tableCapacity = 1000;
+  size_t startingPort = 10000;
+  int timeout = 1000;
+
+  MapType* map0 = nullptr;
+  std::atomic<size_t> received1(0);
+  std::vector<EdgeTransportType::FunctionType> functions0;
+  functions0.push_back([](VastNetflow const& netflow) {});
+  std::vector<EdgeTransportType::FunctionType> functions1;
+  functions1.push_back([&](VastNetflow const& netflow) {
+    EdgeRequestType edgeRequest;
+    edgeRequest.setTarget(std::get<DestIp>(netflow));
+    edgeRequest.setReturn(1);
+    map0->addRequest(edgeRequest);
+    received1++;
+  });
+
+  DirectTransport<VastNetflow> edgeCommunicator0(numNodes, 0, functions0,
+                                                 startingPort, timeout);
+  DirectTransport<VastNetflow> edgeCommunicator1(numNodes, 1, functions1,
+                                                 startingPort, timeout);
+  MapType map(numNodes, 0, tableCapacity, &edgeCommunicator0);
+  map0 = &map;
+
+  EdgeRequestType edgeRequest;
+  edgeRequest.setTarget("192.168.0.0");
+  edgeRequest.setReturn(1);
+  map.addRequest(edgeRequest);
+
+  UniformDestPort generator("192.168.0.0", 1);
+  size_t n = 0;
+  while (n < 10) {
+    VastNetflow netflow = makeVastNetflow(generator.generate());
+    map.process(netflow);
+    if (LastOctetHashFunction()(std::get<SourceIp>(netflow)) % 2 == 0) n++;
+  }
+  BOOST_CHECK_EQUAL(received1, map.getTotalEdgePushes());
+  BOOST_CHECK(received1 > 0);
+
+  std::thread terminate1([&]() { edgeCommunicator1.terminate(); });
+  map.terminate();
+  terminate1.join();
+}
@@ -1,6 +1,7 @@
 #define BOOST_TEST_MAIN TestExpression
 #include <string>
 #include <vector>
+#include <list>
 #include <boost/test/unit_test.hpp>
 #include <sam/Expression.hpp>
 #include <sam/tuples/VastNetflow.hpp>
@@ -61,3 +62,150 @@ BOOST_AUTO_TEST_CASE ( empty_item )
 }
 
 
+
+struct F {
+  VastNetflow netflow;
+  std::shared_ptr<FeatureMap> featureMap = std::make_shared<FeatureMap>();
+  std::list<std::shared_ptr<ExpressionToken<VastNetflow>>> infixList;
+  std::string key = "key";
+
+  F() {
+    std::string s = "1365582756.384094,2013-04-10 08:32:36,"
+                    "20130410083236.384094,17,UDP,172.20.2.18,"
+                    "239.255.255.250,29986,1900,0,0,0,133,0,1,0,1,0,0";
+    netflow = makeVastNetflow(s);
+  }
+};
+
+/**
+ * An operator without an opcode, which forces the expression to be
+ * evaluated token by token.
+ */
+class DivOperator : public OperatorToken<VastNetflow>
+{
+public:
+  DivOperator(std::shared_ptr<FeatureMap> featureMap) :
+    OperatorToken<VastNetflow>(featureMap, this->LEFT_ASSOCIATIVE, 3) {}
+
+  bool evaluate(std::stack<double> & mystack,
+                std::string const& key,
+                VastNetflow const& input)
+  {
+    if (mystack.size() >= 2) {
+      double o2 = mystack.top();
+      mystack.pop();
+      double o1 = mystack.top();
+      mystack.pop();
+      mystack.push(o1 / o2);
+      return true;
+    }
+    return false;
+  }
+};
+
+BOOST_FIXTURE_TEST_CASE( compiled_test, F )
+{
+  // SourcePort - DestPort * 2 > 26000
+  infixList.push_back(
+    std::make_shared<FieldToken<SourcePort, VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<SubOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<FieldToken<DestPort, VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<MultOperator<VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<NumberToken<VastNetflow>>(featureMap, 2));
+  infixList.push_back(
+    std::make_shared<GreaterThanOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<NumberToken<VastNetflow>>(featureMap, 26000));
+
+  Expression<VastNetflow> expression(infixList);
+  BOOST_CHECK(expression.isCompiled());
+
+  double result = 0;
+  BOOST_CHECK(expression.evaluate(key, netflow, result));
+  BOOST_CHECK_EQUAL(result, 1);
+
+  // Without the comparison, the value is 29986 - 3800.
+  infixList.pop_back();
+  infixList.pop_back();
+  Expression<VastNetflow> arithmetic(infixList);
+  BOOST_CHECK(arithmetic.evaluate(key, netflow, result));
+  BOOST_CHECK_EQUAL(result, 26186);
+}
+
+BOOST_FIXTURE_TEST_CASE( compiled_feature_test, F )
+{
+  auto function = [](Feature const * feature)->double {
+    return feature->getValue();
+  };
+
+  // sum.value + 1 < 10
+  infixList.push_back(
+    std::make_shared<FuncToken<VastNetflow>>(featureMap, function, "sum"));
+  infixList.push_back(std::make_shared<AddOperator<VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<NumberToken<VastNetflow>>(featureMap, 1));
+  infixList.push_back(
+    std::make_shared<LessThanOperator<VastNetflow>>(featureMap));
+  infixList.push_back(
+    std::make_shared<NumberToken<VastNetflow>>(featureMap, 10));
+
+  Expression<VastNetflow> expression(infixList);
+  BOOST_CHECK(expression.isCompiled());
+
+  // The feature isn't there yet.
+  double result = 0;
+  BOOST_CHECK(!expression.evaluate(key, netflow, result));
+
+  featureMap->updateInsert(key, "sum", SingleFeature(8));
+  BOOST_CHECK(expression.evaluate(key, netflow, result));
+  BOOST_CHECK_EQUAL(result, 1);
+
+  featureMap->updateInsert(key, "sum", SingleFeature(9));
+  BOOST_CHECK(expression.evaluate(key, netflow, result));
+  BOOST_CHECK_EQUAL(result, 0);
+}
+
+BOOST_FIXTURE_TEST_CASE( uncompilable_test, F )
+{
+  // SourcePort / 2 + 7
+  infixList.push_back(
+    std::make_shared<FieldToken<SourcePort, VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<DivOperator>(featureMap));
+  infixList.push_back(std::make_shared<NumberToken<VastNetflow>>(featureMap, 2));
+  infixList.push_back(std::make_shared<AddOperator<VastNetflow>>(featureMap));
+  infixList.push_back(std::make_shared<NumberToken<VastNetflow>>(featureMap, 7));
+
+  Expression<VastNetflow> expression(infixList);
+  BOOST_CHECK(!expression.isCompiled());
+
+  double result = 0;
+  BOOST_CHECK(expression.evaluate(key, netflow, result));
+  BOOST_CHECK_EQUAL(result, 15000);
+}
+
+BOOST_FIXTURE_TEST_CASE( malformed_test, F )
+{
+  // 1 + (missing operand)
+  infixList.push_back(std::make_shared<NumberToken<VastNetflow>>(featureMap, 1));
+  infixList.push_back(std::make_shared<AddOperator<VastNetflow>>(featureMap));
+
+  Expression<VastNetflow> expression(infixList);
+  double result = 0;
+  BOOST_CHECK(!expression.evaluate(key, netflow, result));
+}
+
+BOOST_FIXTURE_TEST_CASE( function_test, F )
+{
+  auto lambda = [](std::string const& key, VastNetflow const& input,
+                   double& result) -> bool {
+    result = std::get<SourcePort>(input) > std::get<DestPort>(input);
+    return true;
+  };
+
+  Expression<VastNetflow> expression(lambda);
+  BOOST_CHECK(expression.isCompiled());
+
+  double result = 0;
+  BOOST_CHECK(expression.evaluate(key, netflow, result));
+  BOOST_CHECK_EQUAL(result, 1);
+}
@@ -15,6 +15,7 @@
 #include <sam/ExponentialHistogramSum.hpp>
 #include <sam/ExponentialHistogramVariance.hpp>
 #include <stdio.h>
+#include <set>
 
 using namespace sam;
 using namespace sam::vast_netflow;
@@ -318,3 +319,97 @@ BOOST_AUTO_TEST_CASE( test_feature_subscriber )
   BOOST_CHECK_EQUAL(linesSeen, numExamples);
   remove(outputfile.c_str());
 }
+
+namespace {
+
+std::vector<std::vector<double>> readRows(std::string const& file)
+{
+  std::vector<std::vector<double>> rows;
+  auto infile = std::ifstream(file);
+  std::string line;
+  boost::char_separator<char> comma(",");
+  while (std::getline(infile, line)) {
+    boost::tokenizer<boost::char_separator<char>> csvTok(line, comma);
+    std::vector<double> row;
+    BOOST_FOREACH(std::string const &t, csvTok) {
+      row.push_back(boost::lexical_cast<double>(t));
+    }
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+}
+
+/**
+ * Each feature is reported by its own thread, as when operators run in
+ * parallel.  Every row must come out once and whole.
+ */
+BOOST_AUTO_TEST_CASE( test_concurrent_rows_once )
+{
+  size_t numFeatures = 4;
+  size_t n = 20000;
+  std::string outputfile = "TestFeatureSubscriberConcurrent.txt";
+  auto subscriber = std::make_shared<FeatureSubscriber>(outputfile, n);
+  std::vector<size_t> slots;
+  for (size_t f = 0; f < numFeatures; f++) {
+    slots.push_back(
+      subscriber->addFeature(boost::lexical_cast<std::string>(f)));
+  }
+  subscriber->init();
+
+  std::vector<std::thread> threads;
+  for (size_t f = 0; f < numFeatures; f++) {
+    threads.push_back(std::thread([subscriber, &slots, f, n]() {
+      for (size_t key = 0; key < n; key++) {
+        subscriber->update(key, slots[f], (double) key * (f + 1));
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  subscriber->close();
+
+  BOOST_CHECK_EQUAL(subscriber->getNumRows(), n);
+  BOOST_CHECK_EQUAL(subscriber->getNumOverruns(), 0);
+  auto rows = readRows(outputfile);
+  BOOST_REQUIRE_EQUAL(rows.size(), n);
+  std::set<double> keys;
+  for (auto const& row : rows) {
+    BOOST_REQUIRE_EQUAL(row.size(), numFeatures);
+    for (size_t f = 0; f < numFeatures; f++) {
+      BOOST_CHECK_EQUAL(row[f], row[0] * (f + 1));
+    }
+    keys.insert(row[0]);
+  }
+  BOOST_CHECK_EQUAL(keys.size(), n);
+  remove(outputfile.c_str());
+}
+
+/**
+ * Keys capacity apart share a slot.  The older row is dropped and counted
+ * rather than mixed into the newer one.
+ */
+BOOST_AUTO_TEST_CASE( test_overrun_detected )
+{
+  std::string outputfile = "TestFeatureSubscriberOverrun.txt";
+  auto subscriber = std::make_shared<FeatureSubscriber>(outputfile, 4);
+  size_t a = subscriber->addFeature("a");
+  size_t b = subscriber->addFeature("b");
+  BOOST_CHECK_THROW(subscriber->addFeature("a"), std::logic_error);
+  subscriber->init();
+
+  BOOST_CHECK(subscriber->update(0, a, 1.0));
+  BOOST_CHECK(subscriber->update(4, a, 5.0));
+  BOOST_CHECK_EQUAL(subscriber->getNumOverruns(), 1);
+  BOOST_CHECK(!subscriber->update(0, b, 2.0));
+  BOOST_CHECK_EQUAL(subscriber->getNumOverruns(), 2);
+  BOOST_CHECK(subscriber->update(4, "b", 6.0));
+  BOOST_CHECK_THROW(subscriber->update(5, "c", 0.0), std::logic_error);
+  subscriber->close();
+
+  auto rows = readRows(outputfile);
+  BOOST_REQUIRE_EQUAL(rows.size(), 1);
+  BOOST_CHECK_EQUAL(rows[0][0], 5.0);
+  BOOST_CHECK_EQUAL(rows[0][1], 6.0);
+  remove(outputfile.c_str());
+}
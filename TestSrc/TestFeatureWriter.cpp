@@ -0,0 +1,202 @@
+#define BOOST_TEST_MAIN TestFeatureWriter
+#include <boost/test/unit_test.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/FeatureWriter.hpp>
+#include <sam/FeatureSubscriber.hpp>
+
+using namespace sam;
+
+namespace {
+
+/**
+ * Reads a file written in the columnar format into rows.
+ */
+std::vector<std::vector<double>> readColumnar(std::string const& file,
+                                              std::vector<std::string>& names)
+{
+  std::ifstream in(file, std::ios::binary);
+  char magic[8];
+  in.read(magic, 8);
+  BOOST_REQUIRE_EQUAL(std::string(magic, 8), "SAMCOLS1");
+  uint64_t fields[4];
+  in.read(reinterpret_cast<char*>(fields), sizeof(fields));
+  uint64_t numColumns = fields[0], blockRows = fields[1];
+  uint64_t numRows = fields[2], headerSize = fields[3];
+  BOOST_CHECK_EQUAL(headerSize % 64, 0);
+
+  std::string nameBytes(headerSize - 8 - sizeof(fields), '\0');
+  in.read(&nameBytes[0], nameBytes.size());
+  std::istringstream nameStream(nameBytes);
+  names.clear();
+  std::string name;
+  for (uint64_t j = 0; j < numColumns; j++) {
+    std::getline(nameStream, name, '\0');
+    names.push_back(name);
+  }
+
+  uint64_t numBlocks = (numRows + blockRows - 1) / blockRows;
+  std::vector<double> data(numBlocks * numColumns * blockRows);
+  in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(double));
+  BOOST_CHECK(in.good());
+  in.get();
+  BOOST_CHECK(in.eof());
+
+  std::vector<std::vector<double>> rows(numRows,
+                                        std::vector<double>(numColumns));
+  for (uint64_t i = 0; i < numRows; i++) {
+    uint64_t block = i / blockRows, row = i % blockRows;
+    for (uint64_t j = 0; j < numColumns; j++) {
+      rows[i][j] = data[(block * numColumns + j) * blockRows + row];
+    }
+  }
+  return rows;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_csv )
+{
+  std::string file = "TestFeatureWriter.csv";
+  {
+    FeatureWriter writer(file, {"a", "b", "c"}, FeatureOutputFormat::Csv, 4);
+    for (size_t i = 0; i < 10; i++) {
+      double row[] = {(double) i, i + 0.5, -1.0 * i};
+      writer.append(row);
+    }
+    // Nothing is lost when the writer goes away without close.
+  }
+
+  std::ifstream in(file);
+  std::string line;
+  size_t i = 0;
+  while (std::getline(in, line)) {
+    std::ostringstream expected;
+    expected << (double) i << "," << i + 0.5 << "," << -1.0 * i;
+    BOOST_CHECK_EQUAL(line, expected.str());
+    i++;
+  }
+  BOOST_CHECK_EQUAL(i, 10);
+  remove(file.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_threads )
+{
+  std::string file = "TestFeatureWriter.cols";
+  size_t numThreads = 4;
+  size_t n = 1000;
+  size_t blockRows = 64;
+  FeatureWriter writer(file, {"id", "square"}, FeatureOutputFormat::Columnar,
+                       blockRows);
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < numThreads; t++) {
+    threads.push_back(std::thread([&writer, t, n, numThreads]() {
+      for (size_t i = t; i < numThreads * n; i += numThreads) {
+        double row[] = {(double) i, (double) i * i};
+        writer.append(row);
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  writer.close();
+  BOOST_CHECK_EQUAL(writer.getNumRowsWritten(), numThreads * n);
+
+  std::vector<std::string> names;
+  auto rows = readColumnar(file, names);
+  BOOST_CHECK_EQUAL(names.size(), 2);
+  BOOST_CHECK_EQUAL(names[0], "id");
+  BOOST_CHECK_EQUAL(names[1], "square");
+
+  // Every row arrives once, whole, in some order.
+  BOOST_REQUIRE_EQUAL(rows.size(), numThreads * n);
+  std::set<double> ids;
+  for (auto const& row : rows) {
+    BOOST_CHECK_EQUAL(row[1], row[0] * row[0]);
+    ids.insert(row[0]);
+  }
+  BOOST_CHECK_EQUAL(ids.size(), numThreads * n);
+
+  // The rows of each thread keep the order they were appended in.
+  std::vector<double> last(numThreads, -1);
+  for (auto const& row : rows) {
+    size_t t = static_cast<size_t>(row[0]) % numThreads;
+    BOOST_CHECK_GT(row[0], last[t]);
+    last[t] = row[0];
+  }
+  remove(file.c_str());
+}
+
+/**
+ * Rows that don't fill a buffer are written once they've waited maxDelay,
+ * without close.
+ */
+BOOST_AUTO_TEST_CASE( test_max_delay )
+{
+  std::string file = "TestFeatureWriterDelay.csv";
+  FeatureWriter writer(file, {"a", "b"}, FeatureOutputFormat::Csv, 64, 20);
+  for (size_t i = 0; i < 3; i++) {
+    double row[] = {(double) i, 2.0 * i};
+    writer.append(row);
+  }
+  for (size_t i = 0; i < 200 && writer.getNumRowsWritten() < 3; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  BOOST_CHECK_EQUAL(writer.getNumRowsWritten(), 3);
+
+  std::ifstream in(file);
+  std::string line;
+  size_t i = 0;
+  while (std::getline(in, line)) {
+    std::ostringstream expected;
+    expected << (double) i << "," << 2.0 * i;
+    BOOST_CHECK_EQUAL(line, expected.str());
+    i++;
+  }
+  BOOST_CHECK_EQUAL(i, 3);
+
+  // Later rows start a new buffer and are written in turn.
+  double row[] = {3, 6};
+  writer.append(row);
+  writer.close();
+  BOOST_CHECK_EQUAL(writer.getNumRowsWritten(), 4);
+  remove(file.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_subscriber_columnar )
+{
+  std::string file = "TestFeatureWriterSubscriber.cols";
+  auto subscriber = std::make_shared<FeatureSubscriber>(file, 100,
+    FeatureOutputFormat::Columnar);
+  subscriber->addFeature("f0");
+  subscriber->addFeature("f1");
+  subscriber->init();
+  for (size_t i = 0; i < 250; i++) {
+    subscriber->update(i, "f1", 2.0 * i);
+    subscriber->update(i, "f0", i);
+  }
+  subscriber->close();
+
+  std::vector<std::string> names;
+  auto rows = readColumnar(file, names);
+  BOOST_CHECK_EQUAL(names[0], "f0");
+  BOOST_REQUIRE_EQUAL(rows.size(), 250);
+  for (size_t i = 0; i < rows.size(); i++) {
+    BOOST_CHECK_EQUAL(rows[i][0], i);
+    BOOST_CHECK_EQUAL(rows[i][1], 2.0 * i);
+  }
+  remove(file.c_str());
+
+  BOOST_CHECK(featureOutputFormatFromString("columnar") ==
+              FeatureOutputFormat::Columnar);
+  BOOST_CHECK_THROW(featureOutputFormatFromString("parquet"),
+                    FeatureWriterException);
+}
@@ -2,6 +2,9 @@
 #include <boost/test/unit_test.hpp>
 #include <sam/Features.hpp>
 #include <sam/FeatureMap.hpp>
+#include <cmath>
+#include <limits>
+#include <random>
 
 using namespace sam;
 
@@ -107,6 +110,92 @@ BOOST_AUTO_TEST_CASE( map_feature )
 
 }
 
+/**
+ * The running aggregates of a MapFeature match aggregating all of its
+ * features as they are added and replaced.
+ */
+BOOST_AUTO_TEST_CASE( map_feature_aggregates )
+{
+  std::mt19937 random(3);
+  std::uniform_real_distribution<double> uniform(-100, 100);
+  std::map<std::string, double> values;
+
+  MapFeature mapFeature("src0", std::make_shared<SingleFeature>(5));
+  values["src0"] = 5;
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Variance), 0);
+
+  for (size_t i = 0; i < 2000; i++) {
+    std::string key = "src" + std::to_string(random() % 50);
+    double value = uniform(random);
+    values[key] = value;
+    mapFeature.update(MapFeature(key, std::make_shared<SingleFeature>(value)));
+
+    if (i % 100 != 0) continue;
+    double sum = 0, min = values.begin()->second, max = min;
+    for (auto const& it : values) {
+      sum += it.second;
+      min = std::min(min, it.second);
+      max = std::max(max, it.second);
+    }
+    double mean = sum / values.size();
+    double variance = 0;
+    for (auto const& it : values) {
+      variance += (it.second - mean) * (it.second - mean);
+    }
+    variance /= values.size();
+
+    BOOST_CHECK_EQUAL(mapFeature.size(), values.size());
+    BOOST_CHECK_CLOSE(mapFeature.aggregate(Aggregation::Sum), sum, 1e-6);
+    BOOST_CHECK_CLOSE(mapFeature.aggregate(Aggregation::Average), mean, 1e-6);
+    BOOST_CHECK_CLOSE(mapFeature.aggregate(Aggregation::Variance), variance,
+                      1e-6);
+    BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Min), min);
+    BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Max), max);
+  }
+
+  // The copy in the feature map has the same aggregates.
+  auto copy = std::static_pointer_cast<MapFeature>(mapFeature.createCopy());
+  BOOST_CHECK_EQUAL(copy->aggregate(Aggregation::Max),
+                    mapFeature.aggregate(Aggregation::Max));
+
+  std::map<std::string, std::shared_ptr<Feature>> none;
+  BOOST_CHECK(std::isnan(MapFeature(none).aggregate(Aggregation::Average)));
+  BOOST_CHECK_EQUAL(MapFeature(none).aggregate(Aggregation::Sum), 0);
+}
+
+/**
+ * Features that are NaN are left out of the aggregates, also after they are
+ * replaced.
+ */
+BOOST_AUTO_TEST_CASE( map_feature_aggregates_nan )
+{
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  MapFeature mapFeature("src0", std::make_shared<SingleFeature>(nan));
+  BOOST_CHECK_EQUAL(mapFeature.size(), 1);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Sum), 0);
+  BOOST_CHECK(std::isnan(mapFeature.aggregate(Aggregation::Average)));
+  BOOST_CHECK(std::isnan(mapFeature.aggregate(Aggregation::Max)));
+
+  mapFeature.update(MapFeature("src1", std::make_shared<SingleFeature>(2)));
+  mapFeature.update(MapFeature("src2", std::make_shared<SingleFeature>(nan)));
+  mapFeature.update(MapFeature("src3", std::make_shared<SingleFeature>(6)));
+  BOOST_CHECK_EQUAL(mapFeature.size(), 4);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Sum), 8);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Average), 4);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Variance), 4);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Min), 2);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Max), 6);
+
+  // A NaN replaced by a number, and a number replaced by NaN.
+  mapFeature.update(MapFeature("src0", std::make_shared<SingleFeature>(10)));
+  mapFeature.update(MapFeature("src1", std::make_shared<SingleFeature>(nan)));
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Sum), 16);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Average), 8);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Variance), 4);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Min), 6);
+  BOOST_CHECK_EQUAL(mapFeature.aggregate(Aggregation::Max), 10);
+}
+
 BOOST_AUTO_TEST_CASE( topk_feature )
 {
   std::vector<std::string> keys;
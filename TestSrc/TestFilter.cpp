@@ -0,0 +1,110 @@
+#define BOOST_TEST_MAIN TestFilter
+#include <boost/test/unit_test.hpp>
+#include <sam/Filter.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+using std::string;
+
+typedef VastNetflow TupleType;
+typedef EmptyLabel LabelType;
+typedef Edge<size_t, LabelType, TupleType> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer; 
+
+/**
+ * Records the ids of the edges it consumes and how many batches it got.
+ */
+class IdCollector : public AbstractConsumer<EdgeType>
+{
+public:
+  std::vector<size_t> ids;
+  size_t numBatches = 0;
+
+  bool consume(EdgeType const& edge) {
+    ids.push_back(edge.id);
+    return true;
+  }
+
+  bool consumeBatch(EdgeType const* edges, size_t numEdges) {
+    numBatches++;
+    return AbstractConsumer<EdgeType>::consumeBatch(edges, numEdges);
+  }
+
+  void terminate() {}
+};
+
+/**
+ * Creates the filter SrcTotalBytes > 5 with the given queue length.
+ */
+std::shared_ptr<Filter<EdgeType, DestIp>> 
+createFilter(std::shared_ptr<FeatureMap> featureMap, size_t queueLength)
+{
+  auto fieldToken = std::make_shared<FieldToken<SrcTotalBytes, TupleType>>(
+    featureMap);
+  auto greaterThan = std::make_shared<GreaterThanOperator<TupleType>>(
+    featureMap);
+  auto number = std::make_shared<NumberToken<TupleType>>(featureMap, 5);
+  std::list<std::shared_ptr<ExpressionToken<TupleType>>> infixList;
+  infixList.push_back(fieldToken);
+  infixList.push_back(greaterThan);
+  infixList.push_back(number);
+  auto expression = std::make_shared<Expression<TupleType>>(infixList);
+  return std::make_shared<Filter<EdgeType, DestIp>>(expression, 0, 
+    featureMap, "filter0", queueLength);
+}
+
+std::vector<EdgeType> createEdges()
+{
+  Tuplizer tuplizer;
+  std::vector<EdgeType> edges;
+  for (size_t i = 0; i < 10; i++) {
+    string s = "1365582756.384094,2013-04-10 08:32:36,"
+               "20130410083236.384094,17,UDP,172.20.2.18,"
+               "239.255.255.250,29986,1900,0,0,0,133,0," +
+               boost::lexical_cast<string>(i) + ",0,1,0,0";
+    edges.push_back(tuplizer(i, s));
+  }
+  return edges;
+}
+
+BOOST_AUTO_TEST_CASE( test_consume )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  auto filter = createFilter(featureMap, 1);
+  auto collector = std::make_shared<IdCollector>();
+  filter->registerConsumer(collector);
+
+  for (auto const& edge : createEdges()) {
+    filter->consume(edge);
+  }
+
+  // Only the edges with SrcTotalBytes > 5 pass, once each.
+  std::vector<size_t> expected = {6, 7, 8, 9};
+  BOOST_CHECK_EQUAL_COLLECTIONS(collector->ids.begin(), collector->ids.end(),
+                                expected.begin(), expected.end());
+  auto feature = featureMap->at("239.255.255.250", "filter0");
+  BOOST_CHECK_EQUAL(feature->evaluate<double>(valueFunc), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_consume_batch )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  auto filter = createFilter(featureMap, 2);
+  auto collector = std::make_shared<IdCollector>();
+  filter->registerConsumer(collector);
+
+  auto edges = createEdges();
+  filter->consumeBatch(edges.data(), edges.size());
+
+  // The four edges that pass are handed on in two batches of queueLength.
+  std::vector<size_t> expected = {6, 7, 8, 9};
+  BOOST_CHECK_EQUAL_COLLECTIONS(collector->ids.begin(), collector->ids.end(),
+                                expected.begin(), expected.end());
+  BOOST_CHECK_EQUAL(collector->numBatches, 2);
+  BOOST_CHECK_EQUAL(filter->getNumReadItems(), 4);
+  auto feature = featureMap->at("239.255.255.250", "filter0");
+  BOOST_CHECK_EQUAL(feature->evaluate<double>(valueFunc), 1);
+}
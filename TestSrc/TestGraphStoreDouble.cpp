@@ -99,7 +99,7 @@ struct DoubleNodeFixture  {
   AbstractVastNetflowGenerator *generator0;
   AbstractVastNetflowGenerator *generator1;
    
-  DoubleNodeFixture () 
+  DoubleNodeFixture(TransportType transportType = TransportType::ZeroMQ) 
   {
     featureMap = std::make_shared<FeatureMap>(1000);
     y2x = new EdgeExpression(nodey, e1, nodex);
@@ -121,14 +121,14 @@ struct DoubleNodeFixture  {
                             hwm, graphCapacity, 
                             tableCapacity, resultsCapacity, 
                             numPushSockets, numPullThreads, timeout,
-                            timeWindow, featureMap, 1, true); 
+                            timeWindow, featureMap, 1, true, transportType); 
     graphStore1 = new GraphStoreType( 
                             numNodes, nodeId1, 
                             hostnames, startingPort,
                             hwm, graphCapacity, 
                             tableCapacity, resultsCapacity, 
                             numPushSockets, numPullThreads, timeout,
-                            timeWindow, featureMap, 1, true); 
+                            timeWindow, featureMap, 1, true, transportType); 
   
 
   }
@@ -145,13 +145,30 @@ struct DoubleNodeFixture  {
   }
 };
 
+/// Both nodes in this process, talking through in-process queues.
+struct QueueDoubleNodeFixture : public DoubleNodeFixture {
+  QueueDoubleNodeFixture() : DoubleNodeFixture(TransportType::Queue) {}
+};
+
+/// Both nodes in this process, calling each other directly.
+struct DirectDoubleNodeFixture : public DoubleNodeFixture {
+  DirectDoubleNodeFixture() : DoubleNodeFixture(TransportType::Direct) {}
+};
 
 ///
 /// This tests matching a single edge across two nodes.  This doesn't
 /// test the communication of edge requests since each node can
 /// process an edge by itself.
-BOOST_FIXTURE_TEST_CASE( test_single_edge_match_two_nodes, DoubleNodeFixture )
+void singleEdgeMatchTwoNodes(DoubleNodeFixture& fixture)
 {
+  auto featureMap = fixture.featureMap;
+  auto startY2Xboth = fixture.startY2Xboth;
+  auto y2x = fixture.y2x;
+  auto graphStore0 = fixture.graphStore0;
+  auto graphStore1 = fixture.graphStore1;
+  auto generator0 = fixture.generator0;
+  auto generator1 = fixture.generator1;
+
   auto query = std::make_shared<QueryType>(featureMap);
   query->addExpression(*startY2Xboth);
   query->addExpression(*y2x);
@@ -230,6 +247,23 @@ BOOST_FIXTURE_TEST_CASE( test_single_edge_match_two_nodes, DoubleNodeFixture )
   BOOST_CHECK_EQUAL(expected1, graphStore1->getNumResults());
 }
 
+BOOST_FIXTURE_TEST_CASE( test_single_edge_match_two_nodes, DoubleNodeFixture )
+{
+  singleEdgeMatchTwoNodes(*this);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_single_edge_match_two_nodes_queue,
+                         QueueDoubleNodeFixture )
+{
+  singleEdgeMatchTwoNodes(*this);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_single_edge_match_two_nodes_direct,
+                         DirectDoubleNodeFixture )
+{
+  singleEdgeMatchTwoNodes(*this);
+}
+
 ///
 /// This test creates a two graphstores and we send each graphstore
 /// a series of netflows with a source ip/ dest ip pair that is unique
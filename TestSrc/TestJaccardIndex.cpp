@@ -4,6 +4,9 @@
 #include <sam/tuples/VastNetflow.hpp>
 #include <sam/tuples/Edge.hpp>
 #include <sam/tuples/Tuplizer.hpp>
+#include <deque>
+#include <random>
+#include <set>
 
 using namespace sam;
 using namespace sam::vast_netflow;
@@ -110,3 +113,43 @@ BOOST_AUTO_TEST_CASE( jaccard_index_test )
   BOOST_CHECK_EQUAL(jaccardindex, 0.25);
 
 }
+
+/**
+ * Computes the Jaccard index of the older and newer halves of the window
+ * directly from sets so we can compare against the incremental version.
+ */
+double bruteForceJaccard(std::deque<size_t> const& window)
+{
+  std::set<size_t> setA(window.begin(), window.begin() + window.size() / 2);
+  std::set<size_t> setB(window.begin() + window.size() / 2, window.end());
+  size_t intersection = 0;
+  for (auto v : setA) {
+    if (setB.count(v) > 0) intersection++;
+  }
+  double denominator = setA.size() + setB.size() - intersection;
+  if (denominator == 0) return 0;
+  return intersection / denominator;
+}
+
+BOOST_AUTO_TEST_CASE( jaccard_index_random_test )
+{
+  // Odd and even window sizes, including the degenerate N = 1.
+  for (size_t N : {1, 2, 7, 50, 1001}) {
+    JaccardIndexDetails::JaccardIndexDataStructure<size_t> ds(N);
+    std::deque<size_t> window(N, 0);
+    std::mt19937 gen(N);
+    std::uniform_int_distribution<size_t> dist(0, 20);
+
+    for (size_t i = 0; i < 20000; i++) {
+      size_t value = dist(gen);
+      ds.insert(value);
+      window.pop_front();
+      window.push_back(value);
+
+      if (i % 101 == 0) {
+        BOOST_CHECK_CLOSE(ds.getJaccardIndex(), bruteForceJaccard(window),
+                          1e-9);
+      }
+    }
+  }
+}
@@ -46,18 +46,108 @@ BOOST_AUTO_TEST_CASE( simple_median_test )
   std::cout << "Edge 3: " << edge3.toString() << std::endl;
 
   // Start the k-medians testing
+  string key = "239.255.255.250";
 
   // Simple test, should equal 0 since only one value is
   // being put into the window
   kMedianTester.consume(edge1);
-  size_t kMedianTemp = kMedianTester.getKMedian();
+  size_t kMedianTemp = kMedianTester.getKMedian(key);
   std::cout << "KMedian: " << kMedianTemp << std::endl;
   BOOST_CHECK_EQUAL(kMedianTemp, 0);
 
   // Fill window all the way and the median should equal the 
   //  SrcTotalBytes value
   for (int i=0; i <= 9; i++) kMedianTester.consume(edge3);
-  kMedianTemp = kMedianTester.getKMedian();
+  kMedianTemp = kMedianTester.getKMedian(key);
   std::cout << "KMedian: " << kMedianTemp << std::endl;
   BOOST_CHECK_EQUAL(kMedianTemp, 6);
 }
+
+BOOST_AUTO_TEST_CASE( sliding_median_test )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  KMedian<size_t, EdgeType, DestIp, SrcTotalBytes> 
+    kMedianTester(5, 1, 0, featureMap, "median0");
+  Tuplizer tuplizer;
+
+  string prefix = "1365582756.384094,2013-04-10 08:32:36," 
+                  "20130410083236.384094,17,UDP,172.20.2.18," 
+                  "239.255.255.250,29986,1900,0,0,0,133,0,";
+  string suffix = ",0,1,0,0";
+  string key = "239.255.255.250";
+
+  // Window of 5 starting as {0, 0, 0, 0, 0}.  Each value is the 
+  // median after inserting 10, 20, ..., 100.
+  std::vector<size_t> expected = {0, 0, 10, 20, 30, 40, 50, 60, 70, 80};
+  for (size_t i = 0; i < expected.size(); i++) {
+    EdgeType edge = tuplizer(i, prefix + 
+      boost::lexical_cast<string>((i + 1) * 10) + suffix);
+    kMedianTester.consume(edge);
+    BOOST_CHECK_EQUAL(kMedianTester.getKMedian(key), expected[i]);
+    BOOST_CHECK(featureMap->exists(key, "median0"));
+  }
+
+  // Now decreasing values so that the oldest (largest) values get evicted.
+  for (size_t i = 0; i < 5; i++) {
+    EdgeType edge = tuplizer(i, prefix + "1" + suffix);
+    kMedianTester.consume(edge);
+  }
+  BOOST_CHECK_EQUAL(kMedianTester.getKMedian(key), 1);
+}
+
+BOOST_AUTO_TEST_CASE( centroids_test )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  KMedian<size_t, EdgeType, DestIp, SrcTotalBytes> 
+    kMedianTester(9, 3, 0, featureMap, "kmedian0");
+  Tuplizer tuplizer;
+
+  string prefix = "1365582756.384094,2013-04-10 08:32:36," 
+                  "20130410083236.384094,17,UDP,172.20.2.18," 
+                  "239.255.255.250,29986,1900,0,0,0,133,0,";
+  string suffix = ",0,1,0,0";
+  string key = "239.255.255.250";
+
+  // Three well separated clusters around 2, 50, and 1001.
+  std::vector<size_t> values = {1000, 1, 50, 2, 1001, 49, 3, 51, 1002};
+  for (size_t i = 0; i < values.size(); i++) {
+    EdgeType edge = tuplizer(i, prefix + 
+      boost::lexical_cast<string>(values[i]) + suffix);
+    kMedianTester.consume(edge);
+  }
+
+  std::vector<size_t> centroids = kMedianTester.getCentroids(key);
+  BOOST_CHECK_EQUAL(centroids.size(), 3);
+  BOOST_CHECK_EQUAL(centroids[0], 2);
+  BOOST_CHECK_EQUAL(centroids[1], 50);
+  BOOST_CHECK_EQUAL(centroids[2], 1001);
+  BOOST_CHECK_EQUAL(kMedianTester.getKMedian(key), 50);
+}
+
+BOOST_AUTO_TEST_CASE( missing_key_test )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  KMedian<size_t, EdgeType, DestIp, SrcTotalBytes> 
+    kMedianTester(9, 3, 0, featureMap, "kmedian0");
+
+  BOOST_CHECK_THROW(kMedianTester.getKMedian("10.0.0.1"), std::out_of_range);
+  BOOST_CHECK_THROW(kMedianTester.getCentroids("10.0.0.1"),
+                    std::out_of_range);
+  // Asking does not add the key.
+  BOOST_CHECK_EQUAL(kMedianTester.keys().size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( bad_parameters_test )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  typedef KMedian<size_t, EdgeType, DestIp, SrcTotalBytes> KMedianType;
+  BOOST_CHECK_THROW(KMedianType(9, 0, 0, featureMap, "kmedian0"),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(KMedianType(9, 10, 0, featureMap, "kmedian0"),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(KMedianType(0, 1, 0, featureMap, "kmedian0"),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(KMedianDetails::KMedianDataStructure<size_t>(9, 0),
+                    std::invalid_argument);
+  BOOST_CHECK_NO_THROW(KMedianType(9, 9, 0, featureMap, "kmedian0"));
+}
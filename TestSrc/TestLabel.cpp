@@ -40,3 +40,15 @@ BOOST_AUTO_TEST_CASE( test_mixed_label )
 
 
 }
+
+BOOST_AUTO_TEST_CASE( test_extract_label_string_view )
+{
+  typedef std::tuple<int, double> LabelType;
+
+  boost::string_view s = "1,3.6,therest";
+  LabelType label;
+  ExtractLabel<LabelType, 2>::extract(s, label);
+  BOOST_CHECK_EQUAL(s, "therest");
+  BOOST_CHECK_EQUAL(std::get<0>(label), 1);
+  BOOST_CHECK_EQUAL(std::get<1>(label), 3.6);
+}
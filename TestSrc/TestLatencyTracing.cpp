@@ -0,0 +1,236 @@
+#define BOOST_TEST_MAIN TestLatencyTracing
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/LatencyTracing.hpp>
+#include <sam/CaptureWriter.hpp>
+#include <sam/ReadCapture.hpp>
+#include <sam/FeatureProducer.hpp>
+#include <sam/FeatureSubscriber.hpp>
+#include <sam/ZeroMQPushPull.hpp>
+#include <sam/tuples/VastNetflowGenerators.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+
+typedef VastNetflow TupleType;
+typedef EmptyLabel LabelType;
+typedef Edge<size_t, LabelType, TupleType> EdgeType;
+typedef TupleStringHashFunction<TupleType, SourceIp> SourceHash;
+typedef TupleStringHashFunction<TupleType, DestIp> TargetHash;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+typedef ZeroMQPushPull<EdgeType, Tuplizer, SourceHash,
+          TargetHash> PartitionType;
+
+namespace {
+
+size_t stageCount(TraceStage stage)
+{
+  return LatencyTracer::histogram(stage).snapshot().count;
+}
+
+/**
+ * Reports a constant feature for each edge it is given.
+ */
+class ConstantProducer : public FeatureProducer
+{
+public:
+  void produce(EdgeType const& edge) { notifySubscribers(edge, 1.0); }
+};
+
+/**
+ * Counts the edges it gets, and those without an ingest time.
+ */
+class IngestConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  std::atomic<size_t> count;
+  std::atomic<size_t> numUnstamped;
+  std::atomic<int64_t> earliest; ///> The earliest ingest time seen
+
+  IngestConsumer() : count(0), numUnstamped(0),
+    earliest(std::numeric_limits<int64_t>::max()) {}
+
+  bool consume(EdgeType const& edge) {
+    count++;
+    if (edge.ingestTime == 0) {
+      numUnstamped++;
+    } else if (edge.ingestTime < earliest) {
+      earliest = edge.ingestTime;
+    }
+    return true;
+  }
+
+  void terminate() {}
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_stamp_interval )
+{
+  MetricsRegistry::setEnabled(true);
+  LatencyTracer::setSampleInterval(4);
+  size_t numStamped = 0;
+  for (size_t i = 0; i < 100; i++) {
+    if (LatencyTracer::stamp() != 0) numStamped++;
+  }
+  BOOST_CHECK_EQUAL(numStamped, 25);
+
+  // Nothing is stamped when tracing or metrics are off.
+  MetricsRegistry::setEnabled(false);
+  BOOST_CHECK_EQUAL(LatencyTracer::stamp(), 0);
+  MetricsRegistry::setEnabled(true);
+  LatencyTracer::setSampleInterval(0);
+  for (size_t i = 0; i < 10; i++) {
+    BOOST_CHECK_EQUAL(LatencyTracer::stamp(), 0);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_record )
+{
+  MetricsRegistry::setEnabled(true);
+  size_t before = stageCount(TraceStage::GraphAdd);
+
+  // Edges that weren't sampled aren't recorded.
+  LatencyTracer::record(TraceStage::GraphAdd, 0);
+  BOOST_CHECK_EQUAL(stageCount(TraceStage::GraphAdd), before);
+
+  LatencyTracer::record(TraceStage::GraphAdd, LatencyTracer::now() - 5000000);
+  BOOST_CHECK_EQUAL(stageCount(TraceStage::GraphAdd), before + 1);
+  BOOST_CHECK(LatencyTracer::histogram(TraceStage::GraphAdd).snapshot().max()
+              >= 5000000);
+
+  BOOST_CHECK(MetricsRegistry::instance().prometheus().find(
+    "sam_ingest_latency_seconds_count{stage=\"graph_add\"}") !=
+    std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( test_feature_stages )
+{
+  MetricsRegistry::setEnabled(true);
+  std::string outputfile = "TestLatencyTracingFeatures.csv";
+  auto subscriber = std::make_shared<FeatureSubscriber>(outputfile);
+  ConstantProducer producer0, producer1;
+  producer0.registerSubscriber(subscriber, "feature0");
+  producer1.registerSubscriber(subscriber, "feature1");
+  subscriber->init();
+
+  size_t operatorBefore = stageCount(TraceStage::Operator);
+  size_t writeBefore = stageCount(TraceStage::FeatureWrite);
+
+  EdgeType sampled;
+  sampled.id = 0;
+  sampled.ingestTime = LatencyTracer::now();
+  EdgeType unsampled;
+  unsampled.id = 1;
+  for (auto const& edge : {sampled, unsampled}) {
+    producer0.produce(edge);
+    producer1.produce(edge);
+  }
+
+  // Each operator reports the sampled edge, and its row is written once.
+  BOOST_CHECK_EQUAL(stageCount(TraceStage::Operator), operatorBefore + 2);
+  BOOST_CHECK_EQUAL(stageCount(TraceStage::FeatureWrite), writeBefore + 1);
+
+  subscriber->close();
+  remove(outputfile.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_push_pull_carries_ingest_time )
+{
+  MetricsRegistry::setEnabled(true);
+  LatencyTracer::setSampleInterval(1);
+  size_t numNodes = 2;
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t startingPort = 10300;
+  size_t n = 2000;
+
+  AbstractVastNetflowGenerator* generator0 =
+    new UniformDestPort("192.168.0.1", 1);
+  AbstractVastNetflowGenerator* generator1 =
+    new UniformDestPort("192.168.0.2", 1);
+
+  PartitionType* pushPull0 = new PartitionType(1, numNodes, 0, hostnames,
+                                    startingPort, 1000, true, 1000);
+  PartitionType* pushPull1 = new PartitionType(1, numNodes, 1, hostnames,
+                                    startingPort, 1000, true, 1000);
+  auto consumer0 = std::make_shared<IngestConsumer>();
+  auto consumer1 = std::make_shared<IngestConsumer>();
+  pushPull0->registerConsumer(consumer0);
+  pushPull1->registerConsumer(consumer1);
+
+  size_t partitionBefore = stageCount(TraceStage::Partition);
+
+  auto function = [n](AbstractVastNetflowGenerator *generator,
+                      PartitionType* pushPull)
+  {
+    Tuplizer tuplizer;
+    for (size_t i = 0; i < n; i++) {
+      EdgeType edge = tuplizer(i, generator->generate());
+      edge.ingestTime = LatencyTracer::stamp();
+      pushPull->consume(edge);
+    }
+    pushPull->terminate();
+  };
+
+  std::thread thread0(function, generator0, pushPull0);
+  std::thread thread1(function, generator1, pushPull1);
+  thread0.join();
+  thread1.join();
+
+  // Deleting waits for the pull threads.
+  delete pushPull0;
+  delete pushPull1;
+
+  // Edges sent to the other node keep their ingest time, and every edge
+  // handed on is recorded.
+  size_t received = consumer0->count + consumer1->count;
+  BOOST_CHECK(received >= 2 * n);
+  BOOST_CHECK_EQUAL(consumer0->numUnstamped + consumer1->numUnstamped, 0);
+  BOOST_CHECK_EQUAL(stageCount(TraceStage::Partition) - partitionBefore,
+                    received);
+
+  LatencyTracer::setSampleInterval(0);
+  delete generator0;
+  delete generator1;
+}
+
+/**
+ * A replayed capture is stamped as it is read, like the other sources.
+ */
+BOOST_AUTO_TEST_CASE( test_read_capture_stamps )
+{
+  std::string filename = "TestLatencyTracing.samcap";
+  size_t n = 300;
+  {
+    UniformDestPort generator("192.168.0.1", 10);
+    CaptureWriter<EdgeType, TimeSeconds> writer(filename, 64);
+    for (size_t i = 0; i < n; i++) {
+      writer.consume(EdgeType(i, EmptyLabel(),
+        makeVastNetflow(generator.generate(1000.0 + i))));
+    }
+    writer.terminate();
+  }
+
+  MetricsRegistry::setEnabled(true);
+  LatencyTracer::setSampleInterval(1);
+  int64_t before = LatencyTracer::now();
+  ReadCapture<EdgeType, TimeSeconds> reader(0, filename);
+  auto consumer = std::make_shared<IngestConsumer>();
+  reader.registerConsumer(consumer);
+  BOOST_REQUIRE(reader.connect());
+  reader.receive();
+
+  BOOST_CHECK_EQUAL(consumer->count, n);
+  BOOST_CHECK_EQUAL(consumer->numUnstamped, 0);
+  BOOST_CHECK(consumer->earliest >= before);
+
+  LatencyTracer::setSampleInterval(0);
+  remove(filename.c_str());
+}
@@ -0,0 +1,221 @@
+#define BOOST_TEST_MAIN TestMetrics
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/AlignedArray.hpp>
+#include <sam/Metrics.hpp>
+
+using namespace sam;
+
+namespace {
+
+MetricSnapshot const* find(std::vector<MetricSnapshot> const& metrics,
+                           std::string const& name, std::string const& labels)
+{
+  for (auto const& metric : metrics) {
+    if (metric.name == name && metric.labels == labels) return &metric;
+  }
+  return nullptr;
+}
+
+struct alignas(64) Padded
+{
+  static int live;
+  char c;
+  Padded() { live++; }
+  ~Padded() { live--; }
+};
+int Padded::live = 0;
+
+}
+
+/**
+ * Each element of an AlignedArray starts a cache line, and all of them are
+ * destroyed with it.
+ */
+BOOST_AUTO_TEST_CASE( test_aligned_array )
+{
+  for (size_t i = 0; i < 10; i++) {
+    auto array = makeAlignedArray<Padded>(5);
+    BOOST_CHECK_EQUAL(Padded::live, 5);
+    for (size_t j = 0; j < 5; j++) {
+      BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(&array[j]) % 64, 0);
+    }
+  }
+  BOOST_CHECK_EQUAL(Padded::live, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_counter_threads )
+{
+  MetricsRegistry::setEnabled(true);
+  Counter counter;
+  size_t numThreads = 8;
+  size_t n = 100000;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numThreads; i++) {
+    threads.push_back(std::thread([&counter, n]() {
+      for (size_t j = 0; j < n; j++) counter.add();
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  BOOST_CHECK_EQUAL(counter.value(), numThreads * n);
+}
+
+BOOST_AUTO_TEST_CASE( test_disabled )
+{
+  MetricsRegistry::setEnabled(false);
+  Counter counter;
+  LatencyHistogram histogram;
+  counter.add(5);
+  histogram.record(1000);
+  {
+    ScopedTimer timer(histogram);
+    // Turning metrics on mid-way doesn't make the timer record.
+    MetricsRegistry::setEnabled(true);
+  }
+  BOOST_CHECK_EQUAL(counter.value(), 0);
+  BOOST_CHECK_EQUAL(histogram.snapshot().count, 0);
+  BOOST_CHECK(MetricsRegistry::isEnabled());
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_buckets )
+{
+  using namespace MetricsDetails;
+  for (uint64_t value : {0ul, 1ul, 15ul, 16ul, 17ul, 1000ul, 123456789ul}) {
+    size_t index = bucketIndex(value);
+    BOOST_CHECK(bucketLowerBound(index) <= value);
+    BOOST_CHECK(value < bucketUpperBound(index));
+    // Buckets are at most 1/16 of their lower bound wide.
+    BOOST_CHECK(bucketUpperBound(index) - bucketLowerBound(index) <=
+                std::max<uint64_t>(1, bucketLowerBound(index) / 16));
+  }
+  BOOST_CHECK_EQUAL(bucketIndex(uint64_t(1) << 62), NumBuckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_histogram_quantiles )
+{
+  MetricsRegistry::setEnabled(true);
+  LatencyHistogram histogram;
+  for (uint64_t i = 1; i <= 10000; i++) histogram.record(i * 1000);
+  HistogramSnapshot snapshot = histogram.snapshot();
+
+  BOOST_CHECK_EQUAL(snapshot.count, 10000);
+  BOOST_CHECK_CLOSE(snapshot.mean(), 5000500, 0.001);
+  BOOST_CHECK_CLOSE(snapshot.quantile(0.5), 5e6, 100.0 / 16);
+  BOOST_CHECK_CLOSE(snapshot.quantile(0.99), 9.9e6, 100.0 / 16);
+  BOOST_CHECK(snapshot.max() >= 1e7);
+  BOOST_CHECK_CLOSE(histogram.totalSeconds(), 50.005, 0.001);
+  BOOST_CHECK_EQUAL(HistogramSnapshot().quantile(0.5), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_scoped_timer )
+{
+  MetricsRegistry::setEnabled(true);
+  auto histogram = std::make_shared<LatencyHistogram>();
+  {
+    ScopedTimer timer(histogram);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ScopedTimer timer(histogram);
+  timer.stop();
+  timer.stop();
+
+  HistogramSnapshot snapshot = histogram->snapshot();
+  BOOST_CHECK_EQUAL(snapshot.count, 2);
+  BOOST_CHECK(snapshot.sum >= 10000000);
+}
+
+BOOST_AUTO_TEST_CASE( test_registry_scrape )
+{
+  MetricsRegistry::setEnabled(true);
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  std::string node0 = metricLabels({{"node", "0"}, {"stage", "a"}});
+  std::string node1 = metricLabels({{"node", "1"}, {"stage", "a"}});
+  BOOST_CHECK_EQUAL(node0, "node=\"0\",stage=\"a\"");
+
+  auto a = registry.counter("test_scrape_total", node0, "A count");
+  auto b = registry.counter("test_scrape_total", node0, "A count");
+  auto c = registry.counter("test_scrape_total", node1, "A count");
+  a->add(1);
+  b->add(2);
+  c->add(4);
+
+  auto metrics = registry.scrape();
+  BOOST_REQUIRE(find(metrics, "test_scrape_total", node0));
+  BOOST_CHECK_EQUAL(find(metrics, "test_scrape_total", node0)->value, 3);
+  BOOST_CHECK_EQUAL(find(metrics, "test_scrape_total", node1)->value, 4);
+
+  // Metrics go away with the last pointer to them.
+  b.reset();
+  c.reset();
+  metrics = registry.scrape();
+  BOOST_CHECK_EQUAL(find(metrics, "test_scrape_total", node0)->value, 1);
+  BOOST_CHECK(!find(metrics, "test_scrape_total", node1));
+
+  BOOST_CHECK_THROW(registry.histogram("test_scrape_total", node0, ""),
+                    MetricsException);
+
+  auto histogram = registry.histogram("test_scrape_seconds", node0, "");
+  histogram->record(2000);
+  metrics = registry.scrape();
+  BOOST_CHECK_EQUAL(find(metrics, "test_scrape_seconds", node0)->histogram.count,
+                    1);
+  BOOST_CHECK(registry.report().find("test_scrape_seconds{" + node0 +
+                                     "} count 1") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( test_registry_callback )
+{
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  double value = 7;
+  auto callback = registry.callback("test_callback", "", "A gauge",
+    MetricKind::Gauge, [&value]() { return value; });
+
+  // Callbacks are read whether metrics are on or not.
+  MetricsRegistry::setEnabled(false);
+  auto metrics = registry.scrape();
+  BOOST_REQUIRE(find(metrics, "test_callback", ""));
+  BOOST_CHECK_EQUAL(find(metrics, "test_callback", "")->value, 7);
+  BOOST_CHECK(find(metrics, "test_callback", "")->kind == MetricKind::Gauge);
+
+  callback.reset();
+  BOOST_CHECK(!find(registry.scrape(), "test_callback", ""));
+
+  BOOST_CHECK_THROW(registry.callback("test_callback_histogram", "", "",
+                      MetricKind::Histogram, []() { return 0.0; }),
+                    MetricsException);
+}
+
+BOOST_AUTO_TEST_CASE( test_prometheus_format )
+{
+  MetricsRegistry::setEnabled(true);
+  MetricsRegistry& registry = MetricsRegistry::instance();
+  std::string labels = metricLabels({{"path", "a\"b\\c"}});
+  BOOST_CHECK_EQUAL(labels, "path=\"a\\\"b\\\\c\"");
+
+  auto counter = registry.counter("test_format_total", labels, "A count");
+  counter->add(12345678);
+  auto histogram = registry.histogram("test_format_seconds", "", "Times");
+  histogram->record(20);
+  histogram->record(1000);
+
+  std::string text = registry.prometheus();
+  auto has = [&text](std::string const& line) {
+    return text.find(line + "\n") != std::string::npos;
+  };
+  BOOST_CHECK(has("# HELP test_format_total A count"));
+  BOOST_CHECK(has("# TYPE test_format_total counter"));
+  BOOST_CHECK(has("test_format_total{" + labels + "} 12345678"));
+  BOOST_CHECK(has("# TYPE test_format_seconds histogram"));
+  // 20 ns is in the (16, 32] ns bucket and 1000 ns in the (512, 1024] one.
+  BOOST_CHECK(has("test_format_seconds_bucket{le=\"1.6e-08\"} 0"));
+  BOOST_CHECK(has("test_format_seconds_bucket{le=\"3.2e-08\"} 1"));
+  BOOST_CHECK(has("test_format_seconds_bucket{le=\"5.12e-07\"} 1"));
+  BOOST_CHECK(has("test_format_seconds_bucket{le=\"1.024e-06\"} 2"));
+  BOOST_CHECK(has("test_format_seconds_bucket{le=\"+Inf\"} 2"));
+  BOOST_CHECK(has("test_format_seconds_sum 1.02e-06"));
+  BOOST_CHECK(has("test_format_seconds_count 2"));
+}
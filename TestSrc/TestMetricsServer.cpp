@@ -0,0 +1,169 @@
+#define BOOST_TEST_MAIN TestMetricsServer
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sam/MetricsServer.hpp>
+#include <sam/SimpleSum.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+
+typedef VastNetflow TupleType;
+typedef EmptyLabel LabelType;
+typedef Edge<size_t, LabelType, TupleType> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+
+namespace {
+
+/**
+ * A bare-bones HTTP client: sends the request line and returns the whole
+ * response, status line, headers and body.
+ */
+std::string httpRequest(int port, std::string const& method,
+                        std::string const& path)
+{
+  int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+  BOOST_REQUIRE(sockfd >= 0);
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+  BOOST_REQUIRE(connect(sockfd, (struct sockaddr *) &address,
+                        sizeof(address)) == 0);
+
+  std::string request = method + " " + path + " HTTP/1.1\r\n"
+    "Host: localhost\r\n\r\n";
+  send(sockfd, request.data(), request.size(), MSG_NOSIGNAL);
+
+  std::string response;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = recv(sockfd, buffer, sizeof(buffer), 0)) > 0) {
+    response.append(buffer, n);
+  }
+  close(sockfd);
+  return response;
+}
+
+bool contains(std::string const& str, std::string const& part)
+{
+  return str.find(part) != std::string::npos;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_metrics_server )
+{
+  MetricsRegistry::setEnabled(true);
+  auto counter = MetricsRegistry::instance().counter(
+    "test_server_requests_total", metricLabels({{"node", "0"}}),
+    "A counter");
+  counter->add(42);
+
+  MetricsServer server(0);
+  server.start();
+  BOOST_REQUIRE(server.getPort() > 0);
+
+  std::string response = httpRequest(server.getPort(), "GET", "/metrics");
+  BOOST_CHECK(contains(response, "HTTP/1.1 200 OK\r\n"));
+  BOOST_CHECK(contains(response,
+    "Content-Type: text/plain; version=0.0.4\r\n"));
+  BOOST_CHECK(contains(response,
+    "# TYPE test_server_requests_total counter\n"));
+  BOOST_CHECK(contains(response,
+    "test_server_requests_total{node=\"0\"} 42\n"));
+
+  response = httpRequest(server.getPort(), "GET", "/");
+  BOOST_CHECK(contains(response, "HTTP/1.1 404 Not Found\r\n"));
+  response = httpRequest(server.getPort(), "POST", "/metrics");
+  BOOST_CHECK(contains(response, "HTTP/1.1 405 Method Not Allowed\r\n"));
+  BOOST_CHECK_EQUAL(server.getNumRequests(), 3);
+
+  // A second server can't take the same port.
+  MetricsServer other(server.getPort());
+  BOOST_CHECK_THROW(other.start(), MetricsException);
+
+  server.stop();
+}
+
+/**
+ * The operators and the feature map report what they hold.
+ */
+BOOST_AUTO_TEST_CASE( test_operator_metrics )
+{
+  Tuplizer tuplizer;
+  auto featureMap = std::make_shared<FeatureMap>(1000);
+  SimpleSum<size_t, EdgeType, SrcTotalBytes, DestIp>
+    sum(10, 3, featureMap, "sum0");
+
+  std::string netflow = "1365582756.384094,2013-04-10 08:32:36,"
+    "20130410083236.384094,17,UDP,172.20.2.18,239.255.255.25";
+  std::string rest = ",29986,1900,0,0,0,133,0,1,0,1,0,0";
+  for (size_t i = 0; i < 100; i++) {
+    sum.consume(tuplizer(i, netflow + std::to_string(i % 4) + rest));
+  }
+  BOOST_CHECK_EQUAL(sum.getFeedCount(), 100);
+  BOOST_CHECK_EQUAL(featureMap->getNumEntries(), 4);
+
+  MetricsServer server(0);
+  server.start();
+  std::string response = httpRequest(server.getPort(), "GET", "/metrics");
+  std::string labels = "{node=\"3\",operator=\"sum0\"}";
+  BOOST_CHECK(contains(response, "sam_operator_edges_total" + labels +
+                                 " 100\n"));
+  BOOST_CHECK(contains(response, "sam_operator_keys" + labels + " 4\n"));
+  BOOST_CHECK(contains(response, "sam_feature_map_entries 4\n"));
+  BOOST_CHECK(contains(response, "sam_feature_map_capacity 1000\n"));
+}
+
+/**
+ * A client that asks for the metrics and then stops reading is dropped
+ * after METRICS_SERVER_CONNECTION_TIMEOUT ms, even though the response is
+ * much larger than the socket buffers, and the next client is answered.
+ */
+BOOST_AUTO_TEST_CASE( test_stalled_client )
+{
+  MetricsRegistry::setEnabled(true);
+  std::vector<std::unique_ptr<CallbackMetric>> padding;
+  std::string value(1 << 20, 'x');
+  for (size_t i = 0; i < 16; i++) {
+    padding.push_back(MetricsRegistry::instance().callback(
+      "test_server_padding", metricLabels({{"i", std::to_string(i)},
+                                           {"padding", value}}),
+      "Makes the response large", MetricKind::Gauge,
+      []() { return 0.0; }));
+  }
+
+  MetricsServer server(0);
+  server.start();
+
+  int stalled = socket(AF_INET, SOCK_STREAM, 0);
+  BOOST_REQUIRE(stalled >= 0);
+  int bufferSize = 4096;
+  setsockopt(stalled, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(server.getPort());
+  inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+  BOOST_REQUIRE(connect(stalled, (struct sockaddr *) &address,
+                        sizeof(address)) == 0);
+  std::string request = "GET /metrics HTTP/1.1\r\n\r\n";
+  send(stalled, request.data(), request.size(), MSG_NOSIGNAL);
+
+  auto begin = std::chrono::steady_clock::now();
+  std::string response = httpRequest(server.getPort(), "GET", "/");
+  BOOST_CHECK(contains(response, "HTTP/1.1 404 Not Found\r\n"));
+  server.stop();
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - begin).count();
+  BOOST_CHECK_LT(seconds, METRICS_SERVER_CONNECTION_TIMEOUT / 1000.0 + 1);
+  close(stalled);
+}
+
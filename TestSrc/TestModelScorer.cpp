@@ -0,0 +1,331 @@
+#define BOOST_TEST_MAIN TestModelScorer
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/Model.hpp>
+#include <sam/ModelScorer.hpp>
+#include <sam/FeatureSubscriber.hpp>
+
+using namespace sam;
+
+namespace {
+
+void writeFile(std::string const& path, std::string const& contents)
+{
+  std::ofstream out(path);
+  out << contents;
+}
+
+/**
+ * Keeps the alerts it gets.
+ */
+class CollectingSink : public AbstractAlertSink
+{
+public:
+  std::mutex mutex;
+  std::set<std::size_t> keys;
+
+  void alert(std::size_t key, double score) {
+    std::lock_guard<std::mutex> lock(mutex);
+    keys.insert(key);
+  }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_logistic_regression )
+{
+  std::string path = "TestModelScorerLogistic.txt";
+  writeFile(path,
+    "# exported by hand\n"
+    "logistic_regression\n"
+    "features a b\n"
+    "threshold 0.75\n"
+    "intercept -1\n"
+    "weights 0.5 -2\n");
+  auto model = loadModel(path);
+  remove(path.c_str());
+
+  BOOST_CHECK_EQUAL(model->getNumFeatures(), 2);
+  BOOST_CHECK_EQUAL(model->getFeatureNames()[1], "b");
+  BOOST_CHECK_EQUAL(model->getThreshold(), 0.75);
+
+  // Three rows stored column by column with a stride of 4.
+  double columns[] = {0, 2, 4, -1,
+                      0, 1, -1, -1};
+  double scores[3];
+  model->score(columns, 4, 3, scores);
+  for (size_t i = 0; i < 3; i++) {
+    double z = -1 + 0.5 * columns[i] - 2 * columns[4 + i];
+    BOOST_CHECK_CLOSE(scores[i], 1 / (1 + std::exp(-z)), 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_naive_bayes )
+{
+  std::string path = "TestModelScorerBayes.txt";
+  writeFile(path,
+    "naive_bayes\n"
+    "features x\n"
+    "priors 0.9 0.1\n"
+    "means0 0\n"
+    "variances0 1\n"
+    "means1 10\n"
+    "variances1 4\n");
+  auto model = loadModel(path);
+  remove(path.c_str());
+  BOOST_CHECK_EQUAL(model->getThreshold(), 0.5);
+
+  auto gaussian = [](double x, double mean, double variance) {
+    return std::exp(-(x - mean) * (x - mean) / (2 * variance)) /
+           std::sqrt(2 * M_PI * variance);
+  };
+  double columns[] = {0, 5, 7, 10};
+  double scores[4];
+  model->score(columns, 4, 4, scores);
+  for (size_t i = 0; i < 4; i++) {
+    double p0 = 0.9 * gaussian(columns[i], 0, 1);
+    double p1 = 0.1 * gaussian(columns[i], 10, 4);
+    BOOST_CHECK_CLOSE(scores[i], p1 / (p0 + p1), 1e-6);
+  }
+  BOOST_CHECK(scores[0] < 0.01);
+  BOOST_CHECK(scores[3] > 0.99);
+}
+
+BOOST_AUTO_TEST_CASE( test_tree_ensemble )
+{
+  std::string path = "TestModelScorerTrees.txt";
+  // The first tree splits on b, the second is a single leaf.
+  writeFile(path,
+    "tree_ensemble\n"
+    "features a b\n"
+    "link logistic\n"
+    "base_score -2\n"
+    "roots 0 3\n"
+    "nodes 1 4.5 1 2\n"
+    "nodes -1 -0.5 -1 -1\n"
+    "nodes -1 3 -1 -1\n"
+    "nodes -1 0.25 -1 -1\n");
+  auto model = loadModel(path);
+  remove(path.c_str());
+
+  double columns[] = {9, 9, 9,
+                      4.5, 4.6, -1};
+  double scores[3];
+  model->score(columns, 3, 3, scores);
+  double expected[] = {-2 - 0.5 + 0.25, -2 + 3 + 0.25, -2 - 0.5 + 0.25};
+  for (size_t i = 0; i < 3; i++) {
+    BOOST_CHECK_CLOSE(scores[i], 1 / (1 + std::exp(-expected[i])), 1e-9);
+  }
+}
+
+/**
+ * Random trees of different shapes, scored against walking each tree.
+ */
+BOOST_AUTO_TEST_CASE( test_tree_ensemble_random )
+{
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  size_t numFeatures = 5;
+
+  // Each node is feature, threshold, left, right, as in the file.
+  std::vector<std::vector<double>> nodes;
+  std::vector<size_t> roots;
+  std::function<size_t(size_t)> grow = [&](size_t depth) -> size_t {
+    size_t index = nodes.size();
+    nodes.push_back({-1, uniform(random) - 0.5, -1, -1});
+    if (depth < 9 && uniform(random) < 0.7) {
+      nodes[index][0] = random() % numFeatures;
+      nodes[index][1] = uniform(random);
+      size_t left = grow(depth + 1);
+      size_t right = grow(depth + 1);
+      nodes[index][2] = left;
+      nodes[index][3] = right;
+    }
+    return index;
+  };
+  for (size_t t = 0; t < 20; t++) {
+    roots.push_back(grow(0));
+  }
+
+  std::ostringstream file;
+  file.precision(17);
+  file << "tree_ensemble\nfeatures f0 f1 f2 f3 f4\nbase_score 0.5\nroots";
+  for (size_t root : roots) file << " " << root;
+  file << "\n";
+  for (auto const& node : nodes) {
+    file << "nodes " << node[0] << " " << node[1] << " " << node[2] << " "
+         << node[3] << "\n";
+  }
+  std::istringstream in(file.str());
+  TreeEnsembleModel model(ModelDescription(in, "random"));
+  BOOST_CHECK_EQUAL(model.getNumTrees(), 20);
+  BOOST_CHECK_EQUAL(model.getNumNodes(), nodes.size());
+
+  // More rows than a block, with a stride larger than the batch.
+  size_t n = 150, stride = 160;
+  std::vector<double> columns(numFeatures * stride);
+  for (auto& value : columns) value = uniform(random);
+  std::vector<double> scores(n);
+  model.score(columns.data(), stride, n, scores.data());
+
+  for (size_t i = 0; i < n; i++) {
+    double expected = 0.5;
+    for (size_t root : roots) {
+      size_t k = root;
+      while (nodes[k][0] != -1) {
+        double x = columns[nodes[k][0] * stride + i];
+        k = x <= nodes[k][1] ? nodes[k][2] : nodes[k][3];
+      }
+      expected += nodes[k][1];
+    }
+    BOOST_CHECK_CLOSE(scores[i], expected, 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_bad_models )
+{
+  std::string path = "TestModelScorerBad.txt";
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+
+  writeFile(path, "random_forest\nfeatures a\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+
+  writeFile(path, "logistic_regression\nfeatures a b\nintercept 0\n"
+                  "weights 1\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+
+  writeFile(path, "logistic_regression\nfeatures a\nintercept zero\n"
+                  "weights 1\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+
+  // A child that does not exist, a node in two trees, a missing feature.
+  std::string trees = "tree_ensemble\nfeatures a\nnodes 0 1 1 2\n"
+                      "nodes -1 0 -1 -1\nnodes -1 1 -1 -1\n";
+  writeFile(path, trees + "roots 3\nnodes 0 1 1 7\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+  writeFile(path, trees + "roots 0 1\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+  writeFile(path, trees + "roots 3\nnodes 1 1 1 2\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+  writeFile(path, trees + "roots 0\nlink softmax\n");
+  BOOST_CHECK_THROW(loadModel(path), ModelException);
+  writeFile(path, trees + "roots 0\n");
+  BOOST_CHECK_NO_THROW(loadModel(path));
+  remove(path.c_str());
+}
+
+/**
+ * The subscriber writes no file and scores its rows, from several threads.
+ * Rows held back in partial batches are scored by close.
+ */
+BOOST_AUTO_TEST_CASE( test_subscriber_test_mode )
+{
+  std::string path = "TestModelScorerModel.txt";
+  // Scores at or above 0.5 exactly when x >= y.
+  writeFile(path,
+    "logistic_regression\n"
+    "features x y\n"
+    "intercept 0\n"
+    "weights 100 -100\n");
+  auto model = loadModel(path);
+  remove(path.c_str());
+
+  auto sink = std::make_shared<CollectingSink>();
+  auto scorer = std::make_shared<ModelScorer>(model, sink, 16);
+  auto subscriber = std::make_shared<FeatureSubscriber>("", 100000);
+  size_t label = subscriber->addFeature("label");
+  size_t y = subscriber->addFeature("y");
+  size_t x = subscriber->addFeature("x");
+  subscriber->registerRowConsumer(scorer);
+  subscriber->init();
+  BOOST_CHECK_THROW(subscriber->registerRowConsumer(scorer),
+                    std::logic_error);
+
+  size_t n = 1000;
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 3; t++) {
+    threads.push_back(std::thread([=]() {
+      for (size_t key = t; key < n; key += 3) {
+        subscriber->update(key, label, 0);
+        subscriber->update(key, x, key % 7);
+        subscriber->update(key, y, 3);
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  subscriber->close();
+
+  BOOST_CHECK_EQUAL(scorer->getNumScored(), n);
+  std::set<std::size_t> expected;
+  for (size_t key = 0; key < n; key++) {
+    if (key % 7 >= 3) expected.insert(key);
+  }
+  BOOST_CHECK(sink->keys == expected);
+  BOOST_CHECK_EQUAL(scorer->getNumAlerts(), expected.size());
+}
+
+BOOST_AUTO_TEST_CASE( test_missing_feature )
+{
+  std::string path = "TestModelScorerMissing.txt";
+  writeFile(path, "logistic_regression\nfeatures z\nintercept 0\n"
+                  "weights 1\n");
+  auto scorer = std::make_shared<ModelScorer>(loadModel(path),
+    std::make_shared<CollectingSink>());
+  remove(path.c_str());
+
+  FeatureSubscriber subscriber("", 10);
+  subscriber.addFeature("x");
+  subscriber.registerRowConsumer(scorer);
+  BOOST_CHECK_THROW(subscriber.init(), ModelException);
+}
+
+/**
+ * A row that doesn't fill its batch is scored once it has waited maxDelay,
+ * even if no more rows come.
+ */
+BOOST_AUTO_TEST_CASE( test_max_delay )
+{
+  std::string path = "TestModelScorerDelay.txt";
+  writeFile(path, "logistic_regression\nfeatures x\nintercept 0\n"
+                  "weights 100\n");
+  auto model = loadModel(path);
+  remove(path.c_str());
+
+  auto sink = std::make_shared<CollectingSink>();
+  ModelScorer scorer(model, sink, 16, 20);
+  scorer.init({"x"});
+  double row[] = {1};
+  scorer.consumeRow(7, row, 0);
+  BOOST_CHECK_EQUAL(scorer.getNumScored(), 0);
+
+  for (size_t i = 0; i < 100 && scorer.getNumScored() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  BOOST_CHECK_EQUAL(scorer.getNumScored(), 1);
+  BOOST_CHECK_EQUAL(scorer.getNumAlerts(), 1);
+  {
+    std::lock_guard<std::mutex> lock(sink->mutex);
+    BOOST_CHECK(sink->keys == std::set<std::size_t>({7}));
+  }
+
+  // Without a deadline rows wait for the batch to fill or for terminate.
+  ModelScorer untimed(model, sink, 16, 0);
+  untimed.init({"x"});
+  untimed.consumeRow(8, row, 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  untimed.consumeRow(9, row, 0);
+  BOOST_CHECK_EQUAL(untimed.getNumScored(), 0);
+  untimed.terminate();
+  BOOST_CHECK_EQUAL(untimed.getNumScored(), 2);
+}
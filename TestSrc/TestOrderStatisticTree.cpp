@@ -0,0 +1,82 @@
+#define BOOST_TEST_MAIN TestOrderStatisticTree
+#include <boost/test/unit_test.hpp>
+#include <sam/OrderStatisticTree.hpp>
+#include <algorithm>
+#include <deque>
+#include <random>
+
+using namespace sam;
+
+BOOST_AUTO_TEST_CASE( test_insert_select )
+{
+  OrderStatisticTree<int> tree;
+  BOOST_CHECK(tree.empty());
+  BOOST_CHECK_THROW(tree.select(0), std::out_of_range);
+
+  tree.insert(5);
+  tree.insert(1);
+  tree.insert(3);
+  tree.insert(3);
+  tree.insert(0, 2);
+
+  BOOST_CHECK_EQUAL(tree.size(), 6);
+  BOOST_CHECK_EQUAL(tree.select(0), 0);
+  BOOST_CHECK_EQUAL(tree.select(1), 0);
+  BOOST_CHECK_EQUAL(tree.select(2), 1);
+  BOOST_CHECK_EQUAL(tree.select(3), 3);
+  BOOST_CHECK_EQUAL(tree.select(4), 3);
+  BOOST_CHECK_EQUAL(tree.select(5), 5);
+  BOOST_CHECK_EQUAL(tree.rank(3), 3);
+  BOOST_CHECK_EQUAL(tree.rank(4), 5);
+  BOOST_CHECK_EQUAL(tree.rank(-1), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_erase )
+{
+  OrderStatisticTree<int> tree;
+  tree.insert(2);
+  tree.insert(2);
+  tree.insert(7);
+
+  BOOST_CHECK(!tree.erase(4));
+  BOOST_CHECK(tree.erase(2));
+  BOOST_CHECK_EQUAL(tree.size(), 2);
+  BOOST_CHECK_EQUAL(tree.select(0), 2);
+  BOOST_CHECK(tree.erase(2));
+  BOOST_CHECK(!tree.erase(2));
+  BOOST_CHECK_EQUAL(tree.select(0), 7);
+  BOOST_CHECK(tree.erase(7));
+  BOOST_CHECK(tree.empty());
+}
+
+/**
+ * Slides a window over random values and compares every order statistic
+ * against a sorted copy of the window.
+ */
+BOOST_AUTO_TEST_CASE( test_sliding_window )
+{
+  size_t N = 101;
+  OrderStatisticTree<double> tree;
+  std::deque<double> window;
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> dist(0, 50);
+
+  for (size_t i = 0; i < 5000; i++) {
+    double value = dist(gen);
+    window.push_back(value);
+    tree.insert(value);
+    if (window.size() > N) {
+      BOOST_CHECK(tree.erase(window.front()));
+      window.pop_front();
+    }
+
+    BOOST_REQUIRE_EQUAL(tree.size(), window.size());
+    if (i % 97 == 0) {
+      std::vector<double> sorted(window.begin(), window.end());
+      std::sort(sorted.begin(), sorted.end());
+      for (size_t j = 0; j < sorted.size(); j++) {
+        BOOST_CHECK_EQUAL(tree.select(j), sorted[j]);
+      }
+    }
+  }
+}
@@ -0,0 +1,117 @@
+#define BOOST_TEST_MAIN TestQuantile
+#include <boost/test/unit_test.hpp>
+#include <sam/Quantile.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+#include <algorithm>
+#include <deque>
+#include <random>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+using std::string;
+
+typedef VastNetflow TupleType;
+typedef EmptyLabel LabelType;
+typedef Edge<size_t, LabelType, TupleType> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+
+BOOST_AUTO_TEST_CASE( test_bad_parameters )
+{
+  auto featureMap = std::make_shared<FeatureMap>();
+  typedef Quantile<long, EdgeType, SrcTotalBytes, DestIp> QuantileType;
+  BOOST_CHECK_THROW(QuantileType(100, 1.5, 0, featureMap, "q"),
+                    std::invalid_argument);
+  // The window is checked when the operator is made, not on the first
+  // tuple.
+  BOOST_CHECK_THROW(QuantileType(100, 0.5, 0, featureMap, "q", 1),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(QuantileType(4, 0.5, 0, featureMap, "q", 8),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(QuantileType(100, 0.5, 0, featureMap, "q", 8, 1),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(QuantileDetails::QuantileDataStructure<long>(100, 1, 200),
+                    std::invalid_argument);
+  BOOST_CHECK_THROW(QuantileDetails::QuantileDataStructure<long>(4, 8, 200),
+                    std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( test_median )
+{
+  Tuplizer tuplizer;
+  auto featureMap = std::make_shared<FeatureMap>();
+  Quantile<long, EdgeType, SrcTotalBytes, DestIp>
+    median(100, 0.5, 0, featureMap, "median0", 4);
+
+  string prefix = "1365582756.384094,2013-04-10 08:32:36,"
+                  "20130410083236.384094,17,UDP,172.20.2.18,"
+                  "239.255.255.250,29986,1900,0,0,0,133,0,";
+  string suffix = ",0,1,0,0";
+  string key = "239.255.255.250";
+
+  for (size_t i = 1; i <= 9; i++) {
+    EdgeType edge = tuplizer(i, prefix + 
+      boost::lexical_cast<string>(i) + suffix);
+    median.consume(edge);
+  }
+  BOOST_CHECK_EQUAL(median.getQuantile(key), 5);
+  auto quantiles = median.getQuantiles(key, {0, 1});
+  BOOST_CHECK_EQUAL(quantiles[0], 1);
+  BOOST_CHECK_EQUAL(quantiles[1], 9);
+
+  auto feature = featureMap->at(key, "median0");
+  BOOST_CHECK_EQUAL(feature->evaluate<double>(valueFunc), 5);
+
+  // Push the small values out of the window.  The window holds between
+  // 75 and 100 of the most recent items.
+  for (size_t i = 0; i < 100; i++) {
+    EdgeType edge = tuplizer(i, prefix + "1000" + suffix);
+    median.consume(edge);
+  }
+  BOOST_CHECK_EQUAL(median.getQuantile(key), 1000);
+
+  // Keys that were never seen have no quantiles, and asking doesn't add them.
+  BOOST_CHECK_THROW(median.getQuantile("10.0.0.1"), std::out_of_range);
+  BOOST_CHECK_THROW(median.getQuantiles("10.0.0.1", {0.5}), std::out_of_range);
+  BOOST_CHECK_EQUAL(median.keys().size(), 1);
+}
+
+/**
+ * Slides a window over a random stream and checks that the rank of the
+ * reported quantile is close to the target rank within the window.
+ */
+BOOST_AUTO_TEST_CASE( test_sliding_accuracy )
+{
+  size_t N = 20000;
+  QuantileDetails::QuantileDataStructure<double> ds(N, 8, 200);
+  std::deque<double> window;
+  std::mt19937 gen(3);
+  std::exponential_distribution<double> dist(0.01);
+
+  for (size_t i = 0; i < 200000; i++) {
+    // Shift the distribution over time so stale items would be noticed.
+    double value = dist(gen) + i / 100;
+    ds.insert(value);
+    window.push_back(value);
+    while (window.size() > ds.getNumItems()) window.pop_front();
+
+    BOOST_REQUIRE_LE(ds.getNumItems(), N);
+    BOOST_REQUIRE_GE(ds.getNumItems(), std::min(i + 1, N - N / 8));
+
+    if (i % 9973 == 0) {
+      std::vector<double> sorted(window.begin(), window.end());
+      std::sort(sorted.begin(), sorted.end());
+      double n = sorted.size();
+      for (double q : {0.5, 0.9, 0.99}) {
+        double value = ds.getQuantile(q);
+        double low = std::lower_bound(sorted.begin(), sorted.end(), value) -
+                     sorted.begin();
+        double high = std::upper_bound(sorted.begin(), sorted.end(), value) -
+                      sorted.begin();
+        BOOST_CHECK_GE(q * n, low - 0.02 * n);
+        BOOST_CHECK_LE(q * n, high + 0.02 * n);
+      }
+    }
+  }
+}
@@ -0,0 +1,86 @@
+#define BOOST_TEST_MAIN TestQuantileSketch
+#include <boost/test/unit_test.hpp>
+#include <sam/QuantileSketch.hpp>
+#include <algorithm>
+#include <random>
+
+using namespace sam;
+
+/**
+ * Checks that value is within epsilon * n of the target rank of the 
+ * q-quantile in the sorted vector.
+ */
+void checkQuantile(std::vector<double> const& sorted, double q, double value,
+                   double epsilon)
+{
+  double n = sorted.size();
+  double target = q * n;
+  double low = std::lower_bound(sorted.begin(), sorted.end(), value) - 
+               sorted.begin();
+  double high = std::upper_bound(sorted.begin(), sorted.end(), value) - 
+                sorted.begin();
+  BOOST_CHECK_GE(target, low - epsilon * n);
+  BOOST_CHECK_LE(target, high + epsilon * n);
+}
+
+BOOST_AUTO_TEST_CASE( test_exact_when_small )
+{
+  // While level 0 is not full, the sketch is exact.
+  QuantileSketch<int> sketch(200);
+  BOOST_CHECK_EQUAL(sketch.quantile(0.5), 0);
+  for (int i = 100; i > 0; i--) sketch.add(i);
+  BOOST_CHECK_EQUAL(sketch.getN(), 100);
+  BOOST_CHECK_EQUAL(sketch.getNumLevels(), 1);
+  BOOST_CHECK_EQUAL(sketch.quantile(0), 1);
+  BOOST_CHECK_EQUAL(sketch.quantile(0.5), 50);
+  BOOST_CHECK_EQUAL(sketch.quantile(0.99), 99);
+  BOOST_CHECK_EQUAL(sketch.quantile(1), 100);
+  BOOST_CHECK_EQUAL(sketch.rank(10), 10);
+}
+
+BOOST_AUTO_TEST_CASE( test_accuracy )
+{
+  QuantileSketch<double> sketch(200);
+  std::vector<double> values;
+  std::mt19937 gen(1);
+  std::lognormal_distribution<double> dist(5, 2);
+  for (size_t i = 0; i < 1000000; i++) {
+    double value = dist(gen);
+    sketch.add(value);
+    values.push_back(value);
+  }
+  std::sort(values.begin(), values.end());
+
+  // The space is bounded regardless of n.
+  BOOST_CHECK_LT(sketch.getNumRetained(), 1000);
+
+  for (double q : {0.01, 0.25, 0.5, 0.75, 0.9, 0.99}) {
+    checkQuantile(values, q, sketch.quantile(q), 0.02);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_merge )
+{
+  QuantileSketch<double> sketch1(200);
+  QuantileSketch<double> sketch2(200);
+  std::vector<double> values;
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<double> dist1(0, 100);
+  std::uniform_real_distribution<double> dist2(50, 1000);
+  for (size_t i = 0; i < 100000; i++) {
+    double value1 = dist1(gen);
+    double value2 = dist2(gen);
+    sketch1.add(value1);
+    sketch2.add(value2);
+    values.push_back(value1);
+    values.push_back(value2);
+  }
+  std::sort(values.begin(), values.end());
+
+  sketch1.merge(sketch2);
+  BOOST_CHECK_EQUAL(sketch1.getN(), values.size());
+  BOOST_CHECK_LT(sketch1.getNumRetained(), 1000);
+  for (double q : {0.1, 0.5, 0.9, 0.99}) {
+    checkQuantile(values, q, sketch1.quantile(q), 0.02);
+  }
+}
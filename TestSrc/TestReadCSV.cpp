@@ -7,6 +7,10 @@
 #include <sam/tuples/Tuplizer.hpp>
 #include <sam/tuples/Edge.hpp>
 #include <sam/ReadCSV.hpp>
+#include <sam/ReadMappedCSV.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
 
 using namespace sam;
 using namespace sam::vast_netflow;
@@ -73,3 +77,150 @@ BOOST_AUTO_TEST_CASE( test_readcsv )
 
 }
 
+
+/**
+ * Consumer that keeps the edges it is given.
+ */
+class CollectingConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  std::vector<EdgeType> edges;
+
+  bool consume(EdgeType const& edge) {
+    edges.push_back(edge);
+    return true;
+  }
+
+  void terminate() {}
+};
+
+/**
+ * Writes labeled netflows to a file and returns the lines.
+ */
+std::vector<std::string> writeLabeledNetflows(std::string filename, 
+                                              int numNetflows)
+{
+  UniformDestPort generator("192.168.0.1", 4);
+  std::vector<std::string> lines;
+  std::ofstream myfile(filename);
+  for (int i = 0; i < numNetflows; i++) {
+    std::string line = boost::lexical_cast<std::string>(i % 2) + "," +
+                       generator.generate();
+    lines.push_back(line);
+    myfile << line << "\n";
+  }
+  myfile.close();
+  return lines;
+}
+
+BOOST_AUTO_TEST_CASE( test_read_mapped_csv_ordered )
+{
+  std::string testfilename = "testreadmappedcsv.csv";
+  std::vector<std::string> lines = writeLabeledNetflows(testfilename, 1000);
+
+  typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer; 
+
+  // Small chunks so that there are many more chunks than threads.
+  size_t numThreads = 4;
+  size_t chunkSize = 1000;
+  ReadMappedCSV<EdgeType, Tuplizer> receiver(0, testfilename, numThreads,
+                                             true, chunkSize);
+  auto consumer = std::make_shared<CollectingConsumer>();
+  receiver.registerConsumer(consumer);
+  BOOST_CHECK(receiver.connect());
+  BOOST_CHECK(receiver.getNumChunks() > numThreads * 2);
+  receiver.receive(); 
+
+  BOOST_CHECK_EQUAL(consumer->edges.size(), lines.size());
+  for (size_t i = 0; i < consumer->edges.size(); i++) {
+    boost::string_view netflow = boost::string_view(lines[i]).substr(2);
+    BOOST_CHECK(consumer->edges[i].tuple == makeVastNetflow(netflow));
+    BOOST_CHECK_EQUAL(std::get<0>(consumer->edges[i].label), i % 2);
+    if (i > 0) {
+      BOOST_CHECK(consumer->edges[i].id > consumer->edges[i - 1].id);
+    }
+  }
+
+  std::remove(testfilename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_read_mapped_csv_unordered )
+{
+  std::string testfilename = "testreadmappedcsv.csv";
+  std::vector<std::string> lines = writeLabeledNetflows(testfilename, 1000);
+
+  typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer; 
+
+  ReadMappedCSV<EdgeType, Tuplizer> receiver(0, testfilename, 4, false, 1000);
+  auto consumer = std::make_shared<CollectingConsumer>();
+  receiver.registerConsumer(consumer);
+  BOOST_CHECK(receiver.connect());
+  receiver.receive(); 
+
+  // Every line is delivered exactly once, in some order.
+  std::vector<double> expected;
+  for (auto const& line : lines) {
+    expected.push_back(std::get<TimeSeconds>(makeVastNetflow(line.substr(2))));
+  }
+  std::vector<double> actual;
+  for (auto const& edge : consumer->edges) {
+    actual.push_back(std::get<TimeSeconds>(edge.tuple));
+  }
+  std::sort(expected.begin(), expected.end());
+  std::sort(actual.begin(), actual.end());
+  BOOST_CHECK(expected == actual);
+
+  std::remove(testfilename.c_str());
+}
+
+/**
+ * Consumer that throws once it has seen a number of edges.
+ */
+class ThrowingConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  size_t numEdges = 0;
+  size_t throwAfter;
+
+  ThrowingConsumer(size_t throwAfter) : throwAfter(throwAfter) {}
+
+  bool consume(EdgeType const&) {
+    if (++numEdges > throwAfter) {
+      throw std::runtime_error("ThrowingConsumer");
+    }
+    return true;
+  }
+
+  void terminate() {}
+};
+
+/**
+ * An exception from a consumer comes out of receive, after the parsing
+ * threads are stopped, rather than terminating the process.
+ */
+BOOST_AUTO_TEST_CASE( test_read_mapped_csv_consumer_throws )
+{
+  std::string testfilename = "testreadmappedcsv.csv";
+  writeLabeledNetflows(testfilename, 1000);
+
+  typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer; 
+
+  for (bool ordered : {true, false}) {
+    ReadMappedCSV<EdgeType, Tuplizer> receiver(0, testfilename, 4, ordered,
+                                               1000);
+    auto consumer = std::make_shared<ThrowingConsumer>(100);
+    receiver.registerConsumer(consumer);
+    BOOST_CHECK(receiver.connect());
+    BOOST_CHECK_THROW(receiver.receive(), std::runtime_error);
+    BOOST_CHECK_EQUAL(consumer->numEdges, 101);
+  }
+
+  std::remove(testfilename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_read_mapped_csv_missing_file )
+{
+  typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer; 
+  ReadMappedCSV<EdgeType, Tuplizer> receiver(0, "doesnotexist.csv");
+  BOOST_CHECK(!receiver.connect());
+}
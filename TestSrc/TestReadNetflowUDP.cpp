@@ -0,0 +1,410 @@
+#define BOOST_TEST_MAIN TestReadNetflowUDP
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <sam/ReadNetflowUDP.hpp>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/VastNetflowGenerators.hpp>
+#include <sam/tuples/Edge.hpp>
+
+using namespace sam;
+using namespace sam::netflowv5;
+
+typedef Edge<size_t, EmptyLabel, NetflowV5> EdgeType;
+
+/**
+ * Builds export packets with big-endian fields.
+ */
+class PacketWriter
+{
+public:
+  std::vector<char> bytes;
+
+  void put(uint64_t value, size_t length) {
+    for (size_t i = length; i > 0; i--) {
+      bytes.push_back(static_cast<char>((value >> (8 * (i - 1))) & 0xff));
+    }
+  }
+
+  void putIp(std::string const& ip) {
+    struct in_addr address;
+    inet_pton(AF_INET, ip.c_str(), &address);
+    char const* p = reinterpret_cast<char const*>(&address);
+    bytes.insert(bytes.end(), p, p + 4);
+  }
+
+  /// Sets a 2 byte length field at offset.
+  void setLength(size_t offset, size_t length) {
+    bytes[offset] = static_cast<char>(length >> 8);
+    bytes[offset + 1] = static_cast<char>(length & 0xff);
+  }
+};
+
+/**
+ * A flow made from a synthetic VAST netflow.
+ */
+struct Flow
+{
+  std::string sourceIp;
+  std::string destIp;
+  size_t sourcePort;
+  size_t destPort;
+  size_t packets;
+  size_t bytes;
+};
+
+std::vector<Flow> makeFlows(size_t numFlows)
+{
+  sam::UniformDestPort generator("192.168.0.1", 10);
+  std::vector<Flow> flows;
+  for (size_t i = 0; i < numFlows; i++) {
+    auto netflow = sam::vast_netflow::makeVastNetflow(generator.generate());
+    Flow flow;
+    flow.sourceIp = std::get<sam::vast_netflow::SourceIp>(netflow);
+    flow.destIp = std::get<sam::vast_netflow::DestIp>(netflow);
+    flow.sourcePort = std::get<sam::vast_netflow::SourcePort>(netflow);
+    flow.destPort = std::get<sam::vast_netflow::DestPort>(netflow);
+    flow.packets = i + 1;
+    flow.bytes = std::get<sam::vast_netflow::SrcTotalBytes>(netflow) + i;
+    flows.push_back(flow);
+  }
+  return flows;
+}
+
+std::vector<char> makeV5Packet(std::vector<Flow> const& flows)
+{
+  PacketWriter w;
+  w.put(5, 2);
+  w.put(flows.size(), 2);
+  w.put(60000, 4);      // SysUptime
+  w.put(1500000000, 4); // UnixSecs
+  w.put(17, 4);         // UnixNsecs
+  w.put(0, 4);          // Sequence
+  w.put(1, 1);          // EngineType
+  w.put(2, 1);          // EngineId
+  w.put(0, 2);          // Sampling
+  for (auto const& flow : flows) {
+    w.putIp(flow.sourceIp);
+    w.putIp(flow.destIp);
+    w.putIp("10.0.0.1"); // NextHop
+    w.put(3, 2);          // SnmpInput
+    w.put(4, 2);          // SnmpOutput
+    w.put(flow.packets, 4);
+    w.put(flow.bytes, 4);
+    w.put(59000, 4);      // First
+    w.put(59500, 4);      // Last
+    w.put(flow.sourcePort, 2);
+    w.put(flow.destPort, 2);
+    w.put(0, 1);          // Pad
+    w.put(0x12, 1);       // TcpFlags
+    w.put(6, 1);          // Protocol
+    w.put(8, 1);          // Tos
+    w.put(100, 2);        // SourceAS
+    w.put(200, 2);        // DestAS
+    w.put(24, 1);         // SourceMask
+    w.put(16, 1);         // DestMask
+    w.put(0, 2);          // Pad
+  }
+  return w.bytes;
+}
+
+void checkFlow(NetflowV5 const& netflow, Flow const& flow)
+{
+  BOOST_CHECK_EQUAL(std::get<SourceIp>(netflow), flow.sourceIp);
+  BOOST_CHECK_EQUAL(std::get<DestIp>(netflow), flow.destIp);
+  BOOST_CHECK_EQUAL(std::get<SourcePort>(netflow), flow.sourcePort);
+  BOOST_CHECK_EQUAL(std::get<DestPort>(netflow), flow.destPort);
+  BOOST_CHECK_EQUAL(std::get<Dpkts>(netflow), flow.packets);
+  BOOST_CHECK_EQUAL(std::get<Doctets>(netflow), flow.bytes);
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_v5 )
+{
+  auto flows = makeFlows(10);
+  auto packet = makeV5Packet(flows);
+
+  NetflowDecoder decoder;
+  std::vector<NetflowV5> netflows;
+  BOOST_CHECK_EQUAL(decoder.decode(packet.data(), packet.size(), "10.1.1.1",
+                                   netflows), 10);
+  BOOST_CHECK_EQUAL(decoder.getNumMalformed(), 0);
+  for (size_t i = 0; i < flows.size(); i++) {
+    checkFlow(netflows[i], flows[i]);
+  }
+
+  NetflowV5 const& netflow = netflows.front();
+  BOOST_CHECK_EQUAL(std::get<UnixSecs>(netflow), 1500000000);
+  BOOST_CHECK_EQUAL(std::get<UnixNsecs>(netflow), 17);
+  BOOST_CHECK_EQUAL(std::get<SysUptime>(netflow), 60000);
+  BOOST_CHECK_EQUAL(std::get<Exaddr>(netflow), "10.1.1.1");
+  BOOST_CHECK_EQUAL(std::get<First1>(netflow), 59000);
+  BOOST_CHECK_EQUAL(std::get<Last1>(netflow), 59500);
+  BOOST_CHECK_EQUAL(std::get<EngineType>(netflow), 1);
+  BOOST_CHECK_EQUAL(std::get<EngineId>(netflow), 2);
+  BOOST_CHECK_EQUAL(std::get<NextHop>(netflow), "10.0.0.1");
+  BOOST_CHECK_EQUAL(std::get<SnmpInput>(netflow), 3);
+  BOOST_CHECK_EQUAL(std::get<SnmpOutput>(netflow), 4);
+  BOOST_CHECK_EQUAL(std::get<Protocol>(netflow), 6);
+  BOOST_CHECK_EQUAL(std::get<Tos>(netflow), 8);
+  BOOST_CHECK_EQUAL(std::get<TcpFlags>(netflow), 0x12);
+  BOOST_CHECK_EQUAL(std::get<SourceMask>(netflow), 24);
+  BOOST_CHECK_EQUAL(std::get<DestMask>(netflow), 16);
+  BOOST_CHECK_EQUAL(std::get<SourceAS>(netflow), 100);
+  BOOST_CHECK_EQUAL(std::get<DestAS>(netflow), 200);
+
+  // A count larger than the packet is malformed.
+  packet.resize(packet.size() - 1);
+  netflows.clear();
+  BOOST_CHECK_EQUAL(decoder.decode(packet.data(), packet.size(), "10.1.1.1",
+                                   netflows), 0);
+  BOOST_CHECK_EQUAL(decoder.getNumMalformed(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_v9 )
+{
+  auto flows = makeFlows(3);
+
+  // Template flowset followed by a data flowset with padding.
+  PacketWriter w;
+  w.put(9, 2);
+  w.put(2, 2);          // Count
+  w.put(60000, 4);      // SysUptime
+  w.put(1500000000, 4); // UnixSecs
+  w.put(0, 4);          // Sequence
+  w.put(42, 4);         // SourceId
+
+  w.put(0, 2);
+  w.put(4 + 4 + 6 * 4, 2);
+  w.put(256, 2);
+  w.put(6, 2);
+  w.put(8, 2);  w.put(4, 2); // Ipv4SrcAddr
+  w.put(12, 2); w.put(4, 2); // Ipv4DstAddr
+  w.put(7, 2);  w.put(2, 2); // L4SrcPort
+  w.put(11, 2); w.put(2, 2); // L4DstPort
+  w.put(2, 2);  w.put(8, 2); // InPkts
+  w.put(1, 2);  w.put(4, 2); // InBytes
+
+  size_t dataStart = w.bytes.size();
+  w.put(256, 2);
+  w.put(0, 2);
+  for (auto const& flow : flows) {
+    w.putIp(flow.sourceIp);
+    w.putIp(flow.destIp);
+    w.put(flow.sourcePort, 2);
+    w.put(flow.destPort, 2);
+    w.put(flow.packets, 8);
+    w.put(flow.bytes, 4);
+  }
+  w.put(0, 2); // Padding
+  w.setLength(dataStart + 2, w.bytes.size() - dataStart);
+
+  NetflowDecoder decoder;
+  std::vector<NetflowV5> netflows;
+  BOOST_CHECK_EQUAL(decoder.decode(w.bytes.data(), w.bytes.size(), "10.1.1.1",
+                                   netflows), 3);
+  BOOST_CHECK_EQUAL(decoder.getNumTemplates(), 1);
+  for (size_t i = 0; i < flows.size(); i++) {
+    checkFlow(netflows[i], flows[i]);
+    BOOST_CHECK_EQUAL(std::get<SysUptime>(netflows[i]), 60000);
+    BOOST_CHECK_EQUAL(std::get<UnixSecs>(netflows[i]), 1500000000);
+  }
+
+  // Templates are kept per exporter.  Data from an exporter that hasn't
+  // sent its template is dropped.
+  netflows.clear();
+  BOOST_CHECK_EQUAL(decoder.decode(w.bytes.data(), w.bytes.size(), "10.2.2.2",
+                                   netflows), 3);
+  std::vector<char> dataOnly(w.bytes.begin(), w.bytes.begin() + 20);
+  dataOnly.insert(dataOnly.end(), w.bytes.begin() + dataStart, w.bytes.end());
+  netflows.clear();
+  BOOST_CHECK_EQUAL(decoder.decode(dataOnly.data(), dataOnly.size(),
+                                   "10.3.3.3", netflows), 0);
+  BOOST_CHECK_EQUAL(decoder.getNumMissingTemplate(), 1);
+
+  // The template learned earlier is used for data without a template.
+  BOOST_CHECK_EQUAL(decoder.decode(dataOnly.data(), dataOnly.size(),
+                                   "10.1.1.1", netflows), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_ipfix )
+{
+  auto flows = makeFlows(2);
+
+  PacketWriter w;
+  w.put(10, 2);
+  w.put(0, 2);          // Length, set below
+  w.put(1500000000, 4); // ExportTime
+  w.put(0, 4);          // Sequence
+  w.put(7, 4);          // ObservationDomainId
+
+  // Template set with an enterprise field and a variable-length field.
+  size_t templateStart = w.bytes.size();
+  w.put(2, 2);
+  w.put(0, 2);
+  w.put(300, 2);
+  w.put(6, 2);
+  w.put(8, 2);      w.put(4, 2);      // Ipv4SrcAddr
+  w.put(12, 2);     w.put(4, 2);      // Ipv4DstAddr
+  w.put(0x8001, 2); w.put(65535, 2);  // Enterprise, variable length
+  w.put(12345, 4);
+  w.put(7, 2);      w.put(2, 2);      // L4SrcPort
+  w.put(11, 2);     w.put(2, 2);      // L4DstPort
+  w.put(152, 2);    w.put(8, 2);      // FlowStartMilliseconds
+  w.setLength(templateStart + 2, w.bytes.size() - templateStart);
+
+  size_t dataStart = w.bytes.size();
+  w.put(300, 2);
+  w.put(0, 2);
+  for (auto const& flow : flows) {
+    w.putIp(flow.sourceIp);
+    w.putIp(flow.destIp);
+    w.put(3, 1);
+    w.put(0xabcdef, 3);
+    w.put(flow.sourcePort, 2);
+    w.put(flow.destPort, 2);
+    w.put(1500000000ull * 1000 - 2500, 8);
+  }
+  w.setLength(dataStart + 2, w.bytes.size() - dataStart);
+  w.setLength(2, w.bytes.size());
+
+  NetflowDecoder decoder;
+  std::vector<NetflowV5> netflows;
+  BOOST_CHECK_EQUAL(decoder.decode(w.bytes.data(), w.bytes.size(), "10.1.1.1",
+                                   netflows), 2);
+  BOOST_CHECK_EQUAL(decoder.getNumMalformed(), 0);
+  for (size_t i = 0; i < flows.size(); i++) {
+    BOOST_CHECK_EQUAL(std::get<SourceIp>(netflows[i]), flows[i].sourceIp);
+    BOOST_CHECK_EQUAL(std::get<DestIp>(netflows[i]), flows[i].destIp);
+    BOOST_CHECK_EQUAL(std::get<SourcePort>(netflows[i]), flows[i].sourcePort);
+    BOOST_CHECK_EQUAL(std::get<DestPort>(netflows[i]), flows[i].destPort);
+    BOOST_CHECK_EQUAL(std::get<SysUptime>(netflows[i]), 0);
+    BOOST_CHECK_EQUAL(std::get<First1>(netflows[i]), -2500);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_unsupported )
+{
+  PacketWriter w;
+  w.put(7, 2);
+  w.put(0, 22);
+
+  NetflowDecoder decoder;
+  std::vector<NetflowV5> netflows;
+  BOOST_CHECK_EQUAL(decoder.decode(w.bytes.data(), w.bytes.size(), "10.1.1.1",
+                                   netflows), 0);
+  BOOST_CHECK_EQUAL(decoder.getNumUnsupported(), 1);
+}
+
+/**
+ * Consumer that counts what it is given.
+ */
+class CountingConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  std::atomic<size_t> count;
+  std::vector<EdgeType> edges;
+
+  CountingConsumer() : count(0) {}
+
+  bool consume(EdgeType const& edge) {
+    edges.push_back(edge);
+    count++;
+    return true;
+  }
+
+  void terminate() {}
+};
+
+BOOST_AUTO_TEST_CASE( test_read_netflow_udp )
+{
+  size_t numPackets = 50;
+  size_t flowsPerPacket = 20;
+
+  ReadNetflowUDP<EdgeType> receiver(0, "127.0.0.1",
+                                    std::vector<int>{0, 0});
+  auto consumer = std::make_shared<CountingConsumer>();
+  receiver.registerConsumer(consumer);
+  BOOST_REQUIRE(receiver.connect());
+
+  std::thread receiveThread([&receiver]() { receiver.receive(); });
+
+  int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  BOOST_REQUIRE(sockfd >= 0);
+  auto flows = makeFlows(flowsPerPacket);
+  auto packet = makeV5Packet(flows);
+  for (size_t i = 0; i < numPackets; i++) {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(receiver.getPort(i % 2));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    sendto(sockfd, packet.data(), packet.size(), 0,
+           (struct sockaddr *) &address, sizeof(address));
+  }
+  close(sockfd);
+
+  // Loopback doesn't drop datagrams unless the socket buffer fills.
+  size_t expected = numPackets * flowsPerPacket;
+  for (size_t i = 0; i < 100 && consumer->count < expected; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  receiver.stop();
+  receiveThread.join();
+
+  BOOST_CHECK_EQUAL(consumer->count, expected);
+  BOOST_CHECK_EQUAL(receiver.getNumReceived(), expected);
+  BOOST_CHECK_EQUAL(receiver.getNumPackets(), numPackets);
+  BOOST_CHECK_EQUAL(receiver.getNumMalformed(), 0);
+  checkFlow(consumer->edges.front().tuple, flows.front());
+  BOOST_CHECK_EQUAL(std::get<Exaddr>(consumer->edges.front().tuple),
+                    "127.0.0.1");
+}
+
+/**
+ * A stop that comes before the receive thread gets going still ends it.
+ */
+BOOST_AUTO_TEST_CASE( test_stop_before_receive )
+{
+  ReadNetflowUDP<EdgeType> receiver(0, "127.0.0.1", 0);
+  BOOST_REQUIRE(receiver.connect());
+  receiver.stop();
+
+  auto done = std::async(std::launch::async, [&receiver]() {
+    receiver.receive();
+  });
+  bool returned =
+    done.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+  BOOST_CHECK(returned);
+  if (!returned) {
+    receiver.stop();
+  }
+}
+
+/**
+ * A connect that fails leaves nothing for receive to wait on.
+ */
+BOOST_AUTO_TEST_CASE( test_connect_failure )
+{
+  ReadNetflowUDP<EdgeType> bad(0, "not an address", 0);
+  BOOST_CHECK(!bad.connect());
+
+  ReadNetflowUDP<EdgeType> first(0, "127.0.0.1", 0);
+  BOOST_REQUIRE(first.connect());
+  ReadNetflowUDP<EdgeType> second(0, "127.0.0.1",
+                                  std::vector<int>{0, first.getPort()});
+  BOOST_CHECK(!second.connect());
+  BOOST_CHECK_THROW(second.getPort(), std::out_of_range);
+
+  for (auto receiver : {&bad, &second}) {
+    auto done = std::async(std::launch::async, [receiver]() {
+      receiver->receive();
+    });
+    BOOST_CHECK(done.wait_for(std::chrono::seconds(2)) ==
+                std::future_status::ready);
+  }
+}
+
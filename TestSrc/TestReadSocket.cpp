@@ -0,0 +1,143 @@
+#define BOOST_TEST_MAIN TestReadSocket
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sam/tuples/VastNetflow.hpp>
+#include <sam/tuples/Tuplizer.hpp>
+#include <sam/tuples/Edge.hpp>
+#include <sam/ReadSocket.hpp>
+
+using namespace sam;
+using namespace sam::vast_netflow;
+
+typedef Edge<size_t, EmptyLabel, VastNetflow> EdgeType;
+typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+
+namespace {
+
+/**
+ * Keeps the edges it is given and the size of each batch, along with what
+ * the receiver reported as received when the batch came.
+ */
+class CollectingConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  std::vector<EdgeType> edges;
+  std::vector<size_t> batchSizes;
+  std::function<size_t()> getNumReceived;
+  std::vector<size_t> numReceived;
+
+  bool consume(EdgeType const& edge) {
+    edges.push_back(edge);
+    return true;
+  }
+
+  bool consumeBatch(EdgeType const* batch, size_t numEdges) {
+    batchSizes.push_back(numEdges);
+    edges.insert(edges.end(), batch, batch + numEdges);
+    if (getNumReceived) numReceived.push_back(getNumReceived());
+    return true;
+  }
+
+  void terminate() {}
+};
+
+/**
+ * Listens on an ephemeral port of the loopback interface and writes data
+ * to the first connection in small pieces, so that lines are split across
+ * reads, then closes it.
+ */
+class Server
+{
+private:
+  int listenfd;
+  std::thread thread;
+
+public:
+  int port;
+
+  Server(std::string const& data, size_t pieceSize)
+  {
+    listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    BOOST_REQUIRE(bind(listenfd, (struct sockaddr*) &addr, sizeof(addr)) == 0);
+    BOOST_REQUIRE(listen(listenfd, 1) == 0);
+    socklen_t length = sizeof(addr);
+    getsockname(listenfd, (struct sockaddr*) &addr, &length);
+    port = ntohs(addr.sin_port);
+
+    thread = std::thread([this, data, pieceSize]() {
+      int connfd = accept(listenfd, NULL, NULL);
+      for (size_t i = 0; i < data.size(); i += pieceSize) {
+        size_t n = std::min(pieceSize, data.size() - i);
+        send(connfd, data.data() + i, n, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      close(connfd);
+    });
+  }
+
+  ~Server()
+  {
+    thread.join();
+    close(listenfd);
+  }
+};
+
+std::string netflow(size_t i)
+{
+  return "1365582756.384094,2013-04-10 08:32:36,20130410083236.384094,17,"
+         "UDP,172.20.2.18,239.255.255.250," + std::to_string(29980 + i) +
+         ",1900,0,0,0.25,184,73140,10000000000,76064,40,54,0";
+}
+
+}
+
+/**
+ * Lines ending in \r\n and \n, an empty line and a last line without a
+ * newline all arrive, in order, even with a buffer smaller than a line.
+ */
+BOOST_AUTO_TEST_CASE( test_receive_batched )
+{
+  std::string data = netflow(0) + "\r\n" + netflow(1) + "\n\n" +
+                     netflow(2) + "\r\n" + netflow(3) + "\r";
+  Server server(data, 7);
+
+  ReadSocket<EdgeType, Tuplizer> receiver(0, "127.0.0.1", server.port);
+  auto consumer = std::make_shared<CollectingConsumer>();
+  consumer->getNumReceived = [&receiver]() {
+    return receiver.getNumReceived();
+  };
+  receiver.registerConsumer(consumer);
+  BOOST_REQUIRE(receiver.connect());
+  receiver.receiveBatched(2, 16);
+
+  BOOST_CHECK_EQUAL(receiver.getNumReceived(), 4);
+  BOOST_REQUIRE_EQUAL(consumer->edges.size(), 4);
+  for (size_t i = 0; i < 4; i++) {
+    BOOST_CHECK(consumer->edges[i].tuple == makeVastNetflow(netflow(i)));
+    BOOST_CHECK_EQUAL(std::get<SourcePort>(consumer->edges[i].tuple),
+                      29980 + i);
+    BOOST_CHECK_EQUAL(std::get<DurationSeconds>(consumer->edges[i].tuple),
+                      0.25);
+    BOOST_CHECK_EQUAL(std::get<DestPort>(consumer->edges[i].tuple), 1900);
+    BOOST_CHECK_EQUAL(std::get<RecordForceOut>(consumer->edges[i].tuple), 0);
+  }
+  // The count includes each batch by the time the batch is delivered.
+  size_t delivered = 0;
+  for (size_t i = 0; i < consumer->batchSizes.size(); i++) {
+    BOOST_CHECK_LE(consumer->batchSizes[i], 2);
+    delivered += consumer->batchSizes[i];
+    BOOST_CHECK_EQUAL(consumer->numReceived[i], delivered);
+  }
+}
@@ -0,0 +1,163 @@
+#define BOOST_TEST_MAIN TestSharedMemoryRing
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <sam/SharedMemoryRing.hpp>
+#include <sam/ZeroMQUtil.hpp>
+
+using namespace sam;
+
+BOOST_AUTO_TEST_CASE( test_ring_wrap_and_full )
+{
+  SharedMemorySegment segment("/sam_test_ring", 1, 256);
+  segment.create();
+  SharedMemoryRing ring = segment.ring(0);
+  BOOST_CHECK(ring.empty());
+
+  // 40 byte records, so the ring fills after 6 and later ones wrap.
+  std::deque<std::string> expected;
+  std::string message(30, 'a');
+  while (ring.tryWrite(message.data(), message.size())) {
+    expected.push_back(message);
+  }
+  BOOST_CHECK_EQUAL(expected.size(), 6);
+
+  std::string out;
+  for (size_t i = 0; i < 100; i++) {
+    BOOST_REQUIRE(ring.tryRead(out));
+    BOOST_CHECK_EQUAL(out, expected.front());
+    expected.pop_front();
+    message = std::string(1 + i % 50, 'a' + i % 26);
+    while (ring.tryWrite(message.data(), message.size())) {
+      expected.push_back(message);
+    }
+  }
+
+  // The terminate message is empty.
+  while (ring.tryRead(out)) {}
+  BOOST_CHECK(ring.tryWrite("", 0));
+  BOOST_CHECK(ring.tryRead(out));
+  BOOST_CHECK(out.empty());
+  BOOST_CHECK(ring.empty());
+
+  std::string tooLarge(300, 'x');
+  BOOST_CHECK_THROW(ring.tryWrite(tooLarge.data(), tooLarge.size()),
+                    SharedMemoryException);
+}
+
+BOOST_AUTO_TEST_CASE( test_ring_threads )
+{
+  SharedMemorySegment segment("/sam_test_ring_threads", 1, 4096);
+  segment.create();
+  SharedMemoryRing writer = segment.ring(0);
+  SharedMemoryRing reader = segment.ring(0);
+  size_t n = 100000;
+
+  std::thread producer([&]() {
+    for (size_t i = 0; i < n; i++) {
+      std::string message = std::to_string(i);
+      while (!writer.tryWrite(message.data(), message.size())) {
+        std::this_thread::yield();
+      }
+      segment.doorbell().ring();
+    }
+  });
+
+  std::string out;
+  size_t expected = 0;
+  while (expected < n) {
+    uint32_t seen = segment.doorbell().prepare();
+    if (reader.tryRead(out)) {
+      BOOST_REQUIRE_EQUAL(out, std::to_string(expected));
+      expected++;
+    } else {
+      segment.doorbell().wait(seen, 100);
+    }
+  }
+  producer.join();
+  BOOST_CHECK(reader.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_open_before_create )
+{
+  SharedMemorySegment sender("/sam_test_ring_open", 2, 1024);
+  BOOST_CHECK(!sender.open());
+
+  SharedMemorySegment receiver("/sam_test_ring_open", 2, 1024);
+  receiver.create();
+  BOOST_CHECK(sender.open());
+
+  SharedMemoryRing ring = sender.ring(1);
+  BOOST_CHECK(ring.tryWrite("abc", 3));
+  std::string out;
+  BOOST_CHECK(!receiver.ring(0).tryRead(out));
+  BOOST_CHECK(receiver.ring(1).tryRead(out));
+  BOOST_CHECK_EQUAL(out, "abc");
+}
+
+BOOST_AUTO_TEST_CASE( test_pushpull_colocated )
+{
+  // Node 2 is the same machine under another name, so it isn't
+  // co-located as far as PushPull can tell.
+  std::vector<std::string> hostnames = {"localhost", "localhost",
+                                        "127.0.0.1"};
+  std::vector<PushPull::FunctionType> callbacks;
+  PushPull pushPull(3, 0, 1, 1, hostnames, 1000, callbacks, 10400, 100, false,
+                    std::vector<PushPull::DrainFunctionType>(), 100);
+  BOOST_CHECK(pushPull.isColocated(1));
+  BOOST_CHECK(!pushPull.isColocated(2));
+}
+
+/**
+ * Two nodes in different processes on the same host.
+ */
+BOOST_AUTO_TEST_CASE( test_pushpull_processes )
+{
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t numMessages = 10000;
+  size_t startingPort = 10500;
+
+  pid_t pid = fork();
+  BOOST_REQUIRE(pid >= 0);
+  if (pid == 0) {
+    // Node 1 sends and then waits for node 0 to terminate.
+    bool ok = true;
+    {
+      std::vector<PushPull::FunctionType> callbacks;
+      PushPull node1(2, 1, 1, 1, hostnames, 1000, callbacks, startingPort, -1,
+                     false, std::vector<PushPull::DrainFunctionType>(), -1);
+      for (size_t i = 0; i < numMessages; i++) {
+        ok = node1.send("message " + std::to_string(i), 0) && ok;
+      }
+    }
+    _exit(ok ? 0 : 1);
+  }
+
+  std::atomic<size_t> received(0);
+  std::atomic<bool> ordered(true);
+  std::vector<PushPull::FunctionType> callbacks;
+  callbacks.push_back([&](std::string const& str) {
+    if (str != "message " + std::to_string(received)) ordered = false;
+    received++;
+  });
+  {
+    PushPull node0(2, 0, 1, 1, hostnames, 1000, callbacks, startingPort, -1,
+                   false, std::vector<PushPull::DrainFunctionType>(), -1);
+    BOOST_CHECK(node0.isColocated(1));
+    // Returns once node 1 has sent terminate.
+    node0.terminate();
+    BOOST_CHECK_EQUAL(node0.getTotalMessagesReceived(), numMessages);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  BOOST_CHECK(WIFEXITED(status));
+  BOOST_CHECK_EQUAL(WEXITSTATUS(status), 0);
+  BOOST_CHECK_EQUAL(received, numMessages);
+  BOOST_CHECK(ordered);
+}
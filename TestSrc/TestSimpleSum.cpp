@@ -60,3 +60,40 @@ BOOST_AUTO_TEST_CASE( simple_sum_test )
   total = sum.getSum("239.255.255.250");
   BOOST_CHECK_EQUAL(total, 12);
 }
+
+/**
+ * consumeBatch should give the same sums and feature values as calling
+ * consume on each edge.
+ */
+BOOST_AUTO_TEST_CASE( simple_sum_batch_test )
+{
+  Tuplizer tuplizer;
+  auto featureMap1 = std::make_shared<FeatureMap>();
+  auto featureMap2 = std::make_shared<FeatureMap>();
+  SimpleSum<size_t, EdgeType, SrcTotalBytes, DestIp> 
+    sum1(5, 0, featureMap1, "sum0");
+  SimpleSum<size_t, EdgeType, SrcTotalBytes, DestIp> 
+    sum2(5, 0, featureMap2, "sum0");
+
+  std::vector<EdgeType> edges;
+  for (size_t i = 0; i < 100; i++) {
+    string s = "1365582756.384094,2013-04-10 08:32:36," 
+               "20130410083236.384094,17,UDP,172.20.2.18," 
+               "239.255.255." + boost::lexical_cast<string>(i % 3) +
+               ",29986,1900,0,0,0,133,0," + boost::lexical_cast<string>(i) +
+               ",0,1,0,0";
+    edges.push_back(tuplizer(i, s));
+  }
+
+  for (auto const& edge : edges) sum1.consume(edge);
+  for (size_t i = 0; i < edges.size(); i += 7) {
+    sum2.consumeBatch(&edges[i], std::min<size_t>(7, edges.size() - i));
+  }
+
+  BOOST_CHECK_EQUAL(sum2.keys().size(), 3);
+  for (auto key : sum1.keys()) {
+    BOOST_CHECK_EQUAL(sum1.getSum(key), sum2.getSum(key));
+    BOOST_CHECK_EQUAL(featureMap1->at(key, "sum0")->evaluate<double>(valueFunc),
+                      featureMap2->at(key, "sum0")->evaluate<double>(valueFunc));
+  }
+}
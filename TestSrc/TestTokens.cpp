@@ -2,7 +2,9 @@
 #include <boost/test/unit_test.hpp>
 #include <stdexcept>
 #include <stack>
+#include <thread>
 #include <tuple>
+#include <vector>
 #include <sam/Tokens.hpp>
 #include <sam/tuples/VastNetflow.hpp>
 #include <sam/FeatureMap.hpp>
@@ -168,3 +170,62 @@ BOOST_FIXTURE_TEST_CASE( test_prev_token, F )
 }
 
  
+
+BOOST_FIXTURE_TEST_CASE( test_prev_token_store, F )
+{
+  auto store = std::make_shared<PreviousValueStore>();
+  PrevToken<TimeSeconds, VastNetflow> prevToken1(featureMap);
+  PrevToken<SourcePort, VastNetflow> prevToken2(featureMap);
+  prevToken1.setPreviousValueStore(store);
+  prevToken2.setPreviousValueStore(store);
+
+  double value = 0;
+  BOOST_CHECK(!prevToken1.evaluateValue(key, netflow, value));
+  BOOST_CHECK(!prevToken2.evaluateValue(key, netflow, value));
+
+  // Each token has its own slot in the shared store.
+  BOOST_CHECK(prevToken1.evaluateValue(key, netflow, value));
+  BOOST_CHECK_EQUAL(value, 1365582756.384094);
+  BOOST_CHECK(prevToken2.evaluateValue(key, netflow, value));
+  BOOST_CHECK_EQUAL(value, 29986);
+
+  // Keys are independent.
+  BOOST_CHECK(!prevToken1.evaluateValue("otherkey", netflow, value));
+  BOOST_CHECK_EQUAL(store->size(), 2);
+
+  // The previous values are not kept in the feature map.
+  BOOST_CHECK(!featureMap->exists(key, prevToken1.getIdentifier()));
+}
+
+/**
+ * Threads sharing the keys, each with its own slot, see only their own
+ * previous values.
+ */
+BOOST_AUTO_TEST_CASE( test_previous_value_store_threads )
+{
+  PreviousValueStore store;
+  size_t numKeys = 1000, numThreads = 4;
+  std::vector<std::thread> threads;
+  std::vector<size_t> errors(numThreads, 0);
+  for (size_t t = 0; t < numThreads; t++) {
+    size_t slot = store.addSlot();
+    threads.push_back(std::thread([&, t, slot]() {
+      for (size_t round = 0; round < 5; round++) {
+        for (size_t k = 0; k < numKeys; k++) {
+          double previous = -1;
+          bool exists = store.exchange(std::to_string(k), slot,
+                                       t * 100 + round, previous);
+          if (exists != (round > 0) ||
+              (exists && previous != t * 100 + round - 1)) {
+            errors[t]++;
+          }
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) thread.join();
+  for (size_t t = 0; t < numThreads; t++) {
+    BOOST_CHECK_EQUAL(errors[t], 0);
+  }
+  BOOST_CHECK_EQUAL(store.size(), numKeys);
+}
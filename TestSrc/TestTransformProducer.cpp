@@ -112,6 +112,9 @@ BOOST_AUTO_TEST_CASE( test_transform_producer )
     timeLapseSeries->consume(edge);
   }
 
+  // Writes out the buffered rows.
+  subscriber->close();
+
   // Each line should contain the number 1
   auto infile = std::ifstream(outputFile);
   std::string line;
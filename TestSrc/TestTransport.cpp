@@ -0,0 +1,273 @@
+#define BOOST_TEST_MAIN TestTransport
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sam/TransportFactory.hpp>
+
+using namespace sam;
+
+typedef Transport<std::string> StringTransport;
+
+namespace {
+
+/**
+ * Sends n messages from each of two nodes to the other and checks they
+ * all arrive, with terminate called from both nodes at once.
+ */
+void exchange(TransportType type, size_t startingPort, size_t numThreads)
+{
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t n = 1000;
+
+  std::atomic<size_t> received[2];
+  std::atomic<size_t> drained[2];
+  std::atomic<bool> correctSender(true);
+  std::vector<std::unique_ptr<StringTransport>> nodes;
+
+  for (size_t node = 0; node < 2; node++) {
+    received[node] = 0;
+    drained[node] = 0;
+    std::vector<StringTransport::FunctionType> callbacks;
+    callbacks.push_back([&, node](std::string const& message) {
+      if (message[0] == '0' + node) correctSender = false;
+      received[node]++;
+    });
+    std::vector<StringTransport::DrainFunctionType> drainCallbacks;
+    drainCallbacks.push_back([&, node]() { drained[node]++; });
+
+    auto identity = [](std::string const& str) { return str; };
+    nodes.push_back(createTransport<std::string>(type, 2, node, 1,
+      numThreads, hostnames, 1000, callbacks, startingPort, 1000, true,
+      identity, identity, drainCallbacks));
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t node = 0; node < 2; node++) {
+    threads.push_back(std::thread([&, node]() {
+      for (size_t i = 0; i < n; i++) {
+        nodes[node]->send(std::to_string(node) + " message " +
+                          std::to_string(i), 1 - node);
+      }
+      nodes[node]->terminate();
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t node = 0; node < 2; node++) {
+    BOOST_CHECK_EQUAL(received[node], n);
+    BOOST_CHECK_EQUAL(nodes[node]->getTotalMessagesSent(), n);
+    BOOST_CHECK_EQUAL(nodes[node]->getTotalMessagesReceived(), n);
+    BOOST_CHECK_EQUAL(nodes[node]->getTotalMessagesFailed(), 0);
+    BOOST_CHECK(drained[node] > 0);
+  }
+  BOOST_CHECK(correctSender);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_direct_exchange )
+{
+  exchange(TransportType::Direct, 11000, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_queue_exchange )
+{
+  exchange(TransportType::Queue, 11100, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_zeromq_exchange )
+{
+  exchange(TransportType::ZeroMQ, 11200, 1);
+}
+
+/**
+ * sendBatch delivers the messages in order on every backend, and the
+ * ZeroMQ backend hands the compression settings to its PushPull.  The
+ * nodes are colocated, so nothing is compressed here; TestCompression
+ * covers compressed frames.
+ */
+BOOST_AUTO_TEST_CASE( test_send_batch )
+{
+  CompressionCodec codec = CompressionCodec::None;
+  for (auto c : {CompressionCodec::LZ4, CompressionCodec::Zstd}) {
+    if (isCompressionAvailable(c)) codec = c;
+  }
+
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t startingPort = 11700;
+  for (auto type : {TransportType::Direct, TransportType::Queue,
+                    TransportType::ZeroMQ}) {
+    std::vector<std::string> received;
+    std::atomic<size_t> numReceived(0);
+    std::vector<StringTransport::FunctionType> callbacks;
+    callbacks.push_back([&](std::string const& message) {
+      received.push_back(message);
+      numReceived++;
+    });
+    auto identity = [](std::string const& str) { return str; };
+    auto node0 = createTransport<std::string>(type, 2, 0, 1, 1, hostnames,
+      1000, std::vector<StringTransport::FunctionType>(), startingPort,
+      1000, true, identity, identity,
+      std::vector<StringTransport::DrainFunctionType>(), 1000,
+      CompressionConfig(codec, 0));
+    auto node1 = createTransport<std::string>(type, 2, 1, 1, 1, hostnames,
+      1000, callbacks, startingPort, 1000, true, identity, identity,
+      std::vector<StringTransport::DrainFunctionType>(), 1000,
+      CompressionConfig(codec, 0));
+
+    size_t numBatches = 10, batchSize = 20;
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < numBatches; i++) {
+      std::vector<std::string> batch;
+      for (size_t j = 0; j < batchSize; j++) {
+        batch.push_back("message " + std::to_string(expected.size()) +
+                        std::string(20, 'x'));
+        expected.push_back(batch.back());
+      }
+      BOOST_CHECK(node0->sendBatch(batch.data(), batch.size(), 1));
+    }
+
+    // ZeroMQ's terminate message can overtake the data.
+    for (size_t i = 0; i < 500 && numReceived < expected.size(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::thread terminate1([&]() { node1->terminate(); });
+    node0->terminate();
+    terminate1.join();
+
+    BOOST_CHECK(received == expected);
+    BOOST_CHECK_EQUAL(node0->getTotalMessagesSent(), expected.size());
+    if (type == TransportType::ZeroMQ) {
+      auto zeromq = dynamic_cast<ZeroMQTransport<std::string>*>(node0.get());
+      BOOST_REQUIRE(zeromq);
+      BOOST_CHECK(zeromq->getPushPull().getCompression() == codec);
+    }
+    startingPort += 100;
+  }
+}
+
+/**
+ * Messages are handed over as objects, so they need not be strings.
+ */
+BOOST_AUTO_TEST_CASE( test_direct_objects )
+{
+  typedef std::vector<int> MessageType;
+  std::vector<MessageType> received;
+  std::vector<Transport<MessageType>::FunctionType> callbacks;
+  callbacks.push_back([&](MessageType const& message) {
+    received.push_back(message);
+  });
+  std::vector<Transport<MessageType>::FunctionType> none;
+
+  DirectTransport<MessageType> node0(2, 0, none, 11300, 1000);
+  DirectTransport<MessageType> node1(2, 1, callbacks, 11300, 1000);
+  BOOST_CHECK(node0.callsBackOnSender());
+
+  // The callback has run by the time send returns.
+  BOOST_CHECK(node0.send(MessageType({1, 2, 3}), 1));
+  BOOST_REQUIRE_EQUAL(received.size(), 1);
+  BOOST_CHECK_EQUAL(received[0][2], 3);
+
+  BOOST_CHECK_THROW(node0.send(MessageType(), 0), TransportException);
+
+  std::thread terminate1([&]() { node1.terminate(); });
+  node0.terminate();
+  terminate1.join();
+}
+
+/**
+ * Each receive thread knows its index, and its callbacks never overlap.
+ */
+BOOST_AUTO_TEST_CASE( test_queue_receive_threads )
+{
+  size_t numThreads = 3;
+  std::mutex mutex;
+  std::set<size_t> threadIds;
+  std::vector<std::atomic<int>> active(numThreads);
+  for (auto& a : active) a = 0;
+  std::atomic<bool> overlapped(false);
+
+  std::vector<Transport<int>::FunctionType> callbacks;
+  callbacks.push_back([&](int const&) {
+    size_t id = receiveThreadId();
+    if (active.at(id).fetch_add(1) != 0) overlapped = true;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      threadIds.insert(id);
+    }
+    active[id].fetch_sub(1);
+  });
+  std::vector<Transport<int>::FunctionType> none;
+
+  QueueTransport<int> node0(2, 0, 1, 0, none, 11400, 1000);
+  QueueTransport<int> node1(2, 1, numThreads, 0, callbacks, 11400, 1000);
+  for (int i = 0; i < 3000; i++) {
+    node0.send(i, 1);
+  }
+
+  std::thread terminate1([&]() { node1.terminate(); });
+  node0.terminate();
+  terminate1.join();
+
+  BOOST_CHECK_EQUAL(node1.getTotalMessagesReceived(), 3000);
+  BOOST_CHECK_EQUAL(threadIds.size(), numThreads);
+  BOOST_CHECK(!overlapped);
+}
+
+/**
+ * A node may send before the other node exists; send waits up to the
+ * timeout for it.
+ */
+BOOST_AUTO_TEST_CASE( test_send_before_peer_exists )
+{
+  std::atomic<size_t> received(0);
+  std::vector<Transport<int>::FunctionType> callbacks;
+  callbacks.push_back([&](int const&) { received++; });
+  std::vector<Transport<int>::FunctionType> none;
+
+  QueueTransport<int> node0(2, 0, 1, 0, none, 11500, 50);
+  BOOST_CHECK(!node0.send(1, 1));
+  BOOST_CHECK_EQUAL(node0.getTotalMessagesFailed(), 1);
+
+  std::thread late([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    QueueTransport<int> node1(2, 1, 1, 0, callbacks, 11500, 50);
+    node1.terminate();
+  });
+
+  // Node 1 may take a few tries to show up.
+  bool sent = false;
+  for (int i = 0; i < 100 && !sent; i++) {
+    sent = node0.send(2, 1);
+  }
+  BOOST_CHECK(sent);
+  node0.terminate();
+  late.join();
+  BOOST_CHECK_EQUAL(received, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_hub_mismatch )
+{
+  std::vector<Transport<int>::FunctionType> none;
+  DirectTransport<int> node0(2, 0, none, 11600, 10, 
+    std::vector<Transport<int>::DrainFunctionType>(), 10);
+  BOOST_CHECK_THROW(DirectTransport<int>(3, 1, none, 11600, 10),
+                    TransportException);
+  BOOST_CHECK_THROW(DirectTransport<int>(2, 0, none, 11600, 10),
+                    TransportException);
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_type_from_string )
+{
+  BOOST_CHECK(transportTypeFromString("zeromq") == TransportType::ZeroMQ);
+  BOOST_CHECK(transportTypeFromString("direct") == TransportType::Direct);
+  BOOST_CHECK(transportTypeFromString("queue") == TransportType::Queue);
+  BOOST_CHECK_THROW(transportTypeFromString("tcp"), TransportException);
+}
@@ -70,3 +70,51 @@ BOOST_AUTO_TEST_CASE( test_tuplizer )
 
 
 
+
+BOOST_AUTO_TEST_CASE( test_makeNetflow_string_view )
+{
+  // The line is followed by more data, as it would be in a receive buffer.
+  std::string buffer = "1365582756.384094,2013-04-10 08:32:36," 
+                       "20130410083236.384094,17,UDP,172.20.2.18," 
+                       "239.255.255.250,29986,1900,0,0,16,184,73140,"
+                       "2588,76064,40,54,0\n1365582757.0,";
+  boost::string_view s(buffer.data(), buffer.find('\n'));
+
+  VastNetflow netflow = makeVastNetflow(s);
+  checkCommon(netflow);
+  BOOST_CHECK(netflow == makeVastNetflow(std::string(s.data(), s.size())));
+}
+
+BOOST_AUTO_TEST_CASE( test_tuplizer_string_view )
+{
+  typedef std::tuple<int> LabelType;
+  typedef Edge<size_t, LabelType, TupleType> EdgeType;
+  typedef TuplizerFunction<EdgeType, MakeVastNetflow> Tuplizer;
+  Tuplizer tuplizer;
+
+  std::string s = "1,1365582756.384094,2013-04-10 08:32:36," 
+                         "20130410083236.384094,17,UDP,172.20.2.18," 
+                         "239.255.255.250,29986,1900,0,0,16,184,73140,"
+                         "2588,76064,40,54,0";
+
+  EdgeType edge = tuplizer(0, boost::string_view(s));
+  checkCommon(edge.tuple);
+  BOOST_CHECK_EQUAL(std::get<0>(edge.label), 1);
+}
+
+/**
+ * Both overloads keep fractional durations and byte counts that don't fit
+ * in an int.
+ */
+BOOST_AUTO_TEST_CASE( test_makeNetflow_wide_fields )
+{
+  std::string s = "1365582756.384094,2013-04-10 08:32:36," 
+                  "20130410083236.384094,17,UDP,172.20.2.18," 
+                  "239.255.255.250,29986,1900,0,0,0.25,184,73140,"
+                  "10000000000,76064,40,54,0";
+
+  VastNetflow netflow = makeVastNetflow(s);
+  BOOST_CHECK_EQUAL(0.25, std::get<DurationSeconds>(netflow));
+  BOOST_CHECK_EQUAL(10000000000L, std::get<SrcTotalBytes>(netflow));
+  BOOST_CHECK(netflow == makeVastNetflow(boost::string_view(s)));
+}
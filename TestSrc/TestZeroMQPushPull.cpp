@@ -3,8 +3,12 @@
 //#define DEBUG
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <functional>
 #include <stdexcept>
 #include <string>
+#include <set>
+#include <thread>
 #include <vector>
 #include <sam/ZeroMQPushPull.hpp>
 #include <sam/tuples/VastNetflowGenerators.hpp>
@@ -115,3 +119,171 @@ BOOST_AUTO_TEST_CASE( test_zeromqpushpull )
   delete generator1;
 }
 
+
+/**
+ * Counts the edges it gets and remembers which threads called it.
+ */
+class LaneConsumer : public AbstractConsumer<EdgeType>
+{
+public:
+  size_t count = 0;
+  std::set<std::thread::id> threads;
+
+  bool consume(EdgeType const& edge) {
+    return consumeBatch(&edge, 1);
+  }
+
+  bool consumeBatch(EdgeType const* edges, size_t numEdges) {
+    threads.insert(std::this_thread::get_id());
+    count += numEdges;
+    return true;
+  }
+
+  void terminate() {}
+};
+
+BOOST_AUTO_TEST_CASE( test_zeromqpushpull_lanes )
+{
+  size_t queueLength = 50;
+  size_t numNodes = 2;
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t hwm = 1000;
+  size_t timeout = 1000;
+  size_t startingPort = 10100;
+  size_t numPushSockets = 2;
+  size_t numPullThreads = 2;
+  size_t n = 10000;
+
+  AbstractVastNetflowGenerator* generator0 = 
+    new UniformDestPort("192.168.0.1", 1);
+  AbstractVastNetflowGenerator* generator1 = 
+    new UniformDestPort("192.168.0.2", 1);
+
+  PartitionType* pushPull0 = new PartitionType(queueLength, numNodes, 0,
+                                    hostnames, startingPort, timeout, true,
+                                    hwm, numPushSockets, numPullThreads);
+  PartitionType* pushPull1 = new PartitionType(queueLength, numNodes, 1,
+                                    hostnames, startingPort, timeout, true,
+                                    hwm, numPushSockets, numPullThreads);
+  BOOST_CHECK_EQUAL(pushPull0->getNumLanes(), numPullThreads);
+
+  std::vector<std::shared_ptr<LaneConsumer>> laneConsumers;
+  for (auto pushPull : {pushPull0, pushPull1}) {
+    for (size_t i = 0; i < numPullThreads; i++) {
+      laneConsumers.push_back(std::make_shared<LaneConsumer>());
+      pushPull->registerLaneConsumer(i, laneConsumers.back());
+    }
+  }
+
+  Tuplizer tuplizer;
+  auto function = [n](AbstractVastNetflowGenerator *generator,
+                      PartitionType* pushPull,
+                      Tuplizer tuplizer)
+  {
+    for(size_t i = 0; i < n; i++) {
+      std::string str = generator->generate();
+      pushPull->consume(tuplizer(i, str));
+    }
+    pushPull->terminate();
+  };
+
+  std::thread thread0(function, generator0, pushPull0, tuplizer);
+  std::thread thread1(function, generator1, pushPull1, tuplizer);
+  thread0.join();
+  thread1.join();
+
+  // Only the tuples a node keeps for itself go through parallelFeed.
+  size_t localItems = pushPull0->getNumReadItems() + 
+                      pushPull1->getNumReadItems();
+
+  // Deleting waits for the pull threads, which hand on what they hold
+  // before exiting.
+  delete pushPull0;
+  delete pushPull1;
+
+  size_t pulled = 0;
+  for (auto consumer : laneConsumers) {
+    BOOST_CHECK(consumer->threads.size() <= 1);
+    pulled += consumer->count;
+  }
+
+  BOOST_CHECK(pulled > 0);
+  BOOST_CHECK(2 * n <= localItems + pulled);
+  BOOST_CHECK(4 * n >= localItems + pulled);
+
+  delete generator0;
+  delete generator1;
+}
+
+/**
+ * consumeBatch delivers each edge to every node it partitions to, once,
+ * as consume does.
+ */
+BOOST_AUTO_TEST_CASE( test_zeromqpushpull_consume_batch )
+{
+  size_t queueLength = 50;
+  size_t numNodes = 2;
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t hwm = 1000;
+  size_t timeout = 1000;
+  size_t startingPort = 10200;
+  size_t n = 10000;
+  size_t batchSize = 100;
+
+  UniformDestPort generator0("192.168.0.1", 1);
+  UniformDestPort generator1("192.168.0.2", 1);
+
+  PartitionType* pushPull0 = new PartitionType(queueLength, numNodes, 0,
+                                    hostnames, startingPort, timeout, true,
+                                    hwm);
+  PartitionType* pushPull1 = new PartitionType(queueLength, numNodes, 1,
+                                    hostnames, startingPort, timeout, true,
+                                    hwm);
+
+  std::vector<std::shared_ptr<LaneConsumer>> laneConsumers;
+  for (auto pushPull : {pushPull0, pushPull1}) {
+    laneConsumers.push_back(std::make_shared<LaneConsumer>());
+    pushPull->registerLaneConsumer(0, laneConsumers.back());
+  }
+
+  // The edges each generator makes, with the number of nodes each goes to.
+  Tuplizer tuplizer;
+  std::vector<EdgeType> edges0, edges1;
+  size_t expected = 0;
+  for (size_t i = 0; i < n; i++) {
+    edges0.push_back(tuplizer(i, generator0.generate()));
+    edges1.push_back(tuplizer(i, generator1.generate()));
+    for (auto const* edge : {&edges0.back(), &edges1.back()}) {
+      size_t source = SourceHash()(edge->tuple) % numNodes;
+      size_t target = TargetHash()(edge->tuple) % numNodes;
+      expected += source == target ? 1 : 2;
+    }
+  }
+
+  auto function = [batchSize](std::vector<EdgeType> const& edges,
+                              PartitionType* pushPull)
+  {
+    for (size_t i = 0; i < edges.size(); i += batchSize) {
+      pushPull->consumeBatch(edges.data() + i,
+                             std::min(batchSize, edges.size() - i));
+    }
+    pushPull->terminate();
+  };
+
+  std::thread thread0(function, std::cref(edges0), pushPull0);
+  std::thread thread1(function, std::cref(edges1), pushPull1);
+  thread0.join();
+  thread1.join();
+
+  BOOST_CHECK_EQUAL(n, pushPull0->getConsumeCount());
+  BOOST_CHECK_EQUAL(n, pushPull1->getConsumeCount());
+  size_t localItems = pushPull0->getNumReadItems() + 
+                      pushPull1->getNumReadItems();
+  delete pushPull0;
+  delete pushPull1;
+
+  size_t pulled = 0;
+  for (auto consumer : laneConsumers) pulled += consumer->count;
+  BOOST_CHECK(pulled > 0);
+  BOOST_CHECK_EQUAL(localItems + pulled, expected);
+}
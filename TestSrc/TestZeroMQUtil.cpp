@@ -5,6 +5,9 @@
 #include <tuple>
 #include <string>
 #include <random>
+#include <thread>
+#include <chrono>
+#include <atomic>
 #include <sam/ZeroMQUtil.hpp>
 #include <sam/tuples/VastNetflow.hpp>
 
@@ -314,3 +317,64 @@ BOOST_AUTO_TEST_CASE( test_getHostnameForPull )
 
 
 }
+
+BOOST_AUTO_TEST_CASE( test_pull_metrics_and_terminate )
+{
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+  size_t numMessages = 1000;
+  std::atomic<size_t> received(0);
+  std::atomic<size_t> drains(0);
+
+  std::vector<PushPull::FunctionType> callbacks;
+  callbacks.push_back([&received](std::string const& str) { received++; });
+  std::vector<PushPull::DrainFunctionType> drainCallbacks;
+  drainCallbacks.push_back([&drains]() { drains++; });
+
+  // No silence timeout: the pull threads only exit on terminate.
+  PushPull node0(2, 0, 1, 1, hostnames, 1000, 
+                 std::vector<PushPull::FunctionType>(), 10200, -1, true,
+                 std::vector<PushPull::DrainFunctionType>(), -1);
+  PushPull node1(2, 1, 1, 1, hostnames, 1000, callbacks, 10200, -1, true,
+                 drainCallbacks, -1);
+
+  for (size_t i = 0; i < numMessages; i++) {
+    node0.send("message", 1);
+  }
+  for (size_t i = 0; i < 500 && received < numMessages; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto begin = std::chrono::steady_clock::now();
+  std::thread terminate0([&node0]() { node0.terminate(); });
+  node1.terminate();
+  terminate0.join();
+  auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+    std::chrono::steady_clock::now() - begin).count();
+
+  BOOST_CHECK_EQUAL(received, numMessages);
+  BOOST_CHECK_EQUAL(node1.getTotalMessagesReceived(), numMessages);
+  BOOST_CHECK(node1.getTotalBatches() >= 1);
+  BOOST_CHECK(node1.getTotalBatches() <= numMessages);
+  BOOST_CHECK(drains >= node1.getTotalBatches());
+  BOOST_CHECK(node1.getTotalIdleTime() > 0);
+  BOOST_CHECK(node1.getTotalBusyTime() > 0);
+  BOOST_CHECK(seconds < 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_pull_thread_timeout )
+{
+  std::vector<std::string> hostnames = {"localhost", "localhost"};
+
+  // The other node never shows up, so the pull thread exits after the
+  // silence timeout.
+  auto begin = std::chrono::steady_clock::now();
+  {
+    PushPull node0(2, 0, 1, 1, hostnames, 1000, 
+                   std::vector<PushPull::FunctionType>(), 10300, 100, true,
+                   std::vector<PushPull::DrainFunctionType>(), 100);
+  }
+  auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+    std::chrono::steady_clock::now() - begin).count();
+  BOOST_CHECK(seconds < 5);
+}
@@ -0,0 +1,131 @@
+"""
+Exports a trained scikit-learn model to the text format that
+SamSrc/sam/Model.hpp reads, so that a pipeline can score the features it
+creates as they are produced (e.g. ml_v5_manual --model).
+
+The model is read from a pickle (as written by pickle.dump or joblib.dump).
+Supported are LogisticRegression, GaussianNB, RandomForestClassifier and
+GradientBoostingClassifier with two classes.
+
+  python export_model.py --model lr.pkl --features aveSrcBytes,numDests \
+    --threshold 0.9 --outputfile lr.model
+
+The feature names must be the names of the features in the pipeline, in
+the order the model was trained on.
+"""
+
+import argparse
+import pickle
+
+import numpy as np
+from sklearn.ensemble import GradientBoostingClassifier, RandomForestClassifier
+from sklearn.linear_model import LogisticRegression
+from sklearn.naive_bayes import GaussianNB
+
+
+def format_values(values):
+  return " ".join(repr(float(v)) for v in values)
+
+
+def tree_nodes(tree, leaf_value, offset):
+  """
+  The node lines of a fitted sklearn tree (a Tree, i.e. estimator.tree_),
+  numbered from offset.  leaf_value maps the value of a leaf to the number
+  the leaf adds to the score.
+  """
+  lines = []
+  for node in range(tree.node_count):
+    left = tree.children_left[node]
+    if left == -1:
+      lines.append("nodes -1 %r -1 -1" %
+                   float(leaf_value(tree.value[node])))
+    else:
+      lines.append("nodes %d %r %d %d" % (tree.feature[node],
+        float(tree.threshold[node]), offset + left,
+        offset + tree.children_right[node]))
+  return lines
+
+
+def export_trees(trees, leaf_value):
+  """
+  The roots and nodes lines of an ensemble of sklearn trees.
+  """
+  roots = []
+  nodes = []
+  for tree in trees:
+    roots.append(str(len(nodes)))
+    nodes += tree_nodes(tree, leaf_value, len(nodes))
+  return ["roots " + " ".join(roots)] + nodes
+
+
+def export(model, features, threshold):
+  """
+  Returns the lines of the model file for a trained model.
+  """
+  if len(model.classes_) != 2:
+    raise ValueError("Only models with two classes can be exported")
+
+  if isinstance(model, LogisticRegression):
+    lines = ["logistic_regression"]
+    body = ["intercept " + repr(float(model.intercept_[0])),
+            "weights " + format_values(model.coef_[0])]
+    numFeatures = len(model.coef_[0])
+  elif isinstance(model, GaussianNB):
+    lines = ["naive_bayes"]
+    # var_ was sigma_ before scikit-learn 1.0.
+    variances = model.var_ if hasattr(model, "var_") else model.sigma_
+    body = ["priors " + format_values(model.class_prior_)]
+    for c in range(2):
+      body.append("means%d " % c + format_values(model.theta_[c]))
+      body.append("variances%d " % c + format_values(variances[c]))
+    numFeatures = len(model.theta_[0])
+  elif isinstance(model, RandomForestClassifier):
+    # The forest averages the fraction of class 1 in the leaves.
+    lines = ["tree_ensemble"]
+    numTrees = len(model.estimators_)
+    body = ["link identity", "base_score 0"] + export_trees(
+      [estimator.tree_ for estimator in model.estimators_],
+      lambda value: value[0][1] / value[0].sum() / numTrees)
+    numFeatures = model.n_features_in_
+  elif isinstance(model, GradientBoostingClassifier):
+    # The log odds are the initial estimate plus the scaled regression trees.
+    lines = ["tree_ensemble"]
+    base = model._raw_predict_init(np.zeros((1, model.n_features_in_)))
+    rate = model.learning_rate
+    body = ["link logistic", "base_score %r" % float(base[0][0])] + \
+      export_trees([estimator[0].tree_ for estimator in model.estimators_],
+                   lambda value: rate * value[0][0])
+    numFeatures = model.n_features_in_
+  else:
+    raise ValueError("Can't export a " + type(model).__name__)
+
+  if len(features) != numFeatures:
+    raise ValueError("The model has %d features but %d names were given" %
+                     (numFeatures, len(features)))
+  lines.append("features " + " ".join(features))
+  lines.append("threshold " + repr(threshold))
+  return lines + body
+
+
+def main():
+  parser = argparse.ArgumentParser()
+  parser.add_argument('--model', type=str, required=True,
+    help="A pickled LogisticRegression, GaussianNB, RandomForestClassifier "
+         "or GradientBoostingClassifier.")
+  parser.add_argument('--features', type=str, required=True,
+    help="The comma separated feature names, in training order.")
+  parser.add_argument('--threshold', type=float, default=0.5,
+    help="Rows scoring at or above this are alerts.")
+  parser.add_argument('--outputfile', type=str, required=True)
+  FLAGS = parser.parse_args()
+
+  with open(FLAGS.model, "rb") as infile:
+    model = pickle.load(infile)
+
+  lines = export(model, FLAGS.features.split(","), FLAGS.threshold)
+  with open(FLAGS.outputfile, "w") as outfile:
+    outfile.write("\n".join(lines) + "\n")
+
+
+if __name__ == '__main__':
+  main()
@@ -14,9 +14,31 @@ import matplotlib.pyplot as plt
 import pandas
 import math
 import operator
+import struct
 
 import shap
 
+def load_features(path):
+  """
+  Loads a feature file written by FeatureSubscriber, either csv or the
+  columnar format (see SamSrc/sam/FeatureWriter.hpp).  The columnar file is
+  memory mapped rather than parsed.  Returns an array with a row per
+  example.  The rows completed by different threads of the pipeline are
+  not in the order they completed, so the array isn't in time order.
+  """
+  with open(path, "rb") as infile:
+    magic = infile.read(8)
+    if magic != b"SAMCOLS1":
+      infile.seek(0)
+      return np.loadtxt(infile, delimiter=",")
+    numColumns, blockRows, numRows, headerSize = struct.unpack(
+      "=4Q", infile.read(32))
+
+  numBlocks = (numRows + blockRows - 1) // blockRows
+  blocks = np.memmap(path, dtype=np.float64, mode="r", offset=headerSize,
+                     shape=(numBlocks, numColumns, blockRows))
+  return blocks.transpose(0, 2, 1).reshape(-1, numColumns)[:numRows]
+
 def find_optimal_cutoff_closest_to_perfect(fpr, tpr, threshold):
   """ Tries to find the best threshold to select on ROC.
 
@@ -119,42 +141,41 @@ def main():
   FLAGS = parser.parse_args()
 
   # Open a file with the extracted features
-  with open(FLAGS.inputfile, "r") as infile:
-    data = np.loadtxt(infile, delimiter=",")
-
-    y = data[:, 0] #labels are in the first column
-    X = data[:, 1:] #features are in the rest of the columns
-
-    if FLAGS.subset:
-      selectedFeatures = FLAGS.subset.split(",")
-      selectedFeatures = list(map(int, selectedFeatures))
-      X = data[:, selectedFeatures]
-      print( X[1] )
-
-    numNonZero = np.count_nonzero(y)
-    numFound = 0
-    i = 0
-    while numFound < numNonZero/2:
-      if y[i] == 1:
-        numFound += 1
-      i += 1
-    
-    i -= 1
-    y1 = y[0: i]
-    y2 = y[i:]
-    X1 = X[0:i]
-    X2 = X[i :]
-    print( "Length y1, y2", len(y1), len(y2) )
-    print( "Share X1, X2", X1.shape, X2.shape )
-    print( "Nonzero y1, y2", np.count_nonzero(y1), np.count_nonzero(y2) )
-    figurenum = 0
-    figurenum = analysis(figurenum, y1, X1, y2, X2, FLAGS.plot, 
-                          FLAGS.problem_name)#, srcIps[i:], destIps[i:])
-    figurenum = analysis(figurenum, y2, X2, y1, X1, FLAGS.plot, 
-                          FLAGS.problem_name)#, srcIps[0:i], destIps[0:i])
-
-
-    if FLAGS.plot:
-      input()
+  data = load_features(FLAGS.inputfile)
+
+  y = data[:, 0] #labels are in the first column
+  X = data[:, 1:] #features are in the rest of the columns
+
+  if FLAGS.subset:
+    selectedFeatures = FLAGS.subset.split(",")
+    selectedFeatures = list(map(int, selectedFeatures))
+    X = data[:, selectedFeatures]
+    print( X[1] )
+
+  numNonZero = np.count_nonzero(y)
+  numFound = 0
+  i = 0
+  while numFound < numNonZero/2:
+    if y[i] == 1:
+      numFound += 1
+    i += 1
+  
+  i -= 1
+  y1 = y[0: i]
+  y2 = y[i:]
+  X1 = X[0:i]
+  X2 = X[i :]
+  print( "Length y1, y2", len(y1), len(y2) )
+  print( "Share X1, X2", X1.shape, X2.shape )
+  print( "Nonzero y1, y2", np.count_nonzero(y1), np.count_nonzero(y2) )
+  figurenum = 0
+  figurenum = analysis(figurenum, y1, X1, y2, X2, FLAGS.plot, 
+                        FLAGS.problem_name)#, srcIps[i:], destIps[i:])
+  figurenum = analysis(figurenum, y2, X2, y1, X1, FLAGS.plot, 
+                        FLAGS.problem_name)#, srcIps[0:i], destIps[0:i])
+
+
+  if FLAGS.plot:
+    input()
 
 main()